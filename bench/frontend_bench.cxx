@@ -0,0 +1,86 @@
+/* frontend_bench.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * CPU cost of the front end per carrier: the resampling chain fed at
+ * 3.2 Msps against the channel filter alone at the native 4.608 Msps,
+ * producing 4 and 2 samples per symbol. All process the same amount of
+ * air time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include <gnuradio/blocks/head.h>
+#include <gnuradio/blocks/null_sink.h>
+#include <gnuradio/blocks/null_source.h>
+#include <gnuradio/top_block.h>
+
+#include "frontend.h"
+#include "logging.h"
+
+static double cpu_seconds(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+// CPU seconds spent per second of signal
+static double run(double samp_rate, unsigned sps, double air_time)
+{
+	gr::top_block_sptr tb = gr::make_top_block("frontend_bench");
+
+	gr::blocks::null_source::sptr source = gr::blocks::null_source::make(sizeof(gr_complex));
+	gr::blocks::head::sptr head = gr::blocks::head::make(sizeof(gr_complex), (uint64_t)(samp_rate * air_time));
+	gr::blocks::null_sink::sptr sink = gr::blocks::null_sink::make(sizeof(gr_complex));
+	frontend *fe = frontend::make(tb, samp_rate, sps);
+
+	tb->connect(source, 0, head, 0);
+	tb->connect(head, 0, fe->first(), 0);
+	tb->connect(fe->last(), 0, sink, 0);
+
+	double start = cpu_seconds();
+	tb->run();
+	double cpu = cpu_seconds() - start;
+
+	delete fe;
+	return cpu / air_time;
+}
+
+int main(int argc, char **argv)
+{
+	double air_time = (argc > 1) ? atof(argv[1]) : 20.0;
+
+	double resampled = run(3200000, 4, air_time);
+	double native = run(DECT_NATIVE_RATE, 4, air_time);
+	double native_2sps = run(DECT_NATIVE_RATE, 2, air_time);
+
+	log_flush();
+	printf("%.0lf s of signal per carrier\n", air_time);
+	printf("resampling from 3.2 Msps: %6.1lf ms CPU per second\n", resampled * 1e3);
+	printf("native 4.608 Msps:        %6.1lf ms CPU per second\n", native * 1e3);
+	printf("saved:                    %6.1lf ms CPU per second (%.0lf%%)\n",
+		(resampled - native) * 1e3, 100.0 * (resampled - native) / resampled);
+	printf("native, 2 samples/symbol: %6.1lf ms CPU per second\n", native_2sps * 1e3);
+
+	return 0;
+}
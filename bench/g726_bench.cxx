@@ -0,0 +1,194 @@
+/* g726_bench.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Throughput of the G.726 decoder for 1 to MAX_PARTS channels of random
+ * B-fields, decoded together in lanes and one channel per call. Before
+ * timing, the lanes are checked against the scalar decoder that single
+ * channels go through, sample by sample, and the bench exits with 1 on
+ * any difference. So it does if the voice stream of a selected part that
+ * is lost doesn't end with exactly one VOICE_GAP_END record, right away,
+ * whatever deselects or clears it after.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <vector>
+
+#include "dect2core/burst_decoder.h"
+#include "dect2core/g726.h"
+#include "dect2core/voice_stream.h"
+
+using dect2core::burst_info_t;
+using dect2core::burst_result_t;
+using dect2core::g726_state_t;
+using dect2core::voice_record_t;
+using dect2core::voice_stream;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Every fourth frame has only the two smallest codes, to keep the
+// predictors in their small-signal and tone paths too
+static void fill_codes(uint8_t *codes, size_t n, unsigned frame)
+{
+	for (size_t i = 0; i < n; i++)
+		codes[i] = (frame % 4) ? rand() : ((rand() & 1) ? 0x0F : 0xF0);
+}
+
+static bool check(unsigned nchannels, unsigned nframes)
+{
+	std::vector<g726_state_t> states(2 * nchannels);
+	std::vector<g726_state_t *> state_ptrs(2 * nchannels);
+	std::vector<uint8_t> codes((size_t)nchannels * B_FIELD_BYTES);
+	std::vector<const uint8_t *> code_ptrs(nchannels);
+	std::vector<int16_t> pcm((size_t)2 * nchannels * B_FIELD_SAMPLES);
+	std::vector<int16_t *> pcm_ptrs(2 * nchannels);
+
+	for (unsigned c = 0; c < 2 * nchannels; c++) {
+		dect2core::g726_init(&states[c]);
+		state_ptrs[c] = &states[c];
+		pcm_ptrs[c] = &pcm[(size_t)c * B_FIELD_SAMPLES];
+	}
+	for (unsigned c = 0; c < nchannels; c++)
+		code_ptrs[c] = &codes[(size_t)c * B_FIELD_BYTES];
+
+	unsigned long mismatches = 0;
+	for (unsigned f = 0; f < nframes; f++) {
+		fill_codes(&codes[0], codes.size(), f);
+		dect2core::g726_decode(&state_ptrs[0], &code_ptrs[0], &pcm_ptrs[0],
+			nchannels, B_FIELD_SAMPLES);
+		for (unsigned c = 0; c < nchannels; c++)
+			dect2core::g726_decode(&state_ptrs[nchannels + c], &code_ptrs[c],
+				&pcm_ptrs[nchannels + c], 1, B_FIELD_SAMPLES);
+		for (size_t i = 0; i < (size_t)nchannels * B_FIELD_SAMPLES; i++)
+			mismatches += pcm[i] != pcm[(size_t)nchannels * B_FIELD_SAMPLES + i];
+	}
+
+	printf("%2u channels in lanes against scalar: %lu of %lu samples differ\n",
+		nchannels, mismatches, (unsigned long)nframes * nchannels * B_FIELD_SAMPLES);
+	return mismatches == 0;
+}
+
+static void run(unsigned nchannels, unsigned nframes)
+{
+	std::vector<g726_state_t> states(nchannels);
+	std::vector<g726_state_t *> state_ptrs(nchannels);
+	std::vector<uint8_t> codes((size_t)nchannels * nframes * B_FIELD_BYTES);
+	std::vector<const uint8_t *> code_ptrs(nchannels);
+	std::vector<int16_t> pcm((size_t)nchannels * B_FIELD_SAMPLES);
+	std::vector<int16_t *> pcm_ptrs(nchannels);
+
+	for (unsigned f = 0; f < nframes; f++)
+		fill_codes(&codes[(size_t)f * nchannels * B_FIELD_BYTES], (size_t)nchannels * B_FIELD_BYTES, f);
+	for (unsigned c = 0; c < nchannels; c++) {
+		state_ptrs[c] = &states[c];
+		pcm_ptrs[c] = &pcm[(size_t)c * B_FIELD_SAMPLES];
+	}
+
+	for (int together = 1; together >= 0; together--) {
+		for (unsigned c = 0; c < nchannels; c++)
+			dect2core::g726_init(&states[c]);
+
+		double start = now();
+		for (unsigned f = 0; f < nframes; f++) {
+			for (unsigned c = 0; c < nchannels; c++)
+				code_ptrs[c] = &codes[((size_t)f * nchannels + c) * B_FIELD_BYTES];
+			if (together) {
+				dect2core::g726_decode(&state_ptrs[0], &code_ptrs[0], &pcm_ptrs[0],
+					nchannels, B_FIELD_SAMPLES);
+			} else {
+				for (unsigned c = 0; c < nchannels; c++)
+					dect2core::g726_decode(&state_ptrs[c], &code_ptrs[c], &pcm_ptrs[c],
+						1, B_FIELD_SAMPLES);
+			}
+		}
+		double elapsed = now() - start;
+
+		printf("%2u channels %-10s %6.2lf us per frame and channel, %6.3lf%% of real time\n",
+			nchannels, together ? "in lanes:" : "one by one:",
+			elapsed / nframes / nchannels * 1e6, 100.0 * elapsed / (nframes * 0.01));
+	}
+}
+
+/*
+ * The records of a stream with a gap before its part is lost, then
+ * deselected and the parts cleared, as packet_decoder ends it. Then one
+ * more stream, lost right after its first frame.
+ */
+static bool check_end(void)
+{
+	voice_stream stream;
+	voice_record_t out[VOICE_STREAM_MAX_RECORDS];
+	uint8_t b_field[B_FIELD_BYTES] = { 0 };
+	unsigned nends = 0;
+	bool ok = true;
+
+	burst_info_t info = burst_info_t();
+	info.rx_id = 2;
+	burst_result_t result = burst_result_t();
+
+	for (unsigned pass = 0; pass < 2; pass++) {
+		unsigned nframes = pass ? 1 : 10;
+		unsigned ngap = pass ? 0 : 3;
+
+		for (unsigned i = 0; i < nframes + ngap; i++) {
+			result.b_field_ok = (i < nframes);
+			result.frame_number = i & 0xF;
+			size_t n = stream.burst(info, result, b_field, out);
+			for (size_t j = 0; j < n; j++)
+				nends += (out[j].flags & VOICE_GAP_END) != 0;
+		}
+
+		// Lost, deselected, cleared
+		size_t n = stream.end(info.rx_id, out);
+		if (n != 1 || !(out[0].flags & VOICE_GAP_END) || out[0].bursts != ngap || out[0].rx_id != info.rx_id)
+			ok = false;
+		nends += n;
+		nends += stream.end(info.rx_id, out);
+		nends += stream.end(info.rx_id, out);
+	}
+
+	printf("voice stream of a lost part: %u end records for 2 streams\n", nends);
+	return ok && nends == 2;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned nframes = (argc > 1) ? atoi(argv[1]) : 10000;
+	bool same = true;
+
+	for (unsigned n = 2; n <= MAX_PARTS; n++)
+		same &= check(n, nframes);
+	same &= check_end();
+	if (!same)
+		return 1;
+
+	for (unsigned n = 1; n <= MAX_PARTS; n *= 2)
+		run(n, nframes);
+
+	return 0;
+}
@@ -0,0 +1,569 @@
+/* batch.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Offline analysis of I/Q capture files: each file runs through its own
+ * demodulator and decoder on a pool of worker threads, and the part
+ * events of all files are merged into a single report ordered by the
+ * time they were received. Long files can be split into shards that run
+ * in parallel too and are stitched back together as they finish.
+ */
+
+#include <dirent.h>
+#include <getopt.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_analyzer.h"
+#include "capture_file.h"
+#include "dect2core/chase.h"
+#include "logging.h"
+#include "report_writer.h"
+#include "shard_stitcher.h"
+
+#define DECT_CARRIERS	10
+#define MERGE_FLUSH	1024	// Events per report write
+
+typedef struct {
+	std::string path;
+	bool ok;
+	uint64_t bursts;
+	double seconds;		// Of signal
+	std::vector<dect2core::part_event_t> events;
+} file_result_t;
+
+// A whole file, or a shard of one
+typedef struct {
+	size_t file;
+	bool sharded;
+	uint64_t start_item;	// Nominal start and end of a shard
+	uint64_t end_item;
+	uint64_t overlap;	// Items it is read from before its start
+	bool done;
+	bool ok;
+	capture_analyzer::shard_t shard;
+} work_t;
+
+typedef struct {
+	std::vector<file_result_t> files;
+	std::vector<work_t> work;
+	std::atomic<size_t> next;
+	std::mutex lock;
+	std::condition_variable done_cond;
+
+	capture_analyzer::config_t config;
+	capture_file::format_t format;	// Of raw files
+	double samp_rate;
+	double frequency;
+	double shard_length;		// Seconds, 0 for whole files
+} batch_t;
+
+typedef struct {
+	uint64_t timestamp;
+	uint32_t file;
+	uint32_t event;
+} merge_key_t;
+
+// Carrier index i as in the scanner, RF carrier 9 - i
+static double carrier_freqs[DECT_CARRIERS];
+
+static bool key_before(const merge_key_t &a, const merge_key_t &b)
+{
+	if (a.timestamp != b.timestamp)
+		return a.timestamp < b.timestamp;
+	if (a.file != b.file)
+		return a.file < b.file;
+	return a.event < b.event;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// CPU time of the calling thread
+static double thread_cpu(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static capture_file *open_file(batch_t *batch, size_t f)
+{
+	return capture_file::open(batch->files[f].path.c_str(), batch->format, batch->samp_rate, batch->frequency);
+}
+
+static void analyze(batch_t *batch, file_result_t *result, capture_file *file)
+{
+	capture_analyzer analyzer(batch->config, file);
+	result->ok = analyzer.run(&result->events);
+	result->bursts = analyzer.bursts();
+	result->seconds = file->items() / file->samp_rate();
+
+	log_info("%s: %.1lf s, %llu bursts, %zu events\n", result->path.c_str(), result->seconds,
+		(unsigned long long)result->bursts, result->events.size());
+}
+
+// Run a shard from overlap items before its nominal start
+static bool run_shard(batch_t *batch, work_t *work, uint64_t overlap)
+{
+	capture_file *file = open_file(batch, work->file);
+	if (!file)
+		return false;
+
+	capture_analyzer analyzer(batch->config, file);
+	work->shard.records.clear();
+	work->shard.bits.clear();
+	bool ok = analyzer.run_shard(work->start_item - std::min(work->start_item, overlap), work->end_item,
+		&work->shard);
+	delete file;
+	return ok;
+}
+
+static void worker(batch_t *batch, double *cpu)
+{
+	for (;;) {
+		size_t i = batch->next.fetch_add(1);
+		if (i >= batch->work.size())
+			break;
+
+		work_t *work = &batch->work[i];
+		bool ok = false;
+		if (work->sharded) {
+			ok = run_shard(batch, work, work->overlap);
+		} else {
+			capture_file *file = open_file(batch, work->file);
+			if (file) {
+				analyze(batch, &batch->files[work->file], file);
+				ok = batch->files[work->file].ok;
+				delete file;
+			}
+		}
+
+		std::lock_guard<std::mutex> guard(batch->lock);
+		work->ok = ok;
+		work->done = true;
+		batch->done_cond.notify_all();
+	}
+
+	*cpu = thread_cpu();
+}
+
+// Split a file into shards of about shard_length seconds, or keep it whole
+static void plan_file(batch_t *batch, size_t f)
+{
+	work_t work;
+	work.file = f;
+	work.sharded = false;
+	work.start_item = work.end_item = work.overlap = 0;
+	work.done = work.ok = false;
+
+	capture_file *file = batch->shard_length > 0 ? open_file(batch, f) : NULL;
+	if (!file) {
+		batch->work.push_back(work);
+		return;
+	}
+
+	capture_analyzer analyzer(batch->config, file);
+	uint64_t unit = analyzer.shard_unit(), items = file->items();
+	uint64_t shard_items = std::max((uint64_t)(batch->shard_length * file->samp_rate() / unit), (uint64_t)1) * unit;
+	work.overlap = analyzer.shard_overlap();
+	shard_items = std::max(shard_items, work.overlap);
+	delete file;
+
+	if (items <= shard_items) {
+		batch->work.push_back(work);
+		return;
+	}
+
+	work.sharded = true;
+	for (uint64_t start = 0; start < items; start += shard_items) {
+		work.start_item = start;
+		work.end_item = std::min(start + shard_items, items);
+		batch->work.push_back(work);
+	}
+}
+
+/*
+ * Stitch and decode a file's shards, from batch->work[first] on, as they
+ * are done. Returns the work item after the file's last shard.
+ */
+static size_t stitch_file(batch_t *batch, size_t first)
+{
+	size_t f = batch->work[first].file;
+	file_result_t *result = &batch->files[f];
+	capture_file *file = open_file(batch, f);
+	if (!file) {
+		size_t i = first;
+		while (i < batch->work.size() && batch->work[i].file == f)
+			i++;
+		return i;
+	}
+
+	capture_analyzer analyzer(batch->config, file);
+	shard_stitcher stitcher(&analyzer, batch->config.sps);
+	uint64_t items = file->items();
+	result->ok = true;
+
+	size_t i;
+	for (i = first; i < batch->work.size() && batch->work[i].file == f; i++) {
+		work_t *work = &batch->work[i];
+		{
+			std::unique_lock<std::mutex> guard(batch->lock);
+			while (!work->done)
+				batch->done_cond.wait(guard);
+		}
+		if (!work->ok)
+			result->ok = false;
+
+		uint64_t start = analyzer.receiver_sample(work->start_item);
+		uint64_t end = (work->end_item < items) ? analyzer.receiver_sample(work->end_item) : UINT64_MAX;
+
+		// Shards that haven't settled on the parts of the one before are
+		// run again from further back, at worst from the start of the file
+		uint64_t overlap = work->overlap;
+		while (!stitcher.add(work->shard, start, end, &result->events)) {
+			if (overlap >= work->start_item) {
+				log_error("%s: shard at %.1lf s doesn't match the one before\n", result->path.c_str(),
+					work->start_item / file->samp_rate());
+				result->ok = false;
+				break;
+			}
+			overlap = std::min(2 * overlap, work->start_item);
+			log_verbose("%s: running the shard at %.1lf s again from %.1lf s earlier\n", result->path.c_str(),
+				work->start_item / file->samp_rate(), overlap / file->samp_rate());
+			if (!run_shard(batch, work, overlap))
+				result->ok = false;
+		}
+
+		std::vector<capture_analyzer::record_t>().swap(work->shard.records);
+		std::vector<uint8_t>().swap(work->shard.bits);
+	}
+
+	result->bursts = analyzer.bursts();
+	result->seconds = items / file->samp_rate();
+	log_info("%s: %.1lf s in %zu shards, %llu bursts, %zu events\n", result->path.c_str(), result->seconds,
+		i - first, (unsigned long long)result->bursts, result->events.size());
+	delete file;
+	return i;
+}
+
+// Files of a directory that look like captures, sorted by name
+static void add_directory(const std::string &dir, std::vector<std::string> *paths)
+{
+	DIR *d = opendir(dir.c_str());
+	if (!d) {
+		log_error("can't open directory \"%s\"\n", dir.c_str());
+		return;
+	}
+
+	std::vector<std::string> names;
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		if (capture_file::is_capture(entry->d_name))
+			names.push_back(entry->d_name);
+	}
+	closedir(d);
+
+	std::sort(names.begin(), names.end());
+	for (size_t i = 0; i < names.size(); i++)
+		paths->push_back(dir + "/" + names[i]);
+}
+
+static void add_path(const char *arg, std::vector<std::string> *paths)
+{
+	struct stat st;
+
+	// Patterns may also be quoted to get past the shell's argument limit
+	if (strpbrk(arg, "*?[") && stat(arg, &st) < 0) {
+		glob_t g;
+		if (glob(arg, 0, NULL, &g) == 0) {
+			for (size_t i = 0; i < g.gl_pathc; i++)
+				add_path(g.gl_pathv[i], paths);
+		} else {
+			log_warning("no files match \"%s\"\n", arg);
+		}
+		globfree(&g);
+		return;
+	}
+
+	if (stat(arg, &st) == 0 && S_ISDIR(st.st_mode))
+		add_directory(arg, paths);
+	else
+		paths->push_back(arg);
+}
+
+static const char options[] = "f:j:o:s:v";
+static struct option long_options[] = {
+	{ "help", 0, NULL, 0 },
+	{ "verbose", 0, NULL, 'v' },
+	{ "chase-bits", 1, NULL, 0 },
+	{ "frequency", 1, NULL, 0 },
+	{ "input-format", 1, NULL, 0 },
+	{ "jobs", 1, NULL, 'j' },
+	{ "output", 1, NULL, 'o' },
+	{ "output-format", 1, NULL, 'f' },
+	{ "packet", 1, NULL, 0 },
+	{ "sample-rate", 1, NULL, 's' },
+	{ "shard-length", 1, NULL, 0 },
+	{ "sps", 1, NULL, 0 },
+	{ "squelch", 1, NULL, 0 },
+	{ NULL, 0, NULL, 0 },
+};
+
+static void print_help(const char *argv0)
+{
+	fprintf(stderr, "%s [options] {file|directory|pattern}...\n", argv0);
+	fprintf(stderr, "  {-j|--jobs} n  files or shards analysed at once (default: number of CPUs)\n");
+	fprintf(stderr, "  --shard-length seconds  split longer files into shards analysed at once (default: 0, off)\n");
+	fprintf(stderr, "  {-o|--output} file (default: - for stdout)\n");
+	fprintf(stderr, "  {-f|--output-format} {text|text-rf|jsonl|binary}\n");
+	fprintf(stderr, "  --input-format {cs8|cs16|cf32}  raw files without a .cs8, .cs16, .cf32 or .cfile extension (default: cs16)\n");
+	fprintf(stderr, "  {-s|--sample-rate} rate  of raw files (default: 4608000)\n");
+	fprintf(stderr, "  --frequency Hz  centre frequency of raw files, for the carrier index\n");
+	fprintf(stderr, "  --chase-bits k (0-%d)\n", CHASE_MAX_BITS);
+	fprintf(stderr, "  --packet {p00|p32|p80} (default: p32)\n");
+	fprintf(stderr, "  --sps {2|4|8} (default: 2)\n");
+	fprintf(stderr, "  --squelch dB (default: 0, off)\n");
+	fprintf(stderr, "SigMF recordings are found by their .sigmf-data or .sigmf-meta file.\n");
+}
+
+int main(int argc, char **argv)
+{
+	std::string output_path = "-";
+	report_writer::format_t output_format = report_writer::FORMAT_TEXT;
+	unsigned jobs = std::thread::hardware_concurrency();
+	batch_t batch;
+
+	for (int i = 0; i < DECT_CARRIERS; i++)
+		carrier_freqs[i] = 1881.792e6 + i * 1.728e6;
+
+	batch.config.sps = 2;
+	batch.config.packet_format = dect2core::burst_receiver::PACKET_P32;
+	batch.config.squelch_db = 0;
+	batch.config.chase_bits = 0;
+	batch.config.carrier_freqs = carrier_freqs;
+	batch.config.ncarriers = DECT_CARRIERS;
+	batch.format = capture_file::FORMAT_CS16;
+	batch.samp_rate = 4608000;
+	batch.frequency = 0;
+	batch.shard_length = 0;
+
+	for (;;) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, options, long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 0: {
+			const char *option_name = long_options[option_index].name;
+
+			if (strcmp(option_name, "help") == 0) {
+				print_help(argv[0]);
+				return EXIT_SUCCESS;
+
+			} else if (strcmp(option_name, "chase-bits") == 0) {
+				int k = atoi(optarg);
+				if (k < 0 || k > CHASE_MAX_BITS) {
+					log_error("chase bits must be 0 to %d\n", CHASE_MAX_BITS);
+					return EXIT_FAILURE;
+				}
+				batch.config.chase_bits = k;
+
+			} else if (strcmp(option_name, "frequency") == 0) {
+				batch.frequency = atof(optarg);
+
+			} else if (strcmp(option_name, "input-format") == 0) {
+				if (!capture_file::parse_format(optarg, &batch.format)) {
+					log_error("unknown input format \"%s\"\n", optarg);
+					return EXIT_FAILURE;
+				}
+
+			} else if (strcmp(option_name, "packet") == 0) {
+				if (strcmp(optarg, "p00") == 0) {
+					batch.config.packet_format = dect2core::burst_receiver::PACKET_P00;
+				} else if (strcmp(optarg, "p32") == 0) {
+					batch.config.packet_format = dect2core::burst_receiver::PACKET_P32;
+				} else if (strcmp(optarg, "p80") == 0) {
+					batch.config.packet_format = dect2core::burst_receiver::PACKET_P80;
+				} else {
+					log_error("unknown packet format \"%s\"\n", optarg);
+					return EXIT_FAILURE;
+				}
+
+			} else if (strcmp(option_name, "shard-length") == 0) {
+				batch.shard_length = atof(optarg);
+				if (batch.shard_length < 0) {
+					log_error("shard length can't be negative\n");
+					return EXIT_FAILURE;
+				}
+
+			} else if (strcmp(option_name, "sps") == 0) {
+				batch.config.sps = atoi(optarg);
+				if (batch.config.sps != 2 && batch.config.sps != 4 && batch.config.sps != 8) {
+					log_error("samples per symbol must be 2, 4 or 8\n");
+					return EXIT_FAILURE;
+				}
+
+			} else if (strcmp(option_name, "squelch") == 0) {
+				batch.config.squelch_db = atof(optarg);
+				if (batch.config.squelch_db < 0) {
+					log_error("squelch threshold can't be negative\n");
+					return EXIT_FAILURE;
+				}
+			}
+			break;
+		}
+
+		case 'f':
+			if (!report_writer::parse_format(optarg, &output_format)) {
+				log_error("unknown output format \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+
+		case 'o':
+			output_path = optarg;
+			break;
+
+		case 's':
+			batch.samp_rate = atof(optarg);
+			if (batch.samp_rate <= 0) {
+				log_error("bad sample rate \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'v':
+			loglevel++;
+			break;
+
+		default:
+			print_help(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<std::string> paths;
+	for (int i = optind; i < argc; i++)
+		add_path(argv[i], &paths);
+	if (paths.empty()) {
+		print_help(argv[0]);
+		log_flush();
+		return EXIT_FAILURE;
+	}
+
+	report_writer *writer = report_writer::open(output_path.c_str(), output_format, carrier_freqs, DECT_CARRIERS);
+	if (!writer) {
+		log_flush();
+		return EXIT_FAILURE;
+	}
+
+	batch.files.resize(paths.size());
+	for (size_t i = 0; i < paths.size(); i++) {
+		batch.files[i].path = paths[i];
+		batch.files[i].ok = false;
+		batch.files[i].bursts = 0;
+		batch.files[i].seconds = 0;
+	}
+	for (size_t i = 0; i < paths.size(); i++)
+		plan_file(&batch, i);
+	batch.next = 0;
+
+	jobs = std::max(1u, std::min(jobs, (unsigned)batch.work.size()));
+	double start = now();
+
+	std::vector<std::thread> threads;
+	std::vector<double> cpu(jobs);
+	for (unsigned i = 0; i < jobs; i++)
+		threads.push_back(std::thread(worker, &batch, &cpu[i]));
+
+	// Shards are stitched in order while the later ones are still running
+	for (size_t i = 0; i < batch.work.size();) {
+		if (batch.work[i].sharded)
+			i = stitch_file(&batch, i);
+		else
+			i++;
+	}
+	for (unsigned i = 0; i < jobs; i++)
+		threads[i].join();
+
+	// Each file's events are in order already, but files overlap in time
+	std::vector<merge_key_t> keys;
+	unsigned failed = 0;
+	double seconds = 0;
+	for (size_t f = 0; f < batch.files.size(); f++) {
+		const file_result_t &result = batch.files[f];
+		failed += !result.ok;
+		seconds += result.seconds;
+		for (size_t e = 0; e < result.events.size(); e++) {
+			merge_key_t key = { result.events[e].part_info.timestamp, (uint32_t)f, (uint32_t)e };
+			keys.push_back(key);
+		}
+	}
+	std::sort(keys.begin(), keys.end(), key_before);
+
+	for (size_t i = 0; i < keys.size(); i++) {
+		writer->write(&batch.files[keys[i].file].events[keys[i].event], 1);
+		if (i % MERGE_FLUSH == MERGE_FLUSH - 1)
+			writer->flush();
+	}
+	writer->flush();
+	delete writer;
+
+	double elapsed = now() - start;
+	log_info("%zu files, %.1lf s of signal in %.1lf s with %u jobs (%.1lfx real time), %zu events\n",
+		paths.size(), seconds, elapsed, jobs, seconds / elapsed, keys.size());
+
+	// With fewer cores than jobs the wall time says little, the busiest
+	// job's CPU time is what it would come down to with a core for each
+	double main_cpu = thread_cpu(), total_cpu = main_cpu, busiest = 0;
+	for (unsigned i = 0; i < jobs; i++) {
+		total_cpu += cpu[i];
+		busiest = std::max(busiest, cpu[i]);
+	}
+	log_info("CPU time %.2lf s, busiest job %.2lf s, stitching and merging %.2lf s\n",
+		total_cpu, busiest, main_cpu);
+	if (failed)
+		log_error("%u files failed\n", failed);
+
+	log_flush();
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
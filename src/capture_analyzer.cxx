@@ -0,0 +1,386 @@
+/* capture_analyzer.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "capture_analyzer.h"
+#include "dect2core/dect2_common.h"
+
+#define READ_CHUNK		(1 << 18)	// Input items per read
+#define CARRIER_TOLERANCE	200e3		// Hz between a segment's frequency and its carrier
+
+// Same test as frontend::native_decimation()
+static unsigned native_decimation(double samp_rate, unsigned sps)
+{
+	double out_rate = sps * (double)SYMBOL_RATE;
+	unsigned decimation = (unsigned)lrint(samp_rate / out_rate);
+
+	if (decimation == 0 || std::fabs(samp_rate / (decimation * out_rate) - 1.0) >= 10e-6)
+		return 0;
+	return decimation;
+}
+
+// Drop the first n of count items of a buffer
+template <typename T>
+static void shift(T *buf, size_t n, size_t count)
+{
+	memmove(buf, buf + n, (count - n) * sizeof(T));
+}
+
+capture_analyzer::capture_analyzer(const config_t &config, capture_file *file)
+	: d_config(config), d_file(file), d_events(NULL), d_shard(NULL),
+	d_int_discriminator(NULL), d_resampler(NULL), d_discriminator(NULL),
+	d_receiver(dect2core::burst_receiver::make(this, config.sps, config.packet_format)),
+	d_decoder(this), d_item(0), d_read_end(0),
+	d_bits_base(0), d_bits_out(0), d_bursts(0)
+{
+	if (config.chase_bits) {
+		d_receiver->set_soft_output(true);
+		d_receiver->set_chase_bits(config.chase_bits);
+		d_decoder.set_chase_bits(config.chase_bits);
+	}
+
+	unsigned decimation = native_decimation(file->samp_rate(), config.sps);
+	unsigned block_samples = SQUELCH_BLOCK_SYMBOLS * config.sps;
+
+	// Shards start on squelch blocks, and on the resampler's cycle
+	if (decimation && file->format() != capture_file::FORMAT_CF32) {
+		dect2core::sample_format_t format = (file->format() == capture_file::FORMAT_CS8) ?
+			dect2core::SAMPLE_CS8 : dect2core::SAMPLE_CS16;
+		d_int_discriminator = new dect2core::int_discriminator(format, decimation, config.sps,
+			config.squelch_db);
+		d_ratio = decimation;
+		d_offset = d_int_discriminator->delay();
+		d_unit = (uint64_t)decimation * block_samples;
+		d_unit_samples = block_samples;
+	} else {
+		d_resampler = new dect2core::resampler(file->samp_rate(), config.sps * (double)SYMBOL_RATE);
+		d_discriminator = new dect2core::phase_discriminator(config.sps, config.squelch_db);
+		d_ratio = (double)d_resampler->decimation() / d_resampler->interpolation();
+		d_offset = d_resampler->delay() + d_discriminator->delay() * d_ratio;
+		d_unit = (uint64_t)d_resampler->decimation() * block_samples;
+		d_unit_samples = (uint64_t)d_resampler->interpolation() * block_samples;
+	}
+}
+
+capture_analyzer::~capture_analyzer()
+{
+	delete d_receiver;
+	delete d_discriminator;
+	delete d_resampler;
+	delete d_int_discriminator;
+}
+
+bool capture_analyzer::run(std::vector<dect2core::part_event_t> *events)
+{
+	d_events = events;
+	d_read_end = d_file->items();
+	return d_int_discriminator ? demodulate_int() : demodulate_float();
+}
+
+bool capture_analyzer::run_shard(uint64_t first_item, uint64_t end_item, shard_t *shard)
+{
+	// The longest burst, reported after its A-field, and the filters
+	uint64_t tail = (uint64_t)(2 * SLOT_SYMBOLS * d_config.sps * d_ratio) + d_unit;
+
+	if (!d_file->seek(first_item))
+		return false;
+	d_shard = shard;
+	d_item = first_item;
+	d_read_end = std::min(end_item + tail, d_file->items());
+	d_receiver->reset(receiver_sample(first_item));
+	return d_int_discriminator ? demodulate_int() : demodulate_float();
+}
+
+uint64_t capture_analyzer::shard_overlap(void) const
+{
+	uint64_t items = (uint64_t)(SHARD_OVERLAP_FRAMES * FRAME_SYMBOLS * d_config.sps * d_ratio);
+	return (items + d_unit - 1) / d_unit * d_unit;
+}
+
+void capture_analyzer::replay(const record_t &record, const uint8_t *bits,
+	std::vector<dect2core::part_event_t> *events)
+{
+	uint8_t b_field[B_FIELD_BYTES];
+	dect2core::burst_result_t result;
+
+	d_events = events;
+	if (record.lost) {
+		set_time(record.time);
+		d_decoder.part_lost(record.info.rx_id);
+	} else {
+		set_time(record.info.sample_index);
+		d_decoder.decode(record.info, bits, record.info.length, b_field, &result);
+		d_bursts++;
+	}
+	d_events = NULL;
+}
+
+uint32_t capture_analyzer::carrier_index(double frequency) const
+{
+	for (size_t i = 0; i < d_config.ncarriers; i++) {
+		if (std::fabs(frequency - d_config.carrier_freqs[i]) < CARRIER_TOLERANCE)
+			return i;
+	}
+	return d_config.ncarriers;
+}
+
+// Events that follow are stamped with the time of receiver sample sample_index
+void capture_analyzer::set_time(uint64_t sample_index)
+{
+	double item = sample_index * d_ratio + d_offset;
+
+	d_decoder.set_time(d_file->item_time(item));
+	d_decoder.set_carrier(carrier_index(d_file->segment(item > 0 ? (uint64_t)item : 0).frequency));
+}
+
+// Read up to space items, no further than d_read_end. Returns -1 on errors.
+ssize_t capture_analyzer::read(void *buf, size_t space, bool *eof)
+{
+	size_t want = std::min((uint64_t)space, d_read_end - d_item);
+	ssize_t r = want ? d_file->read(buf, want) : 0;
+	if (r < 0)
+		return -1;
+
+	*eof = (d_item == d_read_end) || (want && r == 0);
+	d_item += r;
+	return r;
+}
+
+bool capture_analyzer::demodulate_int(void)
+{
+	unsigned decimation = d_int_discriminator->decimation();
+	size_t item_size = capture_file::item_size(d_file->format());
+	size_t history = d_int_discriminator->history();
+	std::vector<uint8_t> in((READ_CHUNK + history) * item_size);
+	std::vector<float> phase(READ_CHUNK / decimation + 2 * d_config.sps), power(phase.size());
+	size_t nin = 0, nphase = 0;
+
+	for (bool eof = false; !eof;) {
+		ssize_t r = read(&in[nin * item_size], READ_CHUNK + history - nin, &eof);
+		if (r < 0)
+			return false;
+		nin += r;
+
+		if (nin >= history + decimation) {
+			size_t n = std::min((nin - history) / decimation, phase.size() - nphase);
+			d_int_discriminator->process(in.data(), n, &phase[nphase], &power[nphase]);
+			shift(in.data(), n * decimation * item_size, nin * item_size);
+			nin -= n * decimation;
+			nphase += n;
+		}
+
+		size_t consumed;
+		receive(phase.data(), power.data(), nphase, &consumed);
+		shift(phase.data(), consumed, nphase);
+		shift(power.data(), consumed, nphase);
+		nphase -= consumed;
+	}
+
+	return true;
+}
+
+bool capture_analyzer::demodulate_float(void)
+{
+	capture_file::format_t format = d_file->format();
+	size_t item_size = capture_file::item_size(format);
+	size_t lookahead = d_discriminator->lookahead();
+	std::vector<uint8_t> raw(READ_CHUNK * item_size);
+	std::vector<std::complex<float> > in(READ_CHUNK + d_resampler->history());
+	std::vector<std::complex<float> > resampled(
+		(size_t)((double)READ_CHUNK * d_resampler->interpolation() / d_resampler->decimation()) + lookahead + 2);
+	std::vector<float> phase(resampled.size() + 2 * d_config.sps), power(phase.size());
+	size_t nin = 0, nresampled = 0, nphase = 0;
+
+	for (bool eof = false; !eof;) {
+		ssize_t r = read(raw.data(), std::min((size_t)READ_CHUNK, in.size() - nin), &eof);
+		if (r < 0)
+			return false;
+
+		// Integer samples are scaled to a full scale of 1, as powers are
+		// relative to full scale
+		std::complex<float> *out = &in[nin];
+		if (format == capture_file::FORMAT_CS8) {
+			const int8_t *s = (const int8_t *)raw.data();
+			for (ssize_t i = 0; i < r; i++)
+				out[i] = std::complex<float>(s[2 * i] / 128.0f, s[2 * i + 1] / 128.0f);
+		} else if (format == capture_file::FORMAT_CS16) {
+			const int16_t *s = (const int16_t *)raw.data();
+			for (ssize_t i = 0; i < r; i++)
+				out[i] = std::complex<float>(s[2 * i] / 32768.0f, s[2 * i + 1] / 32768.0f);
+		} else {
+			memcpy(out, raw.data(), r * item_size);
+		}
+		nin += r;
+
+		size_t consumed;
+		nresampled += d_resampler->process(in.data(), nin, &resampled[nresampled],
+			resampled.size() - nresampled, &consumed);
+		shift(in.data(), consumed, nin);
+		nin -= consumed;
+
+		if (nresampled > lookahead) {
+			size_t n = std::min(nresampled - lookahead, phase.size() - nphase);
+			d_discriminator->process(resampled.data(), n, &phase[nphase], &power[nphase]);
+			shift(resampled.data(), n, nresampled);
+			nresampled -= n;
+			nphase += n;
+		}
+
+		receive(phase.data(), power.data(), nphase, &consumed);
+		shift(phase.data(), consumed, nphase);
+		shift(power.data(), consumed, nphase);
+		nphase -= consumed;
+	}
+
+	return true;
+}
+
+// Run the receiver over n samples, keeping the ones it may still look at
+void capture_analyzer::receive(const float *phase, const float *power, size_t n, size_t *nconsumed)
+{
+	unsigned sps = d_config.sps;
+	size_t pos = 0;
+
+	while (pos + sps < n) {
+		size_t ninput = n - sps - pos;
+		size_t old = d_bits.size();
+		size_t room = ninput / sps + 2;
+
+		d_bits.resize(old + room);
+		d_bits_out = d_bits_base + old;
+
+		size_t consumed, produced;
+		d_receiver->process(phase + pos, ninput, &d_bits[old], room, &consumed, &produced, power + pos);
+		d_bits.resize(old + produced);
+		pos += consumed;
+
+		decode_pending();
+		if (consumed == 0)
+			break;
+	}
+
+	*nconsumed = pos;
+}
+
+void capture_analyzer::decode_pending(void)
+{
+	uint8_t b_field[B_FIELD_BYTES];
+	dect2core::burst_result_t result;
+
+	while (!d_pending.empty()) {
+		const pending_t &p = d_pending.front();
+
+		if (!p.lost && p.bit + p.info.length > d_bits_base + d_bits.size())
+			break;
+		const uint8_t *bits = p.lost ? NULL : &d_bits[p.bit - d_bits_base];
+
+		// Shards are decoded once stitched, this decoder only learns burst
+		// lengths for the receiver
+		if (d_shard) {
+			record_t record;
+			record.lost = p.lost;
+			record.time = p.time;
+			record.info = p.info;
+			record.bit = d_shard->bits.size();
+			d_shard->records.push_back(record);
+			if (!p.lost)
+				d_shard->bits.insert(d_shard->bits.end(), bits, bits + p.info.length);
+		}
+
+		if (p.lost) {
+			set_time(p.time);
+			d_decoder.part_lost(p.info.rx_id);
+		} else {
+			set_time(p.info.sample_index);
+			d_decoder.decode(p.info, bits, p.info.length, b_field, &result);
+			d_bursts++;
+		}
+		d_pending.pop_front();
+	}
+
+	// Keep the bits from the first burst still waiting for the rest
+	uint64_t keep = d_pending.empty() ? d_bits_base + d_bits.size() : d_pending.front().bit;
+	d_bits.erase(d_bits.begin(), d_bits.begin() + (keep - d_bits_base));
+	d_bits_base = keep;
+}
+
+void capture_analyzer::burst_start(size_t out_offset, const dect2core::burst_info_t &info)
+{
+	pending_t p;
+	p.lost = false;
+	p.time = d_receiver->sample_count();
+	p.bit = d_bits_out + out_offset;
+	p.info = info;
+	d_pending.push_back(p);
+}
+
+// After the bursts announced so far, like the scanner's message to the decoder
+void capture_analyzer::part_lost(uint32_t rx_id)
+{
+	pending_t p;
+	memset(&p, 0, sizeof(p));
+	p.lost = true;
+	p.time = d_receiver->sample_count();
+	p.bit = d_bits_out;
+	p.info.rx_id = rx_id;
+	d_pending.push_back(p);
+}
+
+void capture_analyzer::part_updated(const dect2core::part_info_t &part_info)
+{
+	if (!d_events)
+		return;
+
+	dect2core::part_event_t event;
+	event.type = dect2core::PART_UPDATED;
+	event.part_info = part_info;
+	d_events->push_back(event);
+}
+
+void capture_analyzer::part_lost(const dect2core::part_info_t &part_info)
+{
+	if (!d_events)
+		return;
+
+	dect2core::part_event_t event;
+	event.type = dect2core::PART_LOST;
+	event.part_info = part_info;
+	d_events->push_back(event);
+}
+
+void capture_analyzer::part_matched(const dect2core::part_info_t &part_info)
+{
+	if (!d_events)
+		return;
+
+	dect2core::part_event_t event;
+	event.type = dect2core::PART_MATCHED;
+	event.part_info = part_info;
+	d_events->push_back(event);
+}
+
+void capture_analyzer::burst_length_changed(uint32_t rx_id, uint32_t d_field_bits)
+{
+	d_receiver->set_part_length(rx_id, d_field_bits);
+}
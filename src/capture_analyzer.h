@@ -0,0 +1,166 @@
+/* capture_analyzer.h */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _CAPTURE_ANALYZER_H
+#define _CAPTURE_ANALYZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <complex>
+#include <deque>
+#include <vector>
+
+#include "capture_file.h"
+#include "dect2core/burst_decoder.h"
+#include "dect2core/burst_receiver.h"
+#include "dect2core/int_discriminator.h"
+#include "dect2core/phase_discriminator.h"
+#include "dect2core/resampler.h"
+
+/*
+ * The scanner's demodulator and decoder for one capture file, without
+ * GNU Radio: integer I/Q at a whole multiple of the symbol rate goes
+ * through int_discriminator like --input, anything else is converted to
+ * float and resampled. The file is read in chunks, so memory use doesn't
+ * depend on its length, and part events are stamped with the time the
+ * capture says the burst was received.
+ *
+ * A long file can also be split into shards analysed on their own: each
+ * starts SHARD_OVERLAP_FRAMES early to pick up the parts on air and
+ * keeps its receiver events, which shard_stitcher joins and decodes.
+ */
+
+// Frames a shard starts before its nominal start, and of those the last
+// ones, the receiver's part timeout and a frame more, over which it is
+// compared with the shard before
+#define SHARD_OVERLAP_FRAMES	8
+#define SHARD_COMPARE_FRAMES	5
+
+class capture_analyzer : private dect2core::burst_receiver::listener, private dect2core::burst_decoder::listener
+{
+public:
+	typedef struct {
+		unsigned sps;
+		dect2core::burst_receiver::packet_format_t packet_format;
+		float squelch_db;
+		unsigned chase_bits;
+		const double *carrier_freqs;	// Carrier index for each segment's frequency
+		size_t ncarriers;
+	} config_t;
+
+	// A receiver event of a shard
+	typedef struct {
+		bool lost;
+		uint64_t time;			// Receiver sample it was reported at
+		dect2core::burst_info_t info;	// Only rx_id for lost parts
+		size_t bit;			// First bit of the burst in shard_t::bits
+	} record_t;
+
+	typedef struct {
+		std::vector<record_t> records;
+		std::vector<uint8_t> bits;
+	} shard_t;
+
+private:
+	// Receiver events, handled in order once the burst's bits are there
+	typedef struct {
+		bool lost;
+		uint64_t time;
+		uint64_t bit;			// Output bit the burst starts at
+		dect2core::burst_info_t info;
+	} pending_t;
+
+	config_t d_config;
+	capture_file *d_file;
+	std::vector<dect2core::part_event_t> *d_events;
+	shard_t *d_shard;
+
+	dect2core::int_discriminator *d_int_discriminator;	// Native integer input
+	dect2core::resampler *d_resampler;			// Anything else
+	dect2core::phase_discriminator *d_discriminator;
+	dect2core::burst_receiver *d_receiver;
+	dect2core::burst_decoder d_decoder;
+	double d_ratio;			// Input items per receiver sample
+	double d_offset;		// Input item receiver sample 0 stands for
+	uint64_t d_unit;		// Input items a shard start is a multiple of
+	uint64_t d_unit_samples;	// Receiver samples in d_unit items
+
+	uint64_t d_item;		// Next item to read
+	uint64_t d_read_end;		// Item to stop reading at
+
+	std::deque<pending_t> d_pending;
+	std::vector<uint8_t> d_bits;
+	uint64_t d_bits_base;		// Output bit d_bits[0] is
+	uint64_t d_bits_out;		// Bits produced before the current receiver call
+	uint64_t d_bursts;
+
+	uint32_t carrier_index(double frequency) const;
+	void set_time(uint64_t sample_index);
+	ssize_t read(void *buf, size_t space, bool *eof);
+	bool demodulate_int(void);
+	bool demodulate_float(void);
+	void receive(const float *phase, const float *power, size_t n, size_t *nconsumed);
+	void decode_pending(void);
+
+	// burst_receiver::listener
+	void burst_start(size_t out_offset, const dect2core::burst_info_t &info);
+	void part_lost(uint32_t rx_id);
+
+	// burst_decoder::listener
+	void part_updated(const dect2core::part_info_t &part_info);
+	void part_lost(const dect2core::part_info_t &part_info);
+	void part_matched(const dect2core::part_info_t &part_info);
+	void parts_changed(void) {}
+	void burst_length_changed(uint32_t rx_id, uint32_t d_field_bits);
+
+public:
+	capture_analyzer(const config_t &config, capture_file *file);
+	~capture_analyzer();
+
+	/*
+	 * Run the whole file through and append its part events to events.
+	 * Returns false on read errors, the events up to there are kept.
+	 * Only one of run() and run_shard() may be called.
+	 */
+	bool run(std::vector<dect2core::part_event_t> *events);
+
+	/*
+	 * Run the file from first_item, a multiple of shard_unit(), to end_item
+	 * and a little beyond, to complete the bursts started before it, keeping
+	 * the receiver events in shard instead of decoding them.
+	 */
+	bool run_shard(uint64_t first_item, uint64_t end_item, shard_t *shard);
+
+	// Decode a stitched shard record, appending its part events to events
+	void replay(const record_t &record, const uint8_t *bits, std::vector<dect2core::part_event_t> *events);
+
+	uint64_t shard_unit(void) const { return d_unit; }
+
+	// SHARD_OVERLAP_FRAMES in items, rounded up to shard_unit()
+	uint64_t shard_overlap(void) const;
+
+	// Receiver sample of a multiple of shard_unit()
+	uint64_t receiver_sample(uint64_t item) const { return item / d_unit * d_unit_samples; }
+
+	uint64_t bursts(void) const { return d_bursts; }
+};
+
+#endif
@@ -0,0 +1,317 @@
+/* capture_file.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "capture_file.h"
+#include "logging.h"
+
+static bool ends_with(const std::string &s, const char *suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static bool format_from_extension(const std::string &path, capture_file::format_t *format)
+{
+	if (ends_with(path, ".cs8"))
+		*format = capture_file::FORMAT_CS8;
+	else if (ends_with(path, ".cs16"))
+		*format = capture_file::FORMAT_CS16;
+	else if (ends_with(path, ".cf32") || ends_with(path, ".cfile"))
+		*format = capture_file::FORMAT_CF32;
+	else
+		return false;
+	return true;
+}
+
+/*
+ * Just enough JSON for SigMF metadata: the value of "key" between begin
+ * and end, NULL if it isn't there. Keys are unique within the objects
+ * searched.
+ */
+static const char *json_value(const char *begin, const char *end, const char *key)
+{
+	std::string quoted = std::string("\"") + key + "\"";
+	const char *p = std::search(begin, end, quoted.begin(), quoted.end());
+	if (p == end)
+		return NULL;
+
+	p += quoted.size();
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ':'))
+		p++;
+	return (p < end) ? p : NULL;
+}
+
+static bool json_string(const char *value, const char *end, std::string *s)
+{
+	if (!value || *value != '"')
+		return false;
+	const char *close = std::find(value + 1, end, '"');
+	if (close == end)
+		return false;
+	s->assign(value + 1, close);
+	return true;
+}
+
+// ISO 8601 UTC, "2021-06-01T12:00:00.123456Z", to ns since the epoch
+static bool parse_datetime(const std::string &s, uint64_t *ns)
+{
+	struct tm tm;
+	memset(&tm, 0, sizeof(tm));
+
+	const char *p = strptime(s.c_str(), "%Y-%m-%dT%H:%M:%S", &tm);
+	if (!p)
+		return false;
+
+	uint64_t frac = 0, scale = 1000000000ull;
+	if (*p == '.') {
+		for (p++; *p >= '0' && *p <= '9'; p++) {
+			if (scale > 1) {
+				scale /= 10;
+				frac += (*p - '0') * scale;
+			}
+		}
+	}
+
+	*ns = (uint64_t)timegm(&tm) * 1000000000ull + frac;
+	return true;
+}
+
+static bool starts_before(const capture_file::segment_t &a, const capture_file::segment_t &b)
+{
+	return a.sample_start < b.sample_start;
+}
+
+capture_file::capture_file()
+	: d_fd(-1), d_format(FORMAT_CS16), d_samp_rate(0), d_items(0)
+{
+}
+
+capture_file::~capture_file()
+{
+	if (d_fd >= 0)
+		close(d_fd);
+}
+
+bool capture_file::parse_format(const char *name, format_t *format)
+{
+	if (strcmp(name, "cs8") == 0)
+		*format = FORMAT_CS8;
+	else if (strcmp(name, "cs16") == 0)
+		*format = FORMAT_CS16;
+	else if (strcmp(name, "cf32") == 0)
+		*format = FORMAT_CF32;
+	else
+		return false;
+	return true;
+}
+
+size_t capture_file::item_size(format_t format)
+{
+	switch (format) {
+	case FORMAT_CS8:	return 2;
+	case FORMAT_CS16:	return 4;
+	case FORMAT_CF32:	return 8;
+	}
+	return 0;
+}
+
+bool capture_file::is_capture(const char *path)
+{
+	format_t format;
+	return ends_with(path, ".sigmf-data") || format_from_extension(path, &format);
+}
+
+bool capture_file::read_meta(const std::string &meta_path)
+{
+	FILE *f = fopen(meta_path.c_str(), "r");
+	if (!f) {
+		log_error("can't open \"%s\": %s\n", meta_path.c_str(), strerror(errno));
+		return false;
+	}
+
+	std::string json;
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		json.append(buf, n);
+	fclose(f);
+
+	const char *begin = json.c_str(), *end = begin + json.size();
+	std::string datatype;
+
+	if (!json_string(json_value(begin, end, "core:datatype"), end, &datatype)) {
+		log_error("%s: no core:datatype\n", meta_path.c_str());
+		return false;
+	}
+	if (datatype == "ci8" || datatype == "ci8_le") {
+		d_format = FORMAT_CS8;
+	} else if (datatype == "ci16_le") {
+		d_format = FORMAT_CS16;
+	} else if (datatype == "cf32_le") {
+		d_format = FORMAT_CF32;
+	} else {
+		log_error("%s: unsupported datatype %s\n", meta_path.c_str(), datatype.c_str());
+		return false;
+	}
+
+	const char *rate = json_value(begin, end, "core:sample_rate");
+	if (!rate || (d_samp_rate = strtod(rate, NULL)) <= 0) {
+		log_error("%s: no core:sample_rate\n", meta_path.c_str());
+		return false;
+	}
+
+	// Each object of the captures array is a segment; none has nested objects
+	const char *captures = json_value(begin, end, "captures");
+	if (captures && *captures == '[') {
+		const char *array_end = std::find(captures, end, ']');
+		for (const char *obj = std::find(captures, array_end, '{'); obj != array_end;
+		     obj = std::find(obj, array_end, '{')) {
+			const char *obj_end = std::find(obj, array_end, '}');
+			segment_t seg = { 0, 0, 0 };
+			std::string datetime;
+
+			const char *v = json_value(obj, obj_end, "core:sample_start");
+			if (v)
+				seg.sample_start = strtoull(v, NULL, 10);
+			v = json_value(obj, obj_end, "core:frequency");
+			if (v)
+				seg.frequency = strtod(v, NULL);
+			if (json_string(json_value(obj, obj_end, "core:datetime"), obj_end, &datetime))
+				parse_datetime(datetime, &seg.time);
+
+			d_segments.push_back(seg);
+			obj = obj_end;
+		}
+	}
+
+	return true;
+}
+
+capture_file *capture_file::open(const char *path, format_t format, double samp_rate, double frequency)
+{
+	capture_file *file = new capture_file();
+	std::string data_path = path;
+	bool sigmf = false;
+
+	if (ends_with(data_path, ".sigmf-meta")) {
+		data_path.replace(data_path.size() - 4, 4, "data");
+		sigmf = true;
+	} else if (ends_with(data_path, ".sigmf-data")) {
+		sigmf = true;
+	}
+	file->d_path = data_path;
+
+	if (sigmf) {
+		std::string meta_path = data_path.substr(0, data_path.size() - 4) + "meta";
+		if (!file->read_meta(meta_path)) {
+			delete file;
+			return NULL;
+		}
+	} else {
+		if (!format_from_extension(data_path, &file->d_format))
+			file->d_format = format;
+		file->d_samp_rate = samp_rate;
+	}
+
+	file->d_fd = ::open(data_path.c_str(), O_RDONLY);
+	struct stat st;
+	if (file->d_fd < 0 || fstat(file->d_fd, &st) < 0) {
+		log_error("can't open \"%s\": %s\n", data_path.c_str(), strerror(errno));
+		delete file;
+		return NULL;
+	}
+	file->d_items = st.st_size / item_size(file->d_format);
+
+	std::vector<segment_t> &segments = file->d_segments;
+	if (segments.empty()) {
+		// Raw files are taken to end when they were last written
+		segment_t seg = { 0, frequency, 0 };
+		uint64_t mtime = (uint64_t)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+		uint64_t duration = (uint64_t)(file->d_items / file->d_samp_rate * 1e9);
+		seg.time = (mtime > duration) ? mtime - duration : 0;
+		segments.push_back(seg);
+	}
+	std::stable_sort(segments.begin(), segments.end(), starts_before);
+
+	// Segments without a time continue the previous one
+	for (size_t i = 1; i < segments.size(); i++) {
+		if (segments[i].time == 0 && segments[i - 1].time != 0) {
+			segments[i].time = segments[i - 1].time +
+				(uint64_t)((segments[i].sample_start - segments[i - 1].sample_start) / file->d_samp_rate * 1e9);
+		}
+	}
+
+	return file;
+}
+
+const capture_file::segment_t &capture_file::segment(uint64_t item) const
+{
+	segment_t key = { item, 0, 0 };
+	std::vector<segment_t>::const_iterator it =
+		std::upper_bound(d_segments.begin(), d_segments.end(), key, starts_before);
+	return (it == d_segments.begin()) ? *it : *(it - 1);
+}
+
+uint64_t capture_file::item_time(double item) const
+{
+	const segment_t &seg = segment(item > 0 ? (uint64_t)item : 0);
+	return seg.time + (int64_t)((item - seg.sample_start) / d_samp_rate * 1e9);
+}
+
+bool capture_file::seek(uint64_t item)
+{
+	if (lseek(d_fd, (off_t)(item * item_size(d_format)), SEEK_SET) < 0) {
+		log_error("lseek(\"%s\") failed: %s\n", d_path.c_str(), strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+ssize_t capture_file::read(void *buf, size_t n)
+{
+	size_t size = item_size(d_format);
+	size_t want = n * size, got = 0;
+
+	while (got < want) {
+		ssize_t r = ::read(d_fd, (uint8_t *)buf + got, want - got);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("read(\"%s\") failed: %s\n", d_path.c_str(), strerror(errno));
+			return -1;
+		}
+		if (r == 0)
+			break;
+		got += r;
+	}
+
+	return got / size;
+}
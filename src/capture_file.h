@@ -0,0 +1,101 @@
+/* capture_file.h */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _CAPTURE_FILE_H
+#define _CAPTURE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * An I/Q capture on disk, read sequentially: either a SigMF recording,
+ * whose metadata gives the sample format, rate, and the frequency and
+ * start time of each capture segment, or a raw file, whose format follows
+ * from its extension (.cs8, .cs16, .cf32 or .cfile) and which is assumed
+ * to have been written in one go ending at its modification time.
+ */
+class capture_file
+{
+public:
+	typedef enum {
+		FORMAT_CS8,
+		FORMAT_CS16,
+		FORMAT_CF32,
+	} format_t;
+
+	typedef struct {
+		uint64_t sample_start;	// First item of the segment
+		double frequency;	// Centre frequency, Hz, 0 if unknown
+		uint64_t time;		// Time of the first item, ns since the epoch
+	} segment_t;
+
+private:
+	std::string d_path;
+	int d_fd;
+	format_t d_format;
+	double d_samp_rate;
+	uint64_t d_items;
+	std::vector<segment_t> d_segments;
+
+	capture_file();
+
+	bool read_meta(const std::string &meta_path);
+
+public:
+	~capture_file();
+
+	/*
+	 * Open a SigMF recording, given as its .sigmf-data or .sigmf-meta, or a
+	 * raw file; format, samp_rate and frequency are used for raw files
+	 * with no telling extension. Returns NULL on failure.
+	 */
+	static capture_file *open(const char *path, format_t format, double samp_rate, double frequency);
+
+	// Parse "cs8", "cs16" or "cf32". Returns false if unknown.
+	static bool parse_format(const char *name, format_t *format);
+	static size_t item_size(format_t format);
+
+	// Whether path looks like a capture open() understands, for directory scans
+	static bool is_capture(const char *path);
+
+	const std::string &path(void) const { return d_path; }
+	format_t format(void) const { return d_format; }
+	double samp_rate(void) const { return d_samp_rate; }
+	uint64_t items(void) const { return d_items; }
+
+	// Segment holding item, the first one for items before it
+	const segment_t &segment(uint64_t item) const;
+
+	// Time of (fractional) item, ns since the epoch
+	uint64_t item_time(double item) const;
+
+	// Continue reading at item. Returns false on failure.
+	bool seek(uint64_t item);
+
+	// Read up to n items into buf. Returns the items read, 0 at the end
+	// of the file, -1 on errors.
+	ssize_t read(void *buf, size_t n);
+};
+
+#endif
@@ -0,0 +1,204 @@
+/* control_socket.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "control_socket.h"
+#include "logging.h"
+
+#define CONTROL_MAX_CLIENTS	8
+#define CONTROL_MAX_LINE	256
+
+static uint64_t monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+control_socket::control_socket()
+	: d_listen_fd(-1), d_handler(NULL), d_arg(NULL)
+{
+}
+
+control_socket::~control_socket()
+{
+	for (size_t i = 0; i < d_clients.size(); i++)
+		close(d_clients[i].fd);
+	if (d_listen_fd >= 0) {
+		close(d_listen_fd);
+		unlink(d_path.c_str());
+	}
+}
+
+control_socket *control_socket::open(const char *path, handler_t handler, void *arg)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		log_error("control socket path \"%s\" is too long\n", path);
+		return NULL;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	// Left behind by a scanner that didn't exit cleanly
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd < 0) {
+		log_error("socket() failed: %s\n", strerror(errno));
+		return NULL;
+	}
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		log_error("can't bind control socket \"%s\": %s\n", path, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	if (listen(fd, CONTROL_MAX_CLIENTS) < 0) {
+		log_error("listen(\"%s\") failed: %s\n", path, strerror(errno));
+		close(fd);
+		unlink(path);
+		return NULL;
+	}
+
+	control_socket *control = new control_socket();
+	control->d_path = path;
+	control->d_listen_fd = fd;
+	control->d_handler = handler;
+	control->d_arg = arg;
+	return control;
+}
+
+void control_socket::accept_client(void)
+{
+	int fd = accept4(d_listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (fd < 0)
+		return;
+
+	if (d_clients.size() == CONTROL_MAX_CLIENTS) {
+		log_warning("control socket: too many clients\n");
+		close(fd);
+		return;
+	}
+
+	client_t client;
+	client.fd = fd;
+	d_clients.push_back(client);
+}
+
+/*
+ * Read what the client sent and handle its complete lines. Returns false
+ * when the client is to be closed.
+ */
+bool control_socket::read_client(client_t *client)
+{
+	char buf[CONTROL_MAX_LINE];
+
+	ssize_t n = recv(client->fd, buf, sizeof(buf), 0);
+	if (n < 0)
+		return errno == EAGAIN || errno == EINTR;
+	if (n == 0)
+		return false;
+	client->line.append(buf, n);
+
+	size_t start = 0, end;
+	while ((end = client->line.find('\n', start)) != std::string::npos) {
+		std::string command = client->line.substr(start, end - start);
+		start = end + 1;
+
+		if (!command.empty() && command[command.size() - 1] == '\r')
+			command.erase(command.size() - 1);
+		if (command.empty())
+			continue;
+
+		std::string reply;
+		d_handler(d_arg, command.c_str(), &reply);
+
+		// Replies are short, one that doesn't fit the socket buffer
+		// means the client isn't reading them
+		if (send(client->fd, reply.data(), reply.size(), MSG_NOSIGNAL) != (ssize_t)reply.size())
+			return false;
+	}
+	client->line.erase(0, start);
+
+	if (client->line.size() >= CONTROL_MAX_LINE) {
+		static const char reply[] = "error: line too long\n";
+		send(client->fd, reply, sizeof(reply) - 1, MSG_NOSIGNAL);
+		return false;
+	}
+	return true;
+}
+
+void control_socket::serve(unsigned timeout_us)
+{
+	uint64_t deadline = monotonic_us() + timeout_us;
+
+	for (;;) {
+		uint64_t now = monotonic_us();
+		if (now >= deadline)
+			return;
+
+		struct pollfd fds[CONTROL_MAX_CLIENTS + 1];
+		size_t nfds = 0;
+
+		fds[nfds].fd = d_listen_fd;
+		fds[nfds].events = POLLIN;
+		nfds++;
+		for (size_t i = 0; i < d_clients.size(); i++) {
+			fds[nfds].fd = d_clients[i].fd;
+			fds[nfds].events = POLLIN;
+			nfds++;
+		}
+
+		int ret = poll(fds, nfds, (deadline - now + 999) / 1000);
+		if (ret < 0) {
+			if (errno != EINTR) {
+				log_error("control socket: poll() failed: %s\n", strerror(errno));
+				usleep(deadline - now);
+			}
+			return;
+		}
+
+		// Clients first, accepting may add one that poll() didn't cover
+		for (size_t i = nfds - 1; i > 0; i--) {
+			if (!fds[i].revents)
+				continue;
+			if (!read_client(&d_clients[i - 1])) {
+				close(d_clients[i - 1].fd);
+				d_clients.erase(d_clients.begin() + (i - 1));
+			}
+		}
+		if (fds[0].revents & POLLIN)
+			accept_client();
+	}
+}
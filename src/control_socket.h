@@ -0,0 +1,67 @@
+/* control_socket.h */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _CONTROL_SOCKET_H
+#define _CONTROL_SOCKET_H
+
+#include <string>
+#include <vector>
+
+/*
+ * Local control socket: a UNIX domain stream socket taking one command per
+ * line. Commands are handled in the thread calling serve(), which writes
+ * the handler's reply back, so the handler needs no locking of its own.
+ */
+class control_socket
+{
+public:
+	// Handle command, a line without its newline, and append the lines of
+	// the reply, each ending in a newline, to reply
+	typedef void (*handler_t)(void *arg, const char *command, std::string *reply);
+
+private:
+	typedef struct {
+		int fd;
+		std::string line;
+	} client_t;
+
+	std::string d_path;
+	int d_listen_fd;
+	std::vector<client_t> d_clients;
+	handler_t d_handler;
+	void *d_arg;
+
+	control_socket();
+
+	void accept_client(void);
+	bool read_client(client_t *client);
+
+public:
+	~control_socket();
+
+	// Listen on path, replacing a stale socket there. Returns NULL on failure.
+	static control_socket *open(const char *path, handler_t handler, void *arg);
+
+	// Handle the commands coming in over the next timeout_us, returns
+	// early if a signal comes
+	void serve(unsigned timeout_us);
+};
+
+#endif
@@ -0,0 +1,66 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2014 <+YOU OR YOUR COMPANY+>.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef INCLUDED_DECT2_INT_PHASE_DIFF_H
+#define INCLUDED_DECT2_INT_PHASE_DIFF_H
+
+#include <gnuradio/sync_decimator.h>
+
+#include "api.h"
+#include "dect2core/int_discriminator.h"
+
+namespace gr {
+namespace dect2 {
+
+/*!
+ * \brief Channel filter and phase discriminator for integer I/Q
+ * \ingroup dect2
+ *
+ * Input items are complex cs8 or cs16 samples at decimation times
+ * sps * 1.152 Msps, output is the same phase difference as phase_diff
+ * produces. A second output, if connected, carries the sample power.
+ * squelch_db above 0 turns on the squelch with that threshold over the
+ * noise floor.
+ */
+class DECT2_API int_phase_diff : virtual public gr::sync_decimator
+{
+public:
+	typedef boost::shared_ptr<int_phase_diff> sptr;
+
+	/*!
+	 * \brief Return a shared_ptr to a new instance of dect2::int_phase_diff.
+	 *
+	 * To avoid accidental use of raw pointers, dect2::int_phase_diff's
+	 * constructor is in a private implementation
+	 * class. dect2::int_phase_diff::make is the public interface for
+	 * creating new instances.
+	 */
+	static sptr make(dect2core::sample_format_t format, unsigned decimation, unsigned sps = 4,
+		float squelch_db = 0);
+
+	//! Input item that output item 0 stands for, negative within the history
+	virtual double input_offset(void) const = 0;
+};
+
+} // namespace dect2
+} // namespace gr
+
+#endif /* INCLUDED_DECT2_INT_PHASE_DIFF_H */
@@ -0,0 +1,69 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2015 Pavel Yazev <pyazev@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+
+#include "int_phase_diff_impl.h"
+
+namespace gr {
+namespace dect2 {
+
+int_phase_diff::sptr int_phase_diff::make(dect2core::sample_format_t format, unsigned decimation, unsigned sps,
+	float squelch_db)
+{
+	return gnuradio::get_initial_sptr(new int_phase_diff_impl(format, decimation, sps, squelch_db));
+}
+
+int_phase_diff_impl::int_phase_diff_impl(dect2core::sample_format_t format, unsigned decimation, unsigned sps,
+	float squelch_db)
+	: gr::sync_decimator("int_phase_diff",
+		gr::io_signature::make(1, 1, dect2core::int_discriminator::sample_size(format)),
+		gr::io_signature::make(1, 2, sizeof(float)), decimation),
+	d_discriminator(format, decimation, sps, squelch_db)
+{
+	set_history(d_discriminator.history() + 1);
+}
+
+int_phase_diff_impl::~int_phase_diff_impl()
+{
+}
+
+double int_phase_diff_impl::input_offset(void) const
+{
+	return d_discriminator.delay() - d_discriminator.history();
+}
+
+int int_phase_diff_impl::work(int noutput_items,
+	gr_vector_const_void_star &input_items,
+	gr_vector_void_star &output_items)
+{
+	float *out = (float *)output_items[0];
+	float *power = (output_items.size() > 1) ? (float *)output_items[1] : NULL;
+
+	d_discriminator.process(input_items[0], noutput_items, out, power);
+	return noutput_items;
+}
+
+} /* namespace dect2 */
+} /* namespace gr */
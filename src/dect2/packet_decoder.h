@@ -25,6 +25,13 @@
 #include <gnuradio/tagged_stream_block.h>
 
 #include "api.h"
+#include "dect2core/part_info.h"
+
+namespace dect2core {
+class burst_recorder;
+class part_event_queue;
+class watchlist;
+}
 
 namespace gr {
 namespace dect2 {
@@ -49,21 +56,50 @@ public:
 	 */
 	static sptr make();
 
+	// The output is the selected part's dect2core::voice_record_t stream,
+	// see dect2core/burst_decoder.h. A VOICE_GAP_END record that no burst
+	// comes to carry, because the part was lost or deselected or the parts
+	// were cleared, goes out right away on the voice_end_out message port
+	// instead: a dict with the record as a blob under "record", and under
+	// "offset" the number of records output before it.
+
+	// The setters take effect on the block's thread as soon as it gets to
+	// them, so they are safe to call from one other thread while the
+	// flowgraph runs. Calling one again before then replaces the value,
+	// they never block or fail.
 	virtual void select_rx_part(uint32_t rx_id) = 0;
 
-	typedef struct {
-		uint32_t rx_id;
-		uint8_t part_id[5];
-		bool is_fixed_part;
-		bool voice_present;
-	} part_info_t;
+	// Carrier index reported with part events, only meaningful to the caller
+	virtual void set_carrier(uint32_t carrier) = 0;
+
+	typedef dect2core::part_info_t part_info_t;
+	typedef dect2core::part_event_t part_event_t;
 
 	typedef void (*part_updated_callback_t)(void *arg, const part_info_t *part_info);
 	typedef void (*part_lost_callback_t)(void *arg, const part_info_t *part_info);
 
+	// Flip up to k unreliable bits to recover B-fields failing the X-CRC,
+	// the input must be soft (packet_receiver::set_soft_output())
+	virtual void set_chase_bits(unsigned k) = 0;
+
 	virtual void clear_parts(void) = 0;
+
+	// Copy the table of currently active, identified parts. Safe to call
+	// from any thread. Returns the number of entries written.
+	virtual size_t get_parts(part_info_t *parts, size_t max_parts) = 0;
+
 	virtual void set_part_updated_callback(part_updated_callback_t callback, void *arg) = 0;
 	virtual void set_part_lost_callback(part_lost_callback_t callback, void *arg) = 0;
+
+	// When an event queue is set, part events are pushed to it instead of
+	// calling the callbacks from the work thread
+	virtual void set_event_queue(dect2core::part_event_queue *queue) = 0;
+
+	// Match identified parts against list, see burst_decoder::set_watchlist()
+	virtual void set_watchlist(const dect2core::watchlist *list) = 0;
+
+	// Trigger recorder with every decoded burst
+	virtual void set_burst_recorder(dect2core::burst_recorder *recorder) = 0;
 };
 
 } // namespace dect2
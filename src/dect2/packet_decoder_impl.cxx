@@ -22,7 +22,7 @@
 #include "config.h"
 #endif
 
-#include <cstdio>
+#include <cmath>
 
 #include <gnuradio/io_signature.h>
 
@@ -31,171 +31,6 @@
 namespace gr {
 namespace dect2 {
 
-// scramble table with corrections by Jakub Hruska
-static const uint8_t scrt[8][31] = {
-	{0x3b, 0xcd, 0x21, 0x5d, 0x88, 0x65, 0xbd, 0x44, 0xef, 0x34, 0x85, 0x76, 0x21, 0x96, 0xf5, 0x13, 0xbc, 0xd2, 0x15, 0xd8, 0x86, 0x5b, 0xd4, 0x4e, 0xf3, 0x48, 0x57, 0x62, 0x19, 0x6f, 0x51},
-	{0x32, 0xde, 0xa2, 0x77, 0x9a, 0x42, 0xbb, 0x10, 0xcb, 0x7a, 0x89, 0xde, 0x69, 0x0a, 0xec, 0x43, 0x2d, 0xea, 0x27, 0x79, 0xa4, 0x2b, 0xb1, 0x0c, 0xb7, 0xa8, 0x9d, 0xe6, 0x90, 0xae, 0xc4},
-	{0x2d, 0xea, 0x27, 0x79, 0xa4, 0x2b, 0xb1, 0x0c, 0xb7, 0xa8, 0x9d, 0xe6, 0x90, 0xae, 0xc4, 0x32, 0xde, 0xa2, 0x77, 0x9a, 0x42, 0xbb, 0x10, 0xcb, 0x7a, 0x89, 0xde, 0x69, 0x0a, 0xec, 0x43},
-	{0x27, 0x79, 0xa4, 0x2b, 0xb1, 0x0c, 0xb7, 0xa8, 0x9d, 0xe6, 0x90, 0xae, 0xc4, 0x32, 0xde, 0xa2, 0x77, 0x9a, 0x42, 0xbb, 0x10, 0xcb, 0x7a, 0x89, 0xde, 0x69, 0x0a, 0xec, 0x43, 0x2d, 0xea},
-	{0x19, 0x6f, 0x51, 0x3b, 0xcd, 0x21, 0x5d, 0x88, 0x65, 0xbd, 0x44, 0xef, 0x34, 0x85, 0x76, 0x21, 0x96, 0xf5, 0x13, 0xbc, 0xd2, 0x15, 0xd8, 0x86, 0x5b, 0xd4, 0x4e, 0xf3, 0x48, 0x57, 0x62},
-	{0x13, 0xbc, 0xd2, 0x15, 0xd8, 0x86, 0x5b, 0xd4, 0x4e, 0xf3, 0x48, 0x57, 0x62, 0x19, 0x6f, 0x51, 0x3b, 0xcd, 0x21, 0x5d, 0x88, 0x65, 0xbd, 0x44, 0xef, 0x34, 0x85, 0x76, 0x21, 0x96, 0xf5},
-	{0x0c, 0xb7, 0xa8, 0x9d, 0xe6, 0x90, 0xae, 0xc4, 0x32, 0xde, 0xa2, 0x77, 0x9a, 0x42, 0xbb, 0x10, 0xcb, 0x7a, 0x89, 0xde, 0x69, 0x0a, 0xec, 0x43, 0x2d, 0xea, 0x27, 0x79, 0xa4, 0x2b, 0xb1},
-	{0x79, 0xa4, 0x2b, 0xb1, 0x0c, 0xb7, 0xa8, 0x9d, 0xe6, 0x90, 0xae, 0xc4, 0x32, 0xde, 0xa2, 0x77, 0x9a, 0x42, 0xbb, 0x10, 0xcb, 0x7a, 0x89, 0xde, 0x69, 0x0a, 0xec, 0x43, 0x2d, 0xea, 0x27},
-};
-
-static const uint16_t crc_table[16] = {
-	0x0000, 0x0589, 0x0b12, 0x0e9b, 0x1624, 0x13ad, 0x1d36, 0x18bf,
-	0x2c48, 0x29c1, 0x275a, 0x22d3, 0x3a6c, 0x3fe5, 0x317e, 0x34f7,
-};
-
-static uint16_t calc_rcrc(uint8_t *data, unsigned data_len)
-{
-	uint16_t crc;
-	unsigned tbl_idx;
-
-	crc = 0x0000;
-	while (data_len--) {
-		tbl_idx = (crc >> 12) ^ (*data >> 4);
-		crc = crc_table[tbl_idx & 0x0f] ^ (crc << 4);
-		tbl_idx = (crc >> 12) ^ (*data >> 0);
-		crc = crc_table[tbl_idx & 0x0f] ^ (crc << 4);
-		data++;
-	}
-	return crc ^ 0x0001;
-}
-
-static uint8_t calc_xcrc(uint8_t *b_field)
-{
-	uint8_t rbits[10];
-	uint8_t gp = 0x10;
-	uint8_t crc;
-	uint8_t next;
-	uint32_t i, j;
-	uint32_t bi;
-	uint32_t bw;
-	uint32_t nb;
-	uint8_t rbyte;
-	uint32_t rbit_cnt, rbyte_cnt;
-
-	// Extract test bits
-	memset(rbits, 0, sizeof(rbits));
-	rbit_cnt = 0;
-	rbyte_cnt = 0;
-	rbyte = 0;
-	for (i = 0; i <= (83 - 4); i++) {
-		bi = i + 48 * (1 + (i >> 4));
-		nb = bi >> 3;
-		bw = b_field[nb];
-
-		rbyte <<= 1;
-		rbyte |= (bw >> (7 - (bi - (nb << 3)))) & 1;
-
-		if (++rbit_cnt == 8) {
-			rbits[rbyte_cnt++] = rbyte;
-			rbit_cnt = 0;
-		}
-	}
-
-
-	crc = rbits[0];
-	i = 0;
-	while (i < 10) {
-		if (i < (10 - 1))
-			next = rbits[i + 1];
-		else
-			next=0;
-		i++;
-		j = 0;
-		while (j < 8) {
-			while (!(crc & 0x80)) {
-				crc <<= 1;
-				crc |= !!(next & 0x80);
-				next <<= 1;
-				j++;
-				if (j > 7)
-					break;
-			}
-			if (j > 7)
-				break;
-			crc <<= 1;
-			crc |= !!(next & 0x80);
-			next <<= 1;
-			j++;
-			crc ^= gp;
-		}
-	}
-	return crc >> 4;
-}
-
-static bool part_id_cmp(uint8_t *id1, uint8_t *id2)
-{
-	for (uint32_t i = 0; i < 5; i++)
-		if (id1[i] != id2[i])
-			return false;
-	return true;
-}
-
-uint32_t packet_decoder_impl::decode_afield(uint8_t *field_data)
-{
-	uint16_t rcrc = (uint16_t)field_data[6] << 8 | field_data[7];
-	uint16_t crc = calc_rcrc(field_data, 6);
-
-	if (crc != rcrc) {
-		d_cur_part->afield_bad_crc_cnt++;
-		return 0;
-	}
-
-	uint8_t afield_header = field_data[0];
-	uint8_t ta_bits = (afield_header >> 5) & 0x07;;
-
-	switch(ta_bits) {
-	case 0:
-		break;
-
-	case 1:
-		break;
-
-	case 3:
-		d_cur_part->part_id[0] = field_data[1];
-		d_cur_part->part_id[1] = field_data[2];
-		d_cur_part->part_id[2] = field_data[3];
-		d_cur_part->part_id[3] = field_data[4];
-		d_cur_part->part_id[4] = field_data[5];
-		d_cur_part->part_id_rcvd = true;
-		break;
-
-	case 4: // multiframe synchronization and system information (Qt) - translated every 16 frames in frame number 8
-		//std::cout << "===== FRAME 8 =====" << std::endl;
-		d_cur_part->frame_number = 8;
-		d_cur_part->qt_rcvd = true;
-		// qt_parse(afield.tail);
-		break;
-
-	case 6:
-		// mt_parse(afield.tail);
-		break;
-
-	case 7:
-		//if (pt == _RFP_)
-		//	pt_parse(afield.tail);
-		break;
-	}
-
-	if (((afield_header >> 1) & 7) == 0) {
-		if (!d_cur_part->voice_present) {
-			d_cur_part->voice_present = true;
-			d_cur_part->log_update = true;
-		}
-	} else {
-		if (d_cur_part->voice_present) {
-			d_cur_part->voice_present = false;
-			d_cur_part->log_update = true;
-		}
-	}
-
-	return 1;
-}
-
 packet_decoder::sptr packet_decoder::make()
 {
 	return gnuradio::get_initial_sptr(new packet_decoder_impl());
@@ -204,26 +39,50 @@ packet_decoder::sptr packet_decoder::make()
 packet_decoder_impl::packet_decoder_impl()
 	: gr::tagged_stream_block("packet_decoder",
 		gr::io_signature::make(1, 1, sizeof(unsigned char)),
-		gr::io_signature::make(1, 1, sizeof(unsigned char)), std::string("packet_len"))
+		gr::io_signature::make(1, 1, sizeof(dect2core::voice_record_t)), std::string("packet_len")),
+	d_decoder(this), d_pending(0), d_new_selected(0), d_new_carrier(0), d_new_chase_bits(0)
 {
 	set_tag_propagation_policy(TPP_DONT);
 
-	d_selected_rx_id = 0;
+	part_updated_callback = NULL;
+	part_updated_callback_arg = NULL;
+	part_lost_callback = NULL;
+	part_lost_callback_arg = NULL;
+	d_event_queue = NULL;
+	d_recorder = NULL;
 
 	message_port_register_in(pmt::mp("rcvr_msg_in"));
 	set_msg_handler(pmt::mp("rcvr_msg_in"), boost::bind(&packet_decoder_impl::msg_event_handler, this, _1));
-	message_port_register_out(pmt::mp("log_out"));
-
-	memset(&d_part_descriptor, 0, sizeof(d_part_descriptor));
+	d_log_port = pmt::mp("log_out");
+	d_rx_id_key = pmt::mp("part_rx_id");
+	d_rx_seq_key = pmt::mp("rx_seq");
+	d_part_type_key = pmt::mp("part_type");
+	d_sample_index_key = pmt::mp("sample_index");
+	d_afield_recovered_key = pmt::mp("afield_recovered");
+	d_freq_offset_key = pmt::mp("freq_offset");
+	d_rssi_key = pmt::mp("rssi");
+	message_port_register_out(d_log_port);
+	d_ctrl_port = pmt::mp("rcvr_ctrl_out");
+	message_port_register_out(d_ctrl_port);
+	d_pending_port = pmt::mp("pending_in");
+	message_port_register_in(d_pending_port);
+	set_msg_handler(d_pending_port, boost::bind(&packet_decoder_impl::pending_handler, this, _1));
+	d_voice_end_port = pmt::mp("voice_end_out");
+	message_port_register_out(d_voice_end_port);
+
+	d_voice_end_pending = false;
+
+	d_parts_snapshot_len = 0;
 }
 
 packet_decoder_impl::~packet_decoder_impl()
 {
 }
 
+// At most the end of one stream and a frame of the next
 int packet_decoder_impl::calculate_output_stream_length(const gr_vector_int &ninput_items)
 {
-	int noutput_items = 80;
+	int noutput_items = 2;
 	return noutput_items;
 }
 
@@ -233,113 +92,200 @@ void packet_decoder_impl::msg_event_handler(pmt::pmt_t msg)
 		pmt::pmt_t msg_id = pmt::dict_ref(msg, pmt::mp("rcvr_msg_id"), pmt::PMT_NIL);
 		if (pmt::eq(msg_id, pmt::mp("lost_part"))) {
 			// msg["rcvr_msg_id"] == "lost_part"
+			uint32_t rx_id = (uint32_t)pmt::to_uint64(pmt::dict_ref(msg, pmt::mp("part_rx_id"), pmt::PMT_NIL));
+			if (rx_id == d_decoder.selected_rx_part())
+				end_voice();
+			d_decoder.part_lost(rx_id);
+			publish_voice_end();
+		}
+	}
+}
 
-			// std::cout << "*********** LOST part ************" << std::endl;
+void packet_decoder_impl::pending_handler(pmt::pmt_t msg)
+{
+	(void)msg;
 
-			// Remove active part
-			uint32_t rx_id = (uint32_t)pmt::to_uint64(pmt::dict_ref(msg, pmt::mp("part_rx_id"), pmt::PMT_NIL));
+	apply_pending();
+	publish_voice_end();
+}
 
-			part_descriptor_item *part_item = &d_part_descriptor[rx_id];
-			if (part_item->active && part_item->part_id_rcvd) {
-				emit_part_lost(rx_id);
-			}
-			part_item->active = false;
-			part_item->voice_present = false;
-			part_item->log_update = false;
-			part_item->qt_rcvd = false;
-			if (part_item->part_id_rcvd) {
-				print_parts();
-			}
-
-			// Cleare part's pair
-			if (part_item->pair != NULL) {
-				if (part_item->type == _PP_) {
-					part_item->pair->pair = NULL;
-				} else if(part_item->type == _RFP_) {
-					part_item->pair->voice_present = false;
-					part_item->pair->pair = NULL;
-				}
-
-				part_item->pair = NULL;
-			}
-		}
+/*
+ * Refresh the part table snapshot. The textual table is only built and
+ * published if somebody is subscribed to the log port.
+ */
+void packet_decoder_impl::parts_changed(void)
+{
+	part_info_t parts[MAX_PARTS];
+	size_t nparts = d_decoder.get_parts(parts, MAX_PARTS);
+
+	{
+		std::lock_guard<std::mutex> lock(d_parts_mutex);
+		memcpy(d_parts_snapshot, parts, nparts * sizeof(part_info_t));
+		d_parts_snapshot_len = nparts;
 	}
+
+	if (!pmt::is_null(message_subscribers(d_log_port)))
+		print_parts(parts, nparts);
 }
 
-void packet_decoder_impl::print_parts(void)
+void packet_decoder_impl::print_parts(const part_info_t *parts, size_t nparts)
 {
 	std::ostringstream os;
 
 	os << "===== AVAILABLE PARTS =====" << std::endl;
-	for (uint32_t rx_id = 0; rx_id < MAX_PARTS; rx_id++) {
-		if (d_part_descriptor[rx_id].active) {
-			part_descriptor_item *part_item = &d_part_descriptor[rx_id];
-			if (d_selected_rx_id == rx_id)
-				os << "* ";
-			else
-				os << "  ";
-
-			os << rx_id << "   " << std::hex <<
-				std::setfill('0') << std::setw(2) << (uint32_t)part_item->part_id[0] << \
-				std::setfill('0') << std::setw(2) << (uint32_t)part_item->part_id[1] << \
-				std::setfill('0') << std::setw(2) << (uint32_t)part_item->part_id[2] << \
-				std::setfill('0') << std::setw(2) << (uint32_t)part_item->part_id[3] << \
-				std::setfill('0') << std::setw(2) << (uint32_t)part_item->part_id[4];
+	for (size_t i = 0; i < nparts; i++) {
+		const part_info_t *part_info = &parts[i];
+		if (d_decoder.selected_rx_part() == part_info->rx_id)
+			os << "* ";
+		else
+			os << "  ";
 
-			if (part_item->type == _RFP_)
-				os << " RFP ";
-			else
-				os << " PP  ";
+		os << part_info->rx_id << "   " << std::hex <<
+			std::setfill('0') << std::setw(2) << (uint32_t)part_info->part_id[0] << \
+			std::setfill('0') << std::setw(2) << (uint32_t)part_info->part_id[1] << \
+			std::setfill('0') << std::setw(2) << (uint32_t)part_info->part_id[2] << \
+			std::setfill('0') << std::setw(2) << (uint32_t)part_info->part_id[3] << \
+			std::setfill('0') << std::setw(2) << (uint32_t)part_info->part_id[4] << std::dec;
 
-			if (part_item->voice_present)
-				os << "  " << "V" << std::endl;
-			else
-				os << "  " << std::endl;
-		}
+		if (part_info->is_fixed_part)
+			os << " RFP ";
+		else
+			os << " PP  ";
 
+		if (part_info->voice_present)
+			os << "  " << "V" << std::endl;
+		else
+			os << "  " << std::endl;
 	}
 	os << "===========================\n\n";
 
-	//std::cout << os.str() << std::endl;
-
 	pmt::pmt_t msg = pmt::make_dict();
 	msg = pmt::dict_add(msg, pmt::mp("log_msg"), pmt::mp(os.str()));
-	message_port_pub(pmt::mp("log_out"), msg);
+	message_port_pub(d_log_port, msg);
 }
 
-void packet_decoder_impl::emit_part_updated(uint32_t rx_id)
+void packet_decoder_impl::part_updated(const part_info_t &part_info)
 {
-	if (part_updated_callback) {
-		part_info_t part_info;
+	if (d_event_queue) {
+		part_event_t event;
 
-		memset(&part_info, 0, sizeof(part_info));
-		part_info.rx_id = rx_id;
-		memcpy(part_info.part_id, d_part_descriptor[rx_id].part_id, 5);
-		part_info.is_fixed_part = d_part_descriptor[rx_id].type == _RFP_;
-		part_info.voice_present = d_part_descriptor[rx_id].voice_present;
+		event.type = dect2core::PART_UPDATED;
+		event.part_info = part_info;
+		d_event_queue->push(event);
+	} else if (part_updated_callback) {
+		part_updated_callback(part_updated_callback_arg, &part_info);
+	}
+}
+
+void packet_decoder_impl::part_lost(const part_info_t &part_info)
+{
+	if (d_event_queue) {
+		part_event_t event;
 
+		event.type = dect2core::PART_LOST;
+		event.part_info = part_info;
+		d_event_queue->push(event);
+	} else if (part_lost_callback) {
+		part_lost_callback(part_lost_callback_arg, &part_info);
+	}
+}
+
+void packet_decoder_impl::part_matched(const part_info_t &part_info)
+{
+	if (d_event_queue) {
+		part_event_t event;
+
+		event.type = dect2core::PART_MATCHED;
+		event.part_info = part_info;
+		d_event_queue->push(event);
+	} else if (part_updated_callback) {
 		part_updated_callback(part_updated_callback_arg, &part_info);
 	}
 }
 
-void packet_decoder_impl::emit_part_lost(uint32_t rx_id)
+// Let the receiver cut the part's bursts to their length
+void packet_decoder_impl::burst_length_changed(uint32_t rx_id, uint32_t d_field_bits)
 {
-	if (part_updated_callback) {
-		part_info_t part_info;
+	pmt::pmt_t msg = pmt::make_dict();
+	msg = pmt::dict_add(msg, pmt::mp("rcvr_ctrl_id"), pmt::mp("part_length"));
+	msg = pmt::dict_add(msg, pmt::mp("part_rx_id"), pmt::mp((uint64_t)rx_id));
+	msg = pmt::dict_add(msg, pmt::mp("length"), pmt::mp((uint64_t)d_field_bits));
+	message_port_pub(d_ctrl_port, msg);
+}
 
-		memset(&part_info, 0, sizeof(part_info));
-		part_info.rx_id = rx_id;
-		memcpy(part_info.part_id, d_part_descriptor[rx_id].part_id, 5);
-		part_info.is_fixed_part = d_part_descriptor[rx_id].type == _RFP_;
-		part_info.voice_present = d_part_descriptor[rx_id].voice_present;
+void packet_decoder_impl::set_pending(uint32_t flag)
+{
+	d_pending.fetch_or(flag, std::memory_order_release);
+	_post(d_pending_port, pmt::PMT_T);
+}
 
-		part_lost_callback(part_lost_callback_arg, &part_info);
+void packet_decoder_impl::apply_pending(void)
+{
+	uint32_t pending = d_pending.exchange(0, std::memory_order_acquire);
+	if (!pending)
+		return;
+
+	// Clearing leaves the selection alone, so this order is the same as
+	// any other the setters were called in
+	if (pending & DECODER_CLEAR_PARTS) {
+		end_voice();
+		d_decoder.clear_parts();
+	}
+	if (pending & DECODER_SET_SELECTED) {
+		uint32_t rx_id = d_new_selected.load(std::memory_order_relaxed);
+		if (rx_id != d_decoder.selected_rx_part())
+			end_voice();
+		d_decoder.select_rx_part(rx_id);
 	}
+	if (pending & DECODER_SET_CARRIER)
+		d_decoder.set_carrier(d_new_carrier.load(std::memory_order_relaxed));
+	if (pending & DECODER_SET_CHASE_BITS)
+		d_decoder.set_chase_bits(d_new_chase_bits.load(std::memory_order_relaxed));
+
+	if (pending & DECODER_CLEAR_PARTS)
+		parts_changed();
+}
+
+// The selected part's stream ends, if it had started
+void packet_decoder_impl::end_voice(void)
+{
+	if (d_voice.end(d_decoder.selected_rx_part(), &d_voice_end))
+		d_voice_end_pending = true;
+}
+
+/*
+ * Outside work() the end of the stream can't wait for a burst that may
+ * never come, it goes out on voice_end_out with the number of records
+ * output before it
+ */
+void packet_decoder_impl::publish_voice_end(void)
+{
+	if (!d_voice_end_pending)
+		return;
+	d_voice_end_pending = false;
+
+	pmt::pmt_t msg = pmt::make_dict();
+	msg = pmt::dict_add(msg, pmt::mp("offset"), pmt::from_uint64(nitems_written(0)));
+	msg = pmt::dict_add(msg, pmt::mp("record"), pmt::make_blob(&d_voice_end, sizeof(d_voice_end)));
+	message_port_pub(d_voice_end_port, msg);
 }
 
 void packet_decoder_impl::select_rx_part(uint32_t rx_id)
 {
-	d_selected_rx_id = rx_id;
+	d_new_selected.store(rx_id, std::memory_order_relaxed);
+	set_pending(DECODER_SET_SELECTED);
+}
+
+void packet_decoder_impl::set_carrier(uint32_t carrier)
+{
+	d_new_carrier.store(carrier, std::memory_order_relaxed);
+	set_pending(DECODER_SET_CARRIER);
+}
+
+void packet_decoder_impl::set_chase_bits(unsigned k)
+{
+	d_new_chase_bits.store(k, std::memory_order_relaxed);
+	set_pending(DECODER_SET_CHASE_BITS);
 }
 
 int packet_decoder_impl::work(int noutput_items,
@@ -348,163 +294,78 @@ int packet_decoder_impl::work(int noutput_items,
 	gr_vector_void_star &output_items)
 {
 	const uint8_t *in = (const uint8_t *)input_items[0];
-	uint8_t *out = (uint8_t *)output_items[0];
+	dect2core::voice_record_t *out = (dect2core::voice_record_t *)output_items[0];
 	uint32_t packet_length = ninput_items[0];
+	int nout = 0;
 
-	uint32_t rx_id = 0;
-	uint64_t rx_seq = 0;
-	part_type ptype = _RFP_;
+	dect2core::burst_info_t info;
+	dect2core::burst_result_t result;
+
+	apply_pending();
+
+	memset(&info, 0, sizeof(info));
+	info.part_type = dect2core::PART_RFP;
+	info.length = packet_length;
+	info.rssi = NAN;
 
 	std::vector<tag_t> tags;
 	get_tags_in_range(tags, 0, nitems_read(0), nitems_read(0) + packet_length);
 
 	for (size_t i = 0; i < tags.size(); i++) {
-		if (pmt::eq(tags[i].key, pmt::mp("part_rx_id"))) {
-			rx_id = (uint32_t)pmt::to_uint64(tags[i].value);
-		} else if (pmt::eq(tags[i].key, pmt::mp("rx_seq"))) {
-			rx_seq = (uint64_t)pmt::to_uint64(tags[i].value);
-		} else if (pmt::eq(tags[i].key, pmt::mp("part_type"))) {
+		if (pmt::eq(tags[i].key, d_rx_id_key)) {
+			info.rx_id = (uint32_t)pmt::to_uint64(tags[i].value);
+		} else if (pmt::eq(tags[i].key, d_rx_seq_key)) {
+			info.rx_seq = (uint32_t)pmt::to_uint64(tags[i].value);
+		} else if (pmt::eq(tags[i].key, d_part_type_key)) {
 			if(pmt::eq(tags[i].value, pmt::mp("RFP")))
-				ptype = _RFP_;
+				info.part_type = dect2core::PART_RFP;
 			else
-				ptype = _PP_;
+				info.part_type = dect2core::PART_PP;
+		} else if (pmt::eq(tags[i].key, d_sample_index_key)) {
+			info.sample_index = pmt::to_uint64(tags[i].value);
+		} else if (pmt::eq(tags[i].key, d_afield_recovered_key)) {
+			info.afield_recovered = true;
+		} else if (pmt::eq(tags[i].key, d_freq_offset_key)) {
+			info.freq_offset = (float)pmt::to_double(tags[i].value);
+		} else if (pmt::eq(tags[i].key, d_rssi_key)) {
+			info.rssi = (float)pmt::to_double(tags[i].value);
 		}
 	}
 
-	d_cur_part = &d_part_descriptor[rx_id];
-
-	if (d_cur_part->active) {
-		uint64_t seq_diff = (rx_seq - d_cur_part->rx_seq) & 0x1F;
+	uint8_t b_field[B_FIELD_BYTES];
+	bool selected = d_decoder.decode(info, in, packet_length, b_field, &result);
 
-		if (ptype == _RFP_) {
-			d_cur_part->frame_number = (d_cur_part->frame_number + seq_diff) & 0xF;
+	if (d_recorder)
+		d_recorder->trigger(info, result);
 
-			// Update frame number for pair if available
-			if (d_cur_part->pair != NULL) {
-				d_cur_part->pair->frame_number = d_cur_part->frame_number;
-				d_cur_part->pair->rfp_fn_cor = true;
-			}
-		} else if(ptype == _PP_) {
-			if (d_cur_part->rfp_fn_cor)
-				d_cur_part->rfp_fn_cor = false;
-			else
-				d_cur_part->frame_number = (d_cur_part->frame_number + seq_diff) & 0xF;
-		}
-
-		d_cur_part->rx_seq = rx_seq;
-		d_cur_part->packet_cnt++;
-	} else {
-		// Register a new part
-		d_cur_part->active = true;
-		d_cur_part->frame_number = 0;
-		d_cur_part->rx_seq = rx_seq;
-		d_cur_part->voice_present = false;
-		d_cur_part->packet_cnt = 0;
-		d_cur_part->afield_bad_crc_cnt = 0;
-		d_cur_part->log_update = true;
-		d_cur_part->part_id_rcvd = false;
-		d_cur_part->qt_rcvd = false;
-		d_cur_part->type = ptype;
-		d_cur_part->pair = NULL;
-		//std::cout << "*********** NEW part ************" << std::endl;
-	}
-
-	// Try to find pair RFP for PP
-	if (d_cur_part->pair == NULL && d_cur_part->type == _PP_ && d_cur_part->part_id_rcvd) {
-		for (uint32_t i = 0; i < MAX_PARTS; i++) {
-			if (i != rx_id) {
-				if (d_part_descriptor[i].active) {
-					if (part_id_cmp(d_cur_part->part_id, d_part_descriptor[i].part_id)) {
-						d_cur_part->pair = &d_part_descriptor[i];
-						d_part_descriptor[i].pair = d_cur_part;
-					}
-				}
-			}
-		}
+	if (d_voice_end_pending) {
+		out[nout++] = d_voice_end;
+		d_voice_end_pending = false;
 	}
 
-	uint8_t tmp_byte = 0;
-	uint32_t a_field_byte_cnt = 0;
-	uint8_t a_field[8];
-
-	// Extract A-field
-	for (uint32_t i = 0; i < A_FIELD_BITS; i++) {
-		if (i && ((i & 0x7) == 0))
-			a_field[a_field_byte_cnt++] = tmp_byte;
-		tmp_byte = (tmp_byte << 1) | (*in++ & 0x1);
-	}
-	a_field[a_field_byte_cnt] = tmp_byte;
+	if (selected)
+		nout += d_voice.burst(info, result, b_field, &out[nout]);
 
-	decode_afield(a_field);
-
-	if (ptype == _RFP_ && d_cur_part->qt_rcvd && d_cur_part->pair != NULL)
-		d_cur_part->pair->qt_rcvd = true;
-
-	if (d_cur_part->log_update && d_cur_part->part_id_rcvd) {
-		print_parts();
-		emit_part_updated(rx_id);
-		d_cur_part->log_update = false;
-	}
+	return nout;
+}
 
-	if (rx_id == d_selected_rx_id) {
-		if (d_cur_part->active && d_cur_part->voice_present && d_cur_part->qt_rcvd) {
-			uint8_t b_field[40];
-			uint8_t tmp_byte = 0;
-			uint32_t b_field_byte_cnt = 0;
-
-			for (uint32_t i = 0; i < B_FIELD_BITS; i++) {
-				if (i && ((i & 0x7) == 0))
-					b_field[b_field_byte_cnt++] = tmp_byte;
-				tmp_byte = (tmp_byte << 1) | (*in++ & 0x1);
-			}
-
-			b_field[b_field_byte_cnt] = tmp_byte;
-
-			uint8_t xcrc = calc_xcrc(b_field);
-			uint8_t x_field = 0;
-			x_field |= ((*in++ & 0x1) << 3);
-			x_field |= ((*in++ & 0x1) << 2);
-			x_field |= ((*in++ & 0x1) << 1);
-			x_field |= (*in & 0x1);
-
-			if (xcrc == x_field) {
-				uint8_t *ptr = b_field;
-				uint32_t whitener_offset = d_cur_part->frame_number % 8;
-				uint8_t descrt_byte;
-
-				for (uint32_t i = 0; i < 40; i++) {
-					descrt_byte = *ptr++ ^ scrt[whitener_offset][i % 31];
-					*out++ = (descrt_byte >> 4) & 0xF;
-					*out++ = descrt_byte & 0xF;
-				}
-
-				noutput_items = 80;
-			} else {
-				for (uint32_t i = 0; i < 80; i++)
-					*out++ = 0;
-				noutput_items = 80;
-			}
-		} else {
-			for (uint32_t i = 0; i < 80; i++)
-				*out++ = 0;
-			noutput_items = 80;
-		}
-	} else {
-		noutput_items = 0;
-	}
+void packet_decoder_impl::clear_parts(void)
+{
+	set_pending(DECODER_CLEAR_PARTS);
 
-	return noutput_items;
+	// The decoder only clears its table with the next burst, which may
+	// never come on a quiet carrier
+	std::lock_guard<std::mutex> lock(d_parts_mutex);
+	d_parts_snapshot_len = 0;
 }
 
-void packet_decoder_impl::clear_parts(void)
+size_t packet_decoder_impl::get_parts(part_info_t *parts, size_t max_parts)
 {
-	for (uint32_t i = 0; i < MAX_PARTS; i++) {
-		d_part_descriptor[i].active = false;
-		d_part_descriptor[i].log_update = true;
-		d_part_descriptor[i].part_id_rcvd = false;
-		d_part_descriptor[i].qt_rcvd = false;
-		d_part_descriptor[i].pair = NULL;
-	}
+	std::lock_guard<std::mutex> lock(d_parts_mutex);
+
+	size_t nparts = std::min(max_parts, d_parts_snapshot_len);
+	memcpy(parts, d_parts_snapshot, nparts * sizeof(part_info_t));
+	return nparts;
 }
 
 void packet_decoder_impl::set_part_updated_callback(part_updated_callback_t callback, void *arg)
@@ -519,5 +380,20 @@ void packet_decoder_impl::set_part_lost_callback(part_lost_callback_t callback,
 	part_lost_callback_arg = arg;
 }
 
+void packet_decoder_impl::set_event_queue(dect2core::part_event_queue *queue)
+{
+	d_event_queue = queue;
+}
+
+void packet_decoder_impl::set_watchlist(const dect2core::watchlist *list)
+{
+	d_decoder.set_watchlist(list);
+}
+
+void packet_decoder_impl::set_burst_recorder(dect2core::burst_recorder *recorder)
+{
+	d_recorder = recorder;
+}
+
 } /* namespace dect2 */
 } /* namespace gr */
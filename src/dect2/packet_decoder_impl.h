@@ -21,43 +21,37 @@
 #ifndef INCLUDED_DECT2_PACKET_DECODER_IMPL_H
 #define INCLUDED_DECT2_PACKET_DECODER_IMPL_H
 
-#include "dect2_common.h"
+#include <atomic>
+#include <mutex>
+
+#include "dect2core/burst_decoder.h"
+#include "dect2core/burst_recorder.h"
+#include "dect2core/part_event_queue.h"
+#include "dect2core/voice_stream.h"
 #include "packet_decoder.h"
 
 namespace gr {
 namespace dect2 {
 
-class packet_decoder_impl : public packet_decoder
+// Settings waiting for work()
+#define DECODER_SET_SELECTED	0x01
+#define DECODER_SET_CARRIER	0x02
+#define DECODER_SET_CHASE_BITS	0x04
+#define DECODER_CLEAR_PARTS	0x08
+
+class packet_decoder_impl : public packet_decoder, private dect2core::burst_decoder::listener
 {
 private:
-	typedef enum {
-		_RFP_,	// Radio Fixed Part
-		_PP_,	// Portable Part
-	} part_type;
-
-	typedef struct part_descriptor_item {
-		bool active;
-		bool voice_present;
-		bool log_update;
-		bool part_id_rcvd;
-		bool qt_rcvd;
-
-		bool rfp_fn_cor; // set true if frame number was corrected from RFP part
-
-		uint8_t frame_number;
-		uint64_t rx_seq;
-		uint8_t part_id[5];
-		part_type type;
-
-		uint64_t packet_cnt;
-		uint64_t afield_bad_crc_cnt;
-
-		struct part_descriptor_item *pair;
-	} part_descriptor_item;
+	dect2core::burst_decoder d_decoder;
 
-	part_descriptor_item d_part_descriptor[MAX_PARTS];
-	part_descriptor_item *d_cur_part;
-	uint32_t d_selected_rx_id;
+	// Setters from other threads leave the latest value and a DECODER_*
+	// flag, and post to pending_in to have it applied on the block's
+	// thread. work() also applies it before the next burst. Only the last
+	// one of each counts, so nothing piles up while no bursts come.
+	std::atomic<uint32_t> d_pending;
+	std::atomic<uint32_t> d_new_selected;
+	std::atomic<uint32_t> d_new_carrier;
+	std::atomic<uint32_t> d_new_chase_bits;
 
 	void *part_updated_callback_arg;
 	part_updated_callback_t part_updated_callback;
@@ -65,21 +59,54 @@ private:
 	void *part_lost_callback_arg;
 	part_lost_callback_t part_lost_callback;
 
-	uint32_t decode_afield(uint8_t *field_data);
+	dect2core::part_event_queue *d_event_queue;
+	dect2core::burst_recorder *d_recorder;
+
+	// The selected part's voice stream, and its end until it is sent
+	dect2core::voice_stream d_voice;
+	dect2core::voice_record_t d_voice_end;
+	bool d_voice_end_pending;
+
+	// Copy of the part table for get_parts(), refreshed only when it changes
+	std::mutex d_parts_mutex;
+	part_info_t d_parts_snapshot[MAX_PARTS];
+	size_t d_parts_snapshot_len;
+
+	pmt::pmt_t d_log_port;
+	pmt::pmt_t d_ctrl_port;
+	pmt::pmt_t d_pending_port;
+	pmt::pmt_t d_voice_end_port;
+	pmt::pmt_t d_rx_id_key;
+	pmt::pmt_t d_rx_seq_key;
+	pmt::pmt_t d_part_type_key;
+	pmt::pmt_t d_sample_index_key;
+	pmt::pmt_t d_afield_recovered_key;
+	pmt::pmt_t d_freq_offset_key;
+	pmt::pmt_t d_rssi_key;
 
 	int calculate_output_stream_length(const gr_vector_int &ninput_items);
+	void set_pending(uint32_t flag);
+	void apply_pending(void);
+	void end_voice(void);
+	void publish_voice_end(void);
 	void msg_event_handler(pmt::pmt_t msg);
+	void pending_handler(pmt::pmt_t msg);
 
-	void print_parts(void);
+	void print_parts(const part_info_t *parts, size_t nparts);
 
-	void emit_part_updated(uint32_t rx_id);
-	void emit_part_lost(uint32_t rx_id);
+	virtual void part_updated(const part_info_t &part_info);
+	virtual void part_lost(const part_info_t &part_info);
+	virtual void part_matched(const part_info_t &part_info);
+	virtual void parts_changed(void);
+	virtual void burst_length_changed(uint32_t rx_id, uint32_t d_field_bits);
 
 public:
 	packet_decoder_impl();
 	virtual ~packet_decoder_impl();
 
 	virtual void select_rx_part(uint32_t rx_id);
+	virtual void set_carrier(uint32_t carrier);
+	virtual void set_chase_bits(unsigned k);
 
 	int work(int noutput_items,
 		gr_vector_int &ninput_items,
@@ -87,8 +114,12 @@ public:
 		gr_vector_void_star &output_items);
 
 	virtual void clear_parts(void);
+	virtual size_t get_parts(part_info_t *parts, size_t max_parts);
 	virtual void set_part_updated_callback(part_updated_callback_t callback, void *arg);
 	virtual void set_part_lost_callback(part_lost_callback_t callback, void *arg);
+	virtual void set_event_queue(dect2core::part_event_queue *queue);
+	virtual void set_watchlist(const dect2core::watchlist *list);
+	virtual void set_burst_recorder(dect2core::burst_recorder *recorder);
 };
 
 } // namespace dect2
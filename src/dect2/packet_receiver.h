@@ -25,6 +25,7 @@
 #include <gnuradio/block.h>
 
 #include "api.h"
+#include "dect2core/burst_receiver.h"
 
 namespace gr {
 namespace dect2 {
@@ -47,9 +48,18 @@ public:
 	 * class. dect2::packet_receiver::make is the public interface for
 	 * creating new instances.
 	 */
-	static sptr make();
+	// sps is 2, 4 or 8
+	static sptr make(unsigned sps = 4,
+		dect2core::burst_receiver::packet_format_t format = dect2core::burst_receiver::PACKET_P32);
 
+	// Like packet_decoder's setters these take effect with the next call of
+	// general_work(), and are safe to make from one other thread while running
 	virtual void reset(void) = 0;
+
+	// Output soft bits, see dect2core/chase.h
+	virtual void set_soft_output(bool soft) = 0;
+	// Flip up to k unreliable bits to recover A-fields failing the R-CRC
+	virtual void set_chase_bits(unsigned k) = 0;
 };
 
 } // namespace dect2
@@ -22,6 +22,9 @@
 #include "config.h"
 #endif
 
+#include <cmath>
+#include <stdexcept>
+
 #include <gnuradio/io_signature.h>
 
 #include "packet_receiver_impl.h"
@@ -29,27 +32,35 @@
 namespace gr {
 namespace dect2 {
 
-packet_receiver::sptr packet_receiver::make()
+packet_receiver::sptr packet_receiver::make(unsigned sps, dect2core::burst_receiver::packet_format_t format)
 {
-	return gnuradio::get_initial_sptr(new packet_receiver_impl());
+	return gnuradio::get_initial_sptr(new packet_receiver_impl(sps, format));
 }
 
-packet_receiver_impl::packet_receiver_impl()
+packet_receiver_impl::packet_receiver_impl(unsigned sps, dect2core::burst_receiver::packet_format_t format)
 	: gr::block("packet_receiver",
-		gr::io_signature::make(1, 1, sizeof(float)),
-		gr::io_signature::make(1, 1, sizeof(unsigned char)))
+		gr::io_signature::make(1, 2, sizeof(float)),
+		gr::io_signature::make(1, 1, sizeof(unsigned char))),
+	d_receiver(dect2core::burst_receiver::make(this, sps, format)),
+	d_pending(0), d_new_soft_output(false), d_new_chase_bits(0)
 {
+	if (d_receiver == NULL)
+		throw std::invalid_argument("packet_receiver: unsupported samples per symbol");
+
 	set_fixed_rate(true);
-	set_history(4);
-	set_decimation(4);
+	set_history(sps);
+	set_decimation(sps);
 
-	message_port_register_out(pmt::mp("rcvr_msg_out"));
+	d_msg_port = pmt::mp("rcvr_msg_out");
+	message_port_register_out(d_msg_port);
 
-	_reset();
+	message_port_register_in(pmt::mp("rcvr_ctrl_in"));
+	set_msg_handler(pmt::mp("rcvr_ctrl_in"), boost::bind(&packet_receiver_impl::msg_ctrl_handler, this, _1));
 }
 
 packet_receiver_impl::~packet_receiver_impl()
 {
+	delete d_receiver;
 }
 
 void packet_receiver_impl::forecast(int noutput_items, gr_vector_int &ninput_items_required)
@@ -71,128 +82,60 @@ int packet_receiver_impl::fixed_rate_ninput_to_noutput(int ninput_items)
 }
 
 
-/*
- * Check for parts activity
- * Return:
- *     Part RX ID - if there is no activity for a part
- *     -1 - otherwise
- */
-int packet_receiver_impl::check_part_activity(void)
+void packet_receiver_impl::burst_start(size_t out_offset, const dect2core::burst_info_t &info)
 {
-	if (d_part_activity) {
-		uint32_t j = 0;
-		uint32_t part_mask = 1;
-		while (part_mask <= d_part_activity) {
-			if (d_part_activity & part_mask) {
-				if (d_inc_smpl_cnt - d_part_time[j] > (4 * INTER_FRAME_TIME)) {
-					// Release part
-					d_part_activity &= ~part_mask;
-					return j;
-				}
-			}
-			part_mask <<= 1;
-			j++;
-		}
-	}
-	return -1;
+	uint64_t offset = d_nitems_written + out_offset;
+
+	add_item_tag(0, offset, pmt::mp("packet_len"), pmt::mp((int)info.length));
+	add_item_tag(0, offset, pmt::mp("part_rx_id"), pmt::mp((uint64_t)info.rx_id));
+	add_item_tag(0, offset, pmt::mp("rx_seq"), pmt::mp((uint64_t)info.rx_seq));
+	add_item_tag(0, offset, pmt::mp("part_type"),
+		pmt::mp((info.part_type == dect2core::PART_RFP) ? "RFP" : "PP"));
+	if (info.afield_recovered)
+		add_item_tag(0, offset, pmt::mp("afield_recovered"), pmt::PMT_T);
+	add_item_tag(0, offset, pmt::mp("sample_index"), pmt::from_uint64(info.sample_index));
+	add_item_tag(0, offset, pmt::mp("freq_offset"), pmt::from_double(info.freq_offset));
+	if (!std::isnan(info.rssi))
+		add_item_tag(0, offset, pmt::mp("rssi"), pmt::from_double(info.rssi));
 }
 
-/*
- * If there are several DECT parts on air we need to keep track each in correct way.
- * This function does this by taking into account time intervals (based on incomming sample counter)
- * between received bursts.
- * Return:
- *     Part RX ID - if apropriate part is found or a new one assigned
- *     -1 - otherwise
- */
-int packet_receiver_impl::register_part(void)
+// Inform packet decoder that a part became inactive
+void packet_receiver_impl::part_lost(uint32_t rx_id)
 {
-	if (d_part_activity) {
-		uint32_t j = 0;
-		uint32_t part_mask = 1;
-		uint32_t seq;
-
-		while (j < MAX_PARTS) {
-			if (d_part_activity & part_mask) {
-				uint64_t ltmp = (d_inc_smpl_cnt - d_part_time[j]) % INTER_FRAME_TIME;
-				if (ltmp < TIME_TOL) {
-					seq = (d_inc_smpl_cnt - d_part_time[j]) / INTER_FRAME_TIME;
-					break;
-				} else if (INTER_FRAME_TIME - ltmp <= TIME_TOL) {
-					seq = 1 + (d_inc_smpl_cnt - d_part_time[j]) / INTER_FRAME_TIME;
-					break;
-				}
-			}
-
-			part_mask <<= 1;
-			j++;
-		}
-
-		if (j < MAX_PARTS) {
-			d_part_time[j] = d_inc_smpl_cnt;
-			d_part_seq[j] = (d_part_seq[j] + seq) & 0x1F;
-			return j;
-		} else {
-			// Adding a new active part
-			j = 0;
-			part_mask = 1;
-			while (j < MAX_PARTS) {
-				if (d_part_activity & part_mask) {
-					part_mask <<= 1;
-					j++;
-				} else {
-					d_part_activity |= part_mask;
-					break;
-				}
-			}
-
-			if (j < MAX_PARTS) {
-				d_part_time[j] = d_inc_smpl_cnt;
-				d_part_seq[j] = 0;
-				return j;
-			} else {
-				return -1;
-			}
-		}
-	} else {
-		// Adding the first active part
-		d_part_time[0] = d_inc_smpl_cnt;
-		d_part_seq[0] = 0;
-		d_part_activity = 1;
-		return 0;
-	}
+	pmt::pmt_t msg = pmt::make_dict();
+	msg = pmt::dict_add(msg, pmt::mp("rcvr_msg_id"), pmt::mp("lost_part"));
+	msg = pmt::dict_add(msg, pmt::mp("part_rx_id"), pmt::mp((uint64_t)rx_id));
+	message_port_pub(d_msg_port, msg);
 }
 
-
-int packet_receiver_impl::find_best_smpl_point(void)
+void packet_receiver_impl::msg_ctrl_handler(pmt::pmt_t msg)
 {
-	if (d_begin_pos != d_end_pos) { // If (d_begin_pos == d_end_pos) we have the only optimal sample point
-		float max_val = 0.0;
-		uint32_t max_index = d_begin_pos;
-		while (1) {
-			uint32_t index = d_begin_pos;
-
-			float acc = 0.0;
-			for (uint32_t j = 0; j < 32; j++) {
-				acc += fabs(d_smpl_buf[index]);
-				index = (index - 4) & (SMPL_BUF_LEN - 1);
-			}
-
-			if (acc > max_val) {
-				max_val = acc;
-				max_index = d_begin_pos;
-			}
-
-			if (d_begin_pos == d_end_pos)
-				break;
-
-			d_begin_pos = (d_begin_pos + 1) & (SMPL_BUF_LEN - 1);
-		}
-
-		return (d_end_pos - max_index) & (SMPL_BUF_LEN - 1);
+	pmt::pmt_t msg_id = pmt::dict_ref(msg, pmt::mp("rcvr_ctrl_id"), pmt::PMT_NIL);
+	if (pmt::eq(msg_id, pmt::mp("part_length"))) {
+		// msg["rcvr_ctrl_id"] == "part_length"
+		uint32_t rx_id = (uint32_t)pmt::to_uint64(pmt::dict_ref(msg, pmt::mp("part_rx_id"), pmt::PMT_NIL));
+		uint32_t length = (uint32_t)pmt::to_uint64(pmt::dict_ref(msg, pmt::mp("length"), pmt::PMT_NIL));
+		d_receiver->set_part_length(rx_id, length);
 	}
+}
 
-	return 0; // No Correction
+void packet_receiver_impl::set_pending(uint32_t flag)
+{
+	d_pending.fetch_or(flag, std::memory_order_release);
+}
+
+void packet_receiver_impl::apply_pending(void)
+{
+	uint32_t pending = d_pending.exchange(0, std::memory_order_acquire);
+	if (!pending)
+		return;
+
+	if (pending & RECEIVER_RESET)
+		d_receiver->reset();
+	if (pending & RECEIVER_SET_SOFT_OUTPUT)
+		d_receiver->set_soft_output(d_new_soft_output.load(std::memory_order_relaxed));
+	if (pending & RECEIVER_SET_CHASE_BITS)
+		d_receiver->set_chase_bits(d_new_chase_bits.load(std::memory_order_relaxed));
 }
 
 int packet_receiver_impl::general_work(int noutput_items,
@@ -201,136 +144,38 @@ int packet_receiver_impl::general_work(int noutput_items,
 	gr_vector_void_star &output_items)
 {
 	const float *in = (const float *)input_items[0];
+	const float *power = (input_items.size() > 1) ? (const float *)input_items[1] : NULL;
 	unsigned char *out = (unsigned char *)output_items[0];
 
 	unsigned ni = ninput_items[0] - history();
+	if (power)
+		ni = std::min(ni, (unsigned)(ninput_items[1] - history()));
+	size_t nconsumed, nproduced;
 
-	bool sync_detected;
-
-	uint32_t ii = 0;
-	int oo = 0;
-
-	while (ii < ni && oo < noutput_items) {
-		// Detect RX bit
-		uint32_t rx_bit = (*in >= 0) ? 0 : 1;
-		d_rx_bits_buf[d_rx_bits_buf_index] = (d_rx_bits_buf[d_rx_bits_buf_index] << 1) | rx_bit;
-		d_smpl_buf[d_smpl_buf_index] = *in++; // save samples in cyrcular buffer to search the best sample point later
-
-		switch (d_sync_state) {
-		case _WAIT_BEGIN_:
-			// Perform SYNC detect.
-			// Because we have four samples per symbol there may be several positions where SYNC can be detected.
-			// So we check interval and then look for the best sample point.
-			sync_detected = ((d_rx_bits_buf[d_rx_bits_buf_index] ^ (uint32_t)RFP_SYNC_FIELD) == 0);
-
-			if (sync_detected) {
-				d_part_type = _RFP_;
-			} else {
-				sync_detected = ((d_rx_bits_buf[d_rx_bits_buf_index] ^ (~(uint32_t)RFP_SYNC_FIELD)) == 0);
-				if (sync_detected)
-					d_part_type = _PP_;
-			}
-
-
-			if (sync_detected) {
-				d_begin_pos = d_smpl_buf_index;
-				d_sync_state = _WAIT_END_;
-			}
-			break;
-
-		case _WAIT_END_:
-			if (d_part_type == _RFP_)
-				sync_detected = ((d_rx_bits_buf[d_rx_bits_buf_index] ^ (uint32_t)RFP_SYNC_FIELD) == 0);
-			else if (d_part_type == _PP_)
-				sync_detected = ((d_rx_bits_buf[d_rx_bits_buf_index] ^ (~(uint32_t)RFP_SYNC_FIELD)) == 0);
-			else
-				sync_detected = false;
-
-			if (!sync_detected) {
-				d_end_pos = (d_smpl_buf_index - 1) & (SMPL_BUF_LEN - 1);
-
-				// Perform correction to the best sample position
-				d_smpl_cnt = (1 + find_best_smpl_point()) & 3;
-
-				d_cur_part_rx_id = register_part();
-				if (d_cur_part_rx_id < 0) {
-					d_sync_state = _WAIT_BEGIN_;
-					break;
-				}
-
-				d_out_bit_cnt = 0;
-				d_sync_state = _POST_WAIT_;
-			}
-			break;
-
-		case _POST_WAIT_:
-			// Receive packet payload
-			if (d_smpl_cnt == 0) {
-				*out++ = (char)rx_bit;
-
-				if (d_out_bit_cnt == 0) {
-					add_item_tag(0, nitems_written(0) + oo,
-						pmt::mp("packet_len"),
-						pmt::mp(P32_D_FIELD_BITS));
-
-					add_item_tag(0, nitems_written(0) + oo,
-						pmt::mp("part_rx_id"),
-						pmt::mp((uint64_t)d_cur_part_rx_id));
-
-					add_item_tag(0, nitems_written(0) + oo,
-						pmt::mp("rx_seq"),
-						pmt::mp((uint64_t)d_part_seq[d_cur_part_rx_id]));
-
-					add_item_tag(0, nitems_written(0) + oo,
-						pmt::mp("part_type"),
-						pmt::mp((d_part_type == _RFP_) ? "RFP" : "PP"));
-				}
-
-				oo++;
-
-				if (++d_out_bit_cnt == P32_D_FIELD_BITS)
-					d_sync_state = _WAIT_BEGIN_;
-			}
-			break;
-		}
-
-		// Check parts activity and inform packet decoder if a part becomes inactive
-		int32_t lost_id = check_part_activity();
-		if (lost_id >= 0) {
-			pmt::pmt_t msg = pmt::make_dict();
-			msg = pmt::dict_add(msg, pmt::mp("rcvr_msg_id"), pmt::mp("lost_part"));
-			msg = pmt::dict_add(msg, pmt::mp("part_rx_id"), pmt::mp((uint64_t)lost_id));
-			message_port_pub(pmt::mp("rcvr_msg_out"), msg);
-		}
-
-		d_smpl_buf_index = (d_smpl_buf_index + 1 ) & (SMPL_BUF_LEN - 1);
-		d_rx_bits_buf_index = (d_rx_bits_buf_index + 1) & 3;
-
-		d_smpl_cnt = (d_smpl_cnt + 1) & 3;
-
-		d_inc_smpl_cnt++; // Increase incomming samples counter
-
-		ii++;
-	}
+	apply_pending();
 
-	consume_each(ii);
-	return oo;
+	d_nitems_written = nitems_written(0);
+	d_receiver->process(in, ni, out, noutput_items, &nconsumed, &nproduced, power);
+
+	consume_each(nconsumed);
+	return nproduced;
 }
 
 void packet_receiver_impl::reset(void)
 {
-	_reset();
+	set_pending(RECEIVER_RESET);
 }
 
-void packet_receiver_impl::_reset(void)
+void packet_receiver_impl::set_soft_output(bool soft)
 {
-	d_rx_bits_buf_index = 0;
-	d_smpl_buf_index = 0;
-	d_sync_state = _WAIT_BEGIN_;
-
-	d_inc_smpl_cnt = 0;
+	d_new_soft_output.store(soft, std::memory_order_relaxed);
+	set_pending(RECEIVER_SET_SOFT_OUTPUT);
+}
 
-	d_part_activity = 0;
+void packet_receiver_impl::set_chase_bits(unsigned k)
+{
+	d_new_chase_bits.store(k, std::memory_order_relaxed);
+	set_pending(RECEIVER_SET_CHASE_BITS);
 }
 
 } /* namespace dect2 */
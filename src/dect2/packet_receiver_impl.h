@@ -21,51 +21,32 @@
 #ifndef INCLUDED_DECT2_PACKET_RECEIVER_IMPL_H
 #define INCLUDED_DECT2_PACKET_RECEIVER_IMPL_H
 
-#include "dect2_common.h"
+#include <atomic>
+
+#include "dect2core/burst_receiver.h"
 #include "packet_receiver.h"
 
 namespace gr {
 namespace dect2 {
 
-class packet_receiver_impl : public packet_receiver
+// Settings waiting for general_work()
+#define RECEIVER_RESET			0x01
+#define RECEIVER_SET_SOFT_OUTPUT	0x02
+#define RECEIVER_SET_CHASE_BITS		0x04
+
+class packet_receiver_impl : public packet_receiver, private dect2core::burst_receiver::listener
 {
 private:
-	typedef enum {
-		_RFP_,
-		_PP_,
-	} part_type;
-
-	part_type d_part_type;
-
-	// Buffer to save demodulated bits. Input signal has four samples per bits.
-	// We save bits related to null sample in null element, bits related to first sample in firts element
-	// and so on. Each element in this array should be considered as circular buffer.
-	uint32_t d_rx_bits_buf[4];
-
-	unsigned d_rx_bits_buf_index;
-	enum {
-		_WAIT_BEGIN_,
-		_WAIT_END_,
-		_POST_WAIT_,
-	} d_sync_state;
+	dect2core::burst_receiver *d_receiver;
 
-	uint32_t d_begin_pos;
-	uint32_t d_end_pos;
-	uint32_t d_post_wait_cnt;
+	// Setters from other threads, latest values applied by general_work()
+	// before it runs the receiver, as in packet_decoder_impl
+	std::atomic<uint32_t> d_pending;	// RECEIVER_* flags
+	std::atomic<bool> d_new_soft_output;
+	std::atomic<uint32_t> d_new_chase_bits;
 
-	float d_smpl_buf[SMPL_BUF_LEN];
-	uint32_t d_smpl_buf_index;
-
-	uint32_t d_smpl_cnt;
-	uint32_t d_out_bit_cnt;
-	uint64_t d_inc_smpl_cnt;          // Incomming samples counter
-
-
-	uint64_t d_part_time[MAX_PARTS];
-	uint32_t d_part_seq[MAX_PARTS];
-	uint32_t d_part_activity;
-
-	int32_t d_cur_part_rx_id;
+	pmt::pmt_t d_msg_port;
+	uint64_t d_nitems_written;	// nitems_written(0) of the running general_work()
 
 	int d_decimation;
 	int decimation () const
@@ -81,12 +62,15 @@ private:
 	int fixed_rate_ninput_to_noutput(int ninput);
 	int fixed_rate_noutput_to_ninput(int noutput);
 
-	int check_part_activity(void);
-	int register_part(void);
-	int find_best_smpl_point(void);
+	virtual void burst_start(size_t out_offset, const dect2core::burst_info_t &info);
+	virtual void part_lost(uint32_t rx_id);
+
+	void msg_ctrl_handler(pmt::pmt_t msg);
+	void set_pending(uint32_t flag);
+	void apply_pending(void);
 
 public:
-	packet_receiver_impl();
+	packet_receiver_impl(unsigned sps, dect2core::burst_receiver::packet_format_t format);
 	virtual ~packet_receiver_impl();
 
 	// Where all the action really happens
@@ -98,7 +82,8 @@ public:
 		gr_vector_void_star &output_items);
 
 	virtual void reset(void);
-	void _reset(void); // non-virtual to call from ctor and dtor
+	virtual void set_soft_output(bool soft);
+	virtual void set_chase_bits(unsigned k);
 };
 
 } // namespace dect2
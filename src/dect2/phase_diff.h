@@ -30,9 +30,12 @@ namespace gr {
 namespace dect2 {
 
 /*!
- * \brief <+description of block+>
+ * \brief GFSK phase discriminator
  * \ingroup dect2
  *
+ * A second output, if connected, carries the sample power. squelch_db
+ * above 0 turns on the squelch with that threshold over the noise floor,
+ * squelched samples come out as NaN.
  */
 class DECT2_API phase_diff : virtual public gr::sync_block
 {
@@ -47,7 +50,10 @@ public:
 	 * class. dect2::phase_diff::make is the public interface for
 	 * creating new instances.
 	 */
-	static sptr make();
+	static sptr make(unsigned sps = 4, float squelch_db = 0);
+
+	//! Input item that output item 0 stands for, negative within the history
+	virtual double input_offset(void) const = 0;
 };
 
 } // namespace dect2
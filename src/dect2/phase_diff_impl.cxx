@@ -22,44 +22,45 @@
 #include "config.h"
 #endif
 
-#include <cstdio>
-
 #include <gnuradio/io_signature.h>
-#include <gnuradio/math.h>
 
 #include "phase_diff_impl.h"
 
 namespace gr {
 namespace dect2 {
 
-phase_diff::sptr phase_diff::make()
+phase_diff::sptr phase_diff::make(unsigned sps, float squelch_db)
 {
-	return gnuradio::get_initial_sptr(new phase_diff_impl());
+	return gnuradio::get_initial_sptr(new phase_diff_impl(sps, squelch_db));
 }
 
-phase_diff_impl::phase_diff_impl()
+phase_diff_impl::phase_diff_impl(unsigned sps, float squelch_db)
 	: gr::sync_block("phase_diff",
 		gr::io_signature::make(1, 1, sizeof(gr_complex)),
-		gr::io_signature::make(1, 1, sizeof(float)))
+		gr::io_signature::make(1, 2, sizeof(float))),
+	d_discriminator(sps, squelch_db)
 {
-	set_history(4);
+	set_history(d_discriminator.lookahead() + 1);
 }
 
 phase_diff_impl::~phase_diff_impl()
 {
 }
 
+double phase_diff_impl::input_offset(void) const
+{
+	return d_discriminator.delay() - d_discriminator.lookahead();
+}
+
 int phase_diff_impl::work(int noutput_items,
 	gr_vector_const_void_star &input_items,
 	gr_vector_void_star &output_items)
 {
 	const gr_complex *in = (const gr_complex *)input_items[0];
 	float *out = (float *)output_items[0];
+	float *power = (output_items.size() > 1) ? (float *)output_items[1] : NULL;
 
-	for (int i = 0; i < noutput_items; i++) {
-		gr_complex ph_diff = in[i] * conj(in[i + 3]);
-		*out++ = gr::fast_atan2f(ph_diff.imag(), ph_diff.real());
-	}
+	d_discriminator.process(in, noutput_items, out, power);
 	return noutput_items;
 }
 
@@ -21,6 +21,7 @@
 #ifndef INCLUDED_DECT2_PHASE_DIFF_IMPL_H
 #define INCLUDED_DECT2_PHASE_DIFF_IMPL_H
 
+#include "dect2core/phase_discriminator.h"
 #include "phase_diff.h"
 
 namespace gr {
@@ -29,11 +30,14 @@ namespace dect2 {
 class phase_diff_impl : public phase_diff
 {
 private:
+	dect2core::phase_discriminator d_discriminator;
 
 public:
-	phase_diff_impl();
+	phase_diff_impl(unsigned sps, float squelch_db);
 	virtual ~phase_diff_impl();
 
+	virtual double input_offset(void) const;
+
 	int work(int noutput_items,
 		gr_vector_const_void_star &input_items,
 		gr_vector_void_star &output_items);
@@ -0,0 +1,604 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2015 Pavel Yazev <pyazev@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include "burst_decoder.h"
+#include "chase.h"
+#include "crc.h"
+
+namespace dect2core {
+
+// scramble table with corrections by Jakub Hruska
+static const uint8_t scrt[8][31] = {
+	{0x3b, 0xcd, 0x21, 0x5d, 0x88, 0x65, 0xbd, 0x44, 0xef, 0x34, 0x85, 0x76, 0x21, 0x96, 0xf5, 0x13, 0xbc, 0xd2, 0x15, 0xd8, 0x86, 0x5b, 0xd4, 0x4e, 0xf3, 0x48, 0x57, 0x62, 0x19, 0x6f, 0x51},
+	{0x32, 0xde, 0xa2, 0x77, 0x9a, 0x42, 0xbb, 0x10, 0xcb, 0x7a, 0x89, 0xde, 0x69, 0x0a, 0xec, 0x43, 0x2d, 0xea, 0x27, 0x79, 0xa4, 0x2b, 0xb1, 0x0c, 0xb7, 0xa8, 0x9d, 0xe6, 0x90, 0xae, 0xc4},
+	{0x2d, 0xea, 0x27, 0x79, 0xa4, 0x2b, 0xb1, 0x0c, 0xb7, 0xa8, 0x9d, 0xe6, 0x90, 0xae, 0xc4, 0x32, 0xde, 0xa2, 0x77, 0x9a, 0x42, 0xbb, 0x10, 0xcb, 0x7a, 0x89, 0xde, 0x69, 0x0a, 0xec, 0x43},
+	{0x27, 0x79, 0xa4, 0x2b, 0xb1, 0x0c, 0xb7, 0xa8, 0x9d, 0xe6, 0x90, 0xae, 0xc4, 0x32, 0xde, 0xa2, 0x77, 0x9a, 0x42, 0xbb, 0x10, 0xcb, 0x7a, 0x89, 0xde, 0x69, 0x0a, 0xec, 0x43, 0x2d, 0xea},
+	{0x19, 0x6f, 0x51, 0x3b, 0xcd, 0x21, 0x5d, 0x88, 0x65, 0xbd, 0x44, 0xef, 0x34, 0x85, 0x76, 0x21, 0x96, 0xf5, 0x13, 0xbc, 0xd2, 0x15, 0xd8, 0x86, 0x5b, 0xd4, 0x4e, 0xf3, 0x48, 0x57, 0x62},
+	{0x13, 0xbc, 0xd2, 0x15, 0xd8, 0x86, 0x5b, 0xd4, 0x4e, 0xf3, 0x48, 0x57, 0x62, 0x19, 0x6f, 0x51, 0x3b, 0xcd, 0x21, 0x5d, 0x88, 0x65, 0xbd, 0x44, 0xef, 0x34, 0x85, 0x76, 0x21, 0x96, 0xf5},
+	{0x0c, 0xb7, 0xa8, 0x9d, 0xe6, 0x90, 0xae, 0xc4, 0x32, 0xde, 0xa2, 0x77, 0x9a, 0x42, 0xbb, 0x10, 0xcb, 0x7a, 0x89, 0xde, 0x69, 0x0a, 0xec, 0x43, 0x2d, 0xea, 0x27, 0x79, 0xa4, 0x2b, 0xb1},
+	{0x79, 0xa4, 0x2b, 0xb1, 0x0c, 0xb7, 0xa8, 0x9d, 0xe6, 0x90, 0xae, 0xc4, 0x32, 0xde, 0xa2, 0x77, 0x9a, 0x42, 0xbb, 0x10, 0xcb, 0x7a, 0x89, 0xde, 0x69, 0x0a, 0xec, 0x43, 0x2d, 0xea, 0x27},
+};
+
+// B-field lengths tried when learning a part's burst length. Shortest first,
+// whatever follows a short burst would pass as an all zero longer one.
+static const uint32_t b_field_sizes[] = { 80, B_FIELD_BITS, 800 };
+
+// Consecutive X-CRC matches needed to accept a length, failures to drop it.
+// The check is only 4 bits, a random B-field passes one time in 16, so a
+// length shorter than the bursts as received, which would have the
+// receiver throw the rest away, needs a lot more matches.
+#define BURST_LEN_CONFIRM	3
+#define BURST_LEN_CONFIRM_SHORT	8
+#define BURST_LEN_FAIL_LIMIT	32
+
+// Weight of the newest burst in the per-part frequency offset and RSSI
+#define LEVEL_AVG_WEIGHT	0.125f
+
+// Check the X-field following a b_field_bits long B-field
+static bool xcrc_match(const uint8_t *b_bits, uint32_t b_field_bits)
+{
+	uint8_t b_field[800 / 8];
+
+	memset(b_field, 0, b_field_bits / 8);
+	for (uint32_t i = 0; i < b_field_bits; i++)
+		b_field[i >> 3] |= (b_bits[i] & 1) << (7 - (i & 7));
+
+	const uint8_t *x_bits = b_bits + b_field_bits;
+	uint8_t x_field = ((x_bits[0] & 1) << 3) | ((x_bits[1] & 1) << 2) |
+		((x_bits[2] & 1) << 1) | (x_bits[3] & 1);
+
+	return calc_xcrc(b_field, b_field_bits) == x_field;
+}
+
+static bool part_id_cmp(uint8_t *id1, uint8_t *id2)
+{
+	for (uint32_t i = 0; i < 5; i++)
+		if (id1[i] != id2[i])
+			return false;
+	return true;
+}
+
+burst_decoder::burst_decoder(listener *l)
+	: d_listener(l), d_cur_part(NULL), d_selected_rx_id(0), d_carrier(0), d_chase_bits(0),
+	d_watchlist(NULL), d_time(0)
+{
+	memset(&d_part_descriptor, 0, sizeof(d_part_descriptor));
+}
+
+uint32_t burst_decoder::decode_afield(uint8_t *field_data)
+{
+	uint16_t rcrc = (uint16_t)field_data[6] << 8 | field_data[7];
+	uint16_t crc = calc_rcrc(field_data, 6);
+
+	if (crc != rcrc) {
+		d_cur_part->afield_bad_crc_cnt++;
+		return 0;
+	}
+
+	uint8_t afield_header = field_data[0];
+	uint8_t ta_bits = (afield_header >> 5) & 0x07;;
+
+	uint64_t tail = 0;
+	for (uint32_t i = 1; i < 6; i++)
+		tail = (tail << 8) | field_data[i];
+
+	switch(ta_bits) {
+	case 0:
+		break;
+
+	case 1:
+		break;
+
+	case 2: // identities information on a connectionless bearer
+	case 3:
+		// The identity repeats every few frames, only look up new ones
+		if (!d_cur_part->part_id_rcvd || memcmp(d_cur_part->part_id, &field_data[1], 5) != 0) {
+			memcpy(d_cur_part->part_id, &field_data[1], 5);
+			d_cur_part->watch_actions = d_watchlist ? d_watchlist->match(d_cur_part->part_id) : 0;
+			d_cur_part->watch_reported = false;
+		}
+		d_cur_part->part_id_rcvd = true;
+		break;
+
+	case 4: // multiframe synchronization and system information (Qt) - translated every 16 frames in frame number 8
+		d_cur_part->frame_number = 8;
+		d_cur_part->qt_rcvd = true;
+		if (d_cur_part->type == PART_RFP)
+			qt_parse(tail);
+		break;
+
+	case 6:
+		mt_parse(tail);
+		break;
+
+	case 7:
+		if (d_cur_part->type == PART_RFP)
+			pt_parse(tail);
+		break;
+	}
+
+	if (((afield_header >> 1) & 7) == 0) {
+		if (!d_cur_part->voice_present) {
+			d_cur_part->voice_present = true;
+			d_cur_part->log_update = true;
+		}
+	} else {
+		if (d_cur_part->voice_present) {
+			d_cur_part->voice_present = false;
+			d_cur_part->log_update = true;
+		}
+	}
+
+	return 1;
+}
+
+// n bits of a 40 bit A-field tail, starting pos bits from its beginning
+static inline uint32_t tail_bits(uint64_t tail, unsigned pos, unsigned n)
+{
+	return (tail >> (40 - pos - n)) & ((1u << n) - 1);
+}
+
+// Qt header
+#define QT_STATIC_SYSTEM_INFO	0x0	// 0x1 as well, the last bit is NR
+#define QT_FP_CAPABILITIES	0x3
+#define QT_MULTIFRAME_NUMBER	0x6
+
+void burst_decoder::qt_parse(uint64_t tail)
+{
+	fp_system_info_t *si = &d_cur_part->system_info;
+	uint16_t carrier_bitmap;
+	uint8_t pscn;
+
+	switch (tail_bits(tail, 0, 4)) {
+	case QT_STATIC_SYSTEM_INFO:
+	case QT_STATIC_SYSTEM_INFO + 1:
+		si->slot_number = tail_bits(tail, 4, 4);
+		si->transceivers = tail_bits(tail, 11, 2) + 1;
+		si->carrier_number = tail_bits(tail, 26, 6);
+		// The first bit of the RF carriers field stands for carrier 0
+		carrier_bitmap = 0;
+		for (unsigned n = 0; n < 10; n++)
+			carrier_bitmap |= tail_bits(tail, 14 + n, 1) << n;
+		pscn = tail_bits(tail, 34, 6);
+
+		// The primary scan carrier moves every frame, only report the rest
+		if (!si->static_rcvd || si->carrier_bitmap != carrier_bitmap)
+			d_cur_part->log_update = true;
+		si->carrier_bitmap = carrier_bitmap;
+		si->primary_scan_carrier = pscn;
+		si->static_rcvd = true;
+		break;
+
+	case QT_FP_CAPABILITIES:
+		if (!si->capabilities_rcvd)
+			d_cur_part->log_update = true;
+		si->fp_capabilities = tail_bits(tail, 4, 20);
+		si->hl_capabilities = tail_bits(tail, 24, 16);
+		si->capabilities_rcvd = true;
+		break;
+
+	case QT_MULTIFRAME_NUMBER:
+		si->multiframe_number = tail_bits(tail, 16, 24);
+		si->mfn_rcvd = true;
+		break;
+	}
+}
+
+// Mt header and basic connection control commands
+#define MT_BASIC_CONNECTION_CONTROL	0x0
+#define MT_BEARER_HANDOVER_REQUEST	0x1
+#define MT_CONNECTION_HANDOVER_REQUEST	0x2
+
+void burst_decoder::mt_parse(uint64_t tail)
+{
+	if (tail_bits(tail, 0, 4) != MT_BASIC_CONNECTION_CONTROL)
+		return;
+
+	uint32_t command = tail_bits(tail, 4, 4);
+	if (command == MT_BEARER_HANDOVER_REQUEST || command == MT_CONNECTION_HANDOVER_REQUEST)
+		d_cur_part->handover_cnt++;
+}
+
+// Pt BS SDU length indications followed by MAC layer information
+#define PT_ZERO_LENGTH_PAGE	0x0
+#define PT_SHORT_PAGE		0x1
+
+// MAC layer information types carrying a bearer position
+#define PT_INFO_OTHER_BEARER		0x1
+#define PT_INFO_RECOMMENDED_BEARER	0x2
+#define PT_INFO_GOOD_RFP_BEARER		0x3
+#define PT_INFO_DUMMY_BEARER		0x4
+#define PT_INFO_CL_BEARER		0xb
+
+void burst_decoder::pt_parse(uint64_t tail)
+{
+	uint32_t length = tail_bits(tail, 1, 3);
+	if (length != PT_ZERO_LENGTH_PAGE && length != PT_SHORT_PAGE)
+		return;
+
+	fp_system_info_t *si = &d_cur_part->system_info;
+
+	switch (tail_bits(tail, 24, 4)) {
+	case PT_INFO_OTHER_BEARER:
+	case PT_INFO_RECOMMENDED_BEARER:
+	case PT_INFO_GOOD_RFP_BEARER:
+	case PT_INFO_DUMMY_BEARER:
+	case PT_INFO_CL_BEARER:
+		// SN, SP, CN
+		si->bearer_slot = tail_bits(tail, 28, 4);
+		si->bearer_carrier = tail_bits(tail, 34, 6);
+		si->bearer_rcvd = true;
+		break;
+	}
+}
+
+void burst_decoder::fill_part_info(uint32_t rx_id, part_info_t *part_info) const
+{
+	memset(part_info, 0, sizeof(*part_info));
+
+	if (d_time) {
+		part_info->timestamp = d_time;
+	} else {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		part_info->timestamp = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	}
+	part_info->carrier = d_carrier;
+	part_info->rx_id = rx_id;
+	memcpy(part_info->part_id, d_part_descriptor[rx_id].part_id, 5);
+	part_info->is_fixed_part = d_part_descriptor[rx_id].type == PART_RFP;
+	part_info->voice_present = d_part_descriptor[rx_id].voice_present;
+	part_info->packet_cnt = d_part_descriptor[rx_id].packet_cnt;
+	part_info->afield_bad_crc_cnt = d_part_descriptor[rx_id].afield_bad_crc_cnt;
+	part_info->afield_recovered_cnt = d_part_descriptor[rx_id].afield_recovered_cnt;
+	part_info->bfield_recovered_cnt = d_part_descriptor[rx_id].bfield_recovered_cnt;
+	part_info->b_field_bits = d_part_descriptor[rx_id].b_field_bits;
+	part_info->handover_cnt = d_part_descriptor[rx_id].handover_cnt;
+	part_info->freq_offset = d_part_descriptor[rx_id].freq_offset;
+	part_info->rssi = d_part_descriptor[rx_id].rssi;
+	part_info->system_info = d_part_descriptor[rx_id].system_info;
+	part_info->watch_actions = d_part_descriptor[rx_id].watch_actions;
+}
+
+/*
+ * Flip up to d_chase_bits of the least reliable X-CRC test and X-field bits
+ * of a P32 B-field to make the X-CRC match. Only the test bits are
+ * corrected in the packed b_field.
+ */
+bool burst_decoder::recover_bfield(const uint8_t *b_bits, uint8_t *b_field)
+{
+	chase_set_t set;
+	chase_set_init(&set);
+	for (unsigned i = 0; i < XCRC_TEST_BITS; i++)
+		chase_set_add(&set, d_chase_bits, i, SOFT_RELIABILITY(b_bits[xcrc_test_bit(i, B_FIELD_BITS)]));
+	for (unsigned i = 0; i < X_FIELD_BITS; i++)
+		chase_set_add(&set, d_chase_bits, XCRC_TEST_BITS + i, SOFT_RELIABILITY(b_bits[B_FIELD_BITS + i]));
+	if (set.n == 0)
+		return false;
+
+	uint16_t syndromes[CHASE_MAX_BITS];
+	for (unsigned i = 0; i < set.n; i++)
+		syndromes[i] = xcrc_syndrome(set.pos[i], B_FIELD_BITS);
+
+	const uint8_t *x_bits = b_bits + B_FIELD_BITS;
+	uint8_t x_field = ((x_bits[0] & 1) << 3) | ((x_bits[1] & 1) << 2) |
+		((x_bits[2] & 1) << 1) | (x_bits[3] & 1);
+	uint32_t mask = chase_search(syndromes, set.n, calc_xcrc(b_field) ^ x_field);
+	if (mask == 0)
+		return false;
+
+	for (unsigned i = 0; i < set.n; i++) {
+		if ((mask & (1u << i)) && set.pos[i] < XCRC_TEST_BITS) {
+			unsigned bi = xcrc_test_bit(set.pos[i], B_FIELD_BITS);
+			b_field[bi >> 3] ^= 0x80 >> (bi & 7);
+		}
+	}
+	return true;
+}
+
+/*
+ * Learn the length of the current part's bursts from their X-CRC so the
+ * receiver can cut them short, and forget it again if it stops matching.
+ */
+void burst_decoder::track_burst_length(uint32_t rx_id, const uint8_t *bits, size_t nbits)
+{
+	part_descriptor_item *part = d_cur_part;
+	const uint8_t *b_bits = bits + A_FIELD_BITS;
+
+	if (part->b_field_bits) {
+		if (nbits >= A_FIELD_BITS + part->b_field_bits + X_FIELD_BITS &&
+			xcrc_match(b_bits, part->b_field_bits)) {
+			part->xcrc_fail_cnt = 0;
+			return;
+		}
+
+		if (++part->xcrc_fail_cnt < BURST_LEN_FAIL_LIMIT)
+			return;
+
+		part->b_field_bits = 0;
+		part->b_len_hits = 0;
+		part->log_update = true;
+		d_listener->burst_length_changed(rx_id, 0);
+		return;
+	}
+
+	uint32_t b_field_bits = 0;
+	for (uint32_t i = 0; i < sizeof(b_field_sizes) / sizeof(b_field_sizes[0]); i++) {
+		if (nbits >= A_FIELD_BITS + b_field_sizes[i] + X_FIELD_BITS &&
+			xcrc_match(b_bits, b_field_sizes[i])) {
+			b_field_bits = b_field_sizes[i];
+			break;
+		}
+	}
+
+	if (b_field_bits != part->b_len_candidate) {
+		part->b_len_candidate = b_field_bits;
+		part->b_len_hits = 0;
+	}
+
+	if (b_field_bits == 0)
+		return;
+
+	uint32_t confirm = (A_FIELD_BITS + b_field_bits + X_FIELD_BITS == nbits) ?
+		BURST_LEN_CONFIRM : BURST_LEN_CONFIRM_SHORT;
+	if (++part->b_len_hits < confirm)
+		return;
+
+	part->b_field_bits = b_field_bits;
+	part->xcrc_fail_cnt = 0;
+	part->log_update = true;
+	d_listener->burst_length_changed(rx_id, A_FIELD_BITS + b_field_bits + X_FIELD_BITS);
+}
+
+void burst_decoder::part_lost(uint32_t rx_id)
+{
+	if (rx_id >= MAX_PARTS)
+		return;
+
+	part_descriptor_item *part_item = &d_part_descriptor[rx_id];
+	if (part_item->active && part_item->part_id_rcvd) {
+		part_info_t part_info;
+
+		fill_part_info(rx_id, &part_info);
+		d_listener->part_lost(part_info);
+	}
+	part_item->active = false;
+	part_item->voice_present = false;
+	part_item->log_update = false;
+	part_item->qt_rcvd = false;
+	if (part_item->part_id_rcvd)
+		d_listener->parts_changed();
+
+	// Cleare part's pair
+	if (part_item->pair != NULL) {
+		if (part_item->type == PART_PP) {
+			part_item->pair->pair = NULL;
+		} else if(part_item->type == PART_RFP) {
+			part_item->pair->voice_present = false;
+			part_item->pair->pair = NULL;
+		}
+
+		part_item->pair = NULL;
+	}
+}
+
+bool burst_decoder::decode(const burst_info_t &info, const uint8_t *bits, size_t nbits,
+	uint8_t *out, burst_result_t *result)
+{
+	uint32_t rx_id = info.rx_id;
+	uint64_t rx_seq = info.rx_seq;
+	part_type_t ptype = info.part_type;
+
+	memset(result, 0, sizeof(*result));
+
+	if (rx_id >= MAX_PARTS || nbits < A_FIELD_BITS)
+		return false;
+
+	d_cur_part = &d_part_descriptor[rx_id];
+
+	if (d_cur_part->active) {
+		uint64_t seq_diff = (rx_seq - d_cur_part->rx_seq) & 0x1F;
+
+		if (ptype == PART_RFP) {
+			d_cur_part->frame_number = (d_cur_part->frame_number + seq_diff) & 0xF;
+
+			// Update frame number for pair if available
+			if (d_cur_part->pair != NULL) {
+				d_cur_part->pair->frame_number = d_cur_part->frame_number;
+				d_cur_part->pair->rfp_fn_cor = true;
+			}
+		} else if(ptype == PART_PP) {
+			if (d_cur_part->rfp_fn_cor)
+				d_cur_part->rfp_fn_cor = false;
+			else
+				d_cur_part->frame_number = (d_cur_part->frame_number + seq_diff) & 0xF;
+		}
+
+		d_cur_part->rx_seq = rx_seq;
+		d_cur_part->packet_cnt++;
+		if (info.afield_recovered)
+			d_cur_part->afield_recovered_cnt++;
+
+		d_cur_part->freq_offset += LEVEL_AVG_WEIGHT * (info.freq_offset - d_cur_part->freq_offset);
+		if (std::isnan(d_cur_part->rssi))
+			d_cur_part->rssi = info.rssi;
+		else if (!std::isnan(info.rssi))
+			d_cur_part->rssi += LEVEL_AVG_WEIGHT * (info.rssi - d_cur_part->rssi);
+	} else {
+		// Register a new part
+		d_cur_part->active = true;
+		d_cur_part->frame_number = 0;
+		d_cur_part->rx_seq = rx_seq;
+		d_cur_part->voice_present = false;
+		d_cur_part->packet_cnt = 0;
+		d_cur_part->afield_bad_crc_cnt = 0;
+		d_cur_part->afield_recovered_cnt = info.afield_recovered ? 1 : 0;
+		d_cur_part->bfield_recovered_cnt = 0;
+		d_cur_part->handover_cnt = 0;
+		d_cur_part->freq_offset = info.freq_offset;
+		d_cur_part->rssi = info.rssi;
+		memset(&d_cur_part->system_info, 0, sizeof(d_cur_part->system_info));
+		d_cur_part->log_update = true;
+		d_cur_part->part_id_rcvd = false;
+		d_cur_part->watch_actions = 0;
+		d_cur_part->watch_reported = false;
+		d_cur_part->qt_rcvd = false;
+		d_cur_part->b_field_bits = 0;
+		d_cur_part->b_len_candidate = 0;
+		d_cur_part->b_len_hits = 0;
+		d_cur_part->type = ptype;
+		d_cur_part->pair = NULL;
+	}
+
+	// Try to find pair RFP for PP
+	if (d_cur_part->pair == NULL && d_cur_part->type == PART_PP && d_cur_part->part_id_rcvd) {
+		for (uint32_t i = 0; i < MAX_PARTS; i++) {
+			if (i != rx_id) {
+				if (d_part_descriptor[i].active) {
+					if (part_id_cmp(d_cur_part->part_id, d_part_descriptor[i].part_id)) {
+						d_cur_part->pair = &d_part_descriptor[i];
+						d_part_descriptor[i].pair = d_cur_part;
+					}
+				}
+			}
+		}
+	}
+
+	const uint8_t *in = bits;
+	uint8_t tmp_byte = 0;
+	uint32_t a_field_byte_cnt = 0;
+	uint8_t a_field[8];
+
+	// Extract A-field
+	for (uint32_t i = 0; i < A_FIELD_BITS; i++) {
+		if (i && ((i & 0x7) == 0))
+			a_field[a_field_byte_cnt++] = tmp_byte;
+		tmp_byte = (tmp_byte << 1) | (*in++ & 0x1);
+	}
+	a_field[a_field_byte_cnt] = tmp_byte;
+
+	result->afield_ok = decode_afield(a_field) != 0;
+	if (result->afield_ok && nbits > A_FIELD_BITS)
+		track_burst_length(rx_id, bits, nbits);
+
+	if (ptype == PART_RFP && d_cur_part->qt_rcvd && d_cur_part->pair != NULL)
+		d_cur_part->pair->qt_rcvd = true;
+
+	if (d_cur_part->log_update && d_cur_part->part_id_rcvd) {
+		part_info_t part_info;
+
+		d_listener->parts_changed();
+		fill_part_info(rx_id, &part_info);
+		d_listener->part_updated(part_info);
+		d_cur_part->log_update = false;
+	}
+
+	if ((d_cur_part->watch_actions & WATCH_REPORT) && !d_cur_part->watch_reported) {
+		part_info_t part_info;
+
+		fill_part_info(rx_id, &part_info);
+		d_listener->part_matched(part_info);
+		d_cur_part->watch_reported = true;
+	}
+
+	result->watch_actions = d_cur_part->watch_actions;
+	result->part_id_rcvd = d_cur_part->part_id_rcvd;
+	memcpy(result->part_id, d_cur_part->part_id, sizeof(result->part_id));
+
+	if (rx_id != d_selected_rx_id)
+		return false;
+
+	result->frame_number = d_cur_part->frame_number;
+
+	if (d_cur_part->active && d_cur_part->voice_present && d_cur_part->qt_rcvd &&
+		nbits >= P32_D_FIELD_BITS &&
+		(d_cur_part->b_field_bits == 0 || d_cur_part->b_field_bits == B_FIELD_BITS)) {
+		uint8_t b_field[B_FIELD_BYTES];
+		uint8_t tmp_byte = 0;
+		uint32_t b_field_byte_cnt = 0;
+
+		for (uint32_t i = 0; i < B_FIELD_BITS; i++) {
+			if (i && ((i & 0x7) == 0))
+				b_field[b_field_byte_cnt++] = tmp_byte;
+			tmp_byte = (tmp_byte << 1) | (*in++ & 0x1);
+		}
+
+		b_field[b_field_byte_cnt] = tmp_byte;
+
+		uint8_t xcrc = calc_xcrc(b_field);
+		uint8_t x_field = 0;
+		x_field |= ((*in++ & 0x1) << 3);
+		x_field |= ((*in++ & 0x1) << 2);
+		x_field |= ((*in++ & 0x1) << 1);
+		x_field |= (*in & 0x1);
+
+		result->b_field_present = true;
+
+		bool xcrc_ok = xcrc == x_field;
+		if (!xcrc_ok && d_chase_bits) {
+			xcrc_ok = recover_bfield(bits + A_FIELD_BITS, b_field);
+			if (xcrc_ok) {
+				d_cur_part->bfield_recovered_cnt++;
+				result->b_field_recovered = true;
+			}
+		}
+
+		if (xcrc_ok) {
+			uint32_t whitener_offset = d_cur_part->frame_number % 8;
+
+			for (uint32_t i = 0; i < B_FIELD_BYTES; i++)
+				out[i] = b_field[i] ^ scrt[whitener_offset][i % 31];
+
+			result->b_field_ok = true;
+		}
+	}
+
+	return true;
+}
+
+void burst_decoder::clear_parts(void)
+{
+	for (uint32_t i = 0; i < MAX_PARTS; i++) {
+		d_part_descriptor[i].active = false;
+		d_part_descriptor[i].log_update = true;
+		d_part_descriptor[i].part_id_rcvd = false;
+		d_part_descriptor[i].qt_rcvd = false;
+		d_part_descriptor[i].pair = NULL;
+	}
+}
+
+size_t burst_decoder::get_parts(part_info_t *parts, size_t max_parts) const
+{
+	size_t nparts = 0;
+
+	for (uint32_t rx_id = 0; rx_id < MAX_PARTS && nparts < max_parts; rx_id++) {
+		if (d_part_descriptor[rx_id].active && d_part_descriptor[rx_id].part_id_rcvd)
+			fill_part_info(rx_id, &parts[nparts++]);
+	}
+
+	return nparts;
+}
+
+} /* namespace dect2core */
@@ -0,0 +1,194 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2015 Pavel Yazev <pyazev@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_BURST_DECODER_H
+#define INCLUDED_DECT2CORE_BURST_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "burst_receiver.h"
+#include "dect2_common.h"
+#include "part_info.h"
+#include "watchlist.h"
+
+#define B_FIELD_BYTES		(B_FIELD_BITS / 8)
+#define B_FIELD_SAMPLES		(B_FIELD_BITS / 4)	// G.726 codes, 8 kHz samples
+
+// voice_record_t types
+#define VOICE_FRAME		1	// A valid B-field of the selected part
+#define VOICE_GAP		2	// Its bursts since the frame before carried none
+
+// voice_record_t flags
+#define VOICE_RECOVERED		0x01	// Frame passed the X-CRC after chase recovery
+#define VOICE_GAP_NO_VOICE	0x02	// Bursts without a B-field: silence, or no call
+#define VOICE_GAP_CRC		0x04	// B-fields failing the X-CRC
+#define VOICE_GAP_END		0x08	// The part was lost or deselected, or the carrier changed
+
+namespace dect2core {
+
+typedef struct {
+	bool afield_ok;		// R-CRC matched, possibly after recovery by the receiver
+	bool part_id_rcvd;	// The burst's part is identified, part_id is its RFPI or PMID
+	uint8_t part_id[5];
+	uint32_t watch_actions;	// WATCH_* actions for the part, 0 if not watched
+	bool b_field_present;	// The selected part sent a B-field of voice data
+	bool b_field_ok;	// Its X-CRC matched and out holds it descrambled
+	bool b_field_recovered;	// Only after flipping unreliable bits
+	uint8_t frame_number;
+} burst_result_t;
+
+/*
+ * The selected part's voice: a record for each valid B-field, and once it
+ * has sent one, a gap record before the next telling why the bursts in
+ * between carried none, or that the stream ended.
+ */
+typedef struct {
+	uint8_t type;			// VOICE_FRAME or VOICE_GAP
+	uint8_t rx_id;
+	uint8_t frame_number;		// Of the frame, or of the gap's first burst
+	uint8_t flags;			// VOICE_RECOVERED or VOICE_GAP_*
+	uint32_t bursts;		// Gap: bursts received without a valid B-field
+	uint64_t sample_index;		// Receiver sample of the frame, or of the gap's first burst
+	uint8_t b_field[B_FIELD_BYTES];	// Frame: the descrambled B-field, 80 G.726 codes high nibble first
+} voice_record_t;
+
+/*
+ * Keeps the table of parts seen by the receiver, decodes A-fields and
+ * extracts the B-field of the selected part.
+ */
+class burst_decoder
+{
+public:
+	class listener
+	{
+	public:
+		virtual ~listener() {}
+		virtual void part_updated(const part_info_t &part_info) = 0;
+		virtual void part_lost(const part_info_t &part_info) = 0;
+		// An identified part matched a watchlist pattern with WATCH_REPORT,
+		// once per identity
+		virtual void part_matched(const part_info_t &part_info) = 0;
+		// The set of active, identified parts or their attributes changed
+		virtual void parts_changed(void) = 0;
+		// Bursts of rx_id that carry a B-field are d_field_bits long, 0 if
+		// that is no longer known. Meant for burst_receiver::set_part_length().
+		virtual void burst_length_changed(uint32_t rx_id, uint32_t d_field_bits) = 0;
+	};
+
+private:
+	typedef struct part_descriptor_item {
+		bool active;
+		bool voice_present;
+		bool log_update;
+		bool part_id_rcvd;
+		bool qt_rcvd;
+		bool watch_reported;
+
+		bool rfp_fn_cor; // set true if frame number was corrected from RFP part
+
+		uint8_t frame_number;
+		uint64_t rx_seq;
+		uint8_t part_id[5];
+		uint32_t watch_actions;	// Looked up when part_id changes
+		part_type_t type;
+
+		uint64_t packet_cnt;
+		uint64_t afield_bad_crc_cnt;
+		uint64_t afield_recovered_cnt;
+		uint64_t bfield_recovered_cnt;
+		uint64_t handover_cnt;
+
+		float freq_offset;	// Smoothed over the part's bursts
+		float rssi;
+
+		fp_system_info_t system_info;
+
+		uint32_t b_field_bits;		// Confirmed B-field length, 0 if unknown
+		uint32_t b_len_candidate;
+		uint32_t b_len_hits;
+		uint32_t xcrc_fail_cnt;
+
+		struct part_descriptor_item *pair;
+	} part_descriptor_item;
+
+	listener *d_listener;
+
+	part_descriptor_item d_part_descriptor[MAX_PARTS];
+	part_descriptor_item *d_cur_part;
+	uint32_t d_selected_rx_id;
+	uint32_t d_carrier;
+	unsigned d_chase_bits;
+	const watchlist *d_watchlist;
+	uint64_t d_time;
+
+	bool recover_bfield(const uint8_t *b_bits, uint8_t *b_field);
+	uint32_t decode_afield(uint8_t *field_data);
+	void qt_parse(uint64_t tail);
+	void mt_parse(uint64_t tail);
+	void pt_parse(uint64_t tail);
+	void track_burst_length(uint32_t rx_id, const uint8_t *bits, size_t nbits);
+	void fill_part_info(uint32_t rx_id, part_info_t *part_info) const;
+
+public:
+	explicit burst_decoder(listener *l);
+
+	/*
+	 * Decode one burst of nbits D-field bits (one per byte) announced by
+	 * the receiver: P00, P08, P32 or P80. Returns true if the burst
+	 * belongs to the selected part, and then writes its descrambled
+	 * B-field, B_FIELD_BYTES bytes, to out if result->b_field_ok. Only
+	 * P32 B-fields are extracted, as 32 kbit/s G.726 voice fills exactly
+	 * one per frame; for P08 and P80 bursts b_field_ok is always false.
+	 * The A-field and part fields of result are filled for every burst.
+	 */
+	bool decode(const burst_info_t &info, const uint8_t *bits, size_t nbits,
+		uint8_t *out, burst_result_t *result);
+
+	// The receiver lost track of rx_id
+	void part_lost(uint32_t rx_id);
+
+	void select_rx_part(uint32_t rx_id) { d_selected_rx_id = rx_id; }
+	uint32_t selected_rx_part(void) const { return d_selected_rx_id; }
+
+	// Carrier index reported with part events, only meaningful to the caller
+	void set_carrier(uint32_t carrier) { d_carrier = carrier; }
+
+	// Try flipping up to k unreliable bits of B-fields failing the X-CRC,
+	// 0 disables. The bits passed to decode() must be soft.
+	void set_chase_bits(unsigned k) { d_chase_bits = k; }
+
+	// Match identified parts against list, NULL disables. The list must
+	// outlive the decoder.
+	void set_watchlist(const watchlist *list) { d_watchlist = list; }
+
+	// Timestamp of the part events that follow, ns since the epoch, for
+	// recorded input. 0, the default, stamps them with the current time.
+	void set_time(uint64_t ns) { d_time = ns; }
+
+	void clear_parts(void);
+
+	// Copy the table of currently active, identified parts
+	size_t get_parts(part_info_t *parts, size_t max_parts) const;
+};
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_BURST_DECODER_H */
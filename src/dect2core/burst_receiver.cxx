@@ -0,0 +1,697 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2015 Pavel Yazev <pyazev@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "burst_receiver.h"
+#include "chase.h"
+#include "crc.h"
+#include "phase_discriminator.h"
+#include "squelch.h"
+
+namespace dect2core {
+
+// Fraction of the measured timing error corrected per bit
+#define TIMING_LOOP_GAIN	0.1f
+
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+class burst_receiver_impl : public burst_receiver
+{
+private:
+	enum {
+		SMPL_BUF_LEN = S_FIELD_BITS * SPS,	// Power of two, holds the S-field
+		TIME_TOL_SMPL = TIME_TOL * SPS / 4,
+	};
+	static const uint64_t INTER_FRAME_TIME = (uint64_t)FRAME_SYMBOLS * SPS;
+	static const uint64_t PART_TIMEOUT = 4 * INTER_FRAME_TIME;
+
+	typedef enum {
+		_WAIT_BEGIN_,
+		_WAIT_END_,
+		_POST_WAIT_
+	} sync_state_t;
+
+	listener *d_listener;
+	packet_format_t d_format;
+
+	uint32_t d_rx_bits_buf[SPS];
+	uint32_t d_rx_bits_buf_index;
+
+	float d_smpl_buf[SMPL_BUF_LEN];
+	float d_power_buf[SMPL_BUF_LEN];
+	uint32_t d_smpl_buf_index;
+
+	uint32_t d_begin_pos;
+	uint32_t d_end_pos;
+	float d_sync_level;
+	float d_rel_scale;	// Sample magnitude to soft bit reliability
+	float d_freq_scale;	// Mean discriminator output to Hz
+	float d_freq_offset;
+	float d_rssi;
+
+	bool d_soft;
+	unsigned d_chase_bits;
+
+	double d_strobe;	// Absolute sample time of the next bit
+	float d_prev_smpl;
+
+	sync_state_t d_sync_state;
+	part_type_t d_part_type;
+
+	uint32_t d_out_bit_cnt;
+	uint32_t d_burst_len;
+	uint8_t d_afield[A_FIELD_BITS];	// Soft A-field bits sliced so far
+	uint32_t d_afield_pending;	// Of an accepted A-field, bits not yet output
+	uint64_t d_sync_time;	// Sample counter at the end of the S-field
+
+	uint64_t d_inc_smpl_cnt;
+
+	uint32_t d_part_activity;
+	uint64_t d_part_deadline;	// part_deadline() of the parts active now
+	uint64_t d_part_time[MAX_PARTS];
+	uint32_t d_part_seq[MAX_PARTS];
+	uint32_t d_part_len[MAX_PARTS];
+	int32_t d_cur_part_rx_id;
+
+	int check_part_activity(void);
+	uint64_t part_deadline(void) const;
+	int register_part(uint64_t sync_time, bool new_part);
+	int find_best_smpl_point(void);
+	float sync_power(void) const;
+	void skip(size_t n, const float *power);
+	size_t hunt_sync(const float *in, size_t n, const float *power);
+	float interpolate(double t) const;
+	bool recover_afield(uint8_t *a_field);
+	size_t flush_afield(uint8_t *out, size_t noutput);
+
+public:
+	burst_receiver_impl(listener *l, packet_format_t format)
+		: d_listener(l), d_format(format), d_soft(false), d_chase_bits(0)
+	{
+		// The discriminator output is the phase the signal loses over
+		// its lag
+		d_freq_scale = -(float)(SPS * SYMBOL_RATE / (2 * M_PI * discriminator_lag(SPS)));
+		reset(0);
+	}
+
+	unsigned sps(void) const { return SPS; }
+	packet_format_t packet_format(void) const { return d_format; }
+
+	void process(const float *in, size_t ninput, uint8_t *out, size_t noutput,
+		size_t *nconsumed, size_t *nproduced, const float *power);
+	void reset(uint64_t sample_index);
+	uint64_t sample_count(void) const { return d_inc_smpl_cnt; }
+	void set_part_length(uint32_t rx_id, uint32_t d_field_bits);
+	void set_soft_output(bool soft) { d_soft = soft; }
+	void set_chase_bits(unsigned k) { d_chase_bits = std::min(k, (unsigned)CHASE_MAX_BITS); }
+};
+
+/*
+ * Check for parts activity
+ * Return:
+ *     Part RX ID - if there is no activity for a part
+ *     -1 - otherwise
+ */
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+int burst_receiver_impl<SPS, D_FIELD_BITS>::check_part_activity(void)
+{
+	if (d_part_activity) {
+		uint32_t j = 0;
+		uint32_t part_mask = 1;
+		while (part_mask <= d_part_activity) {
+			if (d_part_activity & part_mask) {
+				if (d_inc_smpl_cnt - d_part_time[j] > PART_TIMEOUT) {
+					// Release part
+					d_part_activity &= ~part_mask;
+					d_part_deadline = part_deadline();
+					return j;
+				}
+			}
+			part_mask <<= 1;
+			j++;
+		}
+	}
+	return -1;
+}
+
+// First sample on which check_part_activity() finds a part gone, UINT64_MAX
+// if there are none
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+uint64_t burst_receiver_impl<SPS, D_FIELD_BITS>::part_deadline(void) const
+{
+	uint64_t deadline = UINT64_MAX;
+	for (uint32_t j = 0; j < MAX_PARTS; j++) {
+		if (d_part_activity & (1u << j))
+			deadline = std::min(deadline, d_part_time[j] + PART_TIMEOUT + 1);
+	}
+	return deadline;
+}
+
+/*
+ * If there are several DECT parts on air we need to keep track each in correct way.
+ * This function does this by taking into account time intervals (based on incomming sample counter)
+ * between received bursts. sync_time is the sample counter at the end of the burst's S-field.
+ * A new part is only assigned if new_part is set.
+ * Return:
+ *     Part RX ID - if apropriate part is found or a new one assigned
+ *     -1 - otherwise
+ */
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+int burst_receiver_impl<SPS, D_FIELD_BITS>::register_part(uint64_t sync_time, bool new_part)
+{
+	if (d_part_activity) {
+		uint32_t j = 0;
+		uint32_t part_mask = 1;
+		uint32_t seq;
+
+		while (j < MAX_PARTS) {
+			if (d_part_activity & part_mask) {
+				uint64_t ltmp = (sync_time - d_part_time[j]) % INTER_FRAME_TIME;
+				if (ltmp < TIME_TOL_SMPL) {
+					seq = (sync_time - d_part_time[j]) / INTER_FRAME_TIME;
+					break;
+				} else if (INTER_FRAME_TIME - ltmp <= TIME_TOL_SMPL) {
+					seq = 1 + (sync_time - d_part_time[j]) / INTER_FRAME_TIME;
+					break;
+				}
+			}
+
+			part_mask <<= 1;
+			j++;
+		}
+
+		if (j < MAX_PARTS) {
+			d_part_time[j] = sync_time;
+			d_part_seq[j] = (d_part_seq[j] + seq) & 0x1F;
+			return j;
+		} else if (new_part) {
+			// Adding a new active part
+			j = 0;
+			part_mask = 1;
+			while (j < MAX_PARTS) {
+				if (d_part_activity & part_mask) {
+					part_mask <<= 1;
+					j++;
+				} else {
+					d_part_activity |= part_mask;
+					break;
+				}
+			}
+
+			if (j < MAX_PARTS) {
+				d_part_time[j] = sync_time;
+				d_part_seq[j] = 0;
+				d_part_len[j] = D_FIELD_BITS;
+				return j;
+			} else {
+				return -1;
+			}
+		} else {
+			return -1;
+		}
+	} else if (new_part) {
+		// Adding the first active part
+		d_part_time[0] = sync_time;
+		d_part_seq[0] = 0;
+		d_part_len[0] = D_FIELD_BITS;
+		d_part_activity = 1;
+		return 0;
+	} else {
+		return -1;
+	}
+}
+
+
+/*
+ * Pick the sample point with the widest eye over the S-field, returns the
+ * number of samples it lies before d_end_pos
+ */
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+int burst_receiver_impl<SPS, D_FIELD_BITS>::find_best_smpl_point(void)
+{
+	float max_val = 0.0;
+	uint32_t max_index = d_begin_pos;
+	while (1) {
+		uint32_t index = d_begin_pos;
+
+		float acc = 0.0;
+		for (uint32_t j = 0; j < S_FIELD_BITS; j++) {
+			acc += std::fabs(d_smpl_buf[index]);
+			index = (index - SPS) & (SMPL_BUF_LEN - 1);
+		}
+
+		if (acc > max_val) {
+			max_val = acc;
+			max_index = d_begin_pos;
+		}
+
+		if (d_begin_pos == d_end_pos)
+			break;
+
+		d_begin_pos = (d_begin_pos + 1) & (SMPL_BUF_LEN - 1);
+	}
+
+	d_sync_level = max_val / S_FIELD_BITS;
+
+	// The S-field has as many ones as zeros, what is left of its mean is
+	// the carrier offset
+	uint32_t index = max_index;
+	float sum = 0.0;
+	for (uint32_t j = 0; j < S_FIELD_BITS; j++) {
+		sum += d_smpl_buf[index];
+		index = (index - SPS) & (SMPL_BUF_LEN - 1);
+	}
+	d_freq_offset = sum / S_FIELD_BITS * d_freq_scale;
+
+	return (d_end_pos - max_index) & (SMPL_BUF_LEN - 1);
+}
+
+// Mean power over the sample buffer, which holds the S-field, in dB
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+float burst_receiver_impl<SPS, D_FIELD_BITS>::sync_power(void) const
+{
+	float sum = 0.0;
+	for (uint32_t i = 0; i < SMPL_BUF_LEN; i++)
+		sum += d_power_buf[i];
+
+	return 10.0f * std::log10(sum / SMPL_BUF_LEN + 1e-20f);
+}
+
+// Linear interpolation at absolute sample time t, which must lie within
+// the sample buffer and not after the current sample
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+float burst_receiver_impl<SPS, D_FIELD_BITS>::interpolate(double t) const
+{
+	uint64_t i0 = (uint64_t)t;
+	float frac = (float)(t - i0);
+	uint32_t index = (d_smpl_buf_index - (uint32_t)(d_inc_smpl_cnt - i0)) & (SMPL_BUF_LEN - 1);
+	float x0 = d_smpl_buf[index];
+	float x1 = d_smpl_buf[(index + 1) & (SMPL_BUF_LEN - 1)];
+
+	return x0 + frac * (x1 - x0);
+}
+
+/*
+ * Flip up to d_chase_bits of the least reliable A-field bits to make the
+ * R-CRC match, in d_afield and in the packed a_field
+ */
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+bool burst_receiver_impl<SPS, D_FIELD_BITS>::recover_afield(uint8_t *a_field)
+{
+	chase_set_t set;
+	chase_set_init(&set);
+	for (unsigned i = 0; i < A_FIELD_BITS; i++)
+		chase_set_add(&set, d_chase_bits, i, SOFT_RELIABILITY(d_afield[i]));
+	if (set.n == 0)
+		return false;
+
+	uint16_t syndromes[CHASE_MAX_BITS];
+	for (unsigned i = 0; i < set.n; i++)
+		syndromes[i] = rcrc_syndrome(set.pos[i]);
+
+	uint16_t syndrome = calc_rcrc(a_field, 6) ^ ((uint16_t)a_field[6] << 8 | a_field[7]);
+	uint32_t mask = chase_search(syndromes, set.n, syndrome);
+	if (mask == 0)
+		return false;
+
+	for (unsigned i = 0; i < set.n; i++) {
+		if (mask & (1u << i)) {
+			unsigned pos = set.pos[i];
+			d_afield[pos] ^= 1;
+			a_field[pos >> 3] ^= 0x80 >> (pos & 7);
+		}
+	}
+	return true;
+}
+
+/*
+ * The A-field is only known to start a burst once all of it is in, then
+ * it goes out before anything else, over as many calls as the output
+ * space takes. Returns the bits written.
+ */
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+size_t burst_receiver_impl<SPS, D_FIELD_BITS>::flush_afield(uint8_t *out, size_t noutput)
+{
+	size_t n = std::min((size_t)d_afield_pending, noutput);
+	const uint8_t *bits = d_afield + (A_FIELD_BITS - d_afield_pending);
+
+	for (size_t i = 0; i < n; i++)
+		out[i] = d_soft ? bits[i] : (bits[i] & 1);
+	d_afield_pending -= n;
+	return n;
+}
+
+/*
+ * Pass over n squelched samples while waiting for a sync: only the sample
+ * counter, and with it part timing, moves on. The last of them go into the
+ * sample buffer as zeros, as they would within a burst, so a sync right
+ * after is measured without samples from before the squelch.
+ */
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+void burst_receiver_impl<SPS, D_FIELD_BITS>::skip(size_t n, const float *power)
+{
+	for (uint32_t i = 0; i < SPS; i++)
+		d_rx_bits_buf[i] = 0;
+	for (size_t i = (n > SMPL_BUF_LEN) ? n - SMPL_BUF_LEN : 0; i < n; i++) {
+		uint32_t index = (d_smpl_buf_index + i) & (SMPL_BUF_LEN - 1);
+		d_smpl_buf[index] = 0.0f;
+		if (power)
+			d_power_buf[index] = power[i];
+	}
+	d_smpl_buf_index = (d_smpl_buf_index + n) & (SMPL_BUF_LEN - 1);
+	d_rx_bits_buf_index = (d_rx_bits_buf_index + n) & (SPS - 1);
+
+	// Parts time out on the very sample, one per sample, as in process()
+	uint64_t end = d_inc_smpl_cnt + n;
+	while (d_part_deadline < end) {
+		d_inc_smpl_cnt = std::max(d_inc_smpl_cnt, d_part_deadline);
+		int32_t lost_id = check_part_activity();
+		if (lost_id >= 0)
+			d_listener->part_lost(lost_id);
+		d_inc_smpl_cnt++;
+	}
+	d_inc_smpl_cnt = end;
+}
+
+/*
+ * Take in up to n samples while waiting for a sync, the way process() does
+ * but without its other states. Stops after the sample that completes a
+ * sync or before a squelched one. Returns the samples taken.
+ */
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+size_t burst_receiver_impl<SPS, D_FIELD_BITS>::hunt_sync(const float *in, size_t n, const float *power)
+{
+	uint32_t bits_index = d_rx_bits_buf_index;
+	uint32_t smpl_index = d_smpl_buf_index;
+
+	size_t i = 0;
+	while (i < n) {
+		float x = in[i];
+		if (is_squelched(x))
+			break;
+
+		uint32_t rx_bits = (d_rx_bits_buf[bits_index] << 1) | ((x >= 0) ? 0 : 1);
+		d_rx_bits_buf[bits_index] = rx_bits;
+		d_smpl_buf[smpl_index] = x;
+		if (power)
+			d_power_buf[smpl_index] = power[i];
+		i++;
+
+		bool rfp = (rx_bits == (uint32_t)RFP_SYNC_FIELD);
+		bool pp = (rx_bits == ~(uint32_t)RFP_SYNC_FIELD);
+		if (rfp || pp) {
+			d_part_type = rfp ? PART_RFP : PART_PP;
+			d_begin_pos = smpl_index;
+			d_sync_state = _WAIT_END_;
+		}
+
+		smpl_index = (smpl_index + 1) & (SMPL_BUF_LEN - 1);
+		bits_index = (bits_index + 1) & (SPS - 1);
+
+		if (rfp || pp)
+			break;
+	}
+
+	d_rx_bits_buf_index = bits_index;
+	d_smpl_buf_index = smpl_index;
+	d_inc_smpl_cnt += i;
+
+	return i;
+}
+
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+void burst_receiver_impl<SPS, D_FIELD_BITS>::process(const float *in, size_t ninput, uint8_t *out, size_t noutput,
+	size_t *nconsumed, size_t *nproduced, const float *power)
+{
+	bool sync_detected;
+
+	size_t ii = 0;
+	size_t oo = flush_afield(out, noutput);
+	out += oo;
+
+	while (ii < ninput && oo < noutput) {
+		// Up to the next part timeout, a wait for a sync needs nothing else
+		if (d_sync_state == _WAIT_BEGIN_ && d_inc_smpl_cnt < d_part_deadline) {
+			size_t n = (size_t)std::min((uint64_t)(ninput - ii), d_part_deadline - d_inc_smpl_cnt);
+			n = hunt_sync(in, n, power);
+			in += n;
+			if (power)
+				power += n;
+			ii += n;
+			if (n > 0)
+				continue;
+		}
+
+		// Squelched stretches can't hold a sync, skip them as a whole. A
+		// burst already started gets zeros instead.
+		float x = *in;
+		if (is_squelched(x)) {
+			if (d_sync_state == _WAIT_BEGIN_) {
+				size_t run = 1;
+				while (ii + run < ninput && is_squelched(in[run]))
+					run++;
+				skip(run, power);
+				in += run;
+				if (power)
+					power += run;
+				ii += run;
+				continue;
+			}
+			x = 0.0f;
+		}
+
+		// Detect RX bit
+		uint32_t rx_bit = (x >= 0) ? 0 : 1;
+		d_rx_bits_buf[d_rx_bits_buf_index] = (d_rx_bits_buf[d_rx_bits_buf_index] << 1) | rx_bit;
+		d_smpl_buf[d_smpl_buf_index] = x; // save samples in cyrcular buffer to search the best sample point later
+		in++;
+		if (power)
+			d_power_buf[d_smpl_buf_index] = *power++;
+
+		switch (d_sync_state) {
+		case _WAIT_BEGIN_:
+			// Perform SYNC detect.
+			// Because we have several samples per symbol there may be several positions where SYNC can be detected.
+			// So we check interval and then look for the best sample point.
+			sync_detected = ((d_rx_bits_buf[d_rx_bits_buf_index] ^ (uint32_t)RFP_SYNC_FIELD) == 0);
+
+			if (sync_detected) {
+				d_part_type = PART_RFP;
+			} else {
+				sync_detected = ((d_rx_bits_buf[d_rx_bits_buf_index] ^ (~(uint32_t)RFP_SYNC_FIELD)) == 0);
+				if (sync_detected)
+					d_part_type = PART_PP;
+			}
+
+
+			if (sync_detected) {
+				d_begin_pos = d_smpl_buf_index;
+				d_sync_state = _WAIT_END_;
+			}
+			break;
+
+		case _WAIT_END_:
+			if (d_part_type == PART_RFP)
+				sync_detected = ((d_rx_bits_buf[d_rx_bits_buf_index] ^ (uint32_t)RFP_SYNC_FIELD) == 0);
+			else if (d_part_type == PART_PP)
+				sync_detected = ((d_rx_bits_buf[d_rx_bits_buf_index] ^ (~(uint32_t)RFP_SYNC_FIELD)) == 0);
+			else
+				sync_detected = false;
+
+			if (!sync_detected) {
+				d_end_pos = (d_smpl_buf_index - 1) & (SMPL_BUF_LEN - 1);
+
+				// Start timing from the best sample position, the first
+				// D-field bit is one symbol after the last S-field bit
+				int corr = find_best_smpl_point();
+				d_prev_smpl = d_smpl_buf[(d_end_pos - corr) & (SMPL_BUF_LEN - 1)];
+				d_rel_scale = (d_sync_level > 0) ? SOFT_NOMINAL / d_sync_level : 0;
+				d_strobe = (double)(d_inc_smpl_cnt - 1 - corr) + SPS;
+				d_rssi = power ? sync_power() : NAN;
+
+				// The part is registered once its A-field is in
+				d_sync_time = d_inc_smpl_cnt;
+				d_out_bit_cnt = 0;
+				d_sync_state = _POST_WAIT_;
+			}
+			break;
+
+		case _POST_WAIT_:
+			// Receive packet payload once the samples around the next
+			// strobe are in
+			if ((uint64_t)d_strobe + 1 <= d_inc_smpl_cnt) {
+				float smpl = interpolate(d_strobe);
+				float mid = interpolate(d_strobe - SPS / 2.0);
+
+				// Gardner detector, positive when sampling late
+				float err = (smpl - d_prev_smpl) * mid;
+				if (d_sync_level > 0)
+					err /= d_sync_level * d_sync_level;
+				if (err > 1.0f)
+					err = 1.0f;
+				else if (err < -1.0f)
+					err = -1.0f;
+
+				d_strobe += SPS - TIMING_LOOP_GAIN * err * SPS / 4;
+				d_prev_smpl = smpl;
+
+				uint8_t bit = (smpl >= 0) ? 0 : 1;
+				if (d_soft || d_chase_bits) {
+					unsigned rel = (unsigned)(std::fabs(smpl) * d_rel_scale);
+					bit = SOFT_BIT(bit, std::min(rel, (unsigned)SOFT_MAX));
+				}
+
+				if (d_out_bit_cnt < A_FIELD_BITS) {
+					d_afield[d_out_bit_cnt] = bit;
+					if (++d_out_bit_cnt < A_FIELD_BITS)
+						break;
+
+					// Bursts that don't follow a known part need a valid
+					// R-CRC to take a part slot
+					uint8_t a_field[A_FIELD_BITS / 8] = { 0 };
+					for (int i = 0; i < A_FIELD_BITS; i++)
+						a_field[i >> 3] = (a_field[i >> 3] << 1) | (d_afield[i] & 1);
+					bool crc_ok = calc_rcrc(a_field, 6) == ((uint16_t)a_field[6] << 8 | a_field[7]);
+
+					bool recovered = false;
+					if (!crc_ok && d_chase_bits)
+						crc_ok = recovered = recover_afield(a_field);
+
+					d_cur_part_rx_id = register_part(d_sync_time, crc_ok);
+					d_part_deadline = part_deadline();
+					if (d_cur_part_rx_id < 0) {
+						d_sync_state = _WAIT_BEGIN_;
+						break;
+					}
+
+					// BA bits 111: no B-field
+					if (((a_field[0] >> 1) & 0x7) == 0x7)
+						d_burst_len = P00_D_FIELD_BITS;
+					else
+						d_burst_len = d_part_len[d_cur_part_rx_id];
+
+					burst_info_t info;
+					info.rx_id = d_cur_part_rx_id;
+					info.rx_seq = d_part_seq[d_cur_part_rx_id];
+					info.part_type = d_part_type;
+					info.length = d_burst_len;
+					info.sample_index = d_part_time[d_cur_part_rx_id];
+					info.afield_recovered = recovered;
+					info.freq_offset = d_freq_offset;
+					info.rssi = d_rssi;
+					d_listener->burst_start(oo, info);
+
+					d_afield_pending = A_FIELD_BITS;
+					size_t n = flush_afield(out, noutput - oo);
+					out += n;
+					oo += n;
+				} else {
+					*out++ = d_soft ? bit : (bit & 1);
+					oo++;
+					d_out_bit_cnt++;
+				}
+
+				if (d_out_bit_cnt == d_burst_len)
+					d_sync_state = _WAIT_BEGIN_;
+			}
+			break;
+		}
+
+		// Check parts activity and inform packet decoder if a part becomes inactive
+		if (d_inc_smpl_cnt >= d_part_deadline) {
+			int32_t lost_id = check_part_activity();
+			if (lost_id >= 0)
+				d_listener->part_lost(lost_id);
+		}
+
+		d_smpl_buf_index = (d_smpl_buf_index + 1 ) & (SMPL_BUF_LEN - 1);
+		d_rx_bits_buf_index = (d_rx_bits_buf_index + 1) & (SPS - 1);
+
+		d_inc_smpl_cnt++; // Increase incomming samples counter
+
+		ii++;
+	}
+
+	*nconsumed = ii;
+	*nproduced = oo;
+}
+
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+void burst_receiver_impl<SPS, D_FIELD_BITS>::reset(uint64_t sample_index)
+{
+	for (uint32_t i = 0; i < SPS; i++)
+		d_rx_bits_buf[i] = 0;
+	d_rx_bits_buf_index = sample_index & (SPS - 1);
+	d_smpl_buf_index = sample_index & (SMPL_BUF_LEN - 1);
+	d_sync_state = _WAIT_BEGIN_;
+	d_afield_pending = 0;
+
+	d_inc_smpl_cnt = sample_index;
+
+	d_part_activity = 0;
+	d_part_deadline = UINT64_MAX;
+}
+
+template <unsigned SPS, uint32_t D_FIELD_BITS>
+void burst_receiver_impl<SPS, D_FIELD_BITS>::set_part_length(uint32_t rx_id, uint32_t d_field_bits)
+{
+	if (rx_id >= MAX_PARTS)
+		return;
+
+	if (d_field_bits == 0 || d_field_bits > D_FIELD_BITS)
+		d_part_len[rx_id] = D_FIELD_BITS;
+	else
+		d_part_len[rx_id] = std::max(d_field_bits, (uint32_t)P00_D_FIELD_BITS);
+}
+
+uint32_t burst_receiver::d_field_bits(packet_format_t format)
+{
+	switch (format) {
+	case PACKET_P00: return P00_D_FIELD_BITS;
+	case PACKET_P80: return P80_D_FIELD_BITS;
+	default:         return P32_D_FIELD_BITS;
+	}
+}
+
+template <unsigned SPS>
+static burst_receiver *make_sps(burst_receiver::listener *l, burst_receiver::packet_format_t format)
+{
+	switch (format) {
+	case burst_receiver::PACKET_P00:
+		return new burst_receiver_impl<SPS, P00_D_FIELD_BITS>(l, format);
+	case burst_receiver::PACKET_P80:
+		return new burst_receiver_impl<SPS, P80_D_FIELD_BITS>(l, format);
+	default:
+		return new burst_receiver_impl<SPS, P32_D_FIELD_BITS>(l, format);
+	}
+}
+
+burst_receiver *burst_receiver::make(listener *l, unsigned sps, packet_format_t format)
+{
+	switch (sps) {
+	case 2: return make_sps<2>(l, format);
+	case 4: return make_sps<4>(l, format);
+	case 8: return make_sps<8>(l, format);
+	default: return NULL;
+	}
+}
+
+} /* namespace dect2core */
@@ -0,0 +1,122 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2015 Pavel Yazev <pyazev@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_BURST_RECEIVER_H
+#define INCLUDED_DECT2CORE_BURST_RECEIVER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "dect2_common.h"
+#include "part_info.h"
+
+namespace dect2core {
+
+typedef struct {
+	uint32_t rx_id;
+	uint32_t rx_seq;	// Frames since the part was registered, modulo 32
+	part_type_t part_type;
+	uint32_t length;	// D-field bits that follow
+	uint64_t sample_index;	// Input sample at the end of the S-field
+	bool afield_recovered;	// The R-CRC only matched after flipping unreliable bits
+	float freq_offset;	// Carrier frequency offset over the S-field, Hz
+	float rssi;		// Mean power over the S-field, dBFS, NAN without power input
+} burst_info_t;
+
+/*
+ * Searches the discriminator output (2, 4 or 8 samples per bit) for the
+ * DECT S-field, keeps track of the parts on air and slices the D-field bits
+ * that follow. Symbol timing starts from the best S-field sample point and
+ * is tracked over the D-field by a Gardner loop.
+ *
+ * The S-field, half ones and half zeros, also gives the carrier frequency
+ * offset as the mean discriminator output at the chosen sample point and,
+ * if the sample power is passed along, the burst's signal strength.
+ *
+ * The A-field is sliced before a burst is announced. Bursts that don't
+ * follow the timing of a known part only take a part slot if its R-CRC is
+ * valid, others are dropped. Bursts are cut to their real length: those
+ * without a B-field end after the A-field and the others after the length
+ * set for their part, by default the longest the packet format allows.
+ *
+ * The implementation is specialised at compile time for each samples per
+ * symbol and packet format combination, make() picks one at runtime.
+ */
+class burst_receiver
+{
+public:
+	class listener
+	{
+	public:
+		virtual ~listener() {}
+		// The burst's first bit is out[out_offset] of the current process() call
+		virtual void burst_start(size_t out_offset, const burst_info_t &info) = 0;
+		virtual void part_lost(uint32_t rx_id) = 0;
+	};
+
+	typedef enum {
+		PACKET_P00,	// A-field only
+		PACKET_P32,	// Up to full slot
+		PACKET_P80,	// Up to double slot
+	} packet_format_t;
+
+	// Returns NULL if sps isn't 2, 4 or 8
+	static burst_receiver *make(listener *l, unsigned sps = 4, packet_format_t format = PACKET_P32);
+
+	// Longest D-field of a packet format
+	static uint32_t d_field_bits(packet_format_t format);
+
+	virtual ~burst_receiver() {}
+
+	virtual unsigned sps(void) const = 0;
+	virtual packet_format_t packet_format(void) const = 0;
+
+	/*
+	 * Consume up to ninput discriminator samples and produce up to noutput
+	 * bits (one per byte, soft bits as described in chase.h if enabled).
+	 * Stops when either side is exhausted; a burst's A-field, which only
+	 * goes out once all of it is in, is spread over calls if need be.
+	 * power, if not NULL, holds the power of the same ninput samples.
+	 */
+	virtual void process(const float *in, size_t ninput, uint8_t *out, size_t noutput,
+		size_t *nconsumed, size_t *nproduced, const float *power = NULL) = 0;
+
+	// Forget all parts and start counting input samples at sample_index,
+	// as if that many had gone before
+	virtual void reset(uint64_t sample_index = 0) = 0;
+
+	// Input samples consumed so far, during listener calls the current one
+	virtual uint64_t sample_count(void) const = 0;
+
+	// D-field bits of rx_id's bursts that carry a B-field, 0 restores the
+	// default. Forgotten when the part is lost.
+	virtual void set_part_length(uint32_t rx_id, uint32_t d_field_bits) = 0;
+
+	// Output soft bits instead of hard ones
+	virtual void set_soft_output(bool soft) = 0;
+
+	// Try flipping up to k unreliable bits of A-fields failing the R-CRC,
+	// 0 disables
+	virtual void set_chase_bits(unsigned k) = 0;
+};
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_BURST_RECEIVER_H */
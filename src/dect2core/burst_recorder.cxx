@@ -0,0 +1,356 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "burst_recorder.h"
+
+namespace dect2core {
+
+#define TRIGGER_RING_LEN	1024
+#define META_INTERVAL		5	// Seconds between metadata rewrites
+
+burst_recorder *burst_recorder::open(const char *path, const config_t &config)
+{
+	std::string data_path = std::string(path) + ".sigmf-data";
+
+	int fd = ::open(data_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return NULL;
+
+	return new burst_recorder(config, path, fd);
+}
+
+burst_recorder::burst_recorder(const config_t &config, const char *path, int data_fd)
+	: d_config(config), d_meta_path(std::string(path) + ".sigmf-meta"), d_data_fd(data_fd),
+	d_head(0), d_triggers(TRIGGER_RING_LEN), d_watch_filter(false), d_running(true),
+	d_pushed_cnt(0), d_handled_cnt(0), d_written_cnt(0), d_dropped_cnt(0), d_flushing(false),
+	d_data_items(0), d_global_base(0), d_recorded_end(0), d_segment_start(0), d_segment_data_start(0),
+	d_frequency(config.frequency),
+	d_meta_dirty(true), d_meta_time(0)
+{
+	uint64_t ring_items = 1;
+	while (ring_items < config.ring_len * config.samp_rate)
+		ring_items <<= 1;
+	d_ring.resize(ring_items * config.item_size);
+	d_ring_mask = ring_items - 1;
+
+	d_margin = (uint64_t)(config.margin * config.samp_rate);
+	memset(&d_capture_time, 0, sizeof(d_capture_time));
+
+	d_thread = std::thread(&burst_recorder::writer_loop, this);
+}
+
+burst_recorder::~burst_recorder()
+{
+	d_flushing = true;
+	d_running = false;
+	d_thread.join();
+
+	write_meta();
+	close(d_data_fd);
+}
+
+void burst_recorder::add_filter(const uint8_t *part_id)
+{
+	d_filters.push_back(std::vector<uint8_t>(part_id, part_id + 5));
+}
+
+bool burst_recorder::matches_filter(const burst_result_t &result) const
+{
+	if (d_filters.empty() && !d_watch_filter)
+		return true;
+	if (!result.part_id_rcvd)
+		return false;
+	if (d_watch_filter && (result.watch_actions & WATCH_RECORD))
+		return true;
+
+	for (size_t i = 0; i < d_filters.size(); i++) {
+		if (memcmp(d_filters[i].data(), result.part_id, 5) == 0)
+			return true;
+	}
+	return false;
+}
+
+void burst_recorder::write(const void *items, size_t n)
+{
+	const uint8_t *in = (const uint8_t *)items;
+	size_t item_size = d_config.item_size;
+	uint64_t head = d_head.load(std::memory_order_relaxed);
+
+	if (head == 0)
+		clock_gettime(CLOCK_REALTIME, &d_capture_time);
+
+	while (n) {
+		uint64_t pos = head & d_ring_mask;
+		size_t len = std::min((uint64_t)n, d_ring_mask + 1 - pos);
+
+		memcpy(&d_ring[pos * item_size], in, len * item_size);
+		in += len * item_size;
+		n -= len;
+		head += len;
+	}
+
+	d_head.store(head, std::memory_order_release);
+}
+
+bool burst_recorder::trigger(const burst_info_t &info, const burst_result_t &result)
+{
+	if (!matches_filter(result))
+		return false;
+
+	trigger_t trigger;
+	unsigned sps = d_config.sps;
+	double start = ((double)info.sample_index - S_FIELD_BITS * sps) * d_config.ratio + d_config.offset;
+
+	trigger.start = (start > 0) ? (uint64_t)llround(start) : 0;
+	trigger.count = (uint32_t)llround((S_FIELD_BITS + info.length) * sps * d_config.ratio);
+	trigger.rx_id = info.rx_id;
+	trigger.part_type = info.part_type;
+	trigger.afield_ok = result.afield_ok;
+	trigger.afield_recovered = info.afield_recovered;
+	trigger.part_id_rcvd = result.part_id_rcvd;
+	memcpy(trigger.part_id, result.part_id, sizeof(trigger.part_id));
+	trigger.rssi = info.rssi;
+	trigger.freq_offset = info.freq_offset;
+
+	if (!d_triggers.push(trigger)) {
+		d_dropped_cnt.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	d_pushed_cnt.fetch_add(1, std::memory_order_release);
+	return true;
+}
+
+void burst_recorder::drain(void)
+{
+	d_flushing = true;
+	while (d_handled_cnt.load(std::memory_order_acquire) < d_pushed_cnt.load(std::memory_order_acquire))
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	d_flushing = false;
+}
+
+void burst_recorder::new_capture(double frequency)
+{
+	drain();
+
+	// The writer is idle until the next trigger
+	d_global_base += d_head.load(std::memory_order_relaxed);
+	d_recorded_end = 0;
+	d_frequency = frequency;
+	d_head.store(0, std::memory_order_release);
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t len)
+{
+	while (len) {
+		ssize_t n = ::write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+static void format_datetime(char *buf, size_t len, const struct timespec &base, double offset)
+{
+	double t = base.tv_sec + base.tv_nsec / 1e9 + offset;
+	time_t sec = (time_t)t;
+	struct tm tm;
+
+	gmtime_r(&sec, &tm);
+	size_t n = strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(buf + n, len - n, ".%06ldZ", (long)((t - sec) * 1e6));
+}
+
+void burst_recorder::record(const trigger_t &trigger)
+{
+	size_t item_size = d_config.item_size;
+	uint64_t end = trigger.start + trigger.count + d_margin;
+
+	// Wait for the margin after the burst unless the input has stopped
+	uint64_t head = d_head.load(std::memory_order_acquire);
+	while (head < end && !d_flushing) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		head = d_head.load(std::memory_order_acquire);
+	}
+	end = std::min(end, head);
+
+	// The input thread may be writing up to a GNU Radio buffer past the
+	// published head, only trust the oldest three quarters of the ring
+	// to stay put while they are copied
+	uint64_t readable = (d_ring_mask + 1) / 4 * 3;
+	uint64_t oldest = (head > readable) ? head - readable : 0;
+	uint64_t begin = (trigger.start > d_margin) ? trigger.start - d_margin : 0;
+	begin = std::max(begin, oldest);
+
+	if (begin > trigger.start || trigger.start >= end) {
+		d_dropped_cnt.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	bool new_segment = d_recorded_end == 0 || begin > d_recorded_end;
+	if (!new_segment) {
+		begin = std::max(begin, d_recorded_end);
+		if (trigger.start < d_segment_start) {
+			d_dropped_cnt.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	if (end > begin) {
+		size_t n = end - begin;
+		d_window.resize(n * item_size);
+		for (uint64_t i = begin; i < end; ) {
+			uint64_t pos = i & d_ring_mask;
+			size_t len = std::min(end - i, d_ring_mask + 1 - pos);
+			memcpy(&d_window[(i - begin) * item_size], &d_ring[pos * item_size], len * item_size);
+			i += len;
+		}
+
+		head = d_head.load(std::memory_order_acquire);
+		if (head > readable && head - readable > begin) {
+			d_dropped_cnt.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		if (!write_all(d_data_fd, d_window.data(), d_window.size())) {
+			// Keep the data file in step with the metadata
+			if (ftruncate(d_data_fd, d_data_items * item_size) == 0)
+				lseek(d_data_fd, d_data_items * item_size, SEEK_SET);
+			d_dropped_cnt.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		if (new_segment) {
+			char datetime[48];
+			char capture[256];
+
+			format_datetime(datetime, sizeof(datetime), d_capture_time, begin / d_config.samp_rate);
+			snprintf(capture, sizeof(capture),
+				"%s\n    {\"core:sample_start\": %llu, \"core:global_index\": %llu, "
+				"\"core:frequency\": %.0f, \"core:datetime\": \"%s\"}",
+				d_captures.empty() ? "" : ",",
+				(unsigned long long)d_data_items, (unsigned long long)(d_global_base + begin),
+				d_frequency, datetime);
+			d_captures += capture;
+
+			d_segment_start = begin;
+			d_segment_data_start = d_data_items;
+		}
+
+		d_data_items += n;
+		d_recorded_end = end;
+	}
+
+	char part_id[40] = "";
+	char rssi[40] = "";
+	char annotation[512];
+
+	if (trigger.part_id_rcvd)
+		snprintf(part_id, sizeof(part_id), ", \"dect:part_id\": \"%02x%02x%02x%02x%02x\"",
+			trigger.part_id[0], trigger.part_id[1], trigger.part_id[2],
+			trigger.part_id[3], trigger.part_id[4]);
+	if (!std::isnan(trigger.rssi))
+		snprintf(rssi, sizeof(rssi), ", \"dect:rssi_dbfs\": %.1f", trigger.rssi);
+
+	snprintf(annotation, sizeof(annotation),
+		"%s\n    {\"core:sample_start\": %llu, \"core:sample_count\": %u, \"core:label\": \"%s\", "
+		"\"dect:rx_id\": %u%s, \"dect:afield_crc\": \"%s\"%s, \"dect:freq_offset_hz\": %.0f}",
+		d_annotations.empty() ? "" : ",",
+		(unsigned long long)(d_segment_data_start + trigger.start - d_segment_start),
+		(unsigned)std::min((uint64_t)trigger.count, end - trigger.start),
+		(trigger.part_type == PART_RFP) ? "RFP" : "PP",
+		trigger.rx_id, part_id,
+		!trigger.afield_ok ? "bad" : (trigger.afield_recovered ? "recovered" : "ok"),
+		rssi, trigger.freq_offset);
+	d_annotations += annotation;
+
+	d_meta_dirty = true;
+	d_written_cnt.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool burst_recorder::write_meta(void)
+{
+	std::string tmp_path = d_meta_path + ".tmp";
+	FILE *f = fopen(tmp_path.c_str(), "w");
+	if (!f)
+		return false;
+
+	fprintf(f,
+		"{\n"
+		"  \"global\": {\n"
+		"    \"core:datatype\": \"%s\",\n"
+		"    \"core:sample_rate\": %.3f,\n"
+		"    \"core:version\": \"1.0.0\",\n"
+		"    \"core:recorder\": \"dect-scanner\",\n"
+		"    \"core:description\": \"DECT bursts with %.0f us margins\",\n"
+		"    \"core:extensions\": [{\"name\": \"dect\", \"version\": \"1.0.0\", \"optional\": true}]\n"
+		"  },\n"
+		"  \"captures\": [%s\n  ],\n"
+		"  \"annotations\": [%s\n  ]\n"
+		"}\n",
+		d_config.datatype, d_config.samp_rate, d_config.margin * 1e6,
+		d_captures.c_str(), d_annotations.c_str());
+
+	bool ok = fclose(f) == 0;
+	if (ok)
+		ok = rename(tmp_path.c_str(), d_meta_path.c_str()) == 0;
+
+	d_meta_dirty = !ok;
+	d_meta_time = time(NULL);
+	return ok;
+}
+
+void burst_recorder::writer_loop(void)
+{
+	trigger_t trigger;
+
+	while (1) {
+		if (d_triggers.pop(&trigger, 1)) {
+			record(trigger);
+			d_handled_cnt.fetch_add(1, std::memory_order_release);
+			continue;
+		}
+
+		if (!d_running.load(std::memory_order_acquire))
+			break;
+
+		if (d_meta_dirty && time(NULL) - d_meta_time >= META_INTERVAL)
+			write_meta();
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+} /* namespace dect2core */
@@ -0,0 +1,160 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_BURST_RECORDER_H
+#define INCLUDED_DECT2CORE_BURST_RECORDER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "burst_decoder.h"
+#include "burst_receiver.h"
+#include "spsc_queue.h"
+
+namespace dect2core {
+
+/*
+ * Records the raw input around received bursts to a SigMF recording,
+ * path.sigmf-data and path.sigmf-meta, instead of the whole stream.
+ *
+ * The input thread copies every item into a ring holding the last
+ * ring_len seconds, the decoder thread triggers on each decoded burst.
+ * Neither ever blocks: the ring's write index is published with a release
+ * store and triggers go through a single-producer ring. A writer thread
+ * waits until the ring holds a burst's window, the burst plus margin
+ * seconds on each side, and appends it to the data file. Windows that
+ * overlap are merged, windows the ring overwrote first are dropped.
+ *
+ * Each run of adjacent windows is a SigMF capture, each burst an
+ * annotation carrying its rx_id, RFPI and A-field CRC status. Receiver
+ * sample n maps to input item n * ratio + offset.
+ */
+class burst_recorder
+{
+public:
+	typedef struct {
+		const char *datatype;	// SigMF datatype of the input items, "cf32_le", "ci16_le", "ci8"
+		size_t item_size;
+		double samp_rate;	// Input items per second
+		double frequency;	// Centre frequency of the first capture, Hz
+		double ratio;		// Input items per receiver sample
+		double offset;		// Input item receiver sample 0 stands for
+		unsigned sps;		// Receiver samples per symbol
+		double margin;		// Seconds recorded before and after each burst
+		double ring_len;	// Seconds of input kept
+	} config_t;
+
+private:
+	typedef struct {
+		uint64_t start;		// Burst's first input item
+		uint32_t count;		// Input items up to the burst's last bit
+		uint32_t rx_id;
+		part_type_t part_type;
+		bool afield_ok;
+		bool afield_recovered;
+		bool part_id_rcvd;
+		uint8_t part_id[5];
+		float rssi;
+		float freq_offset;
+	} trigger_t;
+
+	config_t d_config;
+	std::string d_meta_path;
+	int d_data_fd;
+
+	std::vector<uint8_t> d_ring;
+	uint64_t d_ring_mask;		// Items
+	std::atomic<uint64_t> d_head;	// Items written since the capture started
+	struct timespec d_capture_time;	// When the first item arrived
+
+	spsc_queue<trigger_t> d_triggers;
+	std::vector<std::vector<uint8_t> > d_filters;
+	bool d_watch_filter;
+	uint64_t d_margin;		// Items
+
+	std::thread d_thread;
+	std::atomic<bool> d_running;
+	std::atomic<uint64_t> d_pushed_cnt;
+	std::atomic<uint64_t> d_handled_cnt;
+	std::atomic<uint64_t> d_written_cnt;
+	std::atomic<uint64_t> d_dropped_cnt;
+	std::atomic<bool> d_flushing;	// The input stopped, record what the ring holds
+
+	// Writer thread state
+	uint64_t d_data_items;		// Items in the data file
+	uint64_t d_global_base;		// Input items of earlier captures
+	uint64_t d_recorded_end;	// Input item after the last one recorded, 0 if none
+	uint64_t d_segment_start;	// First input item of the current capture
+	uint64_t d_segment_data_start;	// and where it is in the data file
+	double d_frequency;
+	std::vector<uint8_t> d_window;
+	std::string d_captures;
+	std::string d_annotations;
+	bool d_meta_dirty;
+	time_t d_meta_time;
+
+	burst_recorder(const config_t &config, const char *path, int data_fd);
+
+	bool matches_filter(const burst_result_t &result) const;
+	void writer_loop(void);
+	void record(const trigger_t &trigger);
+	bool write_meta(void);
+
+public:
+	// Returns NULL with errno set if the data file can't be created
+	static burst_recorder *open(const char *path, const config_t &config);
+	// Writes the remaining windows and the final metadata
+	~burst_recorder();
+
+	// Only record bursts of this RFPI or PMID, may be given several times
+	// before the first trigger. Without filters every burst is recorded.
+	void add_filter(const uint8_t *part_id);
+
+	// Also record the bursts of parts the watchlist marks WATCH_RECORD,
+	// and only those unless filters are added
+	void set_watch_filter(bool on) { d_watch_filter = on; }
+
+	// Input thread: the next n items of the stream
+	void write(const void *items, size_t n);
+
+	// Decoder thread: a decoded burst. Returns false if it was filtered
+	// out or the trigger ring is full.
+	bool trigger(const burst_info_t &info, const burst_result_t &result);
+
+	// Block until every trigger so far has been written or dropped, with
+	// the input stopped: windows are cut to what the ring holds
+	void drain(void);
+
+	// Start a new capture at frequency, with the input and the receiver
+	// counting from 0 again. Only call with both stopped.
+	void new_capture(double frequency);
+
+	uint64_t windows_written(void) const { return d_written_cnt.load(std::memory_order_relaxed); }
+	uint64_t windows_dropped(void) const { return d_dropped_cnt.load(std::memory_order_relaxed); }
+};
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_BURST_RECORDER_H */
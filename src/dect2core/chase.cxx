@@ -0,0 +1,80 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "chase.h"
+
+namespace dect2core {
+
+void chase_set_init(chase_set_t *set)
+{
+	set->n = 0;
+}
+
+void chase_set_add(chase_set_t *set, unsigned k, unsigned pos, uint8_t rel)
+{
+	if (rel >= CHASE_MAX_RELIABILITY)
+		return;
+	if (k > CHASE_MAX_BITS)
+		k = CHASE_MAX_BITS;
+
+	// Sorted by reliability, drop the most reliable when full
+	unsigned i = set->n;
+	if (i == k) {
+		if (rel >= set->rel[k - 1])
+			return;
+		i--;
+	} else {
+		set->n++;
+	}
+
+	while (i > 0 && set->rel[i - 1] > rel) {
+		set->pos[i] = set->pos[i - 1];
+		set->rel[i] = set->rel[i - 1];
+		i--;
+	}
+	set->pos[i] = pos;
+	set->rel[i] = rel;
+}
+
+uint32_t chase_search(const uint16_t *syndromes, unsigned n, uint16_t syndrome)
+{
+	uint32_t best = 0;
+	unsigned best_weight = n + 1;
+
+	for (uint32_t mask = 1; mask < (1u << n); mask++) {
+		unsigned weight = __builtin_popcount(mask);
+		if (weight >= best_weight)
+			continue;
+
+		uint16_t s = 0;
+		for (unsigned i = 0; i < n; i++)
+			if (mask & (1u << i))
+				s ^= syndromes[i];
+
+		if (s == syndrome) {
+			best = mask;
+			best_weight = weight;
+		}
+	}
+
+	return best;
+}
+
+} /* namespace dect2core */
@@ -0,0 +1,61 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_CHASE_H
+#define INCLUDED_DECT2CORE_CHASE_H
+
+#include <cstdint>
+
+namespace dect2core {
+
+/*
+ * Soft bits are carried one per byte as bit | reliability << 1. The
+ * reliability is SOFT_NOMINAL for a sample at the mean S-field level.
+ */
+#define SOFT_NOMINAL		64
+#define SOFT_MAX		127
+#define SOFT_BIT(b, rel)	((uint8_t)((b) | ((rel) << 1)))
+#define SOFT_RELIABILITY(s)	((s) >> 1)
+
+#define CHASE_MAX_BITS		8
+// Bits at least this reliable are never flipped
+#define CHASE_MAX_RELIABILITY	(SOFT_NOMINAL / 2)
+
+// The least reliable bits of a field, candidates for flipping
+typedef struct {
+	unsigned n;
+	unsigned pos[CHASE_MAX_BITS];
+	uint8_t rel[CHASE_MAX_BITS];
+} chase_set_t;
+
+void chase_set_init(chase_set_t *set);
+
+// Offer bit pos, kept if it is among the k least reliable so far
+void chase_set_add(chase_set_t *set, unsigned k, unsigned pos, uint8_t rel);
+
+/*
+ * Find the fewest of the n candidate flips whose syndromes add up to
+ * syndrome. Returns the mask of candidates to flip, 0 if there is none.
+ */
+uint32_t chase_search(const uint16_t *syndromes, unsigned n, uint16_t syndrome);
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_CHASE_H */
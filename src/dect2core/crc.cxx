@@ -0,0 +1,135 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2015 Pavel Yazev <pyazev@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <cstring>
+
+#include "crc.h"
+
+namespace dect2core {
+
+static const uint16_t crc_table[16] = {
+	0x0000, 0x0589, 0x0b12, 0x0e9b, 0x1624, 0x13ad, 0x1d36, 0x18bf,
+	0x2c48, 0x29c1, 0x275a, 0x22d3, 0x3a6c, 0x3fe5, 0x317e, 0x34f7,
+};
+
+uint16_t calc_rcrc(const uint8_t *data, unsigned data_len)
+{
+	uint16_t crc;
+	unsigned tbl_idx;
+
+	crc = 0x0000;
+	while (data_len--) {
+		tbl_idx = (crc >> 12) ^ (*data >> 4);
+		crc = crc_table[tbl_idx & 0x0f] ^ (crc << 4);
+		tbl_idx = (crc >> 12) ^ (*data >> 0);
+		crc = crc_table[tbl_idx & 0x0f] ^ (crc << 4);
+		data++;
+	}
+	return crc ^ 0x0001;
+}
+
+uint8_t calc_xcrc(const uint8_t *b_field, unsigned b_field_bits)
+{
+	uint8_t rbits[10];
+	uint8_t gp = 0x10;
+	uint8_t crc;
+	uint8_t next;
+	uint32_t i, j;
+	uint32_t bi;
+	uint32_t bw;
+	uint32_t nb;
+	uint8_t rbyte;
+	uint32_t rbit_cnt, rbyte_cnt;
+
+	// Extract test bits
+	memset(rbits, 0, sizeof(rbits));
+	rbit_cnt = 0;
+	rbyte_cnt = 0;
+	rbyte = 0;
+	for (i = 0; i < XCRC_TEST_BITS; i++) {
+		bi = xcrc_test_bit(i, b_field_bits);
+		nb = bi >> 3;
+		bw = b_field[nb];
+
+		rbyte <<= 1;
+		rbyte |= (bw >> (7 - (bi - (nb << 3)))) & 1;
+
+		if (++rbit_cnt == 8) {
+			rbits[rbyte_cnt++] = rbyte;
+			rbit_cnt = 0;
+		}
+	}
+
+
+	crc = rbits[0];
+	i = 0;
+	while (i < 10) {
+		if (i < (10 - 1))
+			next = rbits[i + 1];
+		else
+			next=0;
+		i++;
+		j = 0;
+		while (j < 8) {
+			while (!(crc & 0x80)) {
+				crc <<= 1;
+				crc |= !!(next & 0x80);
+				next <<= 1;
+				j++;
+				if (j > 7)
+					break;
+			}
+			if (j > 7)
+				break;
+			crc <<= 1;
+			crc |= !!(next & 0x80);
+			next <<= 1;
+			j++;
+			crc ^= gp;
+		}
+	}
+	return crc >> 4;
+}
+
+uint16_t rcrc_syndrome(unsigned bit)
+{
+	if (bit >= 48)
+		return 1 << (63 - bit);
+
+	uint8_t data[6] = { 0 };
+	uint16_t zero = calc_rcrc(data, 6);
+	data[bit >> 3] = 0x80 >> (bit & 7);
+	return calc_rcrc(data, 6) ^ zero;
+}
+
+uint8_t xcrc_syndrome(unsigned i, unsigned b_field_bits)
+{
+	if (i >= XCRC_TEST_BITS)
+		return 1 << (XCRC_TEST_BITS + 3 - i);
+
+	uint8_t b_field[800 / 8];
+	memset(b_field, 0, b_field_bits / 8);
+	uint8_t zero = calc_xcrc(b_field, b_field_bits);
+	unsigned bi = xcrc_test_bit(i, b_field_bits);
+	b_field[bi >> 3] = 0x80 >> (bi & 7);
+	return calc_xcrc(b_field, b_field_bits) ^ zero;
+}
+
+} /* namespace dect2core */
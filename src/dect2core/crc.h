@@ -0,0 +1,58 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2015 Pavel Yazev <pyazev@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_CRC_H
+#define INCLUDED_DECT2CORE_CRC_H
+
+#include <cstdint>
+
+#include "dect2_common.h"
+
+namespace dect2core {
+
+// R-CRC over data_len bytes of the A-field (header and tail)
+uint16_t calc_rcrc(const uint8_t *data, unsigned data_len);
+
+// X-CRC of an 80, 320 or 800 bit B-field, returns the four check bits
+uint8_t calc_xcrc(const uint8_t *b_field, unsigned b_field_bits = B_FIELD_BITS);
+
+#define XCRC_TEST_BITS		80
+
+// B-field bit covered by X-CRC test bit i: the last 16 of each fifth
+static inline unsigned xcrc_test_bit(unsigned i, unsigned b_field_bits)
+{
+	return i + (b_field_bits / 5 - 16) * (1 + (i >> 4));
+}
+
+/*
+ * Change to calc_rcrc() ^ received R-CRC when A-field bit 0..63 flips.
+ * Bits 48 and up are the R-CRC itself.
+ */
+uint16_t rcrc_syndrome(unsigned bit);
+
+/*
+ * Same for the X-CRC: i < XCRC_TEST_BITS is test bit i of the B-field,
+ * the four after it are the X-field.
+ */
+uint8_t xcrc_syndrome(unsigned i, unsigned b_field_bits);
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_CRC_H */
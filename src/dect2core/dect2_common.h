@@ -0,0 +1,20 @@
+#ifndef DECT2_COMMON_H
+#define DECT2_COMMON_H
+
+#define A_FIELD_BITS		64
+#define B_FIELD_BITS		320
+#define X_FIELD_BITS		4
+
+#define MAX_PARTS		8			// Maximum number of DECT parts to be tracked
+#define TIME_TOL		10			// Time tolerance, samples at 4 samples per symbol
+#define SYMBOL_RATE		1152000			// Symbols per second
+#define SLOT_SYMBOLS		480
+#define FRAME_SYMBOLS		(SLOT_SYMBOLS * 24)
+#define S_FIELD_BITS		32
+#define P00_D_FIELD_BITS	64			// A-field only
+#define P08_D_FIELD_BITS	148			// Half slot, j = 0
+#define P32_D_FIELD_BITS	388			// A-field, B-field and X-field
+#define P80_D_FIELD_BITS	868			// Double slot
+#define RFP_SYNC_FIELD		0xAAAAE98A
+
+#endif // DECT2_COMMON_H
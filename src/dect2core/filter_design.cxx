@@ -0,0 +1,87 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <cmath>
+
+#include "dect2_common.h"
+#include "filter_design.h"
+
+namespace dect2core {
+
+// Same channel filter as the float front end
+std::vector<float> channel_filter_taps(double samp_rate)
+{
+	const double cutoff = 1.2 * 1152000 / 2;
+	const double transition = (1.728e6 - 1.2 * 1152000) / 2;
+
+	int ntaps = (int)(30 * samp_rate / (22.0 * transition));
+	ntaps |= 1;
+
+	std::vector<float> taps(ntaps);
+	int m = ntaps / 2;
+	double fw = 2 * M_PI * cutoff / samp_rate;
+	double sum = 0;
+
+	for (int n = -m; n <= m; n++) {
+		double w = 0.54 - 0.46 * cos(2 * M_PI * (n + m) / (ntaps - 1));
+		double h = (n == 0) ? fw / M_PI : sin(n * fw) / (n * M_PI);
+		taps[n + m] = h * w;
+		sum += taps[n + m];
+	}
+
+	for (int i = 0; i < ntaps; i++)
+		taps[i] /= sum;
+
+	return taps;
+}
+
+static double gauss_q(double x)
+{
+	return 0.5 * erfc(x / M_SQRT2);
+}
+
+// Frequency pulse of a symbol centred at t = 0, t in symbols, area 1/2
+static double gfsk_freq_pulse(double t)
+{
+	const double k = 2 * M_PI * GFSK_BT / sqrt(log(2.0));
+	return 0.5 * (gauss_q(k * (t - 0.5)) - gauss_q(k * (t + 0.5)));
+}
+
+void gfsk_modulate(const unsigned char *bits, unsigned nbits, unsigned sps, double *phase, float *out)
+{
+	const int reach = GFSK_PULSE_SYMBOLS / 2 + 1;
+
+	for (unsigned n = 0; n < nbits * sps; n++) {
+		double t = (n + 0.5) / sps;
+		int k0 = (int)t;
+		double freq = 0;
+
+		for (int k = k0 - reach; k <= k0 + reach; k++) {
+			if (k >= 0 && k < (int)nbits)
+				freq += (bits[k] ? 1 : -1) * gfsk_freq_pulse(t - k - 0.5);
+		}
+
+		// Modulation index 0.5: a quarter turn per symbol
+		*phase += M_PI * freq / sps;
+		*out++ = (float)*phase;
+	}
+}
+
+} /* namespace dect2core */
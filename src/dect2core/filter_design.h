@@ -0,0 +1,47 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_FILTER_DESIGN_H
+#define INCLUDED_DECT2CORE_FILTER_DESIGN_H
+
+#include <vector>
+
+namespace dect2core {
+
+// DECT modulation: GFSK, BT 0.5, modulation index 0.5
+#define GFSK_BT		0.5
+#define GFSK_PULSE_SYMBOLS	3	// Frequency pulse truncated to this many symbols
+
+/*
+ * Windowed sinc low-pass passing the DECT occupied bandwidth, 30 dB,
+ * Hamming window, unit DC gain
+ */
+std::vector<float> channel_filter_taps(double samp_rate);
+
+/*
+ * Phase of a GFSK burst at sps samples per symbol for bits (one per byte,
+ * 1 is a positive frequency deviation), continuing from *phase. Writes
+ * nbits * sps samples. For tests and benchmarks.
+ */
+void gfsk_modulate(const unsigned char *bits, unsigned nbits, unsigned sps, double *phase, float *out);
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_FILTER_DESIGN_H */
@@ -0,0 +1,518 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "g726.h"
+
+namespace dect2core {
+
+// Codes decoded per pass over the lanes, a B-field
+#define G726_BLOCK	80
+
+static const int16_t dqlntab[16] = {
+	-2048, 4, 135, 213, 273, 323, 373, 425, 425, 373, 323, 273, 213, 135, 4, -2048
+};
+static const int16_t witab[16] = {
+	-12, 18, 41, 64, 112, 198, 355, 1122, 1122, 355, 198, 112, 64, 41, 18, -12
+};
+static const int16_t fitab[16] = {
+	0, 0, 0, 0x200, 0x200, 0x200, 0x600, 0xE00, 0xE00, 0x600, 0x200, 0x200, 0x200, 0, 0, 0
+};
+
+void g726_init(g726_state_t *state)
+{
+	state->yl = 34816;
+	state->yu = 544;
+	state->dms = 0;
+	state->dml = 0;
+	state->ap = 0;
+	for (int i = 0; i < 2; i++) {
+		state->a[i] = 0;
+		state->pk[i] = 0;
+		state->sr[i] = 32;
+	}
+	for (int i = 0; i < 6; i++) {
+		state->b[i] = 0;
+		state->dq[i] = 32;
+	}
+	state->td = 0;
+}
+
+/*
+ * The reference's helpers, without branches or table searches so that
+ * the loops over the lanes they are inlined into vectorize
+ */
+
+// Number of powers of two, 1 to 0x4000, not above val
+static inline int32_t quan(int32_t val)
+{
+	return (val >= 0x1) + (val >= 0x2) + (val >= 0x4) + (val >= 0x8) +
+		(val >= 0x10) + (val >= 0x20) + (val >= 0x40) + (val >= 0x80) +
+		(val >= 0x100) + (val >= 0x200) + (val >= 0x400) + (val >= 0x800) +
+		(val >= 0x1000) + (val >= 0x2000) + (val >= 0x4000);
+}
+
+// an times srn, srn in the 4-bit exponent 6-bit mantissa format
+static inline int32_t fmult(int32_t an, int32_t srn)
+{
+	int32_t anmag = (an > 0) ? an : ((-an) & 0x1FFF);
+	int32_t anexp = quan(anmag) - 6;
+	int32_t anmant = (anexp >= 0) ? (anmag >> std::max(anexp, 0)) : (anmag << std::max(-anexp, 0));
+	anmant = (anmag == 0) ? 32 : anmant;
+	int32_t wanexp = anexp + ((srn >> 6) & 0xF) - 13;
+	int32_t wanmant = (anmant * (srn & 077) + 0x30) >> 4;
+	int32_t retval = (wanexp >= 0) ? ((wanmant << std::max(wanexp, 0)) & 0x7FFF) : (wanmant >> std::max(-wanexp, 0));
+	return ((an ^ srn) < 0) ? -retval : retval;
+}
+
+// Truncate to 16 bits like the reference's shorts, in a way that vectorizes
+static inline int32_t sxt16(int32_t x)
+{
+	return ((x & 0xFFFF) ^ 0x8000) - 0x8000;
+}
+
+// Magnitude mag to the 4-bit exponent 6-bit mantissa format
+static inline int32_t to_float(int32_t mag)
+{
+	int32_t exp = quan(mag);
+	return (exp << 6) + ((mag << 6) >> exp);
+}
+
+/*
+ * The reference decoder as it is, one code at a time: faster than a lane
+ * loop for a single channel, and what the lanes are checked against
+ */
+
+static int32_t scalar_quan(int32_t val)
+{
+	int32_t i = 0;
+	while (i < 15 && val >= (1 << i))
+		i++;
+	return i;
+}
+
+static int16_t scalar_fmult(int32_t an, int32_t srn)
+{
+	int16_t anmag = (an > 0) ? an : ((-an) & 0x1FFF);
+	int16_t anexp = scalar_quan(anmag) - 6;
+	int16_t anmant = (anmag == 0) ? 32 : (anexp >= 0) ? anmag >> anexp : anmag << -anexp;
+	int16_t wanexp = anexp + ((srn >> 6) & 0xF) - 13;
+	int16_t wanmant = (anmant * (srn & 077) + 0x30) >> 4;
+	int16_t retval = (wanexp >= 0) ? ((wanmant << wanexp) & 0x7FFF) : (wanmant >> -wanexp);
+	return ((an ^ srn) < 0) ? -retval : retval;
+}
+
+// 4-bit exponent 6-bit mantissa format of a nonzero magnitude
+static int16_t scalar_float(int32_t mag, bool negative)
+{
+	int16_t exp = scalar_quan(mag);
+	return (exp << 6) + ((mag << 6) >> exp) - (negative ? 0x400 : 0);
+}
+
+static void scalar_update(g726_state_t *s, int32_t y, int32_t wi, int32_t fi, int16_t dq, int16_t sr, int16_t dqsez)
+{
+	int16_t pk0 = (dqsez < 0) ? 1 : 0;
+	int16_t mag = dq & 0x7FFF;
+	int16_t a2p = 0;
+
+	// Transition detect
+	int16_t ylint = s->yl >> 15;
+	int16_t ylfrac = (s->yl >> 10) & 0x1F;
+	int16_t thr1 = (32 + ylfrac) << ylint;
+	int16_t thr2 = (ylint > 9) ? 31 << 10 : thr1;
+	int16_t dqthr = (thr2 + (thr2 >> 1)) >> 1;
+	bool tr = s->td != 0 && mag > dqthr;
+
+	// Quantizer scale factor adaptation
+	s->yu = std::min(std::max(y + ((wi - y) >> 5), 544), 5120);
+	s->yl += s->yu + ((-s->yl) >> 6);
+
+	if (tr) {
+		s->a[0] = 0;
+		s->a[1] = 0;
+		for (int i = 0; i < 6; i++)
+			s->b[i] = 0;
+	} else {
+		// Pole predictor coefficients
+		int16_t pks1 = pk0 ^ s->pk[0];
+		a2p = s->a[1] - (s->a[1] >> 7);
+		if (dqsez != 0) {
+			int16_t fa1 = pks1 ? s->a[0] : -s->a[0];
+			if (fa1 < -8191)
+				a2p -= 0x100;
+			else if (fa1 > 8191)
+				a2p += 0xFF;
+			else
+				a2p += fa1 >> 5;
+
+			if (pk0 ^ s->pk[1])
+				a2p = (a2p <= -12160) ? -12288 : (a2p >= 12416) ? 12288 : a2p - 0x80;
+			else
+				a2p = (a2p <= -12416) ? -12288 : (a2p >= 12160) ? 12288 : a2p + 0x80;
+		}
+		s->a[1] = a2p;
+
+		s->a[0] -= s->a[0] >> 8;
+		if (dqsez != 0)
+			s->a[0] += pks1 ? -192 : 192;
+		int16_t a1ul = 15360 - a2p;
+		s->a[0] = std::min(std::max((int32_t)s->a[0], -a1ul), (int32_t)a1ul);
+
+		// Zero predictor coefficients
+		for (int i = 0; i < 6; i++) {
+			s->b[i] -= s->b[i] >> 8;
+			if (mag)
+				s->b[i] += ((dq ^ s->dq[i]) >= 0) ? 128 : -128;
+		}
+	}
+
+	for (int i = 5; i > 0; i--)
+		s->dq[i] = s->dq[i - 1];
+	if (mag == 0)
+		s->dq[0] = (dq >= 0) ? 0x20 : (int16_t)0xFC20;
+	else
+		s->dq[0] = scalar_float(mag, dq < 0);
+
+	s->sr[1] = s->sr[0];
+	if (sr == 0)
+		s->sr[0] = 0x20;
+	else if (sr == -32768)
+		s->sr[0] = (int16_t)0xFC20;
+	else
+		s->sr[0] = scalar_float((sr < 0) ? -sr : sr, sr < 0);
+
+	s->pk[1] = s->pk[0];
+	s->pk[0] = pk0;
+
+	// Tone detect and adaptation speed control
+	s->td = !tr && a2p < -11776;
+	s->dms += (fi - s->dms) >> 5;
+	s->dml += ((fi << 2) - s->dml) >> 7;
+	if (tr)
+		s->ap = 256;
+	else if (y < 1536 || s->td || abs((s->dms << 2) - s->dml) >= (s->dml >> 3))
+		s->ap += (0x200 - s->ap) >> 4;
+	else
+		s->ap += (-s->ap) >> 4;
+}
+
+static void decode_scalar(g726_state_t *s, const uint8_t *codes, int16_t *pcm, size_t ncodes)
+{
+	for (size_t k = 0; k < ncodes; k++) {
+		int i = (codes[k / 2] >> ((k & 1) ? 0 : 4)) & 0xF;
+
+		// Predictors
+		int16_t sezi = 0;
+		for (int j = 0; j < 6; j++)
+			sezi += scalar_fmult(s->b[j] >> 2, s->dq[j]);
+		int16_t sez = sezi >> 1;
+		int16_t sei = sezi + scalar_fmult(s->a[1] >> 2, s->sr[1]) + scalar_fmult(s->a[0] >> 2, s->sr[0]);
+		int16_t se = sei >> 1;
+
+		// Quantizer scale factor
+		int16_t y = s->yu;
+		if (s->ap < 256) {
+			int32_t yl6 = s->yl >> 6;
+			int32_t dif = s->yu - yl6;
+			int32_t al = s->ap >> 2;
+			y = yl6 + ((dif > 0) ? (dif * al) >> 6 : (dif < 0) ? (dif * al + 0x3F) >> 6 : 0);
+		}
+
+		// Reconstructed difference and signal
+		int16_t dq;
+		int16_t dql = dqlntab[i] + (y >> 2);
+		if (dql < 0) {
+			dq = (i & 0x08) ? -0x8000 : 0;
+		} else {
+			int16_t dex = (dql >> 7) & 15;
+			int16_t dqt = 128 + (dql & 127);
+			dq = (dqt << 7) >> (14 - dex);
+			if (i & 0x08)
+				dq -= 0x8000;
+		}
+		int16_t sr = (dq < 0) ? se - (dq & 0x3FFF) : se + dq;
+		int16_t dqsez = sr - se + sez;
+
+		scalar_update(s, y, witab[i] << 5, fitab[i], dq, sr, dqsez);
+
+		// sr is 14 bits, the reference returns sr << 2
+		pcm[k] = (int16_t)std::min(std::max(sr << 2, -32768), 32767);
+	}
+}
+
+/*
+ * Lane state: the g726_state_t fields, each an array over W lanes.
+ * Everything is int32_t so that all steps run at the same vector width;
+ * stores to what the reference keeps in shorts are truncated the same.
+ */
+template <int W>
+struct lanes_t {
+	int32_t yl[W];
+	int32_t yu[W];
+	int32_t dms[W];
+	int32_t dml[W];
+	int32_t ap[W];
+	int32_t a[2][W];
+	int32_t b[6][W];
+	int32_t pk[2][W];
+	int32_t dq[6][W];
+	int32_t sr[2][W];
+	int32_t td[W];
+};
+
+template <int W>
+static void load_lanes(lanes_t<W> *s, g726_state_t *const *states, size_t n)
+{
+	g726_state_t idle;
+	g726_init(&idle);
+
+	for (size_t l = 0; l < W; l++) {
+		const g726_state_t *st = (l < n) ? states[l] : &idle;
+		s->yl[l] = st->yl;
+		s->yu[l] = st->yu;
+		s->dms[l] = st->dms;
+		s->dml[l] = st->dml;
+		s->ap[l] = st->ap;
+		for (int i = 0; i < 2; i++) {
+			s->a[i][l] = st->a[i];
+			s->pk[i][l] = st->pk[i];
+			s->sr[i][l] = st->sr[i];
+		}
+		for (int i = 0; i < 6; i++) {
+			s->b[i][l] = st->b[i];
+			s->dq[i][l] = st->dq[i];
+		}
+		s->td[l] = st->td;
+	}
+}
+
+template <int W>
+static void store_lanes(const lanes_t<W> *s, g726_state_t *const *states, size_t n)
+{
+	for (size_t l = 0; l < n; l++) {
+		g726_state_t *st = states[l];
+		st->yl = s->yl[l];
+		st->yu = s->yu[l];
+		st->dms = s->dms[l];
+		st->dml = s->dml[l];
+		st->ap = s->ap[l];
+		for (int i = 0; i < 2; i++) {
+			st->a[i] = s->a[i][l];
+			st->pk[i] = s->pk[i][l];
+			st->sr[i] = s->sr[i][l];
+		}
+		for (int i = 0; i < 6; i++) {
+			st->b[i] = s->b[i][l];
+			st->dq[i] = s->dq[i][l];
+		}
+		st->td = s->td[l];
+	}
+}
+
+/*
+ * One code on every lane, G.721 decoder and update() of the reference.
+ * The loops over the coefficients are outside those over the lanes, so
+ * that the lane loops are the innermost and vectorize.
+ */
+template <int W>
+static inline void decode_step(lanes_t<W> *s, const int32_t *sign, const int32_t *dqln,
+	const int32_t *wi, const int32_t *fi, int32_t *out)
+{
+	int32_t sezi[W], dq[W], mag[W], tr[W];
+
+	// Zero predictor
+	for (int l = 0; l < W; l++)
+		sezi[l] = 0;
+	for (int i = 0; i < 6; i++) {
+		for (int l = 0; l < W; l++)
+			sezi[l] += fmult(s->b[i][l] >> 2, s->dq[i][l]);
+	}
+
+	for (int l = 0; l < W; l++) {
+		// Pole predictor
+		int32_t zi = sxt16(sezi[l]);
+		int32_t sez = zi >> 1;
+		int32_t sei = sxt16(zi + fmult(s->a[1][l] >> 2, s->sr[1][l]) + fmult(s->a[0][l] >> 2, s->sr[0][l]));
+		int32_t se = sei >> 1;
+
+		// Quantizer scale factor
+		int32_t yl6 = s->yl[l] >> 6;
+		int32_t dif = s->yu[l] - yl6;
+		int32_t al = s->ap[l] >> 2;
+		int32_t y = yl6 + ((dif > 0) ? (dif * al) >> 6 : (dif * al + 0x3F) >> 6);
+		y = (s->ap[l] >= 256) ? s->yu[l] : y;
+
+		// Reconstructed difference and signal
+		int32_t dql = sxt16(dqln[l] + (y >> 2));
+		int32_t dex = (dql >> 7) & 15;
+		int32_t dqt = 128 + (dql & 127);
+		int32_t d = (dqt << 7) >> std::max(14 - dex, 0);
+		d = (dql < 0) ? 0 : d;
+		d = sxt16(sign[l] ? d - 0x8000 : d);
+		int32_t sr = sxt16((d < 0) ? se - (d & 0x3FFF) : se + d);
+		int32_t dqsez = sxt16(sr - se + sez);
+
+		out[l] = sr;
+		dq[l] = d;
+		mag[l] = d & 0x7FFF;
+
+		int32_t pk0 = dqsez < 0;
+
+		// Tone and transition detect
+		int32_t ylint = s->yl[l] >> 15;
+		int32_t ylfrac = (s->yl[l] >> 10) & 0x1F;
+		int32_t thr1 = (32 + ylfrac) << std::min(ylint, 9);
+		int32_t thr2 = (ylint > 9) ? 31 << 10 : thr1;
+		int32_t dqthr = (thr2 + (thr2 >> 1)) >> 1;
+		tr[l] = (s->td[l] != 0) & (mag[l] > dqthr);
+
+		// Quantizer scale factor adaptation
+		int32_t yu = y + ((wi[l] - y) >> 5);
+		yu = std::min(std::max(yu, 544), 5120);
+		s->yu[l] = yu;
+		s->yl[l] += yu + ((-s->yl[l]) >> 6);
+
+		// Pole predictor coefficients
+		int32_t pks1 = pk0 ^ s->pk[0][l];
+		int32_t a0 = s->a[0][l];
+		int32_t a2p = sxt16(s->a[1][l] - (s->a[1][l] >> 7));
+		int32_t fa1 = pks1 ? a0 : -a0;
+		int32_t a2d = (fa1 < -8191) ? -0x100 : (fa1 > 8191) ? 0xFF : fa1 >> 5;
+		int32_t a2n = sxt16(a2p + a2d);
+		int32_t a2lim = (pk0 ^ s->pk[1][l]) ?
+			((a2n <= -12160) ? -12288 : (a2n >= 12416) ? 12288 : a2n - 0x80) :
+			((a2n <= -12416) ? -12288 : (a2n >= 12160) ? 12288 : a2n + 0x80);
+		a2p = (dqsez != 0) ? a2lim : a2p;
+
+		a0 -= a0 >> 8;
+		a0 += (dqsez == 0) ? 0 : (pks1 == 0) ? 192 : -192;
+		a0 = sxt16(a0);
+		int32_t a1ul = 15360 - a2p;
+		a0 = std::min(std::max(a0, -a1ul), a1ul);
+
+		s->a[1][l] = tr[l] ? 0 : a2p;
+		s->a[0][l] = tr[l] ? 0 : a0;
+
+		s->pk[1][l] = s->pk[0][l];
+		s->pk[0][l] = pk0;
+
+		int32_t td = tr[l] ? 0 : (a2p < -11776);
+		s->td[l] = td;
+
+		// Adaptation speed control
+		int32_t dms = s->dms[l] + ((fi[l] - s->dms[l]) >> 5);
+		int32_t dml = s->dml[l] + (((fi[l] << 2) - s->dml[l]) >> 7);
+		s->dms[l] = dms;
+		s->dml[l] = dml;
+		int32_t ap = s->ap[l];
+		int32_t ddiff = (dms << 2) - dml;
+		int32_t fast = (y < 1536) | td | (((ddiff < 0) ? -ddiff : ddiff) >= (dml >> 3));
+		ap = fast ? ap + ((0x200 - ap) >> 4) : ap + ((-ap) >> 4);
+		s->ap[l] = tr[l] ? 256 : ap;
+	}
+
+	// Zero predictor coefficients, then the difference history
+	for (int i = 0; i < 6; i++) {
+		for (int l = 0; l < W; l++) {
+			int32_t b = s->b[i][l];
+			b -= b >> 8;
+			b += (mag[l] == 0) ? 0 : ((dq[l] ^ s->dq[i][l]) >= 0) ? 128 : -128;
+			s->b[i][l] = tr[l] ? 0 : sxt16(b);
+		}
+	}
+	for (int i = 5; i > 0; i--) {
+		for (int l = 0; l < W; l++)
+			s->dq[i][l] = s->dq[i - 1][l];
+	}
+
+	for (int l = 0; l < W; l++) {
+		int32_t dqf = sxt16(to_float(mag[l]) - ((dq[l] < 0) ? 0x400 : 0));
+		s->dq[0][l] = (mag[l] == 0) ? ((dq[l] >= 0) ? 0x20 : sxt16(0xFC20)) : dqf;
+
+		int32_t sr = out[l];
+		int32_t srmag = (sr < 0) ? -sr : sr;
+		int32_t srf = sxt16(to_float(srmag) - ((sr < 0) ? 0x400 : 0));
+		s->sr[1][l] = s->sr[0][l];
+		s->sr[0][l] = (sr == 0) ? 0x20 : (sr == -32768) ? sxt16(0xFC20) : srf;
+	}
+}
+
+template <int W>
+static void decode_lanes(g726_state_t *const *states, const uint8_t *const *codes,
+	int16_t *const *pcm, size_t n, size_t ncodes)
+{
+	lanes_t<W> s;
+	int32_t sign[G726_BLOCK][W], dqln[G726_BLOCK][W];
+	int32_t wi[G726_BLOCK][W], fi[G726_BLOCK][W];
+	int32_t out[G726_BLOCK][W];
+
+	load_lanes(&s, states, n);
+
+	for (size_t start = 0; start < ncodes; start += G726_BLOCK) {
+		size_t len = std::min(ncodes - start, (size_t)G726_BLOCK);
+
+		// Table lookups up front, the lanes would need gathers for them
+		for (size_t j = 0; j < len; j++) {
+			for (size_t l = 0; l < W; l++) {
+				size_t k = start + j;
+				int i = (l < n) ? (codes[l][k / 2] >> ((k & 1) ? 0 : 4)) & 0xF : 0;
+				sign[j][l] = i & 0x08;
+				dqln[j][l] = dqlntab[i];
+				wi[j][l] = witab[i] << 5;
+				fi[j][l] = fitab[i];
+			}
+		}
+
+		for (size_t j = 0; j < len; j++)
+			decode_step(&s, sign[j], dqln[j], wi[j], fi[j], out[j]);
+
+		// sr is 14 bits, the reference returns sr << 2
+		for (size_t l = 0; l < n; l++) {
+			for (size_t j = 0; j < len; j++)
+				pcm[l][start + j] = (int16_t)std::min(std::max(out[j][l] << 2, -32768), 32767);
+		}
+	}
+
+	store_lanes(&s, states, n);
+}
+
+// Every lane costs the same whether in use or not, so few channels take
+// narrower ones, and a single one the reference code. Flattened so that
+// the AVX2 clone gets its own copy of the lane code: x86-64 without it
+// has no variable vector shifts.
+__attribute__((flatten, target_clones("avx2", "default")))
+void g726_decode(g726_state_t *const *states, const uint8_t *const *codes,
+	int16_t *const *pcm, size_t n, size_t ncodes)
+{
+	for (size_t i = 0; i < n; i += G726_LANES) {
+		size_t lanes = std::min(n - i, (size_t)G726_LANES);
+		if (lanes > G726_LANES / 2)
+			decode_lanes<G726_LANES>(states + i, codes + i, pcm + i, lanes, ncodes);
+		else if (lanes > 1)
+			decode_lanes<G726_LANES / 2>(states + i, codes + i, pcm + i, lanes, ncodes);
+		else
+			decode_scalar(states[i], codes[i], pcm[i], ncodes);
+	}
+}
+
+} // namespace dect2core
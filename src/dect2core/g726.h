@@ -0,0 +1,63 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_G726_H
+#define INCLUDED_DECT2CORE_G726_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dect2core {
+
+// Channels g726_decode() runs side by side
+#define G726_LANES	8
+
+// State of one G.726 32 kbit/s (G.721) decoder, as in the ITU reference
+typedef struct {
+	int32_t yl;		// Locked quantizer scale factor
+	int16_t yu;		// Unlocked quantizer scale factor
+	int16_t dms;		// Short term average of F(I)
+	int16_t dml;		// Long term average of F(I)
+	int16_t ap;		// Speed control
+	int16_t a[2];		// Pole predictor coefficients
+	int16_t b[6];		// Zero predictor coefficients
+	int16_t pk[2];		// Signs of the partially reconstructed signal
+	int16_t dq[6];		// Quantized differences, 4-bit exponent 6-bit mantissa
+	int16_t sr[2];		// Reconstructed signal, the same
+	int16_t td;		// Tone detect
+} g726_state_t;
+
+void g726_init(g726_state_t *state);
+
+/*
+ * Decode ncodes 4-bit codes, packed high nibble first as in the B-field,
+ * to 16-bit linear PCM for each of n channels. The channels are decoded
+ * up to G726_LANES at a time with their state in structure-of-arrays form,
+ * every step of the algorithm running across all lanes at once, which the
+ * compiler turns into SIMD code, AVX2 where the CPU has it. A channel left
+ * on its own goes through a scalar port of the reference decoder instead.
+ * The output is bit exact with the reference decoder either way.
+ */
+void g726_decode(g726_state_t *const *states, const uint8_t *const *codes,
+	int16_t *const *pcm, size_t n, size_t ncodes);
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_G726_H */
@@ -0,0 +1,170 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2015 Pavel Yazev <pyazev@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "dect2_common.h"
+#include "filter_design.h"
+#include "int_discriminator.h"
+#include "phase_discriminator.h"
+
+namespace dect2core {
+
+#define TAP_SHIFT	14
+#define CHUNK_LEN	1024
+
+int_discriminator::int_discriminator(sample_format_t format, unsigned decimation, unsigned sps, float squelch_db)
+	: d_format(format), d_decimation(decimation), d_lag(discriminator_lag(sps)),
+	d_squelch(SQUELCH_BLOCK_SYMBOLS * sps, squelch_db)
+{
+	float full_scale = (format == SAMPLE_CS8) ? 128.0f : 32768.0f;
+	d_power_scale = 1.0f / (full_scale * full_scale);
+
+	double samp_rate = decimation * sps * (double)SYMBOL_RATE;
+	std::vector<float> taps = channel_filter_taps(samp_rate);
+
+	d_taps.resize(taps.size());
+	for (size_t i = 0; i < taps.size(); i++)
+		d_taps[i] = (int16_t)lrintf(taps[i] * (1 << TAP_SHIFT));
+
+	d_filtered.resize(2 * (CHUNK_LEN + d_lag));
+}
+
+size_t int_discriminator::sample_size(sample_format_t format)
+{
+	return (format == SAMPLE_CS8) ? 2 * sizeof(int8_t) : 2 * sizeof(int16_t);
+}
+
+/*
+ * Decimating FIR producing n samples. The sum of the absolute Q14 taps is
+ * below 2, so the accumulators can't overflow even for full scale 16 bit
+ * input.
+ */
+template <typename T>
+void int_discriminator::filter(const T *in, size_t n, int32_t *out) const
+{
+	const int16_t *taps = d_taps.data();
+	size_t ntaps = d_taps.size();
+
+	for (size_t i = 0; i < n; i++) {
+		const T *x = in + 2 * i * d_decimation;
+		int32_t acc_i = 0;
+		int32_t acc_q = 0;
+
+		for (size_t k = 0; k < ntaps; k++) {
+			acc_i += (int32_t)x[2 * k] * taps[k];
+			acc_q += (int32_t)x[2 * k + 1] * taps[k];
+		}
+
+		*out++ = acc_i >> TAP_SHIFT;
+		*out++ = acc_q >> TAP_SHIFT;
+	}
+}
+
+void int_discriminator::discriminate(const void *in, size_t n, float *out, float *power)
+{
+	size_t step = sample_size(d_format);
+
+	while (n) {
+		size_t len = (n < CHUNK_LEN) ? n : CHUNK_LEN;
+		int32_t *y = d_filtered.data();
+
+		if (d_format == SAMPLE_CS8)
+			filter((const int8_t *)in, len + d_lag, y);
+		else
+			filter((const int16_t *)in, len + d_lag, y);
+
+		if (power) {
+			for (size_t i = 0; i < len; i++) {
+				float si = y[2 * i], sq = y[2 * i + 1];
+				*power++ = (si * si + sq * sq) * d_power_scale;
+			}
+		}
+
+		for (size_t i = 0; i < len; i++) {
+			// y[i] * conj(y[i + lag])
+			int64_t ai = y[2 * i], aq = y[2 * i + 1];
+			int64_t bi = y[2 * (i + d_lag)], bq = y[2 * (i + d_lag) + 1];
+			int64_t re = ai * bi + aq * bq;
+			int64_t im = aq * bi - ai * bq;
+			*out++ = fast_atan2f((float)im, (float)re);
+		}
+
+		in = (const uint8_t *)in + len * d_decimation * step;
+		n -= len;
+	}
+}
+
+/*
+ * Mean power of n input samples at the output rate, taken at the centre of
+ * the channel filter
+ */
+template <typename T>
+float int_discriminator::raw_power(const T *in, size_t n) const
+{
+	const T *x = in + 2 * (d_taps.size() / 2);
+	float sum = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		float si = x[0], sq = x[1];
+		sum += si * si + sq * sq;
+		x += 2 * d_decimation;
+	}
+
+	return sum / n * d_power_scale;
+}
+
+float int_discriminator::block_power(const void *in, size_t n) const
+{
+	if (d_format == SAMPLE_CS8)
+		return raw_power((const int8_t *)in, n);
+	else
+		return raw_power((const int16_t *)in, n);
+}
+
+void int_discriminator::process(const void *in, size_t n, float *out, float *power)
+{
+	if (!d_squelch.enabled()) {
+		discriminate(in, n, out, power);
+		return;
+	}
+
+	size_t block_len = d_squelch.block_len();
+	size_t step = d_decimation * sample_size(d_format);
+	float next_power = block_power(in, block_len);
+
+	for (size_t i = 0; i < n; i += block_len) {
+		size_t len = std::min(block_len, n - i);
+		const uint8_t *block = (const uint8_t *)in + i * step;
+		float power_now = next_power;
+		next_power = block_power(block + len * step, block_len);
+
+		if (d_squelch.next_block(power_now, next_power)) {
+			discriminate(block, len, out + i, power ? power + i : NULL);
+		} else {
+			std::fill(out + i, out + i + len, SQUELCHED_SAMPLE);
+			if (power)
+				std::fill(power + i, power + i + len, power_now);
+		}
+	}
+}
+
+} /* namespace dect2core */
@@ -0,0 +1,96 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2015 Pavel Yazev <pyazev@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_INT_DISCRIMINATOR_H
+#define INCLUDED_DECT2CORE_INT_DISCRIMINATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "squelch.h"
+
+namespace dect2core {
+
+typedef enum {
+	SAMPLE_CS8,	// Interleaved signed 8 bit I/Q (HackRF)
+	SAMPLE_CS16,	// Interleaved signed 16 bit I/Q (bladeRF SC16Q11, USRP sc16)
+} sample_format_t;
+
+/*
+ * Channel filter, decimation and phase discriminator working directly on
+ * integer I/Q. Filtering uses Q14 taps with 32 bit accumulators, the
+ * discriminator 64 bit products; only the output phase is float.
+ *
+ * The squelch, if on, judges blocks by the power of the unfiltered input
+ * at the output rate, closed blocks are neither filtered nor
+ * discriminated and come out as SQUELCHED_SAMPLE.
+ */
+class int_discriminator
+{
+private:
+	sample_format_t d_format;
+	unsigned d_decimation;
+	unsigned d_lag;
+	float d_power_scale;	// 1 / full scale power
+	std::vector<int16_t> d_taps;
+	squelch d_squelch;
+
+	// Filtered samples of the current chunk, I and Q interleaved
+	std::vector<int32_t> d_filtered;
+
+	template <typename T>
+	void filter(const T *in, size_t n, int32_t *out) const;
+	template <typename T>
+	float raw_power(const T *in, size_t n) const;
+	float block_power(const void *in, size_t n) const;
+	void discriminate(const void *in, size_t n, float *out, float *power);
+
+public:
+	// Input rate is decimation * sps * 1.152 Msps. squelch_db is the
+	// squelch threshold over the noise floor, 0 disables it.
+	int_discriminator(sample_format_t format, unsigned decimation, unsigned sps = 4, float squelch_db = 0);
+
+	static size_t sample_size(sample_format_t format);
+
+	unsigned decimation(void) const { return d_decimation; }
+	size_t ntaps(void) const { return d_taps.size(); }
+
+	// Input samples process() reads beyond n * decimation()
+	size_t history(void) const
+	{
+		return (d_lag - 1 + (d_squelch.enabled() ? d_squelch.block_len() : 0)) * d_decimation + d_taps.size();
+	}
+
+	// Input sample, counted from in[0] of process(), that output sample 0
+	// stands for: the middle of the filter and of the discriminator lag
+	double delay(void) const { return (d_taps.size() - 1) / 2.0 + d_lag * d_decimation / 2.0; }
+
+	const squelch &get_squelch(void) const { return d_squelch; }
+
+	// Reads n * decimation() + history() samples from in, writes n phase
+	// differences and, if not NULL, n filtered sample powers relative to
+	// the sample format's full scale
+	void process(const void *in, size_t n, float *out, float *power = NULL);
+};
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_INT_DISCRIMINATOR_H */
@@ -0,0 +1,126 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <chrono>
+
+#include "part_event_queue.h"
+
+namespace dect2core {
+
+part_event_queue::part_event_queue(size_t capacity, overflow_policy_t policy, unsigned max_wait_us)
+	: d_ring(capacity), d_policy(policy), d_max_wait_us(max_wait_us),
+	d_overflow_cnt(0), d_pushed_cnt(0), d_delivered_cnt(0), d_running(false), d_consumer_waiting(false),
+	d_callback(NULL), d_callback_arg(NULL)
+{
+}
+
+part_event_queue::~part_event_queue()
+{
+	stop();
+}
+
+bool part_event_queue::push(const part_event_t &event)
+{
+	bool pushed = d_ring.push(event);
+
+	if (!pushed && d_policy == WAIT && d_running.load(std::memory_order_relaxed)) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(d_max_wait_us);
+		do {
+			d_cond.notify_one();
+			std::this_thread::yield();
+			pushed = d_ring.push(event);
+		} while (!pushed && std::chrono::steady_clock::now() < deadline);
+	}
+
+	if (!pushed) {
+		d_overflow_cnt.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	d_pushed_cnt.fetch_add(1, std::memory_order_relaxed);
+
+	// Only pay for a wakeup if the consumer is actually asleep
+	if (d_consumer_waiting.load(std::memory_order_acquire))
+		d_cond.notify_one();
+
+	return true;
+}
+
+size_t part_event_queue::pop(part_event_t *events, size_t max_events)
+{
+	return d_ring.pop(events, max_events);
+}
+
+void part_event_queue::consumer_loop(void)
+{
+	part_event_t batch[MAX_BATCH];
+
+	while (1) {
+		size_t n = d_ring.pop(batch, MAX_BATCH);
+		if (n) {
+			d_callback(d_callback_arg, batch, n);
+			d_delivered_cnt.fetch_add(n, std::memory_order_release);
+			continue;
+		}
+
+		if (!d_running.load(std::memory_order_acquire))
+			break;
+
+		// The producer never takes the mutex, so a wakeup can be missed;
+		// the timeout bounds the delivery latency in that case.
+		std::unique_lock<std::mutex> lock(d_mutex);
+		d_consumer_waiting.store(true, std::memory_order_release);
+		if (d_ring.empty())
+			d_cond.wait_for(lock, std::chrono::milliseconds(10));
+		d_consumer_waiting.store(false, std::memory_order_release);
+	}
+}
+
+void part_event_queue::start(batch_callback_t callback, void *arg)
+{
+	if (d_running)
+		return;
+
+	d_callback = callback;
+	d_callback_arg = arg;
+	d_running = true;
+	d_thread = std::thread(&part_event_queue::consumer_loop, this);
+}
+
+void part_event_queue::stop(void)
+{
+	if (!d_running)
+		return;
+
+	d_running = false;
+	d_cond.notify_one();
+	d_thread.join();
+}
+
+void part_event_queue::drain(void)
+{
+	while (d_running.load(std::memory_order_relaxed) &&
+		d_delivered_cnt.load(std::memory_order_acquire) < d_pushed_cnt.load(std::memory_order_relaxed)) {
+		d_cond.notify_one();
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+} /* namespace dect2core */
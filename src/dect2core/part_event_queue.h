@@ -0,0 +1,94 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_PART_EVENT_QUEUE_H
+#define INCLUDED_DECT2CORE_PART_EVENT_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "part_info.h"
+#include "spsc_queue.h"
+
+namespace dect2core {
+
+/*
+ * Carries part updated/lost events from the decoder work thread to a
+ * consumer thread. The decoder only ever pushes (from work() and from the
+ * message handler, which GNU Radio runs on the same block thread), so a
+ * single-producer ring is enough.
+ */
+class part_event_queue
+{
+public:
+	typedef enum {
+		DROP,	// Drop the event and count an overflow when the ring is full
+		WAIT,	// Wait up to max_wait_us for the consumer, then drop
+	} overflow_policy_t;
+
+	typedef void (*batch_callback_t)(void *arg, const part_event_t *events, size_t count);
+
+private:
+	spsc_queue<part_event_t> d_ring;
+	overflow_policy_t d_policy;
+	unsigned d_max_wait_us;
+
+	std::atomic<uint64_t> d_overflow_cnt;
+	std::atomic<uint64_t> d_pushed_cnt;
+	std::atomic<uint64_t> d_delivered_cnt;
+
+	std::thread d_thread;
+	std::atomic<bool> d_running;
+	std::atomic<bool> d_consumer_waiting;
+	std::mutex d_mutex;
+	std::condition_variable d_cond;
+
+	batch_callback_t d_callback;
+	void *d_callback_arg;
+
+	void consumer_loop(void);
+
+public:
+	enum { MAX_BATCH = 256 };
+
+	part_event_queue(size_t capacity = 1024, overflow_policy_t policy = DROP, unsigned max_wait_us = 0);
+	~part_event_queue();
+
+	bool push(const part_event_t &event);
+	size_t pop(part_event_t *events, size_t max_events);
+
+	uint64_t overflow_count(void) const
+	{
+		return d_overflow_cnt.load(std::memory_order_relaxed);
+	}
+
+	// Spawn a thread delivering events to callback in batches of up to MAX_BATCH
+	void start(batch_callback_t callback, void *arg);
+	// Deliver the remaining events and join the consumer thread
+	void stop(void);
+	// Block until every event pushed so far has been delivered
+	void drain(void);
+};
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_PART_EVENT_QUEUE_H */
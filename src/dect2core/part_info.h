@@ -0,0 +1,89 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_PART_INFO_H
+#define INCLUDED_DECT2CORE_PART_INFO_H
+
+#include <cstdint>
+
+namespace dect2core {
+
+typedef enum {
+	PART_RFP,	// Radio Fixed Part
+	PART_PP,	// Portable Part
+} part_type_t;
+
+/*
+ * What a fixed part tells about itself in its A-field tails, fields are
+ * only meaningful once the corresponding *_rcvd flag is set
+ */
+typedef struct {
+	bool static_rcvd;	// Qt static system information
+	uint8_t slot_number;	// Slot and carrier the Qt was sent on
+	uint8_t carrier_number;
+	uint8_t primary_scan_carrier;
+	uint8_t transceivers;
+	uint16_t carrier_bitmap;	// Bit n: the FP uses carrier n
+
+	bool capabilities_rcvd;	// Qt fixed part capabilities
+	uint32_t fp_capabilities;	// 20 bit standard capabilities
+	uint16_t hl_capabilities;	// Higher layer capabilities
+
+	bool mfn_rcvd;		// Qt multiframe number
+	uint32_t multiframe_number;
+
+	bool bearer_rcvd;	// Pt other/dummy bearer position
+	uint8_t bearer_slot;
+	uint8_t bearer_carrier;
+} fp_system_info_t;
+
+typedef struct {
+	uint64_t timestamp;	// CLOCK_REALTIME when the event was generated, ns
+	uint32_t carrier;	// Carrier index set with set_carrier()
+	uint32_t rx_id;
+	uint8_t part_id[5];
+	bool is_fixed_part;
+	bool voice_present;
+	uint64_t packet_cnt;
+	uint64_t afield_bad_crc_cnt;
+	uint64_t afield_recovered_cnt;	// A-fields passing the R-CRC after flipping unreliable bits
+	uint64_t bfield_recovered_cnt;	// Same for B-fields and the X-CRC
+	uint32_t b_field_bits;	// 80, 320 or 800 once learned from the X-CRC, 0 otherwise
+	uint64_t handover_cnt;	// Bearer and connection handover requests seen in Mt tails
+	float freq_offset;	// Carrier frequency offset, Hz, averaged over recent bursts
+	float rssi;		// Signal strength, dBFS, averaged over recent bursts, NAN if unknown
+	fp_system_info_t system_info;
+	uint32_t watch_actions;	// WATCH_* actions of the watchlist patterns matching part_id
+} part_info_t;
+
+typedef enum {
+	PART_UPDATED,
+	PART_LOST,
+	PART_MATCHED,	// First identification of a part on the watchlist
+} part_event_type_t;
+
+typedef struct {
+	part_event_type_t type;
+	part_info_t part_info;
+} part_event_t;
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_PART_INFO_H */
@@ -0,0 +1,111 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2015 Pavel Yazev <pyazev@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "phase_discriminator.h"
+
+namespace dect2core {
+
+/*
+ * atan2 approximation, max error about 1e-5 rad. Only the sign and the
+ * rough magnitude of the result matter to the receiver.
+ */
+float fast_atan2f(float y, float x)
+{
+	float ax = std::fabs(x);
+	float ay = std::fabs(y);
+
+	if (ax == 0.0f && ay == 0.0f)
+		return 0.0f;
+
+	bool swap = ay > ax;
+	float z = swap ? ax / ay : ay / ax;
+	float z2 = z * z;
+	float a = z * (0.9998660f + z2 * (-0.3302995f + z2 * (0.1801410f + z2 * (-0.0851330f + z2 * 0.0208351f))));
+
+	if (swap)
+		a = (float)M_PI_2 - a;
+	if (x < 0.0f)
+		a = (float)M_PI - a;
+	return (y < 0.0f) ? -a : a;
+}
+
+phase_discriminator::phase_discriminator(unsigned sps, float squelch_db)
+	: d_lag(discriminator_lag(sps)),
+	d_squelch(SQUELCH_BLOCK_SYMBOLS * sps, squelch_db)
+{
+}
+
+void phase_discriminator::discriminate(const std::complex<float> *in, size_t n, float *out) const
+{
+	for (size_t i = 0; i < n; i++) {
+		// in[i] * conj(in[i + lag]), spelled out to avoid the NaN checks
+		// of the complex multiplication
+		const std::complex<float> &a = in[i];
+		const std::complex<float> &b = in[i + d_lag];
+		float re = a.real() * b.real() + a.imag() * b.imag();
+		float im = a.imag() * b.real() - a.real() * b.imag();
+		*out++ = fast_atan2f(im, re);
+	}
+}
+
+static inline float sample_power(const std::complex<float> &x)
+{
+	return x.real() * x.real() + x.imag() * x.imag();
+}
+
+static float mean_power(const std::complex<float> *in, size_t n)
+{
+	float sum = 0;
+	for (size_t i = 0; i < n; i++)
+		sum += sample_power(in[i]);
+	return sum / n;
+}
+
+void phase_discriminator::process(const std::complex<float> *in, size_t n, float *out, float *power)
+{
+	if (power) {
+		for (size_t i = 0; i < n; i++)
+			power[i] = sample_power(in[i]);
+	}
+
+	if (!d_squelch.enabled()) {
+		discriminate(in, n, out);
+		return;
+	}
+
+	size_t block_len = d_squelch.block_len();
+	float next_power = mean_power(in, block_len);
+
+	for (size_t i = 0; i < n; i += block_len) {
+		size_t len = std::min(block_len, n - i);
+		float block_power = next_power;
+		next_power = mean_power(in + i + len, block_len);
+
+		if (d_squelch.next_block(block_power, next_power))
+			discriminate(in + i, len, out + i);
+		else
+			std::fill(out + i, out + i + len, SQUELCHED_SAMPLE);
+	}
+}
+
+} /* namespace dect2core */
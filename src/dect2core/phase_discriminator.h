@@ -0,0 +1,74 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2015 Pavel Yazev <pyazev@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_PHASE_DISCRIMINATOR_H
+#define INCLUDED_DECT2CORE_PHASE_DISCRIMINATOR_H
+
+#include <complex>
+#include <cstddef>
+
+#include "squelch.h"
+
+namespace dect2core {
+
+float fast_atan2f(float y, float x);
+
+// Lag of 3/4 symbol, half a symbol at 2 samples per symbol
+inline unsigned discriminator_lag(unsigned sps)
+{
+	return (sps > 2) ? 3 * sps / 4 : 1;
+}
+
+/*
+ * GFSK phase discriminator: phase difference between samples that are
+ * lag() samples apart. With the squelch on, samples of closed blocks are
+ * not discriminated and come out as SQUELCHED_SAMPLE.
+ */
+class phase_discriminator
+{
+private:
+	unsigned d_lag;
+	squelch d_squelch;
+
+	void discriminate(const std::complex<float> *in, size_t n, float *out) const;
+
+public:
+	// squelch_db is the squelch threshold over the noise floor, 0 disables it
+	explicit phase_discriminator(unsigned sps = 4, float squelch_db = 0);
+
+	unsigned lag(void) const { return d_lag; }
+
+	// Input sample, counted from in[0] of process(), that output sample 0
+	// stands for
+	double delay(void) const { return d_lag / 2.0; }
+
+	// Number of extra input samples process() looks ahead
+	unsigned lookahead(void) const { return d_lag + (d_squelch.enabled() ? d_squelch.block_len() : 0); }
+
+	const squelch &get_squelch(void) const { return d_squelch; }
+
+	// Reads n + lookahead() samples from in, writes n samples to out and,
+	// if not NULL, the power of the same n input samples to power
+	void process(const std::complex<float> *in, size_t n, float *out, float *power = NULL);
+};
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_PHASE_DISCRIMINATOR_H */
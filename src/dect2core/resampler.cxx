@@ -0,0 +1,105 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <cmath>
+
+#include "filter_design.h"
+#include "resampler.h"
+
+namespace dect2core {
+
+// Best fraction num / den for x with num <= max_num, from the continued
+// fraction convergents
+static void rational_approx(double x, unsigned max_num, unsigned *num, unsigned *den)
+{
+	unsigned long long p0 = 0, q0 = 1, p1 = 1, q1 = 0;
+	double r = x;
+
+	for (int i = 0; i < 32; i++) {
+		double a = std::floor(r);
+		unsigned long long p2 = (unsigned long long)a * p1 + p0;
+		unsigned long long q2 = (unsigned long long)a * q1 + q0;
+		if (p2 > max_num || q2 > (1ull << 31))
+			break;
+		p0 = p1; q0 = q1;
+		p1 = p2; q1 = q2;
+		if (r - a < 1e-12 || std::fabs((double)p1 / q1 - x) < 1e-12 * x)
+			break;
+		r = 1.0 / (r - a);
+	}
+
+	*num = p1 ? p1 : 1;
+	*den = q1 ? q1 : 1;
+}
+
+resampler::resampler(double in_rate, double out_rate)
+	: d_phase(0)
+{
+	rational_approx(out_rate / in_rate, MAX_INTERPOLATION, &d_interpolation, &d_decimation);
+
+	unsigned l = d_interpolation;
+	std::vector<float> proto = channel_filter_taps(in_rate * l);
+
+	// Output 0 is the filter's middle, (ntaps - 1) / 2 at the upsampled
+	// rate, before the last input sample of the first branch
+	d_phase_len = (proto.size() + l - 1) / l;
+	d_delay = (d_phase_len - 1) - (proto.size() - 1) / (2.0 * l);
+
+	// Pad to whole branches; the interpolation gain is L
+	proto.resize((size_t)d_phase_len * l, 0.0f);
+
+	// Branch p holds proto[p], proto[p + L], ..., stored last first so
+	// that process() walks the input forwards
+	d_taps.resize(proto.size());
+	for (unsigned p = 0; p < l; p++) {
+		for (unsigned j = 0; j < d_phase_len; j++)
+			d_taps[(size_t)p * d_phase_len + (d_phase_len - 1 - j)] = proto[(size_t)j * l + p] * l;
+	}
+}
+
+size_t resampler::process(const std::complex<float> *in, size_t nin, std::complex<float> *out, size_t nout,
+	size_t *nconsumed)
+{
+	size_t i = 0, produced = 0;
+	unsigned l = d_interpolation, m = d_decimation;
+	unsigned phase = d_phase;
+
+	while (produced < nout && i + d_phase_len <= nin) {
+		const float *taps = &d_taps[(size_t)phase * d_phase_len];
+		const std::complex<float> *x = in + i;
+		float re = 0, im = 0;
+
+		for (unsigned k = 0; k < d_phase_len; k++) {
+			re += taps[k] * x[k].real();
+			im += taps[k] * x[k].imag();
+		}
+		out[produced++] = std::complex<float>(re, im);
+
+		phase += m;
+		i += phase / l;
+		phase %= l;
+	}
+
+	d_phase = phase;
+	*nconsumed = i;
+	return produced;
+}
+
+} /* namespace dect2core */
@@ -0,0 +1,76 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_RESAMPLER_H
+#define INCLUDED_DECT2CORE_RESAMPLER_H
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace dect2core {
+
+/*
+ * Polyphase rational resampler for complex baseband: interpolates by L,
+ * filters and decimates by M, computing only the outputs kept. The
+ * prototype filter is the DECT channel filter, so this is also the
+ * channel filter; with L = 1 it is a plain decimating one.
+ *
+ * L / M is the closest fraction to the rate ratio with L at most
+ * MAX_INTERPOLATION, the rate error left is a few ppm at worst, which the
+ * receiver's timing loop absorbs like a device clock error.
+ */
+class resampler
+{
+private:
+	unsigned d_interpolation;
+	unsigned d_decimation;
+	unsigned d_phase_len;		// Taps per polyphase branch
+	std::vector<float> d_taps;	// Branch p is d_taps[p * d_phase_len ...], reversed
+	unsigned d_phase;		// Position between input samples, in 1 / L
+	double d_delay;
+
+public:
+	enum { MAX_INTERPOLATION = 1024 };
+
+	resampler(double in_rate, double out_rate);
+
+	unsigned interpolation(void) const { return d_interpolation; }
+	unsigned decimation(void) const { return d_decimation; }
+
+	// Input samples process() reads beyond the ones it consumes
+	size_t history(void) const { return d_phase_len - 1; }
+
+	// Input sample, counted from in[0] of the first process(), that output
+	// sample 0 stands for: the middle of the prototype filter
+	double delay(void) const { return d_delay; }
+
+	/*
+	 * Reads up to nin input samples and writes up to nout outputs, stops
+	 * when either side runs out. Returns the outputs written, *nconsumed
+	 * the inputs the next call starts after.
+	 */
+	size_t process(const std::complex<float> *in, size_t nin, std::complex<float> *out, size_t nout,
+		size_t *nconsumed);
+};
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_RESAMPLER_H */
@@ -0,0 +1,103 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_SPSC_QUEUE_H
+#define INCLUDED_DECT2CORE_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dect2core {
+
+/*
+ * Bounded single-producer/single-consumer lock-free ring.
+ * Capacity is rounded up to a power of two. Indices grow monotonically and
+ * are masked on access, so the full capacity is usable.
+ */
+template <typename T>
+class spsc_queue
+{
+private:
+	std::vector<T> d_buf;
+	size_t d_mask;
+
+	// Producer and consumer indices live on separate cache lines
+	alignas(64) std::atomic<size_t> d_head; // next slot to write
+	alignas(64) std::atomic<size_t> d_tail; // next slot to read
+
+public:
+	explicit spsc_queue(size_t capacity)
+		: d_head(0), d_tail(0)
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		d_buf.resize(size);
+		d_mask = size - 1;
+	}
+
+	size_t capacity(void) const
+	{
+		return d_mask + 1;
+	}
+
+	size_t size(void) const
+	{
+		return d_head.load(std::memory_order_acquire) - d_tail.load(std::memory_order_acquire);
+	}
+
+	bool empty(void) const
+	{
+		return size() == 0;
+	}
+
+	// Producer side. Returns false if the ring is full.
+	bool push(const T &item)
+	{
+		size_t head = d_head.load(std::memory_order_relaxed);
+		if (head - d_tail.load(std::memory_order_acquire) > d_mask)
+			return false;
+
+		d_buf[head & d_mask] = item;
+		d_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Copies up to max_items items and returns their number.
+	size_t pop(T *items, size_t max_items)
+	{
+		size_t tail = d_tail.load(std::memory_order_relaxed);
+		size_t avail = d_head.load(std::memory_order_acquire) - tail;
+		if (avail > max_items)
+			avail = max_items;
+
+		for (size_t i = 0; i < avail; i++)
+			items[i] = d_buf[(tail + i) & d_mask];
+
+		d_tail.store(tail + avail, std::memory_order_release);
+		return avail;
+	}
+};
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_SPSC_QUEUE_H */
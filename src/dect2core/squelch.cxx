@@ -0,0 +1,64 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <algorithm>
+
+#include "squelch.h"
+
+namespace dect2core {
+
+// Noise floor steps towards the block power, per block. Rising is
+// limited to a factor, about 6 dB per frame, so strong bursts hardly move
+// it.
+#define FLOOR_FALL	(1.0f / 8)
+#define FLOOR_RISE	1.001f
+
+squelch::squelch(unsigned block_len, float threshold_db)
+	: d_block_len(block_len),
+	d_ratio((threshold_db > 0) ? powf(10.0f, threshold_db / 10) : 0),
+	d_noise_floor(0), d_prev_above(true), d_blocks(0), d_open_blocks(0)
+{
+}
+
+bool squelch::next_block(float power, float next_power)
+{
+	bool above = power > d_noise_floor * d_ratio;
+	bool open = d_prev_above || above || next_power > d_noise_floor * d_ratio;
+	d_prev_above = above;
+
+	if (d_blocks == 0)
+		d_noise_floor = power;
+	else if (power < d_noise_floor)
+		d_noise_floor += FLOOR_FALL * (power - d_noise_floor);
+	else
+		d_noise_floor = std::min(power, d_noise_floor * FLOOR_RISE);
+
+	d_blocks++;
+	if (open)
+		d_open_blocks++;
+	return open;
+}
+
+double squelch::open_fraction(void) const
+{
+	return d_blocks ? (double)d_open_blocks / d_blocks : 1.0;
+}
+
+} /* namespace dect2core */
@@ -0,0 +1,76 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_SQUELCH_H
+#define INCLUDED_DECT2CORE_SQUELCH_H
+
+#include <cmath>
+#include <cstdint>
+
+namespace dect2core {
+
+// Squelch block length, a quarter of the S-field
+#define SQUELCH_BLOCK_SYMBOLS	8
+
+// Discriminator output of squelched samples
+#define SQUELCHED_SAMPLE	NAN
+
+inline bool is_squelched(float x)
+{
+	return std::isnan(x);
+}
+
+/*
+ * Power squelch over blocks of samples. The noise floor follows the block
+ * mean power, falling fast and rising slowly, so it settles on the gaps
+ * between bursts. A block is open if it, the block before or the block
+ * after is above the threshold, which keeps the edges of bursts and the
+ * whole S-field.
+ */
+class squelch
+{
+private:
+	unsigned d_block_len;
+	float d_ratio;		// Threshold over the noise floor, 0 if disabled
+	float d_noise_floor;
+	bool d_prev_above;
+
+	uint64_t d_blocks;
+	uint64_t d_open_blocks;
+
+public:
+	// threshold_db <= 0 disables the squelch, every block is open
+	squelch(unsigned block_len, float threshold_db);
+
+	bool enabled(void) const { return d_ratio > 0; }
+	unsigned block_len(void) const { return d_block_len; }
+	float noise_floor(void) const { return d_noise_floor; }
+
+	// Called for consecutive blocks with their mean power and that of the
+	// following block, returns whether the block is open
+	bool next_block(float power, float next_power);
+
+	// Fraction of the blocks so far that were open
+	double open_fraction(void) const;
+};
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_SQUELCH_H */
@@ -0,0 +1,93 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <cstring>
+
+#include "voice_stream.h"
+
+namespace dect2core {
+
+voice_stream::voice_stream()
+	: d_active(false)
+{
+	memset(&d_gap, 0, sizeof(d_gap));
+}
+
+size_t voice_stream::burst(const burst_info_t &info, const burst_result_t &result,
+	const uint8_t *b_field, voice_record_t *out)
+{
+	size_t n = 0;
+
+	if (!result.b_field_ok) {
+		if (!d_active)
+			return 0;
+
+		if (d_gap.bursts == 0) {
+			d_gap.type = VOICE_GAP;
+			d_gap.rx_id = info.rx_id;
+			d_gap.frame_number = result.frame_number;
+			d_gap.flags = 0;
+			d_gap.sample_index = info.sample_index;
+		}
+		d_gap.bursts++;
+		d_gap.flags |= result.b_field_present ? VOICE_GAP_CRC : VOICE_GAP_NO_VOICE;
+		return 0;
+	}
+
+	// Only records, no zero fill, so a silent part costs nothing downstream
+	if (d_gap.bursts) {
+		out[n++] = d_gap;
+		d_gap.bursts = 0;
+	}
+
+	voice_record_t *frame = &out[n++];
+	frame->type = VOICE_FRAME;
+	frame->rx_id = info.rx_id;
+	frame->frame_number = result.frame_number;
+	frame->flags = result.b_field_recovered ? VOICE_RECOVERED : 0;
+	frame->bursts = 0;
+	frame->sample_index = info.sample_index;
+	memcpy(frame->b_field, b_field, B_FIELD_BYTES);
+	d_active = true;
+
+	return n;
+}
+
+size_t voice_stream::end(uint32_t rx_id, voice_record_t *out)
+{
+	if (!d_active)
+		return 0;
+
+	if (d_gap.bursts == 0) {
+		d_gap.type = VOICE_GAP;
+		d_gap.rx_id = rx_id;
+		d_gap.frame_number = 0;
+		d_gap.flags = 0;
+		d_gap.sample_index = 0;
+	}
+	d_gap.flags |= VOICE_GAP_END;
+	*out = d_gap;
+
+	d_gap.bursts = 0;
+	d_active = false;
+	return 1;
+}
+
+} // namespace dect2core
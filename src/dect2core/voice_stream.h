@@ -0,0 +1,64 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_VOICE_STREAM_H
+#define INCLUDED_DECT2CORE_VOICE_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "burst_decoder.h"
+
+namespace dect2core {
+
+// Most records voice_stream::burst() writes
+#define VOICE_STREAM_MAX_RECORDS	2
+
+/*
+ * Turns the decoded bursts of the selected part into its voice_record_t
+ * stream: frames, gap records between them, and a VOICE_GAP_END record
+ * once the stream stops.
+ */
+class voice_stream
+{
+private:
+	bool d_active;		// Frames sent since it started
+	voice_record_t d_gap;	// Gap counted since the last frame
+
+public:
+	voice_stream();
+
+	bool active(void) const { return d_active; }
+
+	// A burst of the selected part as decoded by burst_decoder::decode(),
+	// b_field is its B-field if result.b_field_ok. Writes up to
+	// VOICE_STREAM_MAX_RECORDS records to out, returns how many.
+	size_t burst(const burst_info_t &info, const burst_result_t &result,
+		const uint8_t *b_field, voice_record_t *out);
+
+	// The selected part rx_id was lost or deselected, or the parts were
+	// cleared. Writes the VOICE_GAP_END record to out if the stream had
+	// started, returns how many: the stream ends once.
+	size_t end(uint32_t rx_id, voice_record_t *out);
+};
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_VOICE_STREAM_H */
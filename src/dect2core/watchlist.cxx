@@ -0,0 +1,253 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "watchlist.h"
+
+namespace dect2core {
+
+#define PART_ID_BITS	40
+#define PART_ID_MASK	((1ull << PART_ID_BITS) - 1)
+#define SLOT_USED	(1ull << 63)
+#define BLOOM_BITS_PER_KEY	16
+
+// MurmurHash3 finalizer: masked identities differ in few bits, and the
+// Bloom filter takes its bits from both halves of the hash
+uint64_t watchlist::hash(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ull;
+	key ^= key >> 33;
+	return key;
+}
+
+uint64_t watchlist::pack(const uint8_t *part_id)
+{
+	uint64_t key = 0;
+	for (int i = 0; i < 5; i++)
+		key = (key << 8) | part_id[i];
+	return key;
+}
+
+static bool parse_hex40(const char *s, size_t len, uint64_t *value)
+{
+	if (len != 10)
+		return false;
+
+	*value = 0;
+	for (size_t i = 0; i < len; i++) {
+		char c = s[i];
+		unsigned digit;
+		if (c >= '0' && c <= '9')
+			digit = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			digit = c - 'A' + 10;
+		else
+			return false;
+		*value = (*value << 4) | digit;
+	}
+	return true;
+}
+
+bool watchlist::add(const char *pattern, uint32_t actions)
+{
+	pattern_t p;
+	size_t len = strcspn(pattern, "/&");
+
+	if (!parse_hex40(pattern, len, &p.key))
+		return false;
+
+	p.mask = PART_ID_MASK;
+	if (pattern[len] == '/') {
+		char *end;
+		unsigned long bits = strtoul(pattern + len + 1, &end, 10);
+		if (*end || end == pattern + len + 1 || bits == 0 || bits > PART_ID_BITS)
+			return false;
+		p.mask = PART_ID_MASK & ~((1ull << (PART_ID_BITS - bits)) - 1);
+	} else if (pattern[len] == '&') {
+		if (!parse_hex40(pattern + len + 1, strlen(pattern + len + 1), &p.mask) || p.mask == 0)
+			return false;
+	}
+
+	p.key &= p.mask;
+	p.actions = actions;
+	d_patterns.push_back(p);
+	return true;
+}
+
+void watchlist::build(void)
+{
+	d_groups.clear();
+
+	for (size_t i = 0; i < d_patterns.size(); i++) {
+		size_t g;
+		for (g = 0; g < d_groups.size(); g++) {
+			if (d_groups[g].mask == d_patterns[i].mask)
+				break;
+		}
+		if (g == d_groups.size()) {
+			group_t group;
+			group.mask = d_patterns[i].mask;
+			d_groups.push_back(group);
+		}
+	}
+
+	for (size_t g = 0; g < d_groups.size(); g++) {
+		group_t &group = d_groups[g];
+		size_t n = 0;
+		for (size_t i = 0; i < d_patterns.size(); i++)
+			n += d_patterns[i].mask == group.mask;
+
+		// At most half full, so probe sequences stay short
+		unsigned log2_slots = 1;
+		while ((1ull << log2_slots) < 2 * n)
+			log2_slots++;
+		group.shift = 64 - log2_slots;
+		group.keys.assign(1ull << log2_slots, 0);
+		group.actions.assign(1ull << log2_slots, 0);
+
+		uint64_t bloom_bits = 64;
+		while (bloom_bits < BLOOM_BITS_PER_KEY * n)
+			bloom_bits <<= 1;
+		group.bloom.assign(bloom_bits / 64, 0);
+		group.bloom_mask = bloom_bits - 1;
+
+		size_t slot_mask = group.keys.size() - 1;
+		for (size_t i = 0; i < d_patterns.size(); i++) {
+			const pattern_t &p = d_patterns[i];
+			if (p.mask != group.mask)
+				continue;
+
+			uint64_t h = hash(p.key);
+			uint64_t b0 = h & group.bloom_mask, b1 = (h >> 32) & group.bloom_mask;
+			group.bloom[b0 / 64] |= 1ull << (b0 % 64);
+			group.bloom[b1 / 64] |= 1ull << (b1 % 64);
+
+			// Duplicates share a slot and their actions
+			size_t slot = h >> group.shift;
+			while (group.keys[slot] && group.keys[slot] != (p.key | SLOT_USED))
+				slot = (slot + 1) & slot_mask;
+			group.keys[slot] = p.key | SLOT_USED;
+			group.actions[slot] |= p.actions;
+		}
+	}
+}
+
+uint32_t watchlist::match(const uint8_t *part_id) const
+{
+	uint64_t id = pack(part_id);
+	uint32_t actions = 0;
+
+	for (size_t g = 0; g < d_groups.size(); g++) {
+		const group_t &group = d_groups[g];
+		uint64_t key = id & group.mask;
+		uint64_t h = hash(key);
+		uint64_t b0 = h & group.bloom_mask, b1 = (h >> 32) & group.bloom_mask;
+
+		if (!(group.bloom[b0 / 64] & (1ull << (b0 % 64))) || !(group.bloom[b1 / 64] & (1ull << (b1 % 64))))
+			continue;
+
+		size_t slot_mask = group.keys.size() - 1;
+		for (size_t slot = h >> group.shift; group.keys[slot]; slot = (slot + 1) & slot_mask) {
+			if (group.keys[slot] == (key | SLOT_USED)) {
+				actions |= group.actions[slot];
+				break;
+			}
+		}
+	}
+
+	return actions;
+}
+
+uint32_t watchlist::all_actions(void) const
+{
+	uint32_t actions = 0;
+	for (size_t i = 0; i < d_patterns.size(); i++)
+		actions |= d_patterns[i].actions;
+	return actions;
+}
+
+static bool parse_actions(char *s, uint32_t *actions)
+{
+	*actions = 0;
+	for (char *tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+		if (strcmp(tok, "report") == 0)
+			*actions |= WATCH_REPORT;
+		else if (strcmp(tok, "dwell") == 0)
+			*actions |= WATCH_DWELL;
+		else if (strcmp(tok, "record") == 0)
+			*actions |= WATCH_RECORD;
+		else
+			return false;
+	}
+	return true;
+}
+
+watchlist *watchlist::load(const char *path, unsigned *bad_line)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		*bad_line = 0;
+		return NULL;
+	}
+
+	watchlist *list = new watchlist();
+	char line[256];
+	unsigned line_no = 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		line_no++;
+
+		char *comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+
+		char *pattern = strtok(line, " \t\r\n");
+		if (!pattern)
+			continue;
+
+		char *actions_str = strtok(NULL, " \t\r\n");
+		uint32_t actions = WATCH_REPORT;
+
+		bool ok = strtok(NULL, " \t\r\n") == NULL;
+		if (ok && actions_str)
+			ok = parse_actions(actions_str, &actions);
+
+		if (!ok || !list->add(pattern, actions)) {
+			*bad_line = line_no;
+			delete list;
+			fclose(f);
+			return NULL;
+		}
+	}
+
+	fclose(f);
+	list->build();
+	return list;
+}
+
+} /* namespace dect2core */
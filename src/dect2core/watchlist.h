@@ -0,0 +1,95 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_DECT2CORE_WATCHLIST_H
+#define INCLUDED_DECT2CORE_WATCHLIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dect2core {
+
+// What to do when a watched part shows up
+#define WATCH_REPORT	0x01	// Report it at once as a matched event
+#define WATCH_DWELL	0x02	// Stay on its carrier while it is active
+#define WATCH_RECORD	0x04	// Record its bursts (--record)
+
+/*
+ * Set of part identity patterns, each a 40 bit RFPI or PMID under a mask,
+ * with the actions to take on a match.
+ *
+ * Patterns are grouped by mask, a watchlist rarely has more than a few.
+ * Each group is an open addressing hash set of the masked identities with
+ * a small Bloom filter in front, so a part that isn't watched usually
+ * costs one cached bit test per group.
+ */
+class watchlist
+{
+private:
+	typedef struct {
+		uint64_t mask;
+		unsigned shift;			// 64 - log2 of the slot count
+		std::vector<uint64_t> keys;	// Masked identity | SLOT_USED, 0 if free
+		std::vector<uint32_t> actions;
+		std::vector<uint64_t> bloom;
+		uint64_t bloom_mask;		// Bits
+	} group_t;
+
+	typedef struct {
+		uint64_t key;
+		uint64_t mask;
+		uint32_t actions;
+	} pattern_t;
+
+	std::vector<pattern_t> d_patterns;
+	std::vector<group_t> d_groups;
+
+	static uint64_t hash(uint64_t key);
+	static uint64_t pack(const uint8_t *part_id);
+
+public:
+	// Load a watchlist file, see README.md. Returns NULL on failure with
+	// *bad_line set to the offending line, or to 0 and errno set if the
+	// file can't be read.
+	static watchlist *load(const char *path, unsigned *bad_line);
+
+	/*
+	 * Add a pattern: 10 hex digits, optionally followed by /bits to only
+	 * compare the first bits, or by &mask with 10 more hex digits. Returns
+	 * false if it doesn't parse. build() must be called before match().
+	 */
+	bool add(const char *pattern, uint32_t actions);
+
+	// Build the lookup tables from the patterns added so far
+	void build(void);
+
+	size_t size(void) const { return d_patterns.size(); }
+
+	// WATCH_* actions of every pattern matching part_id, 0 if none
+	uint32_t match(const uint8_t *part_id) const;
+
+	// Actions of all patterns together
+	uint32_t all_actions(void) const;
+};
+
+} // namespace dect2core
+
+#endif /* INCLUDED_DECT2CORE_WATCHLIST_H */
@@ -0,0 +1,102 @@
+/* frontend.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <cmath>
+
+#include <gnuradio/filter/fir_filter_ccf.h>
+#include <gnuradio/filter/firdes.h>
+#include <gnuradio/filter/fractional_resampler_cc.h>
+#include <gnuradio/filter/rational_resampler_base_ccc.h>
+
+#include "frontend.h"
+#include "logging.h"
+
+using gr::filter::fir_filter_ccf;
+using gr::filter::firdes;
+using gr::filter::fractional_resampler_cc;
+using gr::filter::rational_resampler_base_ccc;
+
+static const double dect_occupied_bandwidth = 1.2 * DECT_SYMBOL_RATE;
+static const double dect_channel_bandwidth = 1.728e6;
+
+// Device clocks are off by a few ppm anyway, the receiver tolerates far more
+#define NATIVE_RATE_TOL		10e-6
+
+unsigned frontend::native_decimation(double samp_rate, unsigned sps)
+{
+	double out_rate = sps * DECT_SYMBOL_RATE;
+	unsigned decimation = (unsigned)lrint(samp_rate / out_rate);
+
+	if (decimation == 0 || std::fabs(samp_rate / (decimation * out_rate) - 1.0) >= NATIVE_RATE_TOL)
+		return 0;
+	return decimation;
+}
+
+frontend *frontend::make(gr::top_block_sptr tb, double samp_rate, unsigned sps)
+{
+	return new frontend(tb, samp_rate, sps);
+}
+
+frontend::frontend(gr::top_block_sptr tb, double samp_rate, unsigned sps)
+	: d_samp_rate(samp_rate), d_sps(sps)
+{
+	unsigned decimation = native_decimation(samp_rate, sps);
+	d_native = decimation != 0;
+
+	if (d_native) {
+		// Symbol locked capture: a decimating channel filter is all that's needed
+		std::vector<float> taps = firdes::low_pass_2(
+			1, samp_rate, dect_occupied_bandwidth / 2, (dect_channel_bandwidth - dect_occupied_bandwidth) / 2, 30);
+
+		fir_filter_ccf::sptr channel_filter = fir_filter_ccf::make(decimation, taps);
+		d_input_offset = -((taps.size() - 1) / 2.0);
+
+		d_first = channel_filter;
+		d_last = channel_filter;
+
+		log_info("front end: native %5.3lf Msps, %zu tap channel filter, %u samples per symbol\n",
+			samp_rate / 1e6, taps.size(), sps);
+		return;
+	}
+
+	// Upsample 3/2 with the channel filter folded into the interpolator,
+	// then resample to exactly sps samples per symbol
+	std::vector<float> resampler_filter_taps_float = firdes::low_pass_2(
+		1, 3 * samp_rate, dect_occupied_bandwidth / 2, (dect_channel_bandwidth - dect_occupied_bandwidth) / 2, 30);
+	std::vector<gr_complex> resampler_filter_taps;
+	resampler_filter_taps.resize(resampler_filter_taps_float.size());
+	for (size_t i = 0; i < resampler_filter_taps_float.size(); i++)
+		resampler_filter_taps[i] = resampler_filter_taps_float[i];
+
+	rational_resampler_base_ccc::sptr rational_resampler = rational_resampler_base_ccc::make(3, 2, resampler_filter_taps);
+
+	fractional_resampler_cc::sptr fractional_resampler = fractional_resampler_cc::make(0, float((3.0 * samp_rate / 2.0) / (sps * DECT_SYMBOL_RATE)));
+
+	tb->connect(rational_resampler, 0, fractional_resampler, 0);
+
+	// Half the interpolator taps at 3 times the input rate, and about half
+	// of the fractional resampler's 8 taps at 1.5 times
+	d_input_offset = -((resampler_filter_taps.size() - 1) / 6.0 + 4 / 1.5);
+
+	d_first = rational_resampler;
+	d_last = fractional_resampler;
+
+	log_info("front end: %5.3lf Msps, resampling to %5.3lf Msps\n", samp_rate / 1e6, sps * DECT_SYMBOL_RATE / 1e6);
+}
@@ -0,0 +1,64 @@
+/* frontend.h */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _FRONTEND_H
+#define _FRONTEND_H
+
+#include <gnuradio/top_block.h>
+
+// Symbol locked rate asked from devices, 4 samples per 1.152 Msym/s symbol
+#define DECT_SYMBOL_RATE	1152000.0
+#define DECT_NATIVE_RATE	(4 * DECT_SYMBOL_RATE)
+
+/*
+ * Channel filter bringing samp_rate down to sps samples per symbol and,
+ * when samp_rate isn't a multiple of that, the resampling chain in front of
+ * it. Blocks are created in tb, the caller connects its source to first and
+ * last to the demodulator.
+ */
+class frontend
+{
+private:
+	double d_samp_rate;
+	unsigned d_sps;
+	bool d_native;
+	double d_input_offset;
+	gr::basic_block_sptr d_first;
+	gr::basic_block_sptr d_last;
+
+	frontend(gr::top_block_sptr tb, double samp_rate, unsigned sps);
+
+public:
+	static frontend *make(gr::top_block_sptr tb, double samp_rate, unsigned sps = 4);
+
+	// Decimation if samp_rate is close enough to a multiple of sps samples
+	// per symbol to skip resampling, 0 otherwise
+	static unsigned native_decimation(double samp_rate, unsigned sps);
+
+	double samp_rate(void) const { return d_samp_rate; }
+	unsigned sps(void) const { return d_sps; }
+	bool native(void) const { return d_native; }
+	// Input item that output item 0 stands for, negative within the history
+	double input_offset(void) const { return d_input_offset; }
+	gr::basic_block_sptr first(void) const { return d_first; }
+	gr::basic_block_sptr last(void) const { return d_last; }
+};
+
+#endif
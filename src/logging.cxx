@@ -18,8 +18,32 @@
  * Boston, MA 02110-1301, USA.
  */
 
+/*
+ * Messages are not formatted on the calling thread. The caller only copies
+ * the format pointer, the raw arguments and the contents of %s strings into
+ * a per-thread lock-free ring. A background writer thread collects the
+ * records of all threads, orders them by timestamp, formats them and writes
+ * them to stderr in batches.
+ *
+ * Errors, and messages that don't fit a record, are written on the calling
+ * thread once everything logged before them is out.
+ */
+
+#include <errno.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "logging.h"
 
@@ -28,9 +52,477 @@
 		return; \
 } while (0)
 
+#define LOG_RING_SIZE		256	// Records per thread, power of two
+#define LOG_MAX_ARGS		16
+#define LOG_STRBUF_LEN		256	// Room for copied %s arguments
+#define LOG_SITES		256	// Rate limiter slots, power of two
+#define LOG_FLUSH_INTERVAL_MS	20
+
 int loglevel = 0;
 
+typedef enum {
+	ARG_INT,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_INTMAX,
+	ARG_SIZE,
+	ARG_PTRDIFF,
+	ARG_DOUBLE,
+	ARG_LDOUBLE,
+	ARG_PTR,
+	ARG_STR,
+} log_arg_type;
+
+typedef struct {
+	uint64_t timestamp;	// CLOCK_REALTIME, ns
+	const char *fmt;	// NULL: message preformatted into strbuf, see log_report_drops()
+	int level;
+	uint8_t nargs;
+	uint8_t arg_type[LOG_MAX_ARGS];
+	union {
+		long long i;
+		double d;
+		long double ld;
+		const void *p;
+		size_t s;	// Offset into strbuf
+	} arg[LOG_MAX_ARGS];
+	uint16_t strbuf_len;
+	char strbuf[LOG_STRBUF_LEN];
+} log_record;
+
+struct log_ring {
+	log_record records[LOG_RING_SIZE];
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+	std::atomic<bool> closed;	// Owner thread has exited
+	log_ring *next;
+
+	log_ring() : head(0), tail(0), closed(false), next(NULL) {}
+};
+
+typedef struct {
+	std::atomic<const char *> fmt;
+	std::atomic<uint64_t> window;	// Second the count refers to
+	std::atomic<uint32_t> count;
+} log_site;
+
+static std::mutex rings_mutex;
+static log_ring *rings;
+
+static log_site sites[LOG_SITES];
+static std::atomic<unsigned> rate_limit(0);	// Off unless log_set_rate_limit() is called
+
+static std::atomic<uint64_t> ring_full_cnt(0);
+static std::atomic<uint64_t> rate_limited_cnt(0);
+
+static std::once_flag writer_once;
+static std::thread writer_thread;
+static std::atomic<bool> writer_running(false);
+static std::atomic<uint64_t> flush_request(0);
+static std::atomic<uint64_t> flush_done(0);
+static std::mutex writer_mutex;
+static std::condition_variable writer_cond;
+static std::mutex stderr_mutex;
+
+static void writer_loop(void);
+
+static void writer_stop(void)
+{
+	if (!writer_running)
+		return;
+
+	writer_running = false;
+	writer_cond.notify_one();
+	writer_thread.join();
+}
+
+static void writer_start(void)
+{
+	writer_running = true;
+	writer_thread = std::thread(writer_loop);
+	atexit(writer_stop);
+}
+
+/*
+ * Per-thread ring. The ring itself is owned by the writer, which frees it
+ * once the thread has exited and its records have been written out.
+ */
+struct log_ring_handle {
+	log_ring *ring;
+
+	log_ring_handle() : ring(NULL) {}
+	~log_ring_handle()
+	{
+		if (ring)
+			ring->closed.store(true, std::memory_order_release);
+	}
+
+	log_ring *get(void)
+	{
+		if (!ring) {
+			ring = new log_ring;
+			std::lock_guard<std::mutex> lock(rings_mutex);
+			ring->next = rings;
+			rings = ring;
+		}
+		return ring;
+	}
+};
+
+static thread_local log_ring_handle thread_ring;
+
+static uint64_t log_timestamp(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * Rate limiting per call site. Call sites are told apart by their format
+ * string, which for the log_* functions is a string literal.
+ */
+static bool log_rate_limited(const char *fmt, uint64_t timestamp)
+{
+	unsigned limit = rate_limit.load(std::memory_order_relaxed);
+	if (limit == 0)
+		return false;
+
+	uint64_t second = timestamp / 1000000000ull;
+	size_t index = ((uintptr_t)fmt >> 3) & (LOG_SITES - 1);
+
+	for (unsigned probe = 0; probe < 8; probe++) {
+		log_site *site = &sites[(index + probe) & (LOG_SITES - 1)];
+		const char *site_fmt = site->fmt.load(std::memory_order_acquire);
+
+		if (site_fmt == NULL) {
+			if (!site->fmt.compare_exchange_strong(site_fmt, fmt))
+				if (site_fmt != fmt)
+					continue;
+		} else if (site_fmt != fmt) {
+			continue;
+		}
+
+		uint64_t window = site->window.load(std::memory_order_relaxed);
+		if (window != second && site->window.compare_exchange_strong(window, second))
+			site->count.store(0, std::memory_order_relaxed);
+
+		return site->count.fetch_add(1, std::memory_order_relaxed) >= limit;
+	}
+
+	return false; // No free slot, never limit
+}
+
+/*
+ * Walk the format string the same way printf does and save the arguments.
+ * Returns false if the format can not be deferred (too many arguments,
+ * wide strings, %n and the like) or its strings don't fit the record.
+ */
+static bool log_capture(log_record *rec, const char *fmt, va_list ap)
+{
+	const char *p = fmt;
+
+	rec->nargs = 0;
+	rec->strbuf_len = 0;
+
+	while ((p = strchr(p, '%')) != NULL) {
+		p++;
+		if (*p == '%') {
+			p++;
+			continue;
+		}
+
+		while (*p && strchr("-+ #0'", *p))
+			p++;
+
+		if (*p == '*') {
+			if (rec->nargs == LOG_MAX_ARGS)
+				return false;
+			rec->arg_type[rec->nargs] = ARG_INT;
+			rec->arg[rec->nargs++].i = va_arg(ap, int);
+			p++;
+		} else {
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+
+		if (*p == '.') {
+			p++;
+			if (*p == '*') {
+				if (rec->nargs == LOG_MAX_ARGS)
+					return false;
+				rec->arg_type[rec->nargs] = ARG_INT;
+				rec->arg[rec->nargs++].i = va_arg(ap, int);
+				p++;
+			} else {
+				while (*p >= '0' && *p <= '9')
+					p++;
+			}
+		}
+
+		log_arg_type int_type = ARG_INT;
+		bool long_double = false;
+		switch (*p) {
+		case 'h':
+			p++;
+			if (*p == 'h')
+				p++;
+			break;
+		case 'l':
+			p++;
+			int_type = ARG_LONG;
+			if (*p == 'l') {
+				p++;
+				int_type = ARG_LLONG;
+			}
+			break;
+		case 'q':
+			p++;
+			int_type = ARG_LLONG;
+			break;
+		case 'j':
+			p++;
+			int_type = ARG_INTMAX;
+			break;
+		case 'z':
+			p++;
+			int_type = ARG_SIZE;
+			break;
+		case 't':
+			p++;
+			int_type = ARG_PTRDIFF;
+			break;
+		case 'L':
+			p++;
+			long_double = true;
+			break;
+		}
+
+		if (rec->nargs == LOG_MAX_ARGS)
+			return false;
+
+		int n = rec->nargs;
+		switch (*p) {
+		case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+			rec->arg_type[n] = int_type;
+			switch (int_type) {
+			case ARG_LONG:    rec->arg[n].i = va_arg(ap, long);      break;
+			case ARG_LLONG:   rec->arg[n].i = va_arg(ap, long long); break;
+			case ARG_INTMAX:  rec->arg[n].i = va_arg(ap, intmax_t);  break;
+			case ARG_SIZE:    rec->arg[n].i = va_arg(ap, size_t);    break;
+			case ARG_PTRDIFF: rec->arg[n].i = va_arg(ap, ptrdiff_t); break;
+			default:          rec->arg[n].i = va_arg(ap, int);       break;
+			}
+			break;
+
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			if (long_double) {
+				rec->arg_type[n] = ARG_LDOUBLE;
+				rec->arg[n].ld = va_arg(ap, long double);
+			} else {
+				rec->arg_type[n] = ARG_DOUBLE;
+				rec->arg[n].d = va_arg(ap, double);
+			}
+			break;
+
+		case 'p':
+			rec->arg_type[n] = ARG_PTR;
+			rec->arg[n].p = va_arg(ap, void *);
+			break;
+
+		case 's': {
+			if (int_type != ARG_INT)
+				return false; // %ls
+			const char *str = va_arg(ap, const char *);
+			if (str == NULL)
+				str = "(null)";
+			size_t len = strnlen(str, LOG_STRBUF_LEN);
+			if (len >= (size_t)(LOG_STRBUF_LEN - rec->strbuf_len))
+				return false;
+			memcpy(rec->strbuf + rec->strbuf_len, str, len);
+			rec->strbuf[rec->strbuf_len + len] = 0;
+			rec->arg_type[n] = ARG_STR;
+			rec->arg[n].s = rec->strbuf_len;
+			rec->strbuf_len += len + 1;
+			break;
+		}
+
+		default:
+			return false;
+		}
+
+		rec->nargs++;
+		p++;
+	}
+
+	return true;
+}
+
+static void log_format_prefix(std::string &out, uint64_t timestamp, int level);
+
+// Format and write a message right away, after what is queued
+static void log_write_now(int level, uint64_t timestamp, const char *fmt, va_list ap)
+{
+	std::string out;
+	va_list aq;
+
+	log_flush();
+
+	log_format_prefix(out, timestamp, level);
+	size_t start = out.size();
+	va_copy(aq, ap);
+	int len = vsnprintf(NULL, 0, fmt, aq);
+	va_end(aq);
+	if (len > 0) {
+		out.resize(start + len + 1);
+		vsnprintf(&out[start], len + 1, fmt, ap);
+		out.resize(start + len);
+	}
+
+	std::lock_guard<std::mutex> lock(stderr_mutex);
+	fwrite(out.data(), 1, out.size(), stderr);
+	fflush(stderr);
+}
+
 static void log_vprintf_internal(int level, const char *fmt, va_list ap)
+{
+	uint64_t timestamp = log_timestamp();
+
+	// Not lost if the program crashes or exits right after
+	if (level == LOGLEVEL_ERROR) {
+		log_write_now(level, timestamp, fmt, ap);
+		return;
+	}
+
+	if (log_rate_limited(fmt, timestamp)) {
+		rate_limited_cnt.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	std::call_once(writer_once, writer_start);
+
+	log_ring *ring = thread_ring.get();
+	size_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_SIZE) {
+		ring_full_cnt.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	log_record *rec = &ring->records[head & (LOG_RING_SIZE - 1)];
+	rec->timestamp = timestamp;
+	rec->level = level;
+	rec->fmt = fmt;
+
+	va_list aq;
+	va_copy(aq, ap);
+	bool captured = log_capture(rec, fmt, aq);
+	va_end(aq);
+
+	// Can not defer this one, the slot stays free
+	if (!captured) {
+		log_write_now(level, timestamp, fmt, ap);
+		return;
+	}
+
+	ring->head.store(head + 1, std::memory_order_release);
+
+	if (level <= LOGLEVEL_WARNING || (head + 1 - ring->tail.load(std::memory_order_relaxed)) >= LOG_RING_SIZE / 2)
+		writer_cond.notify_one();
+}
+
+/*
+ * Writer side
+ */
+
+// Formatted value, however long
+template <typename T>
+static void log_append(std::string &out, const char *sfmt, T value)
+{
+	char buf[512];
+	int len = snprintf(buf, sizeof(buf), sfmt, value);
+
+	if (len <= 0)
+		return;
+	if ((size_t)len < sizeof(buf)) {
+		out.append(buf, len);
+		return;
+	}
+
+	size_t start = out.size();
+	out.resize(start + len + 1);
+	snprintf(&out[start], len + 1, sfmt, value);
+	out.resize(start + len);
+}
+
+static void log_format_spec(std::string &out, const char *spec, size_t spec_len,
+	const log_record *rec, unsigned *argi)
+{
+	char sfmt[64];
+	size_t n = 0;
+
+	// Resolve '*' width and precision into the spec itself
+	for (size_t i = 0; i < spec_len && n < sizeof(sfmt) - 16; i++) {
+		if (spec[i] == '*')
+			n += snprintf(sfmt + n, sizeof(sfmt) - n, "%d", (int)rec->arg[(*argi)++].i);
+		else
+			sfmt[n++] = spec[i];
+	}
+	sfmt[n] = 0;
+
+	if (*argi >= rec->nargs)
+		return;
+
+	unsigned a = (*argi)++;
+	char conv = spec[spec_len - 1];
+	bool is_signed = (conv == 'd' || conv == 'i');
+
+	switch (rec->arg_type[a]) {
+	case ARG_INT:
+		if (is_signed)
+			log_append(out, sfmt, (int)rec->arg[a].i);
+		else
+			log_append(out, sfmt, (unsigned)rec->arg[a].i);
+		break;
+	case ARG_LONG:
+		if (is_signed)
+			log_append(out, sfmt, (long)rec->arg[a].i);
+		else
+			log_append(out, sfmt, (unsigned long)rec->arg[a].i);
+		break;
+	case ARG_LLONG:
+		if (is_signed)
+			log_append(out, sfmt, (long long)rec->arg[a].i);
+		else
+			log_append(out, sfmt, (unsigned long long)rec->arg[a].i);
+		break;
+	case ARG_INTMAX:
+		if (is_signed)
+			log_append(out, sfmt, (intmax_t)rec->arg[a].i);
+		else
+			log_append(out, sfmt, (uintmax_t)rec->arg[a].i);
+		break;
+	case ARG_SIZE:
+		log_append(out, sfmt, (size_t)rec->arg[a].i);
+		break;
+	case ARG_PTRDIFF:
+		log_append(out, sfmt, (ptrdiff_t)rec->arg[a].i);
+		break;
+	case ARG_DOUBLE:
+		log_append(out, sfmt, rec->arg[a].d);
+		break;
+	case ARG_LDOUBLE:
+		log_append(out, sfmt, rec->arg[a].ld);
+		break;
+	case ARG_PTR:
+		log_append(out, sfmt, rec->arg[a].p);
+		break;
+	case ARG_STR:
+		log_append(out, sfmt, (const char *)(rec->strbuf + rec->arg[a].s));
+		break;
+	}
+}
+
+static void log_format_prefix(std::string &out, uint64_t timestamp, int level)
 {
 	const char *level_name;
 	switch (level) {
@@ -42,8 +534,186 @@ static void log_vprintf_internal(int level, const char *fmt, va_list ap)
 	default: level_name = "TRACE"; break;
 	}
 
-	fprintf(stderr, "%s:main:", level_name);
-	vfprintf(stderr, fmt, ap);
+	char prefix[64];
+	time_t sec = timestamp / 1000000000ull;
+	struct tm tm;
+	localtime_r(&sec, &tm);
+	snprintf(prefix, sizeof(prefix), "%02d:%02d:%02d.%06u %s:main:",
+		tm.tm_hour, tm.tm_min, tm.tm_sec,
+		(unsigned)((timestamp % 1000000000ull) / 1000), level_name);
+	out += prefix;
+}
+
+static void log_format_record(std::string &out, const log_record *rec)
+{
+	log_format_prefix(out, rec->timestamp, rec->level);
+
+	if (rec->fmt == NULL) {
+		out += rec->strbuf;
+		return;
+	}
+
+	const char *p = rec->fmt;
+	unsigned argi = 0;
+	while (*p) {
+		const char *pct = strchr(p, '%');
+		if (pct == NULL) {
+			out += p;
+			break;
+		}
+		out.append(p, pct - p);
+
+		if (pct[1] == '%') {
+			out += '%';
+			p = pct + 2;
+			continue;
+		}
+
+		// The format was validated at capture time, find the conversion
+		const char *end = pct + 1;
+		while (*end && !strchr("diouxXcseEfFgGaAp", *end))
+			end++;
+		if (*end == 0)
+			break;
+
+		log_format_spec(out, pct, end - pct + 1, rec, &argi);
+		p = end + 1;
+	}
+}
+
+static void log_report_drops(std::string &out, uint64_t *reported_full, uint64_t *reported_limited)
+{
+	uint64_t full = ring_full_cnt.load(std::memory_order_relaxed);
+	uint64_t limited = rate_limited_cnt.load(std::memory_order_relaxed);
+
+	if (full == *reported_full && limited == *reported_limited)
+		return;
+
+	log_record rec;
+	rec.timestamp = log_timestamp();
+	rec.level = LOGLEVEL_WARNING;
+	rec.fmt = NULL;
+	snprintf(rec.strbuf, sizeof(rec.strbuf),
+		"log messages dropped: %llu (ring full), %llu (rate limit)\n",
+		(unsigned long long)(full - *reported_full),
+		(unsigned long long)(limited - *reported_limited));
+	log_format_record(out, &rec);
+
+	*reported_full = full;
+	*reported_limited = limited;
+}
+
+// Drain all rings once and write the batch. Returns the number of records.
+static size_t log_write_batch(std::vector<const log_record *> &batch, std::string &out)
+{
+	std::vector<std::pair<log_ring *, size_t> > drained;
+
+	batch.clear();
+	out.clear();
+
+	{
+		std::lock_guard<std::mutex> lock(rings_mutex);
+
+		log_ring **link = &rings;
+		while (*link) {
+			log_ring *ring = *link;
+			bool closed = ring->closed.load(std::memory_order_acquire);
+			size_t tail = ring->tail.load(std::memory_order_relaxed);
+			size_t head = ring->head.load(std::memory_order_acquire);
+
+			if (closed && head == tail) {
+				*link = ring->next;
+				delete ring;
+				continue;
+			}
+
+			for (size_t i = tail; i != head; i++)
+				batch.push_back(&ring->records[i & (LOG_RING_SIZE - 1)]);
+			drained.push_back(std::make_pair(ring, head));
+
+			link = &ring->next;
+		}
+	}
+
+	std::stable_sort(batch.begin(), batch.end(),
+		[](const log_record *a, const log_record *b) { return a->timestamp < b->timestamp; });
+
+	for (const log_record *rec : batch)
+		log_format_record(out, rec);
+
+	// Hand the slots back only after formatting
+	for (auto &it : drained)
+		it.first->tail.store(it.second, std::memory_order_release);
+
+	if (!out.empty()) {
+		std::lock_guard<std::mutex> lock(stderr_mutex);
+		fwrite(out.data(), 1, out.size(), stderr);
+		fflush(stderr);
+	}
+
+	return batch.size();
+}
+
+static void writer_loop(void)
+{
+	std::vector<const log_record *> batch;
+	std::string out;
+	uint64_t reported_full = 0;
+	uint64_t reported_limited = 0;
+
+	batch.reserve(LOG_RING_SIZE);
+	out.reserve(LOG_RING_SIZE * 128);
+
+	while (1) {
+		uint64_t request = flush_request.load(std::memory_order_acquire);
+		bool running = writer_running.load(std::memory_order_acquire);
+
+		while (log_write_batch(batch, out))
+			;
+
+		out.clear();
+		log_report_drops(out, &reported_full, &reported_limited);
+		if (!out.empty()) {
+			std::lock_guard<std::mutex> lock(stderr_mutex);
+			fwrite(out.data(), 1, out.size(), stderr);
+			fflush(stderr);
+		}
+
+		flush_done.store(request, std::memory_order_release);
+
+		if (!running)
+			break;
+
+		std::unique_lock<std::mutex> lock(writer_mutex);
+		if (flush_request.load(std::memory_order_acquire) == request)
+			writer_cond.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+	}
+}
+
+/*
+ * Public API
+ */
+
+void log_flush(void)
+{
+	if (!writer_running)
+		return;
+
+	uint64_t request = flush_request.fetch_add(1) + 1;
+	while (writer_running && flush_done.load(std::memory_order_acquire) < request) {
+		writer_cond.notify_one();
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+}
+
+void log_set_rate_limit(unsigned messages_per_second)
+{
+	rate_limit = messages_per_second;
+}
+
+unsigned long long log_dropped_count(void)
+{
+	return ring_full_cnt.load(std::memory_order_relaxed) + rate_limited_cnt.load(std::memory_order_relaxed);
 }
 
 void log_vprintf(int level, const char *fmt, va_list ap)
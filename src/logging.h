@@ -35,6 +35,20 @@ extern "C" {
 
 extern int loglevel;
 
+/*
+ * Messages are formatted and written to stderr by a background thread.
+ * Errors, and messages too long to queue, are written at once by the
+ * caller, after everything logged before them. log_flush() blocks until
+ * everything logged so far has been written.
+ */
+extern void log_flush(void);
+
+/* Per call site limit, off (0) by default. Errors are never limited. */
+extern void log_set_rate_limit(unsigned messages_per_second);
+
+/* Messages lost to full rings or to the rate limit */
+extern unsigned long long log_dropped_count(void);
+
 extern void log_vprintf(int level, const char *fmt, va_list ap);
 
 extern void log_printf(int level, const char *fmt, ...)
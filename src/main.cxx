@@ -23,16 +23,25 @@
 
 #include <sys/types.h>
 
+#include <errno.h>
 #include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <gnuradio/basic_block.h>
+#include <gnuradio/blocks/file_source.h>
 #include <gnuradio/blocks/null_sink.h>
-#include <gnuradio/filter/firdes.h>
-#include <gnuradio/filter/fractional_resampler_cc.h>
-#include <gnuradio/filter/rational_resampler_base_ccc.h>
-#include <gnuradio/filter/rational_resampler_base_fff.h>
+#include <gnuradio/sync_block.h>
 #include <gnuradio/tagged_stream_block.h>
 #include <gnuradio/thread/thread.h>
 #include <gnuradio/top_block.h>
@@ -44,18 +53,34 @@
 #include <gnuradio/uhd/usrp_source.h>
 #endif
 
+#include "dect2/int_phase_diff.h"
 #include "dect2/packet_decoder.h"
 #include "dect2/packet_receiver.h"
 #include "dect2/phase_diff.h"
+#include "dect2core/burst_decoder.h"
+#include "dect2core/burst_recorder.h"
+#include "dect2core/chase.h"
+#include "dect2core/dect2_common.h"
+#include "dect2core/part_event_queue.h"
+#include "dect2core/watchlist.h"
+#include "control_socket.h"
+#include "frontend.h"
 #include "logging.h"
+#include "report_writer.h"
+#include "shm_ring.h"
+#include "sightings.h"
+#include "voice_writer.h"
 
-using gr::filter::rational_resampler_base_ccc;
-using gr::filter::rational_resampler_base_fff;
-using gr::filter::fractional_resampler_cc;
 using gr::blocks::null_sink;
 
 static volatile bool g_application_running;
 
+static void signal_handler(int signum)
+{
+	(void)signum;
+	g_application_running = false;
+}
+
 class console_dumper : virtual public gr::tagged_stream_block {
 public:
 	typedef boost::shared_ptr<console_dumper> sptr;
@@ -95,15 +120,11 @@ console_dumper_impl::~console_dumper_impl()
 
 void console_dumper_impl::msg_event_handler(pmt::pmt_t msg)
 {
-#if 0
 	pmt::pmt_t value = pmt::dict_ref(msg, pmt::mp("log_msg"), pmt::mp(""));
 	std::string s = symbol_to_string(value);
 	if (s != "") {
-		//fprintf(stderr, "%s\n", s.c_str());
+		log_debug("%s", s.c_str());
 	}
-#else
-	(void)msg;
-#endif
 }
 
 int console_dumper_impl::work(int noutput_items,
@@ -117,13 +138,294 @@ int console_dumper_impl::work(int noutput_items,
 	return noutput_items;
 }
 
-static double dect_symbol_rate = 1152000;
-static double dect_occupied_bandwidth = 1.2 * dect_symbol_rate;
-static double dect_channel_bandwidth = 1.728e6;
-static double baseband_sampling_rate = 3200000;
+/*
+ * Base of the sinks of the decoder's voice records. The end of a stream
+ * that no burst came to carry arrives on voice_end_in with the number of
+ * records before it, and is handed on in its place among them. work()
+ * takes the messages first, as records after an end may be in before the
+ * end is. Streams still open when the flowgraph stops are ended then.
+ */
+class voice_record_sink : virtual public gr::sync_block {
+protected:
+	voice_record_sink();
+
+	// Records in stream order
+	virtual void records(const dect2core::voice_record_t *r, size_t n) = 0;
+
+private:
+	pmt::pmt_t d_end_port;
+	std::deque<std::pair<uint64_t, dect2core::voice_record_t> > d_ends;
+	uint32_t d_open;	// rx_ids with frames since their end
+
+	void deliver(const dect2core::voice_record_t *r, size_t n);
+	void msg_event_handler(pmt::pmt_t msg);
+
+public:
+	virtual int work(int noutput_items,
+		gr_vector_const_void_star &input_items,
+		gr_vector_void_star &output_items);
+	virtual bool stop(void);
+};
+
+voice_record_sink::voice_record_sink() :
+	d_end_port(pmt::mp("voice_end_in")), d_open(0)
+{
+	message_port_register_in(d_end_port);
+	set_msg_handler(d_end_port, boost::bind(&voice_record_sink::msg_event_handler, this, _1));
+}
+
+void voice_record_sink::deliver(const dect2core::voice_record_t *r, size_t n)
+{
+	if (n == 0)
+		return;
+
+	for (size_t i = 0; i < n; i++) {
+		if (r[i].rx_id >= MAX_PARTS)
+			continue;
+		if (r[i].type == VOICE_FRAME)
+			d_open |= 1u << r[i].rx_id;
+		else if (r[i].flags & VOICE_GAP_END)
+			d_open &= ~(1u << r[i].rx_id);
+	}
+	records(r, n);
+}
+
+void voice_record_sink::msg_event_handler(pmt::pmt_t msg)
+{
+	pmt::pmt_t blob = pmt::dict_ref(msg, pmt::mp("record"), pmt::PMT_NIL);
+	if (!pmt::is_blob(blob) || pmt::blob_length(blob) != sizeof(dect2core::voice_record_t))
+		return;
+
+	std::pair<uint64_t, dect2core::voice_record_t> end;
+	end.first = pmt::to_uint64(pmt::dict_ref(msg, pmt::mp("offset"), pmt::from_uint64(0)));
+	memcpy(&end.second, pmt::blob_data(blob), sizeof(end.second));
+
+	if (d_ends.empty() && end.first <= nitems_read(0))
+		deliver(&end.second, 1);
+	else
+		d_ends.push_back(end);
+}
+
+int voice_record_sink::work(int noutput_items,
+	gr_vector_const_void_star &input_items,
+	gr_vector_void_star &output_items)
+{
+	const dect2core::voice_record_t *in = (const dect2core::voice_record_t *)input_items[0];
+	uint64_t offset = nitems_read(0);
+	size_t done = 0;
+
+	(void)output_items;
+
+	while (!empty_p(d_end_port))
+		msg_event_handler(delete_head_nowait(d_end_port));
+
+	while (!d_ends.empty() && d_ends.front().first <= offset + noutput_items) {
+		size_t n = (size_t)(std::max(d_ends.front().first, offset + done) - offset);
+		deliver(in + done, n - done);
+		done = n;
+		deliver(&d_ends.front().second, 1);
+		d_ends.pop_front();
+	}
+	deliver(in + done, noutput_items - done);
+	return noutput_items;
+}
+
+bool voice_record_sink::stop(void)
+{
+	// Nothing follows, the ends still waiting for records included
+	for (size_t i = 0; i < d_ends.size(); i++)
+		deliver(&d_ends[i].second, 1);
+	d_ends.clear();
+
+	for (uint32_t rx_id = 0; rx_id < MAX_PARTS; rx_id++) {
+		if (!(d_open & (1u << rx_id)))
+			continue;
+
+		dect2core::voice_record_t end;
+		memset(&end, 0, sizeof(end));
+		end.type = VOICE_GAP;
+		end.rx_id = rx_id;
+		end.flags = VOICE_GAP_END;
+		deliver(&end, 1);
+	}
+	return true;
+}
+
+/*
+ * Publishes the decoder's voice records to the shared memory frame ring
+ */
+class shm_frame_sink : virtual public gr::sync_block {
+public:
+	typedef boost::shared_ptr<shm_frame_sink> sptr;
+	static sptr make(shm_ring_writer *ring, gr::dect2::packet_decoder::sptr decoder);
+};
+
+class shm_frame_sink_impl : public shm_frame_sink, public voice_record_sink {
+public:
+	shm_frame_sink_impl(shm_ring_writer *ring, gr::dect2::packet_decoder::sptr decoder);
+	~shm_frame_sink_impl();
+private:
+	shm_ring_writer *d_ring;
+	gr::dect2::packet_decoder::sptr d_decoder;
+
+	virtual void records(const dect2core::voice_record_t *r, size_t n);
+};
+
+shm_frame_sink::sptr shm_frame_sink::make(shm_ring_writer *ring, gr::dect2::packet_decoder::sptr decoder)
+{
+	return gnuradio::get_initial_sptr(new shm_frame_sink_impl(ring, decoder));
+}
+
+shm_frame_sink_impl::shm_frame_sink_impl(shm_ring_writer *ring, gr::dect2::packet_decoder::sptr decoder) :
+	gr::sync_block(
+		"shm_frame_sink",
+		gr::io_signature::make(1, 1, sizeof(dect2core::voice_record_t)),
+		gr::io_signature::make(0, 0, 0)),
+	d_ring(ring), d_decoder(decoder)
+{
+}
+
+shm_frame_sink_impl::~shm_frame_sink_impl()
+{
+}
+
+void shm_frame_sink_impl::records(const dect2core::voice_record_t *in, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		const dect2core::voice_record_t *r = &in[i];
+
+		if (r->type == VOICE_GAP) {
+			shm_voice_gap_record gap;
+
+			memset(&gap, 0, sizeof(gap));
+			gap.rx_id = r->rx_id;
+			gap.flags = r->flags;
+			gap.bursts = r->bursts;
+			d_ring->publish(SHM_RECORD_VOICE_GAP, &gap, sizeof(gap));
+			continue;
+		}
+
+		shm_b_field_record rec;
+
+		memset(&rec, 0, sizeof(rec));
+		rec.rx_id = r->rx_id;
+		rec.frame_number = r->frame_number;
+		rec.flags = r->flags;
+		memcpy(rec.b_field, r->b_field, sizeof(rec.b_field));
+
+		gr::dect2::packet_decoder::part_info_t parts[MAX_PARTS];
+		size_t nparts = d_decoder->get_parts(parts, MAX_PARTS);
+		for (size_t j = 0; j < nparts; j++) {
+			if (parts[j].rx_id == rec.rx_id)
+				memcpy(rec.part_id, parts[j].part_id, sizeof(rec.part_id));
+		}
+
+		d_ring->publish(SHM_RECORD_B_FIELD, &rec, sizeof(rec));
+	}
+}
+
+/*
+ * Decodes the decoder's voice records to PCM
+ */
+class voice_sink : virtual public gr::sync_block {
+public:
+	typedef boost::shared_ptr<voice_sink> sptr;
+	static sptr make(voice_writer *writer, gr::dect2::packet_decoder::sptr decoder);
+};
+
+class voice_sink_impl : public voice_sink, public voice_record_sink {
+public:
+	voice_sink_impl(voice_writer *writer, gr::dect2::packet_decoder::sptr decoder);
+	~voice_sink_impl();
+private:
+	voice_writer *d_writer;
+	gr::dect2::packet_decoder::sptr d_decoder;
+
+	virtual void records(const dect2core::voice_record_t *r, size_t n);
+};
+
+voice_sink::sptr voice_sink::make(voice_writer *writer, gr::dect2::packet_decoder::sptr decoder)
+{
+	return gnuradio::get_initial_sptr(new voice_sink_impl(writer, decoder));
+}
+
+voice_sink_impl::voice_sink_impl(voice_writer *writer, gr::dect2::packet_decoder::sptr decoder) :
+	gr::sync_block(
+		"voice_sink",
+		gr::io_signature::make(1, 1, sizeof(dect2core::voice_record_t)),
+		gr::io_signature::make(0, 0, 0)),
+	d_writer(writer), d_decoder(decoder)
+{
+}
+
+voice_sink_impl::~voice_sink_impl()
+{
+}
+
+void voice_sink_impl::records(const dect2core::voice_record_t *r, size_t n)
+{
+	gr::dect2::packet_decoder::part_info_t parts[MAX_PARTS];
+	size_t nparts = d_decoder->get_parts(parts, MAX_PARTS);
+	d_writer->write(r, n, parts, nparts);
+}
+
+/*
+ * Feeds the raw input to the burst recorder's ring
+ */
+class recorder_sink : virtual public gr::sync_block {
+public:
+	typedef boost::shared_ptr<recorder_sink> sptr;
+	static sptr make(dect2core::burst_recorder *recorder, size_t item_size);
+};
+
+class recorder_sink_impl : public recorder_sink {
+public:
+	recorder_sink_impl(dect2core::burst_recorder *recorder, size_t item_size);
+	~recorder_sink_impl();
+private:
+	dect2core::burst_recorder *d_recorder;
+
+	virtual int work(int noutput_items,
+		gr_vector_const_void_star &input_items,
+		gr_vector_void_star &output_items);
+};
+
+recorder_sink::sptr recorder_sink::make(dect2core::burst_recorder *recorder, size_t item_size)
+{
+	return gnuradio::get_initial_sptr(new recorder_sink_impl(recorder, item_size));
+}
+
+recorder_sink_impl::recorder_sink_impl(dect2core::burst_recorder *recorder, size_t item_size) :
+	gr::sync_block(
+		"recorder_sink",
+		gr::io_signature::make(1, 1, item_size),
+		gr::io_signature::make(0, 0, 0)),
+	d_recorder(recorder)
+{
+}
+
+recorder_sink_impl::~recorder_sink_impl()
+{
+}
+
+int recorder_sink_impl::work(int noutput_items,
+	gr_vector_const_void_star &input_items,
+	gr_vector_void_star &output_items)
+{
+	(void)output_items;
+
+	d_recorder->write(input_items[0], noutput_items);
+	return noutput_items;
+}
+
+static double baseband_sampling_rate = DECT_NATIVE_RATE;
+static double fallback_sampling_rate = 3200000;	// Used with resampling if the device can't do the above
+static unsigned samples_per_symbol = 2;
 static double rx_gain = 30;
 static double rx_freq = 1890432000;
 static int rx_freq_index = 0;
+static unsigned scan_period_us = 100000;	// Time on each channel, changed over --control
+static uint32_t selected_rx_id = 0;
 
 // static int part_id = 0;
 
@@ -141,6 +443,50 @@ static double _rx_freq_options[DECT_CHANNELS] = {
 	1897344000, // 9
 };
 
+// DECT RF carrier n is at 1897.344 MHz - n * 1.728 MHz, index DECT_CHANNELS - 1 - n above
+static int carrier_to_index(uint32_t carrier)
+{
+	return (carrier < DECT_CHANNELS) ? (int)(DECT_CHANNELS - 1 - carrier) : -1;
+}
+
+#define ALL_CHANNELS	((1u << DECT_CHANNELS) - 1)
+static uint32_t channel_mask = ALL_CHANNELS;	// Channels scanned, never empty
+
+/*
+ * Channel to tune to after current. Channels hinted by the bearer positions
+ * fixed parts announce in their Pt tails go first, once per sweep, then the
+ * sweep carries on in order. visited is reset when the sweep wraps. Only
+ * channels in mask are tuned to.
+ */
+static int next_channel(int current, uint32_t *hints, uint32_t *visited, uint32_t mask)
+{
+	*visited |= 1u << current;
+
+	uint32_t pending = *hints & mask & ~*visited;
+	if (pending) {
+		for (int i = 0; i < DECT_CHANNELS; i++) {
+			if (pending & (1u << i)) {
+				*hints &= ~(1u << i);
+				return i;
+			}
+		}
+	}
+
+	for (int n = 1; n < DECT_CHANNELS; n++) {
+		int i = (current + n) % DECT_CHANNELS;
+		if ((mask & (1u << i)) && !(*visited & (1u << i)))
+			return i;
+	}
+
+	*visited = 0;
+	for (int n = 1; n <= DECT_CHANNELS; n++) {
+		int i = (current + n) % DECT_CHANNELS;
+		if (mask & (1u << i))
+			return i;
+	}
+	return current;
+}
+
 static gr::top_block_sptr tb;
 #if USE_OSMOSDR
 static osmosdr::source::sptr source;
@@ -149,40 +495,336 @@ static osmosdr::source::sptr source;
 static gr::uhd::usrp_source::sptr source;
 #endif
 static gr::dect2::packet_decoder::sptr packet_decoder;
+static dect2core::part_event_queue *event_queue;
+static shm_ring_writer *shm_events;
+static sightings_writer *sightings;
+static shm_ring_writer *shm_frames;
+static control_socket *control;
+static voice_writer *voice;
+
+#define WATCH_MAX_DWELL		50	// Extra scan periods to stay for a watched part
+
+// A part on the carrier asks to stay there
+static bool watched_part_dwelling(void)
+{
+	dect2core::part_info_t parts[MAX_PARTS];
+	size_t nparts = packet_decoder->get_parts(parts, MAX_PARTS);
+
+	for (size_t i = 0; i < nparts; i++) {
+		if (parts[i].watch_actions & WATCH_DWELL)
+			return true;
+	}
+	return false;
+}
+
+// One scan period, handling control commands meanwhile
+static void scan_period(void)
+{
+	if (control)
+		control->serve(scan_period_us);
+	else
+		usleep(scan_period_us);
+}
 
-static void part_updated_handler(void *arg, const gr::dect2::packet_decoder::part_info_t *part_info)
+static void reply_printf(std::string *reply, const char *format, ...)
 {
-	printf("scan-report: U %d %8.6lf %u %02x%02x%02x%02x%02x %c %c\n",
-		rx_freq_index, _rx_freq_options[rx_freq_index] / 1e6, part_info->rx_id,
-		part_info->part_id[0],
-		part_info->part_id[1],
-		part_info->part_id[2],
-		part_info->part_id[3],
-		part_info->part_id[4],
-		part_info->is_fixed_part ? 'F' : 'P',
-		part_info->voice_present ? 'V' : '-');
+	char line[256];
+	va_list ap;
+
+	va_start(ap, format);
+	vsnprintf(line, sizeof(line), format, ap);
+	va_end(ap);
+	reply->append(line);
 }
 
-static void part_lost_handler(void *arg, const gr::dect2::packet_decoder::part_info_t *part_info)
+// Comma separated channel indices and ranges, e.g. 0,2,5-9, or "all"
+static bool parse_channels(const char *s, uint32_t *mask)
 {
-	printf("scan-report: L %d %8.6lf %u %02x%02x%02x%02x%02x %c %c\n",
-		rx_freq_index, _rx_freq_options[rx_freq_index] / 1e6, part_info->rx_id,
-		part_info->part_id[0],
-		part_info->part_id[1],
-		part_info->part_id[2],
-		part_info->part_id[3],
-		part_info->part_id[4],
-		part_info->is_fixed_part ? 'F' : 'P',
-		part_info->voice_present ? 'V' : '-');
+	if (strcmp(s, "all") == 0) {
+		*mask = ALL_CHANNELS;
+		return true;
+	}
+
+	*mask = 0;
+	for (;;) {
+		char *end;
+		long first = strtol(s, &end, 10), last = first;
+		if (end == s)
+			return false;
+		if (*end == '-') {
+			s = end + 1;
+			last = strtol(s, &end, 10);
+			if (end == s)
+				return false;
+		}
+		if (first < 0 || last >= DECT_CHANNELS || first > last)
+			return false;
+		for (long i = first; i <= last; i++)
+			*mask |= 1u << i;
+
+		if (*end == '\0')
+			return true;
+		if (*end != ',')
+			return false;
+		s = end + 1;
+	}
+}
+
+static std::string format_channels(uint32_t mask)
+{
+	std::string s;
+
+	for (int i = 0; i < DECT_CHANNELS; i++) {
+		if (mask & (1u << i)) {
+			if (!s.empty())
+				s += ",";
+			s += std::to_string(i);
+		}
+	}
+	return s;
 }
 
-static const char options[] = "a:v";
+static bool parse_part_id(const char *s, uint8_t *part_id);
+
+/*
+ * Commands of the --control socket. They run in the main thread, between
+ * the flowgraph starts and stops of the scan loop or while it runs.
+ */
+static void control_handler(void *arg, const char *command, std::string *reply)
+{
+	char verb[16];
+	int n = 0;
+
+	(void)arg;
+
+	if (sscanf(command, "%15s %n", verb, &n) != 1) {
+		reply->append("error: empty command\n");
+		return;
+	}
+	const char *args = command + n;
+
+	try {
+		if (strcmp(verb, "select") == 0) {
+			// rx_id, or the RFPI/PMID of an active part
+			uint8_t part_id[5];
+			unsigned rx_id;
+			char end;
+
+			if (parse_part_id(args, part_id)) {
+				dect2core::part_info_t parts[MAX_PARTS];
+				size_t nparts = packet_decoder->get_parts(parts, MAX_PARTS);
+				size_t i;
+
+				for (i = 0; i < nparts; i++) {
+					if (memcmp(parts[i].part_id, part_id, sizeof(part_id)) == 0)
+						break;
+				}
+				if (i == nparts) {
+					reply_printf(reply, "error: %s is not active\n", args);
+					return;
+				}
+				rx_id = parts[i].rx_id;
+			} else if (sscanf(args, "%u%c", &rx_id, &end) != 1 || rx_id >= MAX_PARTS) {
+				reply_printf(reply, "error: expected rx_id 0-%d or 10 hex digits\n", MAX_PARTS - 1);
+				return;
+			}
+			packet_decoder->select_rx_part(rx_id);
+			selected_rx_id = rx_id;
+			reply_printf(reply, "ok selected %u\n", rx_id);
+
+		} else if (strcmp(verb, "parts") == 0) {
+			dect2core::part_info_t parts[MAX_PARTS];
+			size_t nparts = packet_decoder->get_parts(parts, MAX_PARTS);
+
+			for (size_t i = 0; i < nparts; i++) {
+				const dect2core::part_info_t *p = &parts[i];
+				reply_printf(reply, "%c %u %02x%02x%02x%02x%02x %s %s\n",
+					(p->rx_id == selected_rx_id) ? '*' : ' ', p->rx_id,
+					p->part_id[0], p->part_id[1], p->part_id[2], p->part_id[3], p->part_id[4],
+					p->is_fixed_part ? "FP" : "PP", p->voice_present ? "V" : "-");
+			}
+			reply->append("ok\n");
+
+		} else if (strcmp(verb, "status") == 0) {
+			reply_printf(reply, "channel %d %5.3lf MHz\n", rx_freq_index, rx_freq / 1e6);
+			reply_printf(reply, "selected %u\n", selected_rx_id);
+			if (source) {
+				reply_printf(reply, "gain %.1lf\n", rx_gain);
+				reply_printf(reply, "channels %s\n", format_channels(channel_mask).c_str());
+				reply_printf(reply, "dwell %u\n", scan_period_us / 1000);
+			}
+			reply->append("ok\n");
+
+		} else if (strcmp(verb, "gain") == 0 || strcmp(verb, "channels") == 0 || strcmp(verb, "dwell") == 0) {
+			if (!source) {
+				reply_printf(reply, "error: %s needs a device\n", verb);
+				return;
+			}
+
+			if (strcmp(verb, "gain") == 0) {
+				char *end;
+				double gain = strtod(args, &end);
+				if (end == args || *end != '\0') {
+					reply->append("error: expected gain in dB\n");
+					return;
+				}
+#if USE_OSMOSDR
+				rx_gain = source->set_gain(gain, 0);
+#endif
+#if USE_UHD
+				source->set_gain(gain, 0);
+				rx_gain = gain;
+#endif
+				log_info("gain %5.3lf\n", rx_gain);
+				reply_printf(reply, "ok gain %.1lf\n", rx_gain);
+
+			} else if (strcmp(verb, "channels") == 0) {
+				uint32_t mask;
+				if (!parse_channels(args, &mask)) {
+					reply_printf(reply, "error: expected all or channels 0-%d, e.g. 0,2,5-9\n", DECT_CHANNELS - 1);
+					return;
+				}
+				channel_mask = mask;
+				log_info("scanning channels %s\n", format_channels(mask).c_str());
+				reply_printf(reply, "ok channels %s\n", format_channels(mask).c_str());
+
+			} else {
+				unsigned ms;
+				char end;
+				if (sscanf(args, "%u%c", &ms, &end) != 1 || ms < 10 || ms > 60000) {
+					reply->append("error: expected dwell 10-60000 ms\n");
+					return;
+				}
+				scan_period_us = ms * 1000;
+				reply_printf(reply, "ok dwell %u\n", ms);
+			}
+
+		} else if (strcmp(verb, "help") == 0) {
+			reply->append("select rx_id|rfpi\n");
+			reply->append("parts\n");
+			reply->append("status\n");
+			reply->append("gain dB\n");
+			reply->append("channels all|list\n");
+			reply->append("dwell ms\n");
+			reply->append("ok\n");
+
+		} else {
+			reply_printf(reply, "error: unknown command \"%s\"\n", verb);
+		}
+	} catch (std::exception &ex) {
+		reply_printf(reply, "error: %s\n", ex.what());
+	}
+}
+
+#define RECORD_RING_SECONDS	0.5	// Covers the flowgraph's latency from source to decoder
+
+// RFPI or PMID as 10 hex digits
+static bool parse_part_id(const char *s, uint8_t *part_id)
+{
+	unsigned value[5];
+
+	if (strlen(s) != 10 || sscanf(s, "%2x%2x%2x%2x%2x", &value[0], &value[1], &value[2], &value[3], &value[4]) != 5)
+		return false;
+	for (int i = 0; i < 5; i++)
+		part_id[i] = value[i];
+	return true;
+}
+
+static dect2core::burst_recorder *open_recorder(const std::string &path, dect2core::burst_recorder::config_t *config,
+	const std::vector<std::vector<uint8_t> > &parts)
+{
+	config->frequency = rx_freq;
+	config->sps = samples_per_symbol;
+	config->ring_len = RECORD_RING_SECONDS;
+
+	dect2core::burst_recorder *recorder = dect2core::burst_recorder::open(path.c_str(), *config);
+	if (!recorder) {
+		log_error("can't create recording \"%s.sigmf-data\": %s\n", path.c_str(), strerror(errno));
+		return NULL;
+	}
+
+	for (size_t i = 0; i < parts.size(); i++)
+		recorder->add_filter(parts[i].data());
+
+	log_info("recording bursts to %s.sigmf-{data,meta}, %s, %.0f us margins\n",
+		path.c_str(), config->datatype, config->margin * 1e6);
+	return recorder;
+}
+
+static void part_events_handler(void *arg, const gr::dect2::packet_decoder::part_event_t *events, size_t count)
+{
+	report_writer *writer = (report_writer *)arg;
+
+	for (size_t i = 0; i < count; i++) {
+		if (events[i].type == dect2core::PART_MATCHED) {
+			const dect2core::part_info_t *p = &events[i].part_info;
+			log_info("watchlist: %s %02x%02x%02x%02x%02x on carrier %u\n",
+				p->is_fixed_part ? "FP" : "PP",
+				p->part_id[0], p->part_id[1], p->part_id[2], p->part_id[3], p->part_id[4], p->carrier);
+		}
+	}
+
+	writer->write(events, count);
+	writer->flush();
+
+	if (sightings) {
+		for (size_t i = 0; i < count; i++) {
+			const dect2core::part_info_t *p = &events[i].part_info;
+			if (events[i].type != dect2core::PART_UPDATED)
+				continue;
+
+			sighting_t s;
+			s.timestamp = p->timestamp;
+			s.part_id = 0;
+			for (int j = 0; j < 5; j++)
+				s.part_id = (s.part_id << 8) | p->part_id[j];
+			s.freq_khz = (p->carrier < DECT_CHANNELS) ? _rx_freq_options[p->carrier] / 1e3 : 0;
+			s.rssi = isnan(p->rssi) ? SIGHTING_NO_RSSI : (int16_t)lrintf(p->rssi * 100);
+			s.carrier = p->carrier;
+			s.flags = (p->is_fixed_part ? SIGHTING_FIXED_PART : 0) | (p->voice_present ? SIGHTING_VOICE : 0);
+			if (!sightings->append(s)) {
+				log_error("sightings store failed, no longer recording sightings\n");
+				delete sightings;
+				sightings = NULL;
+				break;
+			}
+		}
+	}
+
+	if (shm_events) {
+		uint8_t rec[report_writer::BINARY_MAX_LEN];
+		for (size_t i = 0; i < count; i++)
+			shm_events->publish(SHM_RECORD_PART_EVENT, rec, writer->encode_binary(&events[i], rec));
+	}
+}
+
+static const char options[] = "a:c:f:i:o:s:v";
 static struct option long_options[] = {
 	{ "help", 0, NULL, 0 },
 	{ "usage", 0, NULL, 0 },
 	{ "version", 0, NULL, 0 },
 	{ "verbose", 0, NULL, 'v' },
 	{ "device-args", 1, NULL, 'a' },
+	{ "carrier", 1, NULL, 'c' },
+	{ "chase-bits", 1, NULL, 0 },
+	{ "control", 1, NULL, 0 },
+	{ "input", 1, NULL, 'i' },
+	{ "input-format", 1, NULL, 0 },
+	{ "log-rate-limit", 1, NULL, 0 },
+	{ "output", 1, NULL, 'o' },
+	{ "output-format", 1, NULL, 'f' },
+	{ "packet", 1, NULL, 0 },
+	{ "record", 1, NULL, 0 },
+	{ "record-margin", 1, NULL, 0 },
+	{ "record-part", 1, NULL, 0 },
+	{ "sample-rate", 1, NULL, 's' },
+	{ "shm", 1, NULL, 0 },
+	{ "shm-frames", 0, NULL, 0 },
+	{ "sightings", 1, NULL, 0 },
+	{ "sps", 1, NULL, 0 },
+	{ "squelch", 1, NULL, 0 },
+	{ "voice", 1, NULL, 0 },
+	{ "watchlist", 1, NULL, 0 },
 	{ NULL, 0, NULL, 0 },
 };
 
@@ -190,6 +832,22 @@ static void print_help(const char *argv0)
 {
 	fprintf(stderr, "%s {--help|--usage|--version}\n", argv0);
 	fprintf(stderr, "%s {-a|--device-args} args\n", argv0);
+	fprintf(stderr, "%s {-c|--carrier} index (0-9, first carrier to scan or carrier of --input)\n", argv0);
+	fprintf(stderr, "%s --chase-bits k (0-%d, flip up to k unreliable bits to pass a failing CRC, default: 0)\n", argv0, CHASE_MAX_BITS);
+	fprintf(stderr, "%s --control path  take commands to select parts, set gain, channels and dwell on a UNIX socket\n", argv0);
+	fprintf(stderr, "%s {-i|--input} file [--input-format {cs8|cs16}]  read integer I/Q instead of a device, - for stdin\n", argv0);
+	fprintf(stderr, "%s --log-rate-limit messages-per-second  per log call site (default: 0, off)\n", argv0);
+	fprintf(stderr, "%s {-o|--output} file (default: - for stdout)\n", argv0);
+	fprintf(stderr, "%s {-f|--output-format} {text|text-rf|jsonl|binary}\n", argv0);
+	fprintf(stderr, "%s {-s|--sample-rate} rate (default: 4608000, resampled if the device can't)\n", argv0);
+	fprintf(stderr, "%s --packet {p00|p32|p80}  longest packet format to receive (default: p32)\n", argv0);
+	fprintf(stderr, "%s --record path [--record-margin us] [--record-part rfpi]...  record raw I/Q around bursts to path.sigmf-{data,meta}\n", argv0);
+	fprintf(stderr, "%s --sps {2|4|8}  samples per symbol the demodulator runs at (default: 2)\n", argv0);
+	fprintf(stderr, "%s --squelch dB  skip blocks less than dB above the noise floor (default: 0, off)\n", argv0);
+	fprintf(stderr, "%s --shm name [--shm-frames]  publish part events (and B-fields) to /dev/shm/name.{events,frames}\n", argv0);
+	fprintf(stderr, "%s --sightings dir  append part sightings to the store in dir, see dect-sightings\n", argv0);
+	fprintf(stderr, "%s --voice {wav:dir|raw:dir|unix:path}  decode the selected part's voice to 8 kHz PCM files or datagrams\n", argv0);
+	fprintf(stderr, "%s --watchlist file  report, dwell on or record the parts it lists\n", argv0);
 }
 
 static void print_version()
@@ -197,11 +855,100 @@ static void print_version()
 	fprintf(stderr, "1.0\n");
 }
 
+/*
+ * Open the SDR and set it up for rx_freq. Returns the actual sample rate.
+ */
+static double open_device(const std::string &device_args, bool sampling_rate_given)
+{
+	double samp_rate = 0;
+
+#if USE_OSMOSDR
+
+#if 0
+	osmosdr::devices_t devs = osmosdr::device::find();
+	for (auto it = devs.begin(); it != devs.end(); it++) {
+		std::string s = it->to_pp_string();
+		printf("OsmoSDR: found device:\n%s\n", s.c_str());
+	}
+#endif
+
+	source = osmosdr::source::make(device_args);
+
+	samp_rate = source->set_sample_rate(baseband_sampling_rate);
+	if (!sampling_rate_given && frontend::native_decimation(samp_rate, samples_per_symbol) == 0) {
+		log_info("Device can't sample at %5.3lf Hz, using %5.3lf Hz\n", baseband_sampling_rate, fallback_sampling_rate);
+		samp_rate = source->set_sample_rate(fallback_sampling_rate);
+	}
+	log_info("Actual sample rate: %5.3lf Hz\n", samp_rate);
+
+	double center_freq = source->set_center_freq(rx_freq, 0);
+	log_info("Actual central frequency: %5.3lf MHz\n", center_freq / 1.0e6);
+
+	std::vector<std::string> gain_names = source->get_gain_names(0);
+	for (auto it : gain_names) {
+		osmosdr::gain_range_t gain_range = source->get_gain_range(it, 0);
+		log_info("Found gain: %s min %lf max %lf step %lf\n", it.c_str(), gain_range.start(), gain_range.stop(), gain_range.step());
+	}
+
+	double gain = source->set_gain(rx_gain, 0);
+	log_info("Actual gain: %5.3lf\n", gain);
+
+	//source->set_antenna("TX/RX", 0);
+
+	std::vector<std::string> antennas = source->get_antennas(0);
+	for (auto it : antennas) {
+		log_info("Found antenna: %s\n", it.c_str());
+	}
+	std::string ant = source->set_antenna("RX1", 0);
+	log_info("Using antenna %s\n", ant.c_str());
+#endif
+
+#if USE_UHD
+	std::string device_addr = "";
+
+	source = gr::uhd::usrp_source::make(device_addr, uhd::stream_args_t("fc32"));
+
+	source->set_samp_rate(baseband_sampling_rate);
+	samp_rate = source->get_samp_rate();
+	if (!sampling_rate_given && frontend::native_decimation(samp_rate, samples_per_symbol) == 0) {
+		source->set_samp_rate(fallback_sampling_rate);
+		samp_rate = source->get_samp_rate();
+	}
+	source->set_center_freq(rx_freq, 0);
+	source->set_gain(rx_gain, 0);
+	source->set_antenna("RX2", 0);
+	// source->set_auto_dc_offset(true, 0);
+	// source->set_auto_iq_balance(true, 0);
+#endif
+
+	double bw = source->get_bandwidth(0);
+	log_info("Bandwidth: %5.3lf MHz\n", bw);
+
+	return samp_rate;
+}
+
 int main(int argc, char **argv)
 {
 	const char *argv0 = argv[0];
 
 	std::string device_args = "bladerf=0"; // "hackrf=0";
+	std::string output_path = "-";
+	report_writer::format_t output_format = report_writer::FORMAT_TEXT;
+	std::string shm_name;
+	std::string sightings_dir;
+	bool shm_publish_frames = false;
+	bool sampling_rate_given = false;
+	std::string input_path;
+	dect2core::sample_format_t input_format = dect2core::SAMPLE_CS16;
+	dect2core::burst_receiver::packet_format_t packet_format = dect2core::burst_receiver::PACKET_P32;
+	int chase_bits = 0;
+	float squelch_db = 0;
+	std::string record_path;
+	double record_margin = 100e-6;
+	std::vector<std::vector<uint8_t> > record_parts;
+	dect2core::watchlist *watchlist = NULL;
+	std::string control_path;
+	std::string voice_spec;
 
 	for (;;) {
 		const char *option_name = NULL;
@@ -226,6 +973,98 @@ int main(int argc, char **argv)
 				print_version();
 				return EXIT_SUCCESS;
 
+			} else if (strcmp(option_name, "watchlist") == 0) {
+				unsigned bad_line;
+				delete watchlist;
+				watchlist = dect2core::watchlist::load(optarg, &bad_line);
+				if (!watchlist) {
+					if (bad_line)
+						log_error("%s:%u: bad watchlist entry\n", optarg, bad_line);
+					else
+						log_error("can't read watchlist \"%s\": %s\n", optarg, strerror(errno));
+					return EXIT_FAILURE;
+				}
+				log_info("watchlist: %zu patterns\n", watchlist->size());
+
+			} else if (strcmp(option_name, "log-rate-limit") == 0) {
+				log_set_rate_limit(strtoul(optarg, NULL, 0));
+
+			} else if (strcmp(option_name, "input-format") == 0) {
+				if (strcmp(optarg, "cs8") == 0) {
+					input_format = dect2core::SAMPLE_CS8;
+				} else if (strcmp(optarg, "cs16") == 0) {
+					input_format = dect2core::SAMPLE_CS16;
+				} else {
+					log_error("unknown input format \"%s\"\n", optarg);
+					return EXIT_FAILURE;
+				}
+
+			} else if (strcmp(option_name, "chase-bits") == 0) {
+				chase_bits = atoi(optarg);
+				if (chase_bits < 0 || chase_bits > CHASE_MAX_BITS) {
+					log_error("chase bits must be 0 to %d\n", CHASE_MAX_BITS);
+					return EXIT_FAILURE;
+				}
+
+			} else if (strcmp(option_name, "packet") == 0) {
+				if (strcmp(optarg, "p00") == 0) {
+					packet_format = dect2core::burst_receiver::PACKET_P00;
+				} else if (strcmp(optarg, "p32") == 0) {
+					packet_format = dect2core::burst_receiver::PACKET_P32;
+				} else if (strcmp(optarg, "p80") == 0) {
+					packet_format = dect2core::burst_receiver::PACKET_P80;
+				} else {
+					log_error("unknown packet format \"%s\"\n", optarg);
+					return EXIT_FAILURE;
+				}
+
+			} else if (strcmp(option_name, "record") == 0) {
+				record_path = optarg;
+
+			} else if (strcmp(option_name, "record-margin") == 0) {
+				record_margin = atof(optarg) * 1e-6;
+				if (record_margin < 0) {
+					log_error("record margin can't be negative\n");
+					return EXIT_FAILURE;
+				}
+
+			} else if (strcmp(option_name, "record-part") == 0) {
+				std::vector<uint8_t> part_id(5);
+				if (!parse_part_id(optarg, part_id.data())) {
+					log_error("bad part identity \"%s\", expected 10 hex digits\n", optarg);
+					return EXIT_FAILURE;
+				}
+				record_parts.push_back(part_id);
+
+			} else if (strcmp(option_name, "sps") == 0) {
+				samples_per_symbol = atoi(optarg);
+				if (samples_per_symbol != 2 && samples_per_symbol != 4 && samples_per_symbol != 8) {
+					log_error("samples per symbol must be 2, 4 or 8\n");
+					return EXIT_FAILURE;
+				}
+
+			} else if (strcmp(option_name, "squelch") == 0) {
+				squelch_db = atof(optarg);
+				if (squelch_db < 0) {
+					log_error("squelch threshold can't be negative\n");
+					return EXIT_FAILURE;
+				}
+
+			} else if (strcmp(option_name, "shm") == 0) {
+				shm_name = optarg;
+
+			} else if (strcmp(option_name, "shm-frames") == 0) {
+				shm_publish_frames = true;
+
+			} else if (strcmp(option_name, "sightings") == 0) {
+				sightings_dir = optarg;
+
+			} else if (strcmp(option_name, "control") == 0) {
+				control_path = optarg;
+
+			} else if (strcmp(option_name, "voice") == 0) {
+				voice_spec = optarg;
+
 			} else {
 				if (optarg)
 					log_error("unknown option --%s=\"%s\"\n", option_name, optarg);
@@ -238,6 +1077,38 @@ int main(int argc, char **argv)
 			device_args = optarg;
 			break;
 
+		case 'c':
+			rx_freq_index = atoi(optarg);
+			if (rx_freq_index < 0 || rx_freq_index >= DECT_CHANNELS) {
+				log_error("carrier must be 0..%d\n", DECT_CHANNELS - 1);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'i':
+			input_path = optarg;
+			break;
+
+		case 'o':
+			output_path = optarg;
+			break;
+
+		case 'f':
+			if (!report_writer::parse_format(optarg, &output_format)) {
+				log_error("unknown output format \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 's':
+			baseband_sampling_rate = strtod(optarg, NULL);
+			if (baseband_sampling_rate <= 0) {
+				log_error("bad sample rate \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			sampling_rate_given = true;
+			break;
+
 		case 'v':
 			loglevel++;
 			break;
@@ -250,123 +1121,238 @@ int main(int argc, char **argv)
 		}
 	}
 
-	log_info("device arguments: \"%s\"\n", device_args.c_str());
+	if (input_path.empty())
+		log_info("device arguments: \"%s\"\n", device_args.c_str());
 
-	tb = gr::make_top_block("dect_scanner");
+	report_writer *writer = report_writer::open(output_path.c_str(), output_format, _rx_freq_options, DECT_CHANNELS);
+	if (!writer)
+		return EXIT_FAILURE;
 
-	rx_freq = _rx_freq_options[4];
+	if (!sightings_dir.empty()) {
+		sightings = sightings_writer::open(sightings_dir.c_str());
+		if (!sightings)
+			return EXIT_FAILURE;
+		log_info("appending sightings to %s\n", sightings_dir.c_str());
+	}
 
-#if USE_OSMOSDR
+	if (!shm_name.empty()) {
+		shm_events = shm_ring_writer::create((shm_name + ".events").c_str(), report_writer::BINARY_MAX_LEN, 4096);
+		if (!shm_events)
+			return EXIT_FAILURE;
 
-#if 0
-	osmosdr::devices_t devs = osmosdr::device::find();
-	for (auto it = devs.begin(); it != devs.end(); it++) {
-		std::string s = it->to_pp_string();
-		printf("OsmoSDR: found device:\n%s\n", s.c_str());
+		if (shm_publish_frames) {
+			shm_frames = shm_ring_writer::create((shm_name + ".frames").c_str(), sizeof(shm_b_field_record), 4096);
+			if (!shm_frames)
+				return EXIT_FAILURE;
+		}
 	}
-#endif
 
-	source = osmosdr::source::make(device_args);
+	tb = gr::make_top_block("dect_scanner");
 
-	double samp_rate = source->set_sample_rate(baseband_sampling_rate);
-	log_info("Actual sample rate: %5.3lf Hz\n", samp_rate);
+	rx_freq = _rx_freq_options[rx_freq_index];
 
-	double center_freq = source->set_center_freq(rx_freq, 0);
-	log_info("Actual central frequency: %5.3lf MHz\n", center_freq / 1.0e6);
+	gr::dect2::packet_receiver::sptr packet_receiver =
+		gr::dect2::packet_receiver::make(samples_per_symbol, packet_format);
 
-	std::vector<std::string> gain_names = source->get_gain_names(0);
-	for (auto it : gain_names) {
-		osmosdr::gain_range_t gain_range = source->get_gain_range(it, 0);
-		log_info("Found gain: %s min %lf max %lf step %lf\n", it.c_str(), gain_range.start(), gain_range.stop(), gain_range.step());
+	packet_decoder = gr::dect2::packet_decoder::make();
+	packet_decoder->set_carrier(rx_freq_index);
+
+	if (chase_bits) {
+		packet_receiver->set_soft_output(true);
+		packet_receiver->set_chase_bits(chase_bits);
+		packet_decoder->set_chase_bits(chase_bits);
 	}
 
-	double gain = source->set_gain(rx_gain, 0);
-	log_info("Actual gain: %5.3lf\n", gain);
+	// Deliver part events from a separate thread so that slow output
+	// consumers never stall the demodulator. That thread is also the only
+	// one writing reports.
+	event_queue = new dect2core::part_event_queue(1024, dect2core::part_event_queue::DROP);
+	event_queue->start(part_events_handler, writer);
+	packet_decoder->set_event_queue(event_queue);
+	uint64_t events_dropped = 0;
+	uint32_t carrier_hints = 0, carriers_visited = 0;
+	uint64_t windows_dropped = 0;
 
-	//source->set_antenna("TX/RX", 0);
+	console_dumper::sptr console_0 = console_dumper::make();
 
-	std::vector<std::string> antennas = source->get_antennas(0);
-	for (auto it : antennas) {
-		log_info("Found antenna: %s\n", it.c_str());
-	}
-	std::string ant = source->set_antenna("RX1", 0);
-	log_info("Using antenna %s\n", ant.c_str());
-#endif
+	null_sink::sptr null_sink_1 = null_sink::make(sizeof(dect2core::voice_record_t));
 
-#if USE_UHD
-	std::string device_addr = "";
+	frontend *fe = NULL;
+	dect2core::burst_recorder *recorder = NULL;
+	dect2core::burst_recorder::config_t record_config;
+	record_config.margin = record_margin;
 
-	source = gr::uhd::usrp_source::make(device_addr, uhd::stream_args_t("fc32"));
+	if (!input_path.empty()) {
+		// Integer samples go straight to the discriminator, decimating
+		// from a multiple of the native rate
+		unsigned decimation = frontend::native_decimation(baseband_sampling_rate, samples_per_symbol);
+		if (decimation == 0) {
+			log_error("integer input needs a multiple of %5.3lf Hz sample rate\n", samples_per_symbol * DECT_SYMBOL_RATE);
+			return EXIT_FAILURE;
+		}
 
-	source->set_samp_rate(baseband_sampling_rate);
-	source->set_center_freq(rx_freq, 0);
-	source->set_gain(rx_gain, 0);
-	source->set_antenna("RX2", 0);
-	// source->set_auto_dc_offset(true, 0);
-	// source->set_auto_iq_balance(true, 0);
-#endif
+		gr::blocks::file_source::sptr file_source = gr::blocks::file_source::make(
+			dect2core::int_discriminator::sample_size(input_format),
+			(input_path == "-") ? "/dev/stdin" : input_path.c_str());
+
+		gr::dect2::int_phase_diff::sptr int_phase_diff =
+			gr::dect2::int_phase_diff::make(input_format, decimation, samples_per_symbol, squelch_db);
+
+		tb->connect(file_source, 0, int_phase_diff, 0);
+		tb->connect(int_phase_diff, 0, packet_receiver, 0);
+		tb->connect(int_phase_diff, 1, packet_receiver, 1);
+
+		if (!record_path.empty()) {
+			// The receiver's history puts its sample 0 sps - 1 items back
+			record_config.datatype = (input_format == dect2core::SAMPLE_CS8) ? "ci8" : "ci16_le";
+			record_config.item_size = dect2core::int_discriminator::sample_size(input_format);
+			record_config.samp_rate = baseband_sampling_rate;
+			record_config.ratio = decimation;
+			record_config.offset = int_phase_diff->input_offset() - (samples_per_symbol - 1.0) * decimation;
+
+			recorder = open_recorder(record_path, &record_config, record_parts);
+			if (!recorder)
+				return EXIT_FAILURE;
+			tb->connect(file_source, 0, recorder_sink::make(recorder, record_config.item_size), 0);
+		}
+	} else {
+		double samp_rate = open_device(device_args, sampling_rate_given);
 
-	double bw = source->get_bandwidth(0);
-	log_info("Bandwidth: %5.3lf MHz\n", bw);
+		// Channel filter, plus resampling unless the device runs symbol locked
+		fe = frontend::make(tb, samp_rate, samples_per_symbol);
 
-	std::vector<float> taps0;
+		gr::dect2::phase_diff::sptr phase_diff =
+			gr::dect2::phase_diff::make(samples_per_symbol, squelch_db);
 
-	rational_resampler_base_fff::sptr rational_resampler_xxx_0 = rational_resampler_base_fff::make(6, 1, taps0);
+		tb->connect(source, 0, fe->first(), 0);
+		tb->connect(fe->last(), 0, phase_diff, 0);
+		tb->connect(phase_diff, 0, packet_receiver, 0);
+		tb->connect(phase_diff, 1, packet_receiver, 1);
 
-	std::vector<float> resampler_filter_taps_float = gr::filter::firdes::low_pass_2(
-		1, 3 * baseband_sampling_rate, dect_occupied_bandwidth / 2, (dect_channel_bandwidth - dect_occupied_bandwidth) / 2, 30);
-	std::vector<gr_complex> resampler_filter_taps;
-	resampler_filter_taps.resize(resampler_filter_taps_float.size());
-	for (size_t i = 0; i < resampler_filter_taps_float.size(); i++)
-		resampler_filter_taps[i] = resampler_filter_taps_float[i];
+		if (!record_path.empty()) {
+			double ratio = samp_rate / (samples_per_symbol * DECT_SYMBOL_RATE);
 
-	rational_resampler_base_ccc::sptr rational_resampler = rational_resampler_base_ccc::make(3, 2, resampler_filter_taps);
+			record_config.datatype = "cf32_le";
+			record_config.item_size = sizeof(gr_complex);
+			record_config.samp_rate = samp_rate;
+			record_config.ratio = ratio;
+			record_config.offset = (phase_diff->input_offset() - (samples_per_symbol - 1.0)) * ratio + fe->input_offset();
 
-	fractional_resampler_cc::sptr fractional_resampler = fractional_resampler_cc::make(0, float((3.0 * baseband_sampling_rate / 2.0) / dect_symbol_rate / 4.0));
+			recorder = open_recorder(record_path, &record_config, record_parts);
+			if (!recorder)
+				return EXIT_FAILURE;
+			tb->connect(source, 0, recorder_sink::make(recorder, record_config.item_size), 0);
+		}
+	}
 
-	gr::dect2::phase_diff::sptr phase_diff =
-		gr::dect2::phase_diff::make();
+	tb->connect(packet_receiver, 0, packet_decoder, 0);
+	packet_decoder->set_burst_recorder(recorder);
+
+	if (watchlist) {
+		packet_decoder->set_watchlist(watchlist);
+		if (watchlist->all_actions() & WATCH_RECORD) {
+			if (recorder)
+				recorder->set_watch_filter(true);
+			else
+				log_warning("watchlist record actions need --record\n");
+		}
+	}
+	// The decoder only formats its part table when log_out has a subscriber
+	if (loglevel >= LOGLEVEL_DEBUG)
+		tb->msg_connect(packet_decoder, "log_out", console_0, "in");
+	tb->msg_connect(packet_receiver, "rcvr_msg_out", packet_decoder, "rcvr_msg_in");
+	tb->msg_connect(packet_decoder, "rcvr_ctrl_out", packet_receiver, "rcvr_ctrl_in");
 
-	gr::dect2::packet_receiver::sptr packet_receiver =
-		gr::dect2::packet_receiver::make();
+	if (!voice_spec.empty()) {
+		voice = voice_writer::open(voice_spec.c_str());
+		if (!voice)
+			return EXIT_FAILURE;
+		log_info("writing voice to %s\n", voice_spec.c_str());
+		voice_sink::sptr voice_0 = voice_sink::make(voice, packet_decoder);
+		tb->connect(packet_decoder, 0, voice_0, 0);
+		tb->msg_connect(packet_decoder, "voice_end_out", voice_0, "voice_end_in");
+	}
+	if (shm_frames) {
+		shm_frame_sink::sptr frame_sink = shm_frame_sink::make(shm_frames, packet_decoder);
+		tb->connect(packet_decoder, 0, frame_sink, 0);
+		tb->msg_connect(packet_decoder, "voice_end_out", frame_sink, "voice_end_in");
+	} else if (!voice) {
+		tb->connect(packet_decoder, 0, null_sink_1, 0);
+	}
 
-	packet_decoder = gr::dect2::packet_decoder::make();
-	packet_decoder->set_part_updated_callback(part_updated_handler, nullptr);
-	packet_decoder->set_part_lost_callback(part_lost_handler, nullptr);
+	if (!control_path.empty()) {
+		control = control_socket::open(control_path.c_str(), control_handler, NULL);
+		if (!control)
+			return EXIT_FAILURE;
+		log_info("taking commands on %s\n", control_path.c_str());
+	}
 
-	console_dumper::sptr console_0 = console_dumper::make();
+	g_application_running = true;
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
 
-	null_sink::sptr null_sink_1 = null_sink::make(1);
+	if (!input_path.empty()) {
+		// A recording holds a single carrier, run it to the end
+		std::atomic<bool> finished(false);
 
-#if USE_UHD
-	tb->connect(source, 0, rational_resampler, 0);
-#endif
-#if USE_OSMOSDR
-	tb->connect(source, 0, rational_resampler, 0);
-#endif
-	tb->connect(rational_resampler, 0, fractional_resampler, 0);
-	tb->connect(fractional_resampler, 0, phase_diff, 0);
-	tb->connect(phase_diff, 0, packet_receiver, 0);
-	tb->connect(packet_receiver, 0, packet_decoder, 0);
-	tb->msg_connect(packet_decoder, "log_out", console_0, "in");
-	tb->msg_connect(packet_receiver, "rcvr_msg_out", packet_decoder, "rcvr_msg_in");
+		tb->start();
+		std::thread waiter([&finished] { tb->wait(); finished = true; });
+		while (g_application_running && !finished)
+			scan_period();
+		tb->stop();
+		waiter.join();
 
-	tb->connect(packet_decoder, 0, null_sink_1, 0);
+		g_application_running = false;
+	}
 
-	g_application_running = true;
 	while (g_application_running) {
 		try {
 			tb->start(1);
 
-			usleep(100000);
+			scan_period();
 
-			rx_freq_index = (rx_freq_index == (DECT_CHANNELS - 1)) ? 0 : (rx_freq_index + 1);
+			for (unsigned n = 0; n < WATCH_MAX_DWELL && watched_part_dwelling(); n++)
+				scan_period();
+
+			// Scanning a single channel, stay tuned until that changes
+			while (g_application_running && channel_mask == 1u << rx_freq_index)
+				scan_period();
+
+			tb->stop();
+			tb->wait();
+
+			// Report everything seen on this channel before moving on
+			event_queue->drain();
+			if (event_queue->overflow_count() != events_dropped) {
+				events_dropped = event_queue->overflow_count();
+				log_warning("part event queue overflow, %llu events dropped\n", (unsigned long long)events_dropped);
+			}
+
+			dect2core::part_info_t parts[MAX_PARTS];
+			size_t nparts = packet_decoder->get_parts(parts, MAX_PARTS);
+			for (size_t i = 0; i < nparts; i++) {
+				const dect2core::fp_system_info_t *si = &parts[i].system_info;
+				int index = carrier_to_index(si->bearer_carrier);
+				if (si->bearer_rcvd && index >= 0)
+					carrier_hints |= 1u << index;
+			}
+
+			rx_freq_index = next_channel(rx_freq_index, &carrier_hints, &carriers_visited, channel_mask);
 			rx_freq = _rx_freq_options[rx_freq_index];
 
 			log_debug("DECT channel %d, frequency %5.3lf MHz\n", rx_freq_index, rx_freq / 1e6);
 
-			tb->stop();
 			source->set_center_freq(rx_freq, 0);
+			packet_decoder->set_carrier(rx_freq_index);
+
+			if (recorder) {
+				recorder->new_capture(rx_freq);
+				if (recorder->windows_dropped() != windows_dropped) {
+					windows_dropped = recorder->windows_dropped();
+					log_warning("burst recorder fell behind, %llu bursts not recorded\n",
+						(unsigned long long)windows_dropped);
+				}
+			}
 			packet_receiver->reset();
 			packet_decoder->clear_parts();
 
@@ -385,5 +1371,24 @@ int main(int argc, char **argv)
 		}
 	}
 
+	event_queue->stop();
+	if (recorder) {
+		log_info("recorded %llu bursts, %llu not recorded\n",
+			(unsigned long long)recorder->windows_written(), (unsigned long long)recorder->windows_dropped());
+		delete recorder;
+	}
+	delete fe;
+	delete watchlist;
+	delete writer;
+	delete shm_events;
+	delete shm_frames;
+	delete sightings;
+	delete control;
+	if (voice) {
+		if (voice->dropped_count())
+			log_info("%llu voice datagrams not received\n", (unsigned long long)voice->dropped_count());
+		delete voice;
+	}
+
 	return 0;
 }
@@ -0,0 +1,258 @@
+/* report_writer.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "report_writer.h"
+
+#define REPORT_FLUSH_THRESHOLD	(64 * 1024)
+
+using dect2core::part_event_t;
+using dect2core::part_info_t;
+
+report_writer::report_writer(int fd, format_t format, const double *carrier_freqs, size_t ncarriers)
+	: d_fd(fd), d_close_fd(false), d_format(format),
+	d_carrier_freqs(carrier_freqs), d_ncarriers(ncarriers)
+{
+	d_buf.reserve(2 * REPORT_FLUSH_THRESHOLD);
+}
+
+report_writer::~report_writer()
+{
+	flush();
+	if (d_close_fd)
+		close(d_fd);
+}
+
+report_writer *report_writer::open(const char *path, format_t format, const double *carrier_freqs, size_t ncarriers)
+{
+	if (strcmp(path, "-") == 0)
+		return new report_writer(STDOUT_FILENO, format, carrier_freqs, ncarriers);
+
+	int fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		log_error("can't open report output \"%s\": %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	report_writer *writer = new report_writer(fd, format, carrier_freqs, ncarriers);
+	writer->d_close_fd = true;
+	return writer;
+}
+
+bool report_writer::parse_format(const char *name, format_t *format)
+{
+	if (strcmp(name, "text") == 0)
+		*format = FORMAT_TEXT;
+	else if (strcmp(name, "text-rf") == 0)
+		*format = FORMAT_TEXT_RF;
+	else if (strcmp(name, "jsonl") == 0)
+		*format = FORMAT_JSONL;
+	else if (strcmp(name, "binary") == 0)
+		*format = FORMAT_BINARY;
+	else
+		return false;
+	return true;
+}
+
+static char event_code(dect2core::part_event_type_t type)
+{
+	switch (type) {
+	case dect2core::PART_UPDATED: return 'U';
+	case dect2core::PART_LOST:    return 'L';
+	case dect2core::PART_MATCHED: return 'M';
+	}
+	return '?';
+}
+
+static const char *event_name(dect2core::part_event_type_t type)
+{
+	switch (type) {
+	case dect2core::PART_UPDATED: return "updated";
+	case dect2core::PART_LOST:    return "lost";
+	case dect2core::PART_MATCHED: return "matched";
+	}
+	return "unknown";
+}
+
+double report_writer::carrier_freq(uint32_t carrier) const
+{
+	return (carrier < d_ncarriers) ? d_carrier_freqs[carrier] : 0.0;
+}
+
+void report_writer::append(const void *data, size_t len)
+{
+	const uint8_t *ptr = (const uint8_t *)data;
+	d_buf.insert(d_buf.end(), ptr, ptr + len);
+}
+
+// The plain line is what collectors of the original scanner output parse,
+// it must not change
+void report_writer::append_text(const part_event_t *event, bool rf)
+{
+	const part_info_t *part_info = &event->part_info;
+	char line[160];
+
+	int len = snprintf(line, sizeof(line), "scan-report: %c %u %8.6lf %u %02x%02x%02x%02x%02x %c %c",
+		event_code(event->type),
+		part_info->carrier, carrier_freq(part_info->carrier) / 1e6, part_info->rx_id,
+		part_info->part_id[0],
+		part_info->part_id[1],
+		part_info->part_id[2],
+		part_info->part_id[3],
+		part_info->part_id[4],
+		part_info->is_fixed_part ? 'F' : 'P',
+		part_info->voice_present ? 'V' : '-');
+
+	// '-' for what wasn't measured, such as RSSI on the GR decoder path
+	if (rf) {
+		if (isnan(part_info->rssi))
+			len += snprintf(line + len, sizeof(line) - len, " -");
+		else
+			len += snprintf(line + len, sizeof(line) - len, " %.1f", part_info->rssi);
+		if (isnan(part_info->freq_offset))
+			len += snprintf(line + len, sizeof(line) - len, " -");
+		else
+			len += snprintf(line + len, sizeof(line) - len, " %.1f", part_info->freq_offset / 1e3);
+	}
+	line[len++] = '\n';
+
+	append(line, len);
+}
+
+void report_writer::append_jsonl(const part_event_t *event)
+{
+	const part_info_t *part_info = &event->part_info;
+	char line[576];
+	char rssi[16];
+
+	if (isnan(part_info->rssi))
+		strcpy(rssi, "null");
+	else
+		snprintf(rssi, sizeof(rssi), "%.1f", part_info->rssi);
+
+	int len = snprintf(line, sizeof(line),
+		"{\"ts\":%llu.%09llu,\"event\":\"%s\",\"carrier\":%u,\"freq_mhz\":%.6lf,\"rx_id\":%u,"
+		"\"rfpi\":\"%02x%02x%02x%02x%02x\",\"type\":\"%s\",\"voice\":%s,"
+		"\"packets\":%llu,\"afield_bad_crc\":%llu,"
+		"\"afield_recovered\":%llu,\"bfield_recovered\":%llu,\"b_field_bits\":%u,"
+		"\"rf_carriers\":%u,\"fp_capabilities\":%u,\"multiframe\":%u,\"handovers\":%llu,"
+		"\"rssi_dbfs\":%s,\"freq_offset_hz\":%.0f,\"watch\":%u}\n",
+		(unsigned long long)(part_info->timestamp / 1000000000ull),
+		(unsigned long long)(part_info->timestamp % 1000000000ull),
+		event_name(event->type),
+		part_info->carrier, carrier_freq(part_info->carrier) / 1e6, part_info->rx_id,
+		part_info->part_id[0],
+		part_info->part_id[1],
+		part_info->part_id[2],
+		part_info->part_id[3],
+		part_info->part_id[4],
+		part_info->is_fixed_part ? "FP" : "PP",
+		part_info->voice_present ? "true" : "false",
+		(unsigned long long)part_info->packet_cnt,
+		(unsigned long long)part_info->afield_bad_crc_cnt,
+		(unsigned long long)part_info->afield_recovered_cnt,
+		(unsigned long long)part_info->bfield_recovered_cnt,
+		part_info->b_field_bits,
+		part_info->system_info.carrier_bitmap,
+		part_info->system_info.fp_capabilities,
+		part_info->system_info.multiframe_number,
+		(unsigned long long)part_info->handover_cnt,
+		rssi, part_info->freq_offset, part_info->watch_actions);
+
+	append(line, len);
+}
+
+static uint8_t *put_le(uint8_t *ptr, uint64_t value, unsigned nbytes)
+{
+	for (unsigned i = 0; i < nbytes; i++) {
+		*ptr++ = value & 0xFF;
+		value >>= 8;
+	}
+	return ptr;
+}
+
+size_t report_writer::encode_binary(const part_event_t *event, uint8_t *rec) const
+{
+	const part_info_t *part_info = &event->part_info;
+	uint8_t *ptr = rec + 2; // Length is filled in last
+
+	*ptr++ = BINARY_VERSION;
+	*ptr++ = event_code(event->type);
+	ptr = put_le(ptr, part_info->timestamp, 8);
+	ptr = put_le(ptr, (uint64_t)(carrier_freq(part_info->carrier) / 1e3), 4);
+	*ptr++ = part_info->carrier;
+	*ptr++ = part_info->rx_id;
+	memcpy(ptr, part_info->part_id, 5);
+	ptr += 5;
+	*ptr++ = (part_info->is_fixed_part ? 0x01 : 0) | (part_info->voice_present ? 0x02 : 0);
+	ptr = put_le(ptr, part_info->packet_cnt, 8);
+	ptr = put_le(ptr, part_info->afield_bad_crc_cnt, 8);
+	ptr = put_le(ptr, (uint16_t)(isnan(part_info->rssi) ? INT16_MIN : lrintf(part_info->rssi * 100)), 2);
+	ptr = put_le(ptr, (uint32_t)(int32_t)lrintf(part_info->freq_offset), 4);
+
+	put_le(rec, ptr - rec - 2, 2);
+	return ptr - rec;
+}
+
+void report_writer::append_binary(const part_event_t *event)
+{
+	uint8_t rec[BINARY_MAX_LEN];
+	append(rec, encode_binary(event, rec));
+}
+
+void report_writer::write(const part_event_t *events, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		switch (d_format) {
+		case FORMAT_TEXT:    append_text(&events[i], false); break;
+		case FORMAT_TEXT_RF: append_text(&events[i], true);  break;
+		case FORMAT_JSONL:   append_jsonl(&events[i]);       break;
+		case FORMAT_BINARY:  append_binary(&events[i]);      break;
+		}
+
+		if (d_buf.size() >= REPORT_FLUSH_THRESHOLD)
+			flush();
+	}
+}
+
+void report_writer::flush(void)
+{
+	size_t off = 0;
+
+	while (off < d_buf.size()) {
+		ssize_t n = ::write(d_fd, d_buf.data() + off, d_buf.size() - off);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("report write failed: %s\n", strerror(errno));
+			break;
+		}
+		off += n;
+	}
+
+	d_buf.clear();
+}
@@ -0,0 +1,80 @@
+/* report_writer.h */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _REPORT_WRITER_H
+#define _REPORT_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "dect2core/part_info.h"
+
+/*
+ * Scan report output. Records are appended to a memory buffer and written
+ * with a single write() per flush; all calls are expected to come from
+ * the part event queue consumer thread.
+ */
+class report_writer
+{
+public:
+	typedef enum {
+		FORMAT_TEXT,	// "scan-report: U ..." lines
+		FORMAT_TEXT_RF,	// the same with RSSI and frequency offset appended
+		FORMAT_JSONL,	// one JSON object per line
+		FORMAT_BINARY,	// length-prefixed little-endian records
+	} format_t;
+
+	// Binary record layout version, see README.md
+	enum { BINARY_VERSION = 2, BINARY_MAX_LEN = 64 };
+
+private:
+	int d_fd;
+	bool d_close_fd;
+	format_t d_format;
+	const double *d_carrier_freqs;
+	size_t d_ncarriers;
+
+	std::vector<uint8_t> d_buf;
+
+	void append(const void *data, size_t len);
+	void append_text(const dect2core::part_event_t *event, bool rf);
+	void append_jsonl(const dect2core::part_event_t *event);
+	void append_binary(const dect2core::part_event_t *event);
+	double carrier_freq(uint32_t carrier) const;
+
+public:
+	report_writer(int fd, format_t format, const double *carrier_freqs, size_t ncarriers);
+	~report_writer();
+
+	// Open path for appending, "-" means stdout. Returns NULL on failure.
+	static report_writer *open(const char *path, format_t format, const double *carrier_freqs, size_t ncarriers);
+	// Parse "text", "text-rf", "jsonl" or "binary". Returns false if unknown.
+	static bool parse_format(const char *name, format_t *format);
+
+	// Encode one event as a binary record into buf (BINARY_MAX_LEN bytes)
+	size_t encode_binary(const dect2core::part_event_t *event, uint8_t *buf) const;
+
+	void write(const dect2core::part_event_t *events, size_t count);
+	void flush(void);
+};
+
+#endif
@@ -0,0 +1,181 @@
+/* shard_stitcher.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "shard_stitcher.h"
+
+typedef capture_analyzer::record_t record_t;
+
+static bool same_level(float a, float b)
+{
+	return (std::isnan(a) && std::isnan(b)) || a == b;
+}
+
+// Everything but the rx_id and rx_seq, which are the shard's own
+static bool same_burst(const record_t &a, const uint8_t *a_bits, const record_t &b, const uint8_t *b_bits)
+{
+	return a.time == b.time && a.info.sample_index == b.info.sample_index &&
+		a.info.part_type == b.info.part_type && a.info.length == b.info.length &&
+		a.info.afield_recovered == b.info.afield_recovered &&
+		same_level(a.info.freq_offset, b.info.freq_offset) && same_level(a.info.rssi, b.info.rssi) &&
+		memcmp(a_bits, b_bits, a.info.length) == 0;
+}
+
+shard_stitcher::shard_stitcher(capture_analyzer *analyzer, unsigned sps)
+	: d_analyzer(analyzer), d_window((uint64_t)SHARD_COMPARE_FRAMES * FRAME_SYMBOLS * sps),
+	d_first(true), d_active(0)
+{
+	for (uint32_t i = 0; i < MAX_PARTS; i++) {
+		d_rx_map[i] = -1;
+		d_seq_delta[i] = 0;
+	}
+}
+
+/*
+ * Compare the shard's records of the window before start with the tail
+ * of the stream so far, and take the rx_id mapping from them
+ */
+bool shard_stitcher::match(const capture_analyzer::shard_t &shard, uint64_t start)
+{
+	int32_t map[MAX_PARTS], inverse[MAX_PARTS];
+	uint32_t delta[MAX_PARTS];
+	size_t t = 0;
+
+	for (uint32_t i = 0; i < MAX_PARTS; i++) {
+		map[i] = inverse[i] = -1;
+		delta[i] = 0;
+	}
+
+	for (size_t i = 0; i < shard.records.size(); i++) {
+		const record_t &r = shard.records[i];
+		if (r.time < start - std::min(start, d_window))
+			continue;
+		if (r.time >= start)
+			break;
+		if (t == d_tail.size())
+			return false;
+
+		const record_t &s = d_tail[t++];
+		uint32_t id = r.info.rx_id, stitched_id = s.info.rx_id;
+		if (r.lost != s.lost)
+			return false;
+
+		// Parts lost early in the window may have had their last burst
+		// before it, the same time on both sides says it was the same one
+		if (r.lost) {
+			bool mapped = map[id] >= 0;
+			if (r.time != s.time || mapped != (inverse[stitched_id] >= 0) ||
+			    (mapped && map[id] != (int32_t)stitched_id))
+				return false;
+			map[id] = inverse[stitched_id] = -1;
+			continue;
+		}
+
+		if (!same_burst(r, &shard.bits[r.bit], s, &d_tail_bits[s.bit]))
+			return false;
+
+		uint32_t seq_delta = (s.info.rx_seq - r.info.rx_seq) & 0x1F;
+		if (map[id] < 0 && inverse[stitched_id] < 0) {
+			map[id] = stitched_id;
+			inverse[stitched_id] = id;
+			delta[id] = seq_delta;
+		} else if (map[id] != (int32_t)stitched_id || delta[id] != seq_delta) {
+			return false;
+		}
+	}
+	if (t != d_tail.size())
+		return false;
+
+	// Parts without bursts in the window are gone from both receivers, so
+	// those left have to be the ones active in the stream
+	uint32_t active = 0;
+	for (uint32_t i = 0; i < MAX_PARTS; i++) {
+		if (map[i] >= 0)
+			active |= 1u << map[i];
+	}
+	if (active != d_active)
+		return false;
+
+	memcpy(d_rx_map, map, sizeof(d_rx_map));
+	memcpy(d_seq_delta, delta, sizeof(d_seq_delta));
+	return true;
+}
+
+bool shard_stitcher::add(const capture_analyzer::shard_t &shard, uint64_t start, uint64_t end,
+	std::vector<dect2core::part_event_t> *events)
+{
+	if (!d_first && !match(shard, start))
+		return false;
+	d_first = false;
+
+	d_tail.clear();
+	d_tail_bits.clear();
+
+	for (size_t i = 0; i < shard.records.size(); i++) {
+		const record_t &r = shard.records[i];
+		if (r.time < start)
+			continue;
+		if (r.time >= end)
+			break;
+
+		record_t m = r;
+		uint32_t id = r.info.rx_id;
+		const uint8_t *bits = NULL;
+
+		if (r.lost) {
+			if (d_rx_map[id] < 0)
+				continue;
+			m.info.rx_id = d_rx_map[id];
+			d_active &= ~(1u << m.info.rx_id);
+			d_rx_map[id] = -1;
+		} else {
+			// A part new to the shard is new to the stream too, and gets
+			// the lowest rx_id free there
+			if (d_rx_map[id] < 0) {
+				uint32_t j = 0;
+				while (j < MAX_PARTS && (d_active & (1u << j)))
+					j++;
+				if (j == MAX_PARTS)
+					continue;
+				d_rx_map[id] = j;
+				d_seq_delta[id] = 0;
+				d_active |= 1u << j;
+			}
+			m.info.rx_id = d_rx_map[id];
+			m.info.rx_seq = (r.info.rx_seq + d_seq_delta[id]) & 0x1F;
+			bits = &shard.bits[r.bit];
+		}
+
+		d_analyzer->replay(m, bits, events);
+
+		if (r.time >= end - std::min(end, d_window)) {
+			m.bit = d_tail_bits.size();
+			d_tail.push_back(m);
+			if (bits)
+				d_tail_bits.insert(d_tail_bits.end(), bits, bits + m.info.length);
+		}
+	}
+
+	return true;
+}
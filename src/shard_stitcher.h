@@ -0,0 +1,71 @@
+/* shard_stitcher.h */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _SHARD_STITCHER_H
+#define _SHARD_STITCHER_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "capture_analyzer.h"
+
+/*
+ * Joins the receiver events of consecutive shards of a file into the
+ * stream a single receiver would have reported, and decodes it.
+ *
+ * Each shard is taken from its nominal start on. Before that it has run
+ * over the end of the shard before, and its bursts over the last
+ * SHARD_COMPARE_FRAMES have to be those of the shard before: a receiver
+ * forgets a part after four frames without bursts, so the parts both
+ * have at the start, and their timing, are then the same. The shards'
+ * rx_ids differ, the receiver hands out the lowest free one, so they are
+ * mapped to those the stream so far has given out, rx_seq counts along.
+ */
+class shard_stitcher
+{
+private:
+	capture_analyzer *d_analyzer;		// Decodes the stitched records
+	uint64_t d_window;			// Receiver samples compared
+	bool d_first;
+	int32_t d_rx_map[MAX_PARTS];		// Shard rx_id to stitched, -1 if not active
+	uint32_t d_seq_delta[MAX_PARTS];	// Added to the shard's rx_seq
+	uint32_t d_active;			// Stitched rx_ids given out
+
+	// Stitched bursts of the last window, for the next shard
+	std::vector<capture_analyzer::record_t> d_tail;
+	std::vector<uint8_t> d_tail_bits;
+
+	bool match(const capture_analyzer::shard_t &shard, uint64_t start);
+
+public:
+	shard_stitcher(capture_analyzer *analyzer, unsigned sps);
+
+	/*
+	 * Add the next shard, from receiver sample start to end, appending the
+	 * part events up to end to events. Returns false, and changes nothing,
+	 * if the shard doesn't agree with the one before: it has to be run
+	 * again from further back.
+	 */
+	bool add(const capture_analyzer::shard_t &shard, uint64_t start, uint64_t end,
+		std::vector<dect2core::part_event_t> *events);
+};
+
+#endif
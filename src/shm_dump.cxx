@@ -0,0 +1,166 @@
+/* shm_dump.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Example consumer of the scanner's shared memory rings. Records are
+ * decoded in place, without copying them out of the ring.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dect2core/burst_decoder.h"
+#include "logging.h"
+#include "shm_ring.h"
+
+static uint64_t get_le(const uint8_t *ptr, unsigned nbytes)
+{
+	uint64_t value = 0;
+	for (unsigned i = 0; i < nbytes; i++)
+		value |= (uint64_t)ptr[i] << (8 * i);
+	return value;
+}
+
+static void print_part_event(char *line, size_t size, const uint8_t *rec, uint16_t len)
+{
+	if (len < 2 + 36) {
+		snprintf(line, size, "short part event record (%u bytes)", len);
+		return;
+	}
+
+	const uint8_t *ptr = rec + 2;
+	snprintf(line, size, "%c ts=%llu.%09llu freq=%.3lf MHz carrier=%u rx_id=%u rfpi=%02x%02x%02x%02x%02x %s %c packets=%llu afield_bad_crc=%llu",
+		ptr[1],
+		(unsigned long long)(get_le(ptr + 2, 8) / 1000000000ull),
+		(unsigned long long)(get_le(ptr + 2, 8) % 1000000000ull),
+		get_le(ptr + 10, 4) / 1e3, ptr[14], ptr[15],
+		ptr[16], ptr[17], ptr[18], ptr[19], ptr[20],
+		(ptr[21] & 0x01) ? "FP" : "PP",
+		(ptr[21] & 0x02) ? 'V' : '-',
+		(unsigned long long)get_le(ptr + 22, 8),
+		(unsigned long long)get_le(ptr + 30, 8));
+
+	// Version 2 adds RSSI and frequency offset
+	if (ptr[0] >= 2 && len >= 2 + 42) {
+		size_t n = strlen(line);
+		int16_t rssi = (int16_t)get_le(ptr + 38, 2);
+		if (rssi != INT16_MIN)
+			snprintf(line + n, size - n, " rssi=%.2lf dBFS", rssi / 100.0);
+		n = strlen(line);
+		snprintf(line + n, size - n, " freq_offset=%d Hz", (int32_t)get_le(ptr + 40, 4));
+	}
+}
+
+static void print_b_field(char *line, size_t size, const uint8_t *rec, uint16_t len)
+{
+	const shm_b_field_record *b = (const shm_b_field_record *)rec;
+
+	if (len < sizeof(*b)) {
+		snprintf(line, size, "short B-field record (%u bytes)", len);
+		return;
+	}
+
+	int n = snprintf(line, size, "B rx_id=%u fn=%u rfpi=%02x%02x%02x%02x%02x%s ",
+		b->rx_id, b->frame_number,
+		b->part_id[0], b->part_id[1], b->part_id[2], b->part_id[3], b->part_id[4],
+		(b->flags & VOICE_RECOVERED) ? " recovered" : "");
+	for (size_t i = 0; i < sizeof(b->b_field) && n + 3 < (int)size; i++)
+		n += snprintf(line + n, size - n, "%02x", b->b_field[i]);
+}
+
+static void print_voice_gap(char *line, size_t size, const uint8_t *rec, uint16_t len)
+{
+	const shm_voice_gap_record *g = (const shm_voice_gap_record *)rec;
+
+	if (len < sizeof(*g)) {
+		snprintf(line, size, "short voice gap record (%u bytes)", len);
+		return;
+	}
+
+	snprintf(line, size, "G rx_id=%u bursts=%u%s%s%s", g->rx_id, g->bursts,
+		(g->flags & VOICE_GAP_NO_VOICE) ? " no-voice" : "",
+		(g->flags & VOICE_GAP_CRC) ? " crc" : "",
+		(g->flags & VOICE_GAP_END) ? " end" : "");
+}
+
+int main(int argc, char **argv)
+{
+	bool from_oldest = false;
+	int c;
+
+	while ((c = getopt(argc, argv, "o")) != -1) {
+		switch (c) {
+		case 'o':
+			from_oldest = true;
+			break;
+		default:
+			fprintf(stderr, "%s [-o] name\n", argv[0]);
+			fprintf(stderr, "  -o  start with the oldest record in the ring\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "%s [-o] name\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	shm_ring_reader *reader = shm_ring_reader::open(argv[optind], from_oldest);
+	if (!reader) {
+		log_flush();
+		return EXIT_FAILURE;
+	}
+
+	uint64_t lost = 0;
+	char line[256];
+
+	while (1) {
+		uint16_t type, len;
+		const uint8_t *rec = (const uint8_t *)reader->peek(&type, &len);
+		if (rec == NULL) {
+			usleep(1000);
+			continue;
+		}
+
+		uint64_t seq = reader->sequence();
+		if (type == SHM_RECORD_PART_EVENT)
+			print_part_event(line, sizeof(line), rec, len);
+		else if (type == SHM_RECORD_B_FIELD)
+			print_b_field(line, sizeof(line), rec, len);
+		else if (type == SHM_RECORD_VOICE_GAP)
+			print_voice_gap(line, sizeof(line), rec, len);
+		else
+			snprintf(line, sizeof(line), "unknown record type %u", type);
+
+		// Only print what the writer did not overwrite while we looked at it
+		if (reader->release())
+			printf("%llu %s\n", (unsigned long long)seq, line);
+
+		if (reader->lost_count() != lost) {
+			lost = reader->lost_count();
+			fprintf(stderr, "overrun, %llu records lost so far\n", (unsigned long long)lost);
+		}
+		fflush(stdout);
+	}
+
+	return 0;
+}
@@ -0,0 +1,260 @@
+/* shm_ring.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
+#include <string>
+
+#include "logging.h"
+#include "shm_ring.h"
+
+static std::string shm_path(const char *name)
+{
+	return (name[0] == '/') ? std::string(name) : std::string("/") + name;
+}
+
+/*
+ * Writer
+ */
+
+shm_ring_writer::shm_ring_writer()
+	: d_name(NULL), d_hdr(NULL), d_slots(NULL), d_map_len(0), d_seq(0), d_oversize_cnt(0)
+{
+}
+
+shm_ring_writer::~shm_ring_writer()
+{
+	if (d_hdr)
+		munmap(d_hdr, d_map_len);
+	if (d_name) {
+		// Attached readers keep their mapping, new ones can't attach anymore
+		shm_unlink(d_name);
+		free(d_name);
+	}
+}
+
+shm_ring_writer *shm_ring_writer::create(const char *name, uint32_t slot_size, uint32_t nslots)
+{
+	if (nslots == 0 || (nslots & (nslots - 1)) != 0) {
+		log_error("shm ring \"%s\": number of slots must be a power of two\n", name);
+		return NULL;
+	}
+
+	// Keep slots cache line aligned
+	slot_size = (slot_size + sizeof(shm_ring_slot) + 63) & ~63u;
+
+	std::string path = shm_path(name);
+	shm_unlink(path.c_str());
+
+	int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		log_error("shm_open(\"%s\") failed: %s\n", path.c_str(), strerror(errno));
+		return NULL;
+	}
+
+	size_t map_len = sizeof(shm_ring_header) + (size_t)slot_size * nslots;
+	if (ftruncate(fd, map_len) < 0) {
+		log_error("ftruncate(\"%s\") failed: %s\n", path.c_str(), strerror(errno));
+		close(fd);
+		shm_unlink(path.c_str());
+		return NULL;
+	}
+
+	void *map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		log_error("mmap(\"%s\") failed: %s\n", path.c_str(), strerror(errno));
+		shm_unlink(path.c_str());
+		return NULL;
+	}
+
+	shm_ring_writer *writer = new shm_ring_writer();
+	writer->d_name = strdup(path.c_str());
+	writer->d_map_len = map_len;
+	writer->d_hdr = (shm_ring_header *)map;
+	writer->d_slots = (uint8_t *)map + sizeof(shm_ring_header);
+
+	// The object is zero filled, which is a valid empty state for the slots
+	shm_ring_header *hdr = writer->d_hdr;
+	new (&hdr->write_seq) std::atomic<uint64_t>(0);
+	hdr->slot_size = slot_size;
+	hdr->nslots = nslots;
+	hdr->version = SHM_RING_VERSION;
+	std::atomic_thread_fence(std::memory_order_release);
+	hdr->magic = SHM_RING_MAGIC;
+
+	return writer;
+}
+
+bool shm_ring_writer::publish(uint16_t type, const void *data, size_t len)
+{
+	if (len > d_hdr->slot_size - sizeof(shm_ring_slot)) {
+		d_oversize_cnt++;
+		return false;
+	}
+
+	uint64_t seq = d_seq++;
+	shm_ring_slot *slot = (shm_ring_slot *)(d_slots + (size_t)(seq & (d_hdr->nslots - 1)) * d_hdr->slot_size);
+
+	slot->lock.store(2 * seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot->type = type;
+	slot->len = len;
+	memcpy((uint8_t *)slot + sizeof(shm_ring_slot), data, len);
+
+	slot->lock.store(2 * seq + 2, std::memory_order_release);
+	d_hdr->write_seq.store(seq + 1, std::memory_order_release);
+
+	return true;
+}
+
+/*
+ * Reader
+ */
+
+shm_ring_reader::shm_ring_reader()
+	: d_hdr(NULL), d_slots(NULL), d_map_len(0), d_seq(0), d_lost_cnt(0)
+{
+}
+
+shm_ring_reader::~shm_ring_reader()
+{
+	if (d_hdr)
+		munmap(d_hdr, d_map_len);
+}
+
+shm_ring_reader *shm_ring_reader::open(const char *name, bool from_oldest)
+{
+	std::string path = shm_path(name);
+
+	int fd = shm_open(path.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		log_error("shm_open(\"%s\") failed: %s\n", path.c_str(), strerror(errno));
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(shm_ring_header)) {
+		log_error("shm ring \"%s\" is not initialized\n", path.c_str());
+		close(fd);
+		return NULL;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		log_error("mmap(\"%s\") failed: %s\n", path.c_str(), strerror(errno));
+		return NULL;
+	}
+
+	shm_ring_header *hdr = (shm_ring_header *)map;
+	if (hdr->magic != SHM_RING_MAGIC || hdr->version != SHM_RING_VERSION ||
+		sizeof(shm_ring_header) + (size_t)hdr->slot_size * hdr->nslots > (size_t)st.st_size) {
+		log_error("shm ring \"%s\": bad header\n", path.c_str());
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	shm_ring_reader *reader = new shm_ring_reader();
+	reader->d_hdr = hdr;
+	reader->d_slots = (uint8_t *)map + sizeof(shm_ring_header);
+	reader->d_map_len = st.st_size;
+
+	uint64_t write_seq = hdr->write_seq.load(std::memory_order_acquire);
+	if (from_oldest && write_seq > hdr->nslots)
+		reader->d_seq = write_seq - hdr->nslots;
+	else if (from_oldest)
+		reader->d_seq = 0;
+	else
+		reader->d_seq = write_seq;
+
+	return reader;
+}
+
+shm_ring_slot *shm_ring_reader::slot(uint64_t seq) const
+{
+	return (shm_ring_slot *)(d_slots + (size_t)(seq & (d_hdr->nslots - 1)) * d_hdr->slot_size);
+}
+
+const void *shm_ring_reader::peek(uint16_t *type, uint16_t *len)
+{
+	while (1) {
+		shm_ring_slot *s = slot(d_seq);
+		uint64_t lock = s->lock.load(std::memory_order_acquire);
+
+		if (lock == 2 * d_seq + 2) {
+			*type = s->type;
+			*len = s->len;
+			if (*len > d_hdr->slot_size - sizeof(shm_ring_slot))
+				*len = d_hdr->slot_size - sizeof(shm_ring_slot);
+			return (const uint8_t *)s + sizeof(shm_ring_slot);
+		}
+
+		if (lock < 2 * d_seq + 1)
+			return NULL; // Not written yet
+
+		// The writer is at least one lap ahead, skip to the oldest record
+		// that can still be valid
+		uint64_t write_seq = d_hdr->write_seq.load(std::memory_order_acquire);
+		uint64_t oldest = (write_seq > d_hdr->nslots) ? write_seq - d_hdr->nslots : 0;
+		if (oldest <= d_seq)
+			return NULL; // Slot is being written right now
+		d_lost_cnt += oldest - d_seq;
+		d_seq = oldest;
+	}
+}
+
+bool shm_ring_reader::release(void)
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	bool valid = slot(d_seq)->lock.load(std::memory_order_relaxed) == 2 * d_seq + 2;
+	if (!valid)
+		d_lost_cnt++;
+	d_seq++;
+	return valid;
+}
+
+int shm_ring_reader::read(uint16_t *type, void *buf, size_t buflen)
+{
+	while (1) {
+		uint16_t len;
+		const void *data = peek(type, &len);
+		if (data == NULL)
+			return 0;
+
+		if (len > buflen) {
+			release();
+			return -1;
+		}
+
+		memcpy(buf, data, len);
+		if (release())
+			return len;
+	}
+}
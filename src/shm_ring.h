@@ -0,0 +1,147 @@
+/* shm_ring.h */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _SHM_RING_H
+#define _SHM_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/*
+ * Single-producer/multi-consumer ring of variable length records in a
+ * POSIX shared memory object (/dev/shm/<name>).
+ *
+ * Every record gets a sequence number. A slot is guarded by a seqlock:
+ * the writer marks the slot odd while filling it and stores the final even
+ * value afterwards, so readers can consume records in place and detect
+ * that the writer has lapped them. Readers never write to the ring and
+ * never block the writer.
+ */
+
+#define SHM_RING_MAGIC		0x44454354	// "DECT"
+#define SHM_RING_VERSION	1
+
+// Record types
+#define SHM_RECORD_PART_EVENT	1	// Binary scan-report record, see README.md
+#define SHM_RECORD_B_FIELD	2	// shm_b_field_record
+#define SHM_RECORD_VOICE_GAP	3	// shm_voice_gap_record
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slot_size;		// Bytes per slot including shm_ring_slot
+	uint32_t nslots;		// Power of two
+	uint8_t pad0[48];
+	std::atomic<uint64_t> write_seq;	// Sequence number of the next record
+	uint8_t pad1[56];
+} shm_ring_header;
+
+typedef struct {
+	std::atomic<uint64_t> lock;	// 2 * seq + 1 while writing, 2 * seq + 2 when done
+	uint16_t type;
+	uint16_t len;
+	uint32_t reserved;
+} shm_ring_slot;
+
+typedef struct {
+	uint8_t rx_id;
+	uint8_t frame_number;
+	uint8_t part_id[5];
+	uint8_t flags;			// VOICE_RECOVERED, see dect2core/burst_decoder.h
+	uint8_t b_field[40];		// Descrambled B-field
+} shm_b_field_record;
+
+// No B-fields for a while, or no more, see voice_record_t
+typedef struct {
+	uint8_t rx_id;
+	uint8_t flags;			// VOICE_GAP_*
+	uint8_t reserved[2];
+	uint32_t bursts;
+} shm_voice_gap_record;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory ring needs lock-free 64-bit atomics");
+static_assert(sizeof(shm_ring_header) == 128, "unexpected shm_ring_header layout");
+static_assert(sizeof(shm_ring_slot) == 16, "unexpected shm_ring_slot layout");
+
+class shm_ring_writer
+{
+private:
+	char *d_name;
+	shm_ring_header *d_hdr;
+	uint8_t *d_slots;
+	size_t d_map_len;
+	uint64_t d_seq;
+	uint64_t d_oversize_cnt;
+
+	shm_ring_writer();
+
+public:
+	~shm_ring_writer();
+
+	// Create (or replace) the shared memory object. Returns NULL on failure.
+	static shm_ring_writer *create(const char *name, uint32_t slot_size, uint32_t nslots);
+
+	// Returns false if the record does not fit into a slot
+	bool publish(uint16_t type, const void *data, size_t len);
+
+	uint64_t oversize_count(void) const { return d_oversize_cnt; }
+};
+
+class shm_ring_reader
+{
+private:
+	shm_ring_header *d_hdr;
+	uint8_t *d_slots;
+	size_t d_map_len;
+	uint64_t d_seq;
+	uint64_t d_lost_cnt;
+
+	shm_ring_reader();
+
+	shm_ring_slot *slot(uint64_t seq) const;
+
+public:
+	~shm_ring_reader();
+
+	// Attach to an existing ring. With from_oldest the reader starts at the
+	// oldest record still in the ring, otherwise at the next new one.
+	static shm_ring_reader *open(const char *name, bool from_oldest);
+
+	/*
+	 * Zero-copy access: peek() returns a pointer into the ring for the next
+	 * record, or NULL if there is none. After using the data call
+	 * release(); it returns false if the writer overwrote the record in the
+	 * meantime, in which case the data must be discarded.
+	 */
+	const void *peek(uint16_t *type, uint16_t *len);
+	bool release(void);
+
+	// Copying variant. Returns the record length, 0 if there is no new
+	// record, or -1 if buf is too small (the record is skipped).
+	int read(uint16_t *type, void *buf, size_t buflen);
+
+	uint64_t sequence(void) const { return d_seq; }
+	// Records overwritten before this reader got to them
+	uint64_t lost_count(void) const { return d_lost_cnt; }
+};
+
+#endif
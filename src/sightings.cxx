@@ -0,0 +1,574 @@
+/* sightings.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+#include <unordered_map>
+
+#include "logging.h"
+#include "sightings.h"
+
+#define SLOT_USED	(1ull << 63)
+#define SEGMENT_SUFFIX	".sgt"
+
+static size_t align64(size_t n)
+{
+	return (n + 63) & ~(size_t)63;
+}
+
+/*
+ * Point the segment's index and column pointers into a mapping at base,
+ * returns the length the mapping needs
+ */
+static size_t layout(sightings_segment *seg, uint8_t *base, uint32_t capacity, uint32_t block_rows, uint32_t hash_slots)
+{
+	uintptr_t addr = (uintptr_t)base;
+	size_t off = sizeof(sightings_header);
+
+#define PLACE(field, n) \
+	seg->field = (decltype(seg->field))(addr + off); \
+	off = align64(off + (size_t)(n) * sizeof(*seg->field));
+
+	PLACE(blocks, capacity / block_rows);
+	PLACE(slots, hash_slots);
+	PLACE(timestamp, capacity);
+	PLACE(part_id, capacity);
+	PLACE(prev, capacity);
+	PLACE(freq_khz, capacity);
+	PLACE(rssi, capacity);
+	PLACE(carrier, capacity);
+	PLACE(flags, capacity);
+
+#undef PLACE
+
+	seg->hdr = (sightings_header *)base;
+	return off;
+}
+
+// MurmurHash3 finalizer, identities of one manufacturer share most bits
+static uint64_t hash_part(uint64_t part_id)
+{
+	part_id ^= part_id >> 33;
+	part_id *= 0xff51afd7ed558ccdull;
+	part_id ^= part_id >> 33;
+	part_id *= 0xc4ceb9fe1a85ec53ull;
+	part_id ^= part_id >> 33;
+	return part_id;
+}
+
+static std::string segment_path(const std::string &dir, unsigned seq)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/%08u" SEGMENT_SUFFIX, seq);
+	return dir + name;
+}
+
+// Segment numbers in dir, ascending
+static bool list_segments(const char *dir, std::vector<unsigned> *seqs)
+{
+	DIR *d = opendir(dir);
+	if (!d)
+		return false;
+
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		char *end;
+		unsigned long seq = strtoul(entry->d_name, &end, 10);
+		if (end != entry->d_name && strcmp(end, SEGMENT_SUFFIX) == 0)
+			seqs->push_back(seq);
+	}
+	closedir(d);
+
+	std::sort(seqs->begin(), seqs->end());
+	return true;
+}
+
+// Map an existing segment, checking its header
+static bool map_segment(sightings_segment *seg, const std::string &path, int fd, bool writable)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		log_error("stat(\"%s\") failed: %s\n", path.c_str(), strerror(errno));
+		return false;
+	}
+	if ((size_t)st.st_size < sizeof(sightings_header)) {
+		log_warning("%s: not a sightings segment\n", path.c_str());
+		return false;
+	}
+
+	void *map = mmap(NULL, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		log_error("mmap(\"%s\") failed: %s\n", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	const sightings_header *hdr = (const sightings_header *)map;
+	bool ok = hdr->magic == SIGHTINGS_MAGIC && hdr->version == SIGHTINGS_VERSION &&
+		hdr->block_rows && hdr->capacity % hdr->block_rows == 0 &&
+		hdr->hash_slots && (hdr->hash_slots & (hdr->hash_slots - 1)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	if (!ok || layout(seg, (uint8_t *)map, hdr->capacity, hdr->block_rows, hdr->hash_slots) > (size_t)st.st_size) {
+		log_warning("%s: not a sightings segment\n", path.c_str());
+		munmap(map, st.st_size);
+		return false;
+	}
+
+	seg->fd = fd;
+	seg->map = (uint8_t *)map;
+	seg->map_len = st.st_size;
+	return true;
+}
+
+static void unmap_segment(sightings_segment *seg)
+{
+	if (seg->map)
+		munmap(seg->map, seg->map_len);
+	if (seg->fd >= 0)
+		close(seg->fd);
+	seg->map = NULL;
+	seg->fd = -1;
+}
+
+static void read_row(const sightings_segment *seg, uint32_t row, sighting_t *s)
+{
+	s->timestamp = seg->timestamp[row];
+	s->part_id = seg->part_id[row];
+	s->freq_khz = seg->freq_khz[row];
+	s->rssi = seg->rssi[row];
+	s->carrier = seg->carrier[row];
+	s->flags = seg->flags[row];
+}
+
+// Whether any of the first rows rows may lie in [from, to)
+static bool segment_overlaps(const sightings_segment *seg, uint32_t rows, uint64_t from, uint64_t to)
+{
+	uint32_t block_rows = seg->hdr->block_rows;
+	uint32_t full = rows / block_rows;
+
+	for (uint32_t b = 0; b < full; b++) {
+		if (seg->blocks[b].max_ts >= from && seg->blocks[b].min_ts < to)
+			return true;
+	}
+	for (uint32_t row = full * block_rows; row < rows; row++) {
+		if (seg->timestamp[row] >= from && seg->timestamp[row] < to)
+			return true;
+	}
+	return false;
+}
+
+static const sightings_slot *find_slot(const sightings_segment *seg, uint64_t part_id)
+{
+	uint32_t mask = seg->hdr->hash_slots - 1;
+
+	for (uint32_t i = hash_part(part_id) & mask;; i = (i + 1) & mask) {
+		uint64_t key = seg->slots[i].key.load(std::memory_order_acquire);
+		if (key == 0)
+			return NULL;
+		if (key == (part_id | SLOT_USED))
+			return &seg->slots[i];
+	}
+}
+
+/*
+ * Writer
+ */
+
+sightings_writer::sightings_writer(const char *dir)
+	: d_dir(dir), d_rows(0), d_parts(0)
+{
+	memset(&d_seg, 0, sizeof(d_seg));
+	d_seg.fd = -1;
+}
+
+sightings_writer::~sightings_writer()
+{
+	close_segment();
+}
+
+sightings_writer *sightings_writer::open(const char *dir)
+{
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+		log_error("mkdir(\"%s\") failed: %s\n", dir, strerror(errno));
+		return NULL;
+	}
+
+	std::vector<unsigned> seqs;
+	if (!list_segments(dir, &seqs)) {
+		log_error("opendir(\"%s\") failed: %s\n", dir, strerror(errno));
+		return NULL;
+	}
+
+	sightings_writer *writer = new sightings_writer(dir);
+
+	// Continue the last segment unless it is full or unusable
+	if (!seqs.empty()) {
+		errno = 0;
+		if (writer->open_segment(seqs.back(), false)) {
+			if (writer->d_rows < writer->d_seg.hdr->capacity && 2 * writer->d_parts < writer->d_seg.hdr->hash_slots)
+				return writer;
+			writer->close_segment();
+		} else if (errno == EWOULDBLOCK) {
+			delete writer;
+			return NULL;
+		}
+	}
+
+	if (!writer->open_segment(seqs.empty() ? 0 : seqs.back() + 1, true)) {
+		delete writer;
+		return NULL;
+	}
+	return writer;
+}
+
+bool sightings_writer::open_segment(unsigned seq, bool create)
+{
+	std::string path = segment_path(d_dir, seq);
+
+	int fd = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0644);
+	if (fd < 0) {
+		log_error("open(\"%s\") failed: %s\n", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	// Readers don't lock, a second writer must not append to the same segment
+	if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+		int err = errno;
+		log_error("%s is in use by another writer\n", path.c_str());
+		close(fd);
+		errno = err;
+		return false;
+	}
+
+	if (create) {
+		// The file starts sparse and zero filled, which is a valid empty state
+		size_t len = layout(&d_seg, NULL, SIGHTINGS_SEGMENT_ROWS, SIGHTINGS_BLOCK_ROWS, SIGHTINGS_HASH_SLOTS);
+		if (ftruncate(fd, len) < 0) {
+			log_error("ftruncate(\"%s\") failed: %s\n", path.c_str(), strerror(errno));
+			close(fd);
+			unlink(path.c_str());
+			return false;
+		}
+
+		void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED) {
+			log_error("mmap(\"%s\") failed: %s\n", path.c_str(), strerror(errno));
+			close(fd);
+			unlink(path.c_str());
+			return false;
+		}
+
+		layout(&d_seg, (uint8_t *)map, SIGHTINGS_SEGMENT_ROWS, SIGHTINGS_BLOCK_ROWS, SIGHTINGS_HASH_SLOTS);
+		d_seg.fd = fd;
+		d_seg.map = (uint8_t *)map;
+		d_seg.map_len = len;
+
+		sightings_header *hdr = d_seg.hdr;
+		new (&hdr->rows) std::atomic<uint64_t>(0);
+		new (&hdr->parts) std::atomic<uint32_t>(0);
+		hdr->capacity = SIGHTINGS_SEGMENT_ROWS;
+		hdr->block_rows = SIGHTINGS_BLOCK_ROWS;
+		hdr->hash_slots = SIGHTINGS_HASH_SLOTS;
+		hdr->version = SIGHTINGS_VERSION;
+		std::atomic_thread_fence(std::memory_order_release);
+		hdr->magic = SIGHTINGS_MAGIC;
+	} else if (!map_segment(&d_seg, path, fd, true)) {
+		close(fd);
+		errno = 0;
+		return false;
+	}
+
+	d_seg.seq = seq;
+	d_rows = d_seg.hdr->rows.load(std::memory_order_relaxed);
+	d_parts = d_seg.hdr->parts.load(std::memory_order_relaxed);
+	return true;
+}
+
+void sightings_writer::close_segment(void)
+{
+	unmap_segment(&d_seg);
+}
+
+bool sightings_writer::append(const sighting_t &s)
+{
+	sightings_header *hdr = d_seg.hdr;
+
+	if (d_rows == hdr->capacity || 2 * d_parts >= hdr->hash_slots) {
+		unsigned seq = d_seg.seq + 1;
+		close_segment();
+		if (!open_segment(seq, true))
+			return false;
+		hdr = d_seg.hdr;
+	}
+
+	uint32_t row = d_rows;
+	uint64_t part_id = s.part_id & ((1ull << 40) - 1);
+
+	uint32_t mask = hdr->hash_slots - 1;
+	uint32_t i = hash_part(part_id) & mask;
+	while (d_seg.slots[i].key.load(std::memory_order_relaxed) &&
+	       d_seg.slots[i].key.load(std::memory_order_relaxed) != (part_id | SLOT_USED))
+		i = (i + 1) & mask;
+	sightings_slot *slot = &d_seg.slots[i];
+	bool new_part = slot->key.load(std::memory_order_relaxed) == 0;
+
+	d_seg.timestamp[row] = s.timestamp;
+	d_seg.part_id[row] = part_id;
+	d_seg.prev[row] = new_part ? SIGHTINGS_NO_ROW : slot->last_row.load(std::memory_order_relaxed);
+	d_seg.freq_khz[row] = s.freq_khz;
+	d_seg.rssi[row] = s.rssi;
+	d_seg.carrier[row] = s.carrier;
+	d_seg.flags[row] = s.flags;
+
+	// Rows need not arrive in time order, blocks keep their full range
+	sightings_block *block = &d_seg.blocks[row / hdr->block_rows];
+	if (row % hdr->block_rows == 0) {
+		block->min_ts = s.timestamp;
+		block->max_ts = s.timestamp;
+	} else {
+		block->min_ts = std::min(block->min_ts, s.timestamp);
+		block->max_ts = std::max(block->max_ts, s.timestamp);
+	}
+
+	if (new_part) {
+		slot->first_row = row;
+		slot->count.store(0, std::memory_order_relaxed);
+	}
+	slot->count.store(slot->count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	slot->last_row.store(row, std::memory_order_release);
+	if (new_part) {
+		slot->key.store(part_id | SLOT_USED, std::memory_order_release);
+		hdr->parts.store(++d_parts, std::memory_order_relaxed);
+	}
+
+	hdr->rows.store(++d_rows, std::memory_order_release);
+	return true;
+}
+
+/*
+ * Reader
+ */
+
+sightings_reader::sightings_reader()
+{
+}
+
+sightings_reader::~sightings_reader()
+{
+	for (size_t i = 0; i < d_segments.size(); i++)
+		unmap_segment(&d_segments[i]);
+}
+
+sightings_reader *sightings_reader::open(const char *dir)
+{
+	std::vector<unsigned> seqs;
+	if (!list_segments(dir, &seqs)) {
+		log_error("opendir(\"%s\") failed: %s\n", dir, strerror(errno));
+		return NULL;
+	}
+
+	sightings_reader *reader = new sightings_reader();
+
+	for (size_t i = 0; i < seqs.size(); i++) {
+		std::string path = segment_path(dir, seqs[i]);
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			log_warning("open(\"%s\") failed: %s\n", path.c_str(), strerror(errno));
+			continue;
+		}
+
+		sightings_segment seg;
+		if (!map_segment(&seg, path, fd, false)) {
+			close(fd);
+			continue;
+		}
+		seg.seq = seqs[i];
+		reader->d_segments.push_back(seg);
+	}
+
+	if (reader->d_segments.empty()) {
+		log_error("%s: no sightings\n", dir);
+		delete reader;
+		return NULL;
+	}
+	return reader;
+}
+
+uint64_t sightings_reader::rows(void) const
+{
+	uint64_t rows = 0;
+	for (size_t i = 0; i < d_segments.size(); i++)
+		rows += d_segments[i].hdr->rows.load(std::memory_order_acquire);
+	return rows;
+}
+
+uint64_t sightings_reader::scan(uint64_t from, uint64_t to, callback_t fn, void *arg) const
+{
+	uint64_t cnt = 0;
+
+	for (size_t i = 0; i < d_segments.size(); i++) {
+		const sightings_segment *seg = &d_segments[i];
+		uint32_t rows = seg->hdr->rows.load(std::memory_order_acquire);
+		uint32_t block_rows = seg->hdr->block_rows;
+
+		for (uint32_t start = 0; start < rows; start += block_rows) {
+			uint32_t end = std::min(start + block_rows, rows);
+
+			// The last block may still be growing, its range isn't final
+			if (end - start == block_rows) {
+				const sightings_block *block = &seg->blocks[start / block_rows];
+				if (block->max_ts < from || block->min_ts >= to)
+					continue;
+			}
+
+			for (uint32_t row = start; row < end; row++) {
+				uint64_t ts = seg->timestamp[row];
+				if (ts < from || ts >= to)
+					continue;
+
+				sighting_t s;
+				read_row(seg, row, &s);
+				cnt++;
+				if (!fn(arg, &s))
+					return cnt;
+			}
+		}
+	}
+
+	return cnt;
+}
+
+uint64_t sightings_reader::count(uint64_t from, uint64_t to) const
+{
+	uint64_t cnt = 0;
+
+	for (size_t i = 0; i < d_segments.size(); i++) {
+		const sightings_segment *seg = &d_segments[i];
+		uint32_t rows = seg->hdr->rows.load(std::memory_order_acquire);
+		uint32_t block_rows = seg->hdr->block_rows;
+
+		for (uint32_t start = 0; start < rows; start += block_rows) {
+			uint32_t end = std::min(start + block_rows, rows);
+
+			if (end - start == block_rows) {
+				const sightings_block *block = &seg->blocks[start / block_rows];
+				if (block->max_ts < from || block->min_ts >= to)
+					continue;
+				if (block->min_ts >= from && block->max_ts < to) {
+					cnt += block_rows;
+					continue;
+				}
+			}
+
+			for (uint32_t row = start; row < end; row++)
+				cnt += seg->timestamp[row] >= from && seg->timestamp[row] < to;
+		}
+	}
+
+	return cnt;
+}
+
+uint64_t sightings_reader::scan_part(uint64_t part_id, uint64_t from, uint64_t to, callback_t fn, void *arg) const
+{
+	uint64_t cnt = 0;
+
+	for (size_t i = d_segments.size(); i-- > 0;) {
+		const sightings_segment *seg = &d_segments[i];
+		uint32_t rows = seg->hdr->rows.load(std::memory_order_acquire);
+
+		if ((from > 0 || to < UINT64_MAX) && !segment_overlaps(seg, rows, from, to))
+			continue;
+
+		const sightings_slot *slot = find_slot(seg, part_id);
+		if (!slot)
+			continue;
+
+		// The writer may have added rows after we loaded the row count
+		uint32_t row = slot->last_row.load(std::memory_order_acquire);
+		while (row != SIGHTINGS_NO_ROW && row >= rows)
+			row = seg->prev[row];
+
+		for (; row != SIGHTINGS_NO_ROW; row = seg->prev[row]) {
+			uint64_t ts = seg->timestamp[row];
+			if (ts < from || ts >= to)
+				continue;
+
+			sighting_t s;
+			read_row(seg, row, &s);
+			cnt++;
+			if (!fn(arg, &s))
+				return cnt;
+		}
+	}
+
+	return cnt;
+}
+
+void sightings_reader::parts(std::vector<part_summary_t> *summaries) const
+{
+	std::unordered_map<uint64_t, size_t> index;
+
+	summaries->clear();
+
+	for (size_t i = 0; i < d_segments.size(); i++) {
+		const sightings_segment *seg = &d_segments[i];
+		uint32_t rows = seg->hdr->rows.load(std::memory_order_acquire);
+
+		for (uint32_t j = 0; j < seg->hdr->hash_slots; j++) {
+			const sightings_slot *slot = &seg->slots[j];
+			uint64_t key = slot->key.load(std::memory_order_acquire);
+			if (key == 0 || slot->first_row >= rows)
+				continue;
+
+			uint32_t last = slot->last_row.load(std::memory_order_acquire);
+			uint32_t count = slot->count.load(std::memory_order_relaxed);
+			while (last >= rows) {
+				last = seg->prev[last];
+				count--;
+			}
+
+			uint64_t part_id = key & ~SLOT_USED;
+			std::unordered_map<uint64_t, size_t>::iterator it = index.find(part_id);
+			if (it == index.end()) {
+				part_summary_t summary;
+				summary.part_id = part_id;
+				summary.count = 0;
+				read_row(seg, slot->first_row, &summary.first);
+				it = index.insert(std::make_pair(part_id, summaries->size())).first;
+				summaries->push_back(summary);
+			}
+
+			part_summary_t *summary = &(*summaries)[it->second];
+			summary->count += count;
+			read_row(seg, last, &summary->last);
+		}
+	}
+}
@@ -0,0 +1,181 @@
+/* sightings.h */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _SIGHTINGS_H
+#define _SIGHTINGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/*
+ * Append-only store of part sightings for long surveys: a directory of
+ * numbered segment files, each memory mapped and holding up to
+ * SIGHTINGS_SEGMENT_ROWS rows column by column, so that a query only
+ * touches the columns it needs.
+ *
+ * Each segment carries two indexes next to its columns. The time index
+ * keeps the timestamp range of every SIGHTINGS_BLOCK_ROWS rows, so range
+ * queries skip or count whole blocks. The part index is a hash table from
+ * part identity to the part's first and last row and row count, and every
+ * row links back to the previous row of its part, so per-part queries
+ * only visit that part's rows, newest first.
+ *
+ * There is a single writer, which publishes a row by storing the row count
+ * last. Readers may open the store at any time, also while it is written.
+ */
+
+#define SIGHTINGS_MAGIC		0x44534754	// "DSGT"
+#define SIGHTINGS_VERSION	1
+
+#define SIGHTINGS_SEGMENT_ROWS	(1u << 20)
+#define SIGHTINGS_BLOCK_ROWS	4096
+#define SIGHTINGS_HASH_SLOTS	(1u << 16)	// A segment ends when half are used
+#define SIGHTINGS_NO_ROW	0xffffffffu
+
+#define SIGHTING_FIXED_PART	0x01
+#define SIGHTING_VOICE		0x02
+#define SIGHTING_NO_RSSI	INT16_MIN
+
+typedef struct {
+	uint64_t timestamp;	// ns since the epoch
+	uint64_t part_id;	// RFPI or PMID, 40 bits, first byte most significant
+	uint32_t freq_khz;	// Carrier frequency
+	int16_t rssi;		// 0.01 dBFS, SIGHTING_NO_RSSI if unknown
+	uint8_t carrier;	// Carrier index
+	uint8_t flags;		// SIGHTING_FIXED_PART, SIGHTING_VOICE
+} sighting_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;		// Rows
+	uint32_t block_rows;		// Rows per time index entry
+	uint32_t hash_slots;		// Power of two
+	uint8_t pad0[44];
+	std::atomic<uint64_t> rows;	// Rows written, stored after the row
+	std::atomic<uint32_t> parts;	// Hash slots used
+	uint8_t pad1[52];
+} sightings_header;
+
+typedef struct {
+	uint64_t min_ts;
+	uint64_t max_ts;
+} sightings_block;
+
+typedef struct {
+	std::atomic<uint64_t> key;	// part_id | SLOT_USED, stored after the rows
+	uint32_t first_row;
+	std::atomic<uint32_t> last_row;
+	std::atomic<uint32_t> count;
+	uint32_t reserved;
+} sightings_slot;
+
+static_assert(sizeof(sightings_header) == 128, "unexpected sightings_header layout");
+static_assert(sizeof(sightings_slot) == 24, "unexpected sightings_slot layout");
+
+// One mapped segment file
+typedef struct {
+	unsigned seq;			// File name number
+	int fd;
+	uint8_t *map;
+	size_t map_len;
+
+	sightings_header *hdr;
+	sightings_block *blocks;
+	sightings_slot *slots;
+
+	// Columns
+	uint64_t *timestamp;
+	uint64_t *part_id;
+	uint32_t *prev;			// Previous row of the part, SIGHTINGS_NO_ROW if none
+	uint32_t *freq_khz;
+	int16_t *rssi;
+	uint8_t *carrier;
+	uint8_t *flags;
+} sightings_segment;
+
+class sightings_writer
+{
+private:
+	std::string d_dir;
+	sightings_segment d_seg;
+	uint32_t d_rows;
+	uint32_t d_parts;
+
+	sightings_writer(const char *dir);
+
+	bool open_segment(unsigned seq, bool create);
+	void close_segment(void);
+
+public:
+	~sightings_writer();
+
+	// Open the store in dir for appending, creating it if needed. Returns
+	// NULL on failure, also if another writer has it open.
+	static sightings_writer *open(const char *dir);
+
+	// Returns false if a new segment can't be created
+	bool append(const sighting_t &s);
+};
+
+class sightings_reader
+{
+public:
+	// Return false to stop the query
+	typedef bool (*callback_t)(void *arg, const sighting_t *s);
+
+	typedef struct {
+		uint64_t part_id;
+		uint64_t count;
+		sighting_t first;
+		sighting_t last;
+	} part_summary_t;
+
+private:
+	std::vector<sightings_segment> d_segments;
+
+	sightings_reader();
+
+public:
+	~sightings_reader();
+
+	// Returns NULL if dir holds no readable segment
+	static sightings_reader *open(const char *dir);
+
+	size_t segments(void) const { return d_segments.size(); }
+	uint64_t rows(void) const;
+
+	// Sightings with from <= timestamp < to in the order they were written
+	uint64_t scan(uint64_t from, uint64_t to, callback_t fn, void *arg) const;
+	// Only counts them, whole blocks inside the range from the time index
+	uint64_t count(uint64_t from, uint64_t to) const;
+
+	// Sightings of one part with from <= timestamp < to, newest first
+	uint64_t scan_part(uint64_t part_id, uint64_t from, uint64_t to, callback_t fn, void *arg) const;
+
+	// Every part seen, in no particular order
+	void parts(std::vector<part_summary_t> *summaries) const;
+};
+
+#endif
@@ -0,0 +1,235 @@
+/* sightings_query.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Queries a sightings store written with dect-scanner --sightings.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "logging.h"
+#include "sightings.h"
+
+typedef struct {
+	uint64_t limit;
+	uint64_t printed;
+} print_state_t;
+
+static void format_time(char *buf, size_t size, uint64_t ns)
+{
+	time_t secs = ns / 1000000000ull;
+	struct tm tm;
+	gmtime_r(&secs, &tm);
+	size_t n = strftime(buf, size, "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(buf + n, size - n, ".%03uZ", (unsigned)(ns % 1000000000ull / 1000000));
+}
+
+static void print_sighting(const sighting_t *s)
+{
+	char ts[40], rssi[16];
+
+	format_time(ts, sizeof(ts), s->timestamp);
+	if (s->rssi == SIGHTING_NO_RSSI)
+		strcpy(rssi, "-");
+	else
+		snprintf(rssi, sizeof(rssi), "%.1f", s->rssi / 100.0);
+
+	printf("%s %u %.3lf %010llx %c %c %s\n", ts, s->carrier, s->freq_khz / 1e3,
+		(unsigned long long)s->part_id,
+		(s->flags & SIGHTING_FIXED_PART) ? 'F' : 'P',
+		(s->flags & SIGHTING_VOICE) ? 'V' : '-',
+		rssi);
+}
+
+static bool print_cb(void *arg, const sighting_t *s)
+{
+	print_state_t *state = (print_state_t *)arg;
+
+	print_sighting(s);
+	return ++state->printed < state->limit;
+}
+
+static bool count_cb(void *arg, const sighting_t *s)
+{
+	return true;
+}
+
+// Most recently seen first
+static bool seen_later(const sightings_reader::part_summary_t &a, const sightings_reader::part_summary_t &b)
+{
+	return a.last.timestamp > b.last.timestamp;
+}
+
+// Seconds since the epoch or YYYY-MM-DDTHH:MM:SS in UTC, to ns
+static bool parse_time(const char *s, uint64_t *ns)
+{
+	struct tm tm;
+	memset(&tm, 0, sizeof(tm));
+
+	const char *end = strptime(s, "%Y-%m-%dT%H:%M:%S", &tm);
+	if (end && *end == '\0') {
+		*ns = (uint64_t)timegm(&tm) * 1000000000ull;
+		return true;
+	}
+
+	char *num_end;
+	double secs = strtod(s, &num_end);
+	if (num_end == s || *num_end || secs < 0)
+		return false;
+	*ns = (uint64_t)(secs * 1e9);
+	return true;
+}
+
+static bool parse_part_id(const char *s, uint64_t *part_id)
+{
+	char *end;
+	if (strlen(s) != 10)
+		return false;
+	*part_id = strtoull(s, &end, 16);
+	return *end == '\0';
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "%s [-r rfpi] [-f time] [-t time] [-n max] [-c] [-s] [-v] dir\n", argv0);
+	fprintf(stderr, "  -r rfpi  only sightings of this RFPI or PMID, newest first\n");
+	fprintf(stderr, "  -f time  from time, seconds since the epoch or YYYY-MM-DDTHH:MM:SS (UTC)\n");
+	fprintf(stderr, "  -t time  until time\n");
+	fprintf(stderr, "  -n max   print at most max sightings, -r rfpi -n 1 prints when it was last seen\n");
+	fprintf(stderr, "  -c       only print the number of sightings\n");
+	fprintf(stderr, "  -s       one line per part: sightings, first and last seen, last carrier\n");
+	fprintf(stderr, "  -v       print the query time\n");
+	fprintf(stderr, "Without -r, -f, -t, -c or -s prints the size of the store.\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t part_id = 0, from = 0, to = UINT64_MAX, limit = UINT64_MAX;
+	bool by_part = false, query = false, count_only = false, summary = false, verbose = false;
+	int c;
+
+	while ((c = getopt(argc, argv, "r:f:t:n:csv")) != -1) {
+		switch (c) {
+		case 'r':
+			if (!parse_part_id(optarg, &part_id)) {
+				fprintf(stderr, "bad RFPI \"%s\", expected 10 hex digits\n", optarg);
+				return EXIT_FAILURE;
+			}
+			by_part = query = true;
+			break;
+		case 'f':
+		case 't':
+			if (!parse_time(optarg, (c == 'f') ? &from : &to)) {
+				fprintf(stderr, "bad time \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			query = true;
+			break;
+		case 'n':
+			limit = strtoull(optarg, NULL, 10);
+			break;
+		case 'c':
+			count_only = query = true;
+			break;
+		case 's':
+			summary = true;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	sightings_reader *reader = sightings_reader::open(argv[optind]);
+	if (!reader) {
+		log_flush();
+		return EXIT_FAILURE;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint64_t cnt;
+
+	if (summary) {
+		std::vector<sightings_reader::part_summary_t> parts;
+		reader->parts(&parts);
+		std::sort(parts.begin(), parts.end(), seen_later);
+
+		cnt = std::min((uint64_t)parts.size(), limit);
+		for (size_t i = 0; i < cnt; i++) {
+			char first[40], last[40];
+			format_time(first, sizeof(first), parts[i].first.timestamp);
+			format_time(last, sizeof(last), parts[i].last.timestamp);
+			printf("%010llx %c %llu %s %s %u %.3lf\n", (unsigned long long)parts[i].part_id,
+				(parts[i].last.flags & SIGHTING_FIXED_PART) ? 'F' : 'P',
+				(unsigned long long)parts[i].count, first, last,
+				parts[i].last.carrier, parts[i].last.freq_khz / 1e3);
+		}
+	} else if (!query) {
+		std::vector<sightings_reader::part_summary_t> parts;
+		reader->parts(&parts);
+		printf("%zu segments, %llu sightings of %zu parts\n", reader->segments(),
+			(unsigned long long)reader->rows(), parts.size());
+		cnt = reader->rows();
+	} else if (count_only && !by_part) {
+		cnt = reader->count(from, to);
+		printf("%llu\n", (unsigned long long)cnt);
+	} else {
+		print_state_t state = { count_only ? UINT64_MAX : limit, 0 };
+		sightings_reader::callback_t fn = count_only ? count_cb : print_cb;
+
+		if (limit == 0)
+			cnt = 0;
+		else if (by_part)
+			cnt = reader->scan_part(part_id, from, to, fn, &state);
+		else
+			cnt = reader->scan(from, to, fn, &state);
+
+		if (count_only)
+			printf("%llu\n", (unsigned long long)cnt);
+	}
+
+	if (verbose)
+		fprintf(stderr, "%llu results in %.2f ms\n", (unsigned long long)cnt, elapsed_ms(&start));
+
+	delete reader;
+	return 0;
+}
@@ -0,0 +1,281 @@
+/* voice_writer.cxx */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "logging.h"
+#include "voice_writer.h"
+
+#define WAV_HEADER_LEN		44
+#define VOICE_SAMPLE_RATE	8000
+
+using dect2core::voice_record_t;
+
+static uint8_t *put_le(uint8_t *ptr, uint64_t value, unsigned len)
+{
+	for (unsigned i = 0; i < len; i++)
+		*ptr++ = value >> (8 * i);
+	return ptr;
+}
+
+// 16-bit mono, data_len bytes of samples
+static void wav_header(uint8_t *hdr, uint32_t data_len)
+{
+	uint8_t *ptr = hdr;
+
+	memcpy(ptr, "RIFF", 4);
+	ptr = put_le(ptr + 4, 36 + data_len, 4);
+	memcpy(ptr, "WAVEfmt ", 8);
+	ptr = put_le(ptr + 8, 16, 4);
+	ptr = put_le(ptr, 1, 2);			// PCM
+	ptr = put_le(ptr, 1, 2);			// Channels
+	ptr = put_le(ptr, VOICE_SAMPLE_RATE, 4);
+	ptr = put_le(ptr, VOICE_SAMPLE_RATE * 2, 4);	// Bytes per second
+	ptr = put_le(ptr, 2, 2);			// Block align
+	ptr = put_le(ptr, 16, 2);			// Bits per sample
+	memcpy(ptr, "data", 4);
+	put_le(ptr + 4, data_len, 4);
+}
+
+voice_writer::voice_writer(output_t output)
+	: d_output(output), d_sock(-1), d_dropped(0), d_nbatch(0), d_batch_mask(0)
+{
+	memset(&d_addr, 0, sizeof(d_addr));
+	for (uint32_t i = 0; i < MAX_PARTS; i++) {
+		d_streams[i].active = false;
+		d_streams[i].fd = -1;
+	}
+}
+
+voice_writer::~voice_writer()
+{
+	decode_batch();
+	for (uint32_t i = 0; i < MAX_PARTS; i++)
+		end(i);
+	if (d_sock >= 0)
+		close(d_sock);
+}
+
+voice_writer *voice_writer::open(const char *spec)
+{
+	const char *colon = strchr(spec, ':');
+	if (colon == NULL || colon[1] == '\0') {
+		log_error("voice output \"%s\" is not wav:dir, raw:dir or unix:path\n", spec);
+		return NULL;
+	}
+	std::string mode(spec, colon - spec);
+	const char *path = colon + 1;
+
+	if (mode == "wav" || mode == "raw") {
+		struct stat st;
+		if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode)) {
+			log_error("voice output directory \"%s\" doesn't exist\n", path);
+			return NULL;
+		}
+		voice_writer *writer = new voice_writer(mode == "wav" ? OUTPUT_WAV : OUTPUT_RAW);
+		writer->d_dir = path;
+		return writer;
+	}
+
+	if (mode != "unix") {
+		log_error("voice output \"%s\" is not wav:dir, raw:dir or unix:path\n", spec);
+		return NULL;
+	}
+
+	voice_writer *writer = new voice_writer(OUTPUT_SOCKET);
+	if (strlen(path) >= sizeof(writer->d_addr.sun_path)) {
+		log_error("voice socket path \"%s\" is too long\n", path);
+		delete writer;
+		return NULL;
+	}
+	writer->d_addr.sun_family = AF_UNIX;
+	strcpy(writer->d_addr.sun_path, path);
+
+	// Nobody has to be listening yet, datagrams are dropped until then
+	writer->d_sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (writer->d_sock < 0) {
+		log_error("socket() failed: %s\n", strerror(errno));
+		delete writer;
+		return NULL;
+	}
+	return writer;
+}
+
+void voice_writer::start(uint32_t rx_id, const dect2core::part_info_t *parts, size_t nparts)
+{
+	stream_t *s = &d_streams[rx_id];
+
+	s->active = true;
+	s->samples = 0;
+	memset(s->part_id, 0, sizeof(s->part_id));
+	for (size_t i = 0; i < nparts; i++) {
+		if (parts[i].rx_id == rx_id)
+			memcpy(s->part_id, parts[i].part_id, sizeof(s->part_id));
+	}
+	dect2core::g726_init(&s->g726);
+
+	if (d_output == OUTPUT_SOCKET)
+		return;
+
+	char name[64], date[32];
+	struct tm tm;
+	time_t now = time(NULL);
+	localtime_r(&now, &tm);
+	strftime(date, sizeof(date), "%Y%m%d-%H%M%S", &tm);
+	snprintf(name, sizeof(name), "/%s-%02x%02x%02x%02x%02x-rx%u.%s", date,
+		s->part_id[0], s->part_id[1], s->part_id[2], s->part_id[3], s->part_id[4],
+		rx_id, d_output == OUTPUT_WAV ? "wav" : "raw");
+	std::string path = d_dir + name;
+
+	s->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (s->fd < 0) {
+		log_error("can't open voice output \"%s\": %s\n", path.c_str(), strerror(errno));
+		return;
+	}
+
+	// Sizes are filled in when the stream ends
+	if (d_output == OUTPUT_WAV) {
+		uint8_t hdr[WAV_HEADER_LEN];
+		wav_header(hdr, 0);
+		if (::write(s->fd, hdr, sizeof(hdr)) != sizeof(hdr)) {
+			log_error("voice write failed: %s\n", strerror(errno));
+			close(s->fd);
+			s->fd = -1;
+		}
+	}
+}
+
+void voice_writer::end(uint32_t rx_id)
+{
+	stream_t *s = &d_streams[rx_id];
+
+	if (!s->active)
+		return;
+	s->active = false;
+
+	if (d_output == OUTPUT_SOCKET) {
+		output(rx_id, 0, VOICE_GAP_END, NULL, 0);
+		return;
+	}
+	if (s->fd < 0)
+		return;
+
+	if (d_output == OUTPUT_WAV) {
+		uint8_t hdr[WAV_HEADER_LEN];
+		wav_header(hdr, std::min(s->samples * 2, (uint64_t)UINT32_MAX - 36));
+		if (pwrite(s->fd, hdr, sizeof(hdr), 0) != sizeof(hdr))
+			log_error("voice write failed: %s\n", strerror(errno));
+	}
+	close(s->fd);
+	s->fd = -1;
+}
+
+void voice_writer::output(uint32_t rx_id, uint8_t frame_number, uint8_t flags, const int16_t *pcm, size_t nsamples)
+{
+	stream_t *s = &d_streams[rx_id];
+
+	if (d_output == OUTPUT_SOCKET) {
+		voice_datagram_t dgram;
+		dgram.rx_id = rx_id;
+		dgram.frame_number = frame_number;
+		dgram.flags = flags;
+		memcpy(dgram.part_id, s->part_id, sizeof(dgram.part_id));
+		memcpy(dgram.pcm, pcm, nsamples * sizeof(int16_t));
+
+		size_t len = offsetof(voice_datagram_t, pcm) + nsamples * sizeof(int16_t);
+		if (sendto(d_sock, &dgram, len, MSG_DONTWAIT, (struct sockaddr *)&d_addr, sizeof(d_addr)) < 0)
+			d_dropped++;
+		return;
+	}
+	if (s->fd < 0)
+		return;
+
+	ssize_t len = nsamples * sizeof(int16_t);
+	if (::write(s->fd, pcm, len) != len) {
+		log_error("voice write failed: %s\n", strerror(errno));
+		close(s->fd);
+		s->fd = -1;
+		return;
+	}
+	s->samples += nsamples;
+}
+
+void voice_writer::decode_batch(void)
+{
+	if (d_nbatch == 0)
+		return;
+
+	dect2core::g726_decode(d_batch_states, d_batch_codes, d_batch_pcm, d_nbatch, B_FIELD_SAMPLES);
+	for (size_t i = 0; i < d_nbatch; i++) {
+		const voice_record_t *r = d_batch[i];
+		output(r->rx_id, r->frame_number, r->flags, d_batch_pcm[i], B_FIELD_SAMPLES);
+	}
+	d_nbatch = 0;
+	d_batch_mask = 0;
+}
+
+void voice_writer::write(const voice_record_t *records, size_t n,
+	const dect2core::part_info_t *parts, size_t nparts)
+{
+	static const int16_t silence[B_FIELD_SAMPLES] = { 0 };
+
+	for (size_t i = 0; i < n; i++) {
+		const voice_record_t *r = &records[i];
+		uint32_t rx_id = r->rx_id;
+		if (rx_id >= MAX_PARTS)
+			continue;
+
+		// A stream's records are handled in order, the batch only
+		// ever holds its latest frame
+		if (d_batch_mask & (1u << rx_id))
+			decode_batch();
+
+		stream_t *s = &d_streams[rx_id];
+		if (r->type == VOICE_FRAME) {
+			if (!s->active)
+				start(rx_id, parts, nparts);
+			d_batch[d_nbatch] = r;
+			d_batch_states[d_nbatch] = &s->g726;
+			d_batch_codes[d_nbatch] = r->b_field;
+			d_batch_pcm[d_nbatch] = d_pcm[d_nbatch];
+			d_nbatch++;
+			d_batch_mask |= 1u << rx_id;
+		} else if (r->flags & VOICE_GAP_END) {
+			end(rx_id);
+		} else if (s->active) {
+			// A burst a frame; the predictor carries on over the gap
+			uint32_t frames = std::min(r->bursts, (uint32_t)VOICE_MAX_GAP_FRAMES);
+			for (uint32_t f = 0; f < frames; f++)
+				output(rx_id, (r->frame_number + f) & 0xF, r->flags, silence, B_FIELD_SAMPLES);
+		}
+	}
+
+	// Records don't outlive the call
+	decode_batch();
+}
@@ -0,0 +1,110 @@
+/* voice_writer.h */
+/*
+ * Copyright 2021 Alexander Samarin <sasha.devel@gmail.com>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _VOICE_WRITER_H
+#define _VOICE_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/un.h>
+
+#include <string>
+
+#include "dect2core/burst_decoder.h"
+#include "dect2core/g726.h"
+#include "dect2core/part_info.h"
+
+// Longest gap filled with silence, frames
+#define VOICE_MAX_GAP_FRAMES	100
+
+// Datagram sent for every frame in socket mode, in native byte order. A
+// stream's last one has flags VOICE_GAP_END and no samples.
+typedef struct {
+	uint8_t rx_id;
+	uint8_t frame_number;
+	uint8_t flags;			// VOICE_RECOVERED, VOICE_GAP_* for silence filling a gap
+	uint8_t part_id[5];
+	int16_t pcm[B_FIELD_SAMPLES];	// 8 kHz
+} voice_datagram_t;
+
+/*
+ * Decodes the voice records of packet_decoder to 8 kHz 16-bit PCM and
+ * writes each stream, from its first frame to its VOICE_GAP_END, to a
+ * WAV or raw file of its own or as datagrams to a UNIX socket. Gaps are
+ * filled with silence. The frames of a write() call are decoded together,
+ * one lane of g726_decode() per stream.
+ */
+class voice_writer
+{
+public:
+	typedef enum {
+		OUTPUT_WAV,	// <dir>/<time>-<part id>-rx<rx_id>.wav
+		OUTPUT_RAW,	// The same named .raw, samples only
+		OUTPUT_SOCKET,	// voice_datagram_t to a bound SOCK_DGRAM socket
+	} output_t;
+
+private:
+	typedef struct {
+		bool active;
+		int fd;			// File modes
+		uint64_t samples;
+		uint8_t part_id[5];
+		dect2core::g726_state_t g726;
+	} stream_t;
+
+	output_t d_output;
+	std::string d_dir;
+	int d_sock;
+	struct sockaddr_un d_addr;
+	uint64_t d_dropped;
+
+	stream_t d_streams[MAX_PARTS];
+
+	// Frames waiting to be decoded, at most one per stream
+	size_t d_nbatch;
+	uint32_t d_batch_mask;
+	const dect2core::voice_record_t *d_batch[MAX_PARTS];
+	dect2core::g726_state_t *d_batch_states[MAX_PARTS];
+	const uint8_t *d_batch_codes[MAX_PARTS];
+	int16_t *d_batch_pcm[MAX_PARTS];
+	int16_t d_pcm[MAX_PARTS][B_FIELD_SAMPLES];
+
+	voice_writer(output_t output);
+
+	void start(uint32_t rx_id, const dect2core::part_info_t *parts, size_t nparts);
+	void end(uint32_t rx_id);
+	void decode_batch(void);
+	void output(uint32_t rx_id, uint8_t frame_number, uint8_t flags, const int16_t *pcm, size_t nsamples);
+
+public:
+	~voice_writer();
+
+	// Parse "wav:dir", "raw:dir" or "unix:path". Returns NULL on failure.
+	static voice_writer *open(const char *spec);
+
+	// parts are looked up for the part id of streams starting
+	void write(const dect2core::voice_record_t *records, size_t n,
+		const dect2core::part_info_t *parts, size_t nparts);
+
+	// Datagrams nobody received
+	uint64_t dropped_count(void) const { return d_dropped; }
+};
+
+#endif